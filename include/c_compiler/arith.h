@@ -0,0 +1,52 @@
+// SPDX-License-Identifier: GPL-3.0-only
+#ifndef C_COMPILER_ARITH_H
+#define C_COMPILER_ARITH_H
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * Lowering of 32 bit multiplication and division by constants into cheaper
+ * instruction sequences. The code generator emits the plans, the eval
+ * functions model the emitted instructions exactly so they can be tested
+ * against the hardware.
+ */
+
+enum arith_mul_op {
+	ARITH_MUL_SHL, /* x <<= k */
+	ARITH_MUL_LEA, /* x += x << k, k in 1..3 */
+	ARITH_MUL_ADD, /* x += original x */
+	ARITH_MUL_SUB, /* x -= original x */
+	ARITH_MUL_NEG, /* x = -x */
+	ARITH_MUL_ZERO, /* x = 0 */
+};
+struct arith_mul {
+	int n;
+	bool save; /* the original x has to be kept */
+	struct { enum arith_mul_op op; int k; } steps[3];
+};
+/* false if a plain imul is cheaper */
+bool arith_plan_mul(int32_t c, struct arith_mul *res);
+uint32_t arith_eval_mul(uint32_t x, const struct arith_mul *p);
+
+enum arith_div_kind {
+	ARITH_DIV_ONE, /* q = x, or -x for a divisor of -1 */
+	ARITH_DIV_POW2, /* shifts, with a bias for negative dividends */
+	ARITH_DIV_MAGIC, /* multiply high by a magic number */
+	ARITH_DIV_GE, /* unsigned divisor >= 2^31: q = x >= d */
+};
+struct arith_div {
+	enum arith_div_kind kind;
+	bool is_unsigned;
+	bool neg; /* negate the quotient */
+	int shift;
+	uint32_t magic;
+	/* signed: add (1) or subtract (-1) x from the high product,
+	 * unsigned: use the 33 bit magic fixup (1) */
+	int fixup;
+};
+/* false for a zero divisor */
+bool arith_plan_div(int64_t d, bool is_unsigned, struct arith_div *res);
+int32_t arith_eval_sdiv(int32_t x, const struct arith_div *p);
+uint32_t arith_eval_udiv(uint32_t x, const struct arith_div *p);
+
+#endif
@@ -1,7 +1,9 @@
 // SPDX-License-Identifier: GPL-3.0-only
 #ifndef C_COMPILER_AST_H
 #define C_COMPILER_AST_H
+#include <stdio.h>
 #include <stdlib.h>
+#include <stdbool.h>
 #include <string.h>
 #include <ds/vec.h>
 
@@ -270,6 +272,17 @@ struct ast_node {
 };
 
 void ast_fprint(FILE *f, const struct ast_node *n, int ind);
+
+/* Visits the statements and expressions of a tree in pre-order, the children
+ * of a node are only visited if the callback returns true. Declarators and
+ * type names are not descended into. */
+typedef bool (*ast_visit_fn)(const struct ast_node *n, void *ud);
+void ast_walk(const struct ast_node *n, ast_visit_fn fn, void *ud);
+/* the bytes a string literal stands for, as it is written in the source with
+ * quotes and escapes, into res, which has room for strlen(src) of them;
+ * returns their number, not counting the nul that ends them */
+int ast_string_bytes(const char *src, char *res);
+
 struct ast_node *ast_ident(const char *ident);
 struct ast_node *ast_integer(long long int integer);
 struct ast_node *ast_character_constant(int integer);
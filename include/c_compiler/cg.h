@@ -2,7 +2,17 @@
 #ifndef C_COMPILER_CG_H
 #define C_COMPILER_CG_H
 #include <c_compiler/ast.h>
+#include <c_compiler/pass.h>
+#include <c_compiler/emit.h>
 
-int cg_gen(const struct ast_node *n);
+struct cg_options {
+	bool avx2; /* vectorize with AVX2 instead of SSE2 */
+	int unroll; /* copies of a loop body per iteration, 1 to not unroll */
+	struct pass_manager *passes; /* the optimizations that run */
+};
+
+/* appends the code for the translation unit to out */
+int cg_gen(const struct ast_node *n, const struct cg_options *opts,
+	struct emit *out);
 
 #endif
@@ -0,0 +1,16 @@
+// SPDX-License-Identifier: GPL-3.0-only
+#ifndef C_COMPILER_ELF_H
+#define C_COMPILER_ELF_H
+#include <stdbool.h>
+#include <c_compiler/x86.h>
+
+/*
+ * ELF64 relocatable objects for the encoded code, with the sections of the
+ * code, their relocations and a symbol table, ready for the system linker
+ * without an assembler in between.
+ */
+
+/* writes the object file to the file descriptor, false on an error */
+bool elf_write(const struct x86_code *c, int fd);
+
+#endif
@@ -0,0 +1,177 @@
+// SPDX-License-Identifier: GPL-3.0-only
+#ifndef C_COMPILER_EMIT_H
+#define C_COMPILER_EMIT_H
+#include <stdbool.h>
+#include <ds/vec.h>
+
+/*
+ * The generated code as compact instruction records in memory. The code
+ * generator appends an opcode and its operands for every instruction and
+ * directive, without formatting anything, and the whole buffer is turned
+ * into NASM text in one pass at the end, with the numbers formatted by hand
+ * and the text written out in large blocks. Passes that work on the
+ * instructions, and other back ends, take the records from the buffer
+ * instead of the text.
+ */
+
+/* the numbers the hardware uses for them */
+enum emit_reg {
+	EMIT_RAX, EMIT_RCX, EMIT_RDX, EMIT_RBX,
+	EMIT_RSP, EMIT_RBP, EMIT_RSI, EMIT_RDI,
+	EMIT_R8, EMIT_R9, EMIT_R10, EMIT_R11,
+	EMIT_R12, EMIT_R13, EMIT_R14, EMIT_R15,
+};
+/* condition codes by their encoding, the inverse of one is cc ^ 1 */
+enum emit_cc {
+	EMIT_CC_B = 2,
+	EMIT_CC_AE,
+	EMIT_CC_E,
+	EMIT_CC_NE,
+	EMIT_CC_BE,
+	EMIT_CC_A,
+	EMIT_CC_L = 12,
+	EMIT_CC_GE,
+	EMIT_CC_LE,
+	EMIT_CC_G,
+};
+
+enum emit_op {
+	EMIT_MOV,
+	EMIT_MOVZX,
+	EMIT_LEA,
+	EMIT_ADD,
+	EMIT_SUB,
+	EMIT_IMUL, /* with two or three operands */
+	EMIT_AND,
+	EMIT_XOR,
+	EMIT_NOT,
+	EMIT_NEG,
+	EMIT_INC,
+	EMIT_DEC,
+	EMIT_SHL,
+	EMIT_SHR,
+	EMIT_SAR,
+	EMIT_CMP,
+	EMIT_MUL,
+	EMIT_DIV,
+	EMIT_IDIV,
+	EMIT_CDQ,
+	EMIT_JMP,
+	EMIT_JCC,
+	EMIT_SETCC,
+	EMIT_CMOVCC,
+	EMIT_CALL,
+	EMIT_RET,
+	EMIT_PUSH,
+	EMIT_POP,
+	EMIT_REP_MOVSB,
+	EMIT_REP_STOSB,
+	EMIT_REP_STOSD,
+	EMIT_MOVD,
+	EMIT_MOVDQU,
+	EMIT_MOVDQA,
+	EMIT_PADDB,
+	EMIT_PADDD,
+	EMIT_PSUBB,
+	EMIT_PSUBD,
+	EMIT_PSHUFD,
+	EMIT_VMOVD,
+	EMIT_VMOVDQU,
+	EMIT_VPADDB,
+	EMIT_VPADDD,
+	EMIT_VPSUBB,
+	EMIT_VPSUBD,
+	EMIT_VPBROADCASTD,
+	EMIT_VZEROUPPER,
+	/* directives */
+	EMIT_LABEL, /* the operand is the name defined here */
+	EMIT_COMMENT, /* x is the offset of the text */
+	EMIT_BLANK,
+	EMIT_SECTION, /* the name is a symbol */
+	EMIT_GLOBAL,
+	EMIT_EXTERN,
+	EMIT_DB, /* a string, and its contents as written in the source */
+	EMIT_DQ,
+	EMIT_OP_N,
+};
+
+enum emit_kind {
+	EMIT_O_REG,
+	EMIT_O_IMM,
+	EMIT_O_MEM, /* [reg + index * scale + x] */
+	EMIT_O_LABEL, /* label_<x> */
+	EMIT_O_SYM,
+	EMIT_O_STRING, /* s<x>, the address of a string constant */
+	EMIT_O_TABLE, /* t<x>, the address of a jump table */
+};
+struct emit_operand {
+	unsigned char kind;
+	/* of a register, 16 and 32 for xmm and ymm, or of a memory access, 0
+	 * if the other operand says it */
+	unsigned char size;
+	signed char reg; /* also the base of memory, -1 if there is none */
+	signed char index; /* -1 if there is none */
+	unsigned char scale;
+	union {
+		long long x;
+		const char *sym;
+	};
+};
+#define EMIT_OPERANDS_MAX 3
+struct emit_ins {
+	unsigned char op;
+	unsigned char cc; /* of EMIT_JCC, EMIT_SETCC and EMIT_CMOVCC */
+	unsigned char n;
+	struct emit_operand o[EMIT_OPERANDS_MAX];
+};
+
+struct emit {
+	struct vec ins; /* vec<struct emit_ins> */
+	struct vec text; /* vec<char>, the comments, each 0 terminated */
+	bool discard; /* drop everything appended */
+};
+
+struct emit_operand emit_o_reg(enum emit_reg r, int size);
+struct emit_operand emit_o_imm(long long x);
+/* base and index are -1 if there are none */
+struct emit_operand emit_o_mem(int size, int base, int index, int scale,
+	long long disp);
+struct emit_operand emit_o_label(int label);
+/* sym is kept, not copied */
+struct emit_operand emit_o_sym(const char *sym);
+struct emit_operand emit_o_string(int i);
+struct emit_operand emit_o_table(int i);
+
+/* the mnemonic of an instruction */
+const char *emit_op_name(enum emit_op op);
+
+void emit_init(struct emit *e);
+void emit_free(struct emit *e);
+/* forgets the records, keeps the memory */
+void emit_reset(struct emit *e);
+
+void emit_ins(struct emit *e, enum emit_op op, int cc, int n,
+	const struct emit_operand *o);
+void emit0(struct emit *e, enum emit_op op);
+void emit1(struct emit *e, enum emit_op op, struct emit_operand a);
+void emit2(struct emit *e, enum emit_op op, struct emit_operand a,
+	struct emit_operand b);
+void emit3(struct emit *e, enum emit_op op, struct emit_operand a,
+	struct emit_operand b, struct emit_operand c);
+void emit_jcc(struct emit *e, enum emit_cc cc, int label);
+void emit_setcc(struct emit *e, enum emit_cc cc, struct emit_operand a);
+void emit_cmovcc(struct emit *e, enum emit_cc cc, struct emit_operand a,
+	struct emit_operand b);
+void emit_label(struct emit *e, int label);
+/* a line of text, formatted like printf does */
+void emit_comment(struct emit *e, const char *fmt, ...);
+/* moves the records of src to the end of e */
+void emit_append(struct emit *e, struct emit *src);
+
+/* the comment of a record */
+const char *emit_text(const struct emit *e, const struct emit_ins *x);
+/* writes the records as NASM text to the file descriptor, false on an
+ * error */
+bool emit_write(const struct emit *e, int fd);
+
+#endif
@@ -0,0 +1,89 @@
+// SPDX-License-Identifier: GPL-3.0-only
+#ifndef C_COMPILER_ISEL_H
+#define C_COMPILER_ISEL_H
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * Instruction selection for integer expression trees by bottom up tree
+ * rewriting. Every node is labelled with the cheapest way to compute it as
+ * each kind of operand, using a table of tree patterns with costs, and the
+ * cover of least total cost is then emitted top down. This finds lea for
+ * sums of scaled values, ALU instructions with memory and immediate
+ * operands, and read-modify-write instructions for in place updates. The
+ * code generator builds the trees from operands it has evaluated already,
+ * the eval function models the selected instructions so they can be tested.
+ */
+
+enum isel_op {
+	ISEL_IMM, /* a constant, as rax holds it after reading it */
+	ISEL_MEM, /* a value in memory, read zero extended */
+	ISEL_ADD,
+	ISEL_SUB,
+	ISEL_MUL,
+	ISEL_STORE, /* a = b, a is memory */
+	ISEL_CMP, /* sets the flags for the 64 bit comparison of a and b */
+};
+struct isel_node {
+	enum isel_op op;
+	int size; /* of the result, 4 or 8, or of a memory operand */
+	int a, b; /* operands, as indices of earlier nodes */
+	int64_t imm;
+	int mem; /* which memory operand, the same one for the same location */
+};
+#define ISEL_TREE_MAX 16
+struct isel_tree {
+	int n;
+	struct isel_node nodes[ISEL_TREE_MAX]; /* the root is the last one */
+};
+/* the index of the new node, -1 if the tree is full */
+int isel_add(struct isel_tree *t, struct isel_node n);
+
+/* rax, rbx, rsi and rdi, rcx and rdx are left to address memory operands */
+#define ISEL_REGS 4
+
+enum isel_opcode {
+	ISEL_I_LOAD, /* d = s, zero extended from size */
+	ISEL_I_MOV, /* d = s, 64 bit */
+	ISEL_I_STORE, /* d = s, the low size bytes */
+	ISEL_I_ADD, /* d += s */
+	ISEL_I_SUB, /* d -= s */
+	ISEL_I_IMUL, /* d *= s */
+	ISEL_I_IMUL3, /* d = s * k */
+	ISEL_I_SHL, /* d <<= k */
+	ISEL_I_LEA, /* d = base + s * scale + k, base -1 if there is none */
+	ISEL_I_INC, /* d += 1 */
+	ISEL_I_DEC, /* d -= 1 */
+	ISEL_I_CMP, /* flags = d - s */
+};
+enum isel_kind {
+	ISEL_O_REG,
+	ISEL_O_IMM, /* sign extended from 32 bits */
+	ISEL_O_MEM,
+};
+struct isel_operand {
+	enum isel_kind kind;
+	int reg, mem;
+	int64_t imm;
+};
+struct isel_insn {
+	enum isel_opcode op;
+	int size; /* of the operation, or of the memory for loads and stores */
+	struct isel_operand d, s;
+	int base, scale;
+	int64_t k;
+};
+#define ISEL_CODE_MAX 48
+struct isel_code {
+	int n;
+	int cost;
+	struct isel_insn insns[ISEL_CODE_MAX];
+};
+/* false if the tree needs more registers than there are, a value ends up
+ * in rax */
+bool isel_select(const struct isel_tree *t, struct isel_code *res);
+/* runs the code on the memory operands, returns rax, or for a comparison
+ * 0 if equal, 1 if less and 2 if greater */
+uint64_t isel_eval(const struct isel_code *c, uint64_t *mem);
+
+#endif
@@ -0,0 +1,21 @@
+// SPDX-License-Identifier: GPL-3.0-only
+#ifndef C_COMPILER_JIT_H
+#define C_COMPILER_JIT_H
+#include <stdbool.h>
+#include <c_compiler/x86.h>
+
+/*
+ * Running encoded code in the process of the compiler. The sections are
+ * copied into memory mapped for them and relocated there, the functions
+ * from elsewhere are looked up in the process with dlsym and reached
+ * through jumps placed next to the code, and main is called the way the C
+ * library would call it. The addresses of the functions can be written to
+ * /tmp/perf-<pid>.map for perf.
+ */
+
+/* runs main with the arguments, false with a message on stderr if the code
+ * can't be loaded, the result of main in *res */
+bool jit_run(struct x86_code *c, int argc, char **argv, bool perf_map,
+	int *res);
+
+#endif
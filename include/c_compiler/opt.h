@@ -0,0 +1,217 @@
+// SPDX-License-Identifier: GPL-3.0-only
+#ifndef C_COMPILER_OPT_H
+#define C_COMPILER_OPT_H
+#include <c_compiler/ast.h>
+
+/*
+ * AST level analyses used by the code generator. Variables are tracked by
+ * name, which stays conservative under shadowing because a declaration counts
+ * as a write to the name.
+ */
+
+bool opt_names_contain(const struct vec *names, const char *ident);
+/* collects the identifiers that have their address taken with `&` */
+void opt_address_taken(const struct ast_node *n, struct vec *res);
+/* what a call may do, from the fewest effects */
+enum opt_effects {
+	OPT_CONST, /* computes its result from the arguments alone */
+	OPT_PURE, /* may also read memory */
+	OPT_SIDE_EFFECTS,
+};
+/* the effects of a call, `fns` is a vec<struct opt_function> or NULL */
+enum opt_effects opt_call_effects(const struct vec *fns,
+	const struct ast_node *call);
+/* true if `n` contains no assignments, increments or calls other than to
+ * pure functions of `fns` */
+bool opt_expr_pure(const struct ast_node *n, const struct vec *fns);
+/* true if `n` contains a jump out of the normal flow or a label */
+bool opt_stmt_may_jump(const struct ast_node *n);
+/* can be evaluated even on paths where the original program would not */
+bool opt_expr_speculatable(const struct ast_node *n);
+/* a rough count of the instructions needed to evaluate `n` */
+int opt_expr_cost(const struct ast_node *n);
+/* true if a store through a pointer or a call could change the value of `n` */
+bool opt_expr_reads_memory(const struct ast_node *n,
+	const struct vec *address_taken, const struct vec *fns);
+/* structural equality of side effect free expressions */
+bool opt_expr_equal(const struct ast_node *a, const struct ast_node *b);
+/* the number of occurrences of an identifier in `n` */
+int opt_ident_count(const struct ast_node *n, const char *ident);
+/* evaluates constant expressions, supplied by the code generator */
+typedef bool (*opt_const_fn)(const struct ast_node *n, long long *res, void *ud);
+/* whether two accesses to memory, `*p`, `p[i]` or a variable whose address
+ * is taken, may refer to the same object, supplied by the code generator */
+typedef bool (*opt_alias_fn)(const struct ast_node *a,
+	const struct ast_node *b, void *ud);
+/* true if evaluating `n` may read what a store to `target` writes */
+bool opt_expr_reads_store(const struct ast_node *n,
+	const struct ast_node *target, const struct vec *address_taken,
+	const struct vec *fns, opt_alias_fn alias, void *ud);
+/* the number of occurrences of an identifier as the pointer or array an
+ * access is based on, as in `*p`, `*(p + i)` or `p[i]` */
+int opt_base_count(const struct ast_node *n, const char *ident);
+
+struct loop_info {
+	const struct vec *address_taken; /* vec<const char *> */
+	const struct vec *fns; /* vec<struct opt_function>, may be NULL */
+	const struct vec *globals; /* vec<const char *>, may be NULL */
+	struct vec modified; /* vec<const char *> */
+	bool stores; /* assigns through a pointer or to a global */
+	bool calls; /* to functions with side effects */
+	struct vec targets; /* vec<const struct ast_node *>, of the stores */
+	opt_alias_fn alias; /* set to tell the stores apart, NULL by default */
+	void *ud;
+};
+
+void loop_info_init(struct loop_info *li, const struct ast_node *loop,
+	const struct vec *address_taken, const struct vec *fns,
+	const struct vec *globals);
+void loop_info_finish(struct loop_info *li);
+bool loop_invariant(const struct loop_info *li, const struct ast_node *n);
+/* Collects the maximal invariant subexpressions of the loop that are worth
+ * evaluating once in a preheader. Loads are only collected where they run in
+ * every iteration, so the caller has to make sure the body is entered at
+ * least once after the preheader. */
+void loop_hoistable(const struct loop_info *li, const struct ast_node *loop,
+	struct vec *res);
+
+/* an expression statement that adds a constant to an induction variable */
+struct iv_write {
+	const struct ast_node *stmt;
+	long long step;
+};
+/* an expression of the form iv * coeff + (loop invariant) */
+struct iv_derived {
+	const struct ast_node *n;
+	long long coeff;
+	bool uncond; /* evaluated in every iteration */
+	int group; /* index of the first structurally equal expression */
+};
+/* a variable that is only ever changed by constant steps in the loop */
+struct iv {
+	const char *ident;
+	struct vec writes; /* vec<struct iv_write> */
+	struct vec derived; /* vec<struct iv_derived> */
+	int uses; /* occurrences of the identifier in the loop */
+};
+void loop_find_ivs(const struct loop_info *li, const struct ast_node *loop,
+	opt_const_fn ce, void *ud, struct vec *res /* vec<struct iv> */);
+void loop_ivs_free(struct vec *ivs);
+
+/* if `n` is the element `*(p + iv)`, `*(iv + p)` or `p[iv]`, its p */
+const struct ast_node *opt_elem_ptr(const struct ast_node *n, const char *iv);
+/* `while (iv < bound) { ...; iv = iv + step; }` whose other statements all
+ * assign sums and differences of elements at iv, constants and variables to
+ * elements at iv, so distinct iterations only share memory if the arrays
+ * overlap */
+struct vec_loop {
+	const char *iv;
+	const struct ast_node *bound;
+	long long step;
+	struct vec stores; /* vec<const struct ast_node *>, the assignments */
+};
+bool loop_vectorizable(const struct ast_node *loop, opt_const_fn ce, void *ud,
+	struct vec_loop *res);
+void vec_loop_finish(struct vec_loop *vl);
+/* `while (iv < bound) { ...; iv = iv + step; }` where the other statements
+ * never write iv or the bound and never jump, so that every iteration runs
+ * the whole body */
+struct unroll_loop {
+	const char *iv;
+	const struct ast_node *bound;
+	long long step;
+	const struct ast_node *incr; /* the statement that steps iv */
+	int size; /* nodes in the body */
+};
+bool loop_unrollable(const struct ast_node *loop, opt_const_fn ce, void *ud,
+	struct unroll_loop *res);
+
+/* if `n` is `if (x == c) ...` without an else, its x and c */
+bool opt_eq_test(const struct ast_node *n, const struct ast_node **ident,
+	const struct ast_node **value, opt_const_fn ce, void *ud);
+/*
+ * The number of statements from `stmts[i]` on that test the same variable
+ * against distinct constants, with none but the last of the bodies writing
+ * to it or containing labels. At most one of them can be taken.
+ */
+int opt_if_chain(const struct vec *stmts, int i,
+	const struct vec *address_taken, opt_const_fn ce, void *ud);
+
+/* a case or default label of an enclosing switch */
+struct switch_label {
+	const struct ast_node *n;
+	int label; /* given by the backend */
+};
+/* appends the labels of the switch `n` to `labels`, vec<struct
+ * switch_label>, but not those of the switches nested in it */
+void opt_switch_labels(const struct ast_node *n, struct vec *labels);
+/* the label of the case or default `n`, -1 if it has none */
+int opt_switch_label_get(const struct vec *labels, const struct ast_node *n);
+/* a value to jump on in a multi-way dispatch */
+struct dispatch_case {
+	int v;
+	int label;
+};
+/* sorts the cases, vec<struct dispatch_case>, by value, false with a
+ * message if two of them are equal */
+bool opt_dispatch_sort(struct vec *cases);
+
+/* true if `n` contains a label that could be jumped to */
+bool opt_stmt_has_label(const struct ast_node *n);
+/* whether a call never returns, supplied by the code generator */
+typedef bool (*opt_noreturn_fn)(const struct ast_node *call, void *ud);
+struct opt_flow {
+	opt_const_fn ce;
+	opt_noreturn_fn noreturn;
+	void *ud;
+};
+/* false if control never reaches the end of `n` */
+bool opt_stmt_falls_through(const struct ast_node *n,
+	const struct opt_flow *flow);
+/* true if `n` is unlikely to run: every path through it ends in a call that
+ * never returns or returns a negative constant, as errors are reported */
+bool opt_stmt_cold(const struct ast_node *n, const struct opt_flow *flow);
+/* collects the local variables of a function that are stored to but never
+ * read */
+void opt_dead_locals(const struct ast_node *def, struct vec *res);
+/* true if pointers into the stack frame of a function may exist */
+bool opt_frame_escapes(const struct ast_node *def);
+
+/* a function defined in the translation unit */
+struct opt_function {
+	const struct ast_node *def;
+	const char *ident;
+	int params; /* -1 if some parameter has no name */
+	int size; /* nodes in the body */
+	int calls; /* direct call sites */
+	bool is_static;
+	bool leaf; /* calls no functions */
+	bool recursive;
+	struct vec refs; /* vec<int>, the functions named in the body */
+	bool inline_; /* calls with matching arguments are expanded */
+	bool scanned;
+	bool emit; /* the body is still needed after inlining */
+	enum opt_effects effects; /* of a call, including what it calls */
+};
+/*
+ * Collects the function definitions of a translation unit and decides which
+ * of them are inlined at their call sites, by size, linkage and the `inline`
+ * specifier. Static functions are only emitted if something still refers to
+ * them afterwards.
+ *
+ * The effects of a function are those of its own body joined with the
+ * effects of the functions it calls. They start out as the body's alone and
+ * only grow while they are propagated along the calls, so the functions of
+ * a recursive cycle settle on the effects of the whole cycle. Calls to
+ * functions defined elsewhere or through pointers have side effects.
+ */
+void opt_functions(const struct ast_node *tu,
+	struct vec *res /* vec<struct opt_function> */);
+void opt_functions_free(struct vec *fns);
+const struct opt_function *opt_function_get(const struct vec *fns,
+	const char *ident);
+/* the function whose body replaces `call`, if any */
+const struct opt_function *opt_inline_callee(const struct vec *fns,
+	const struct ast_node *call);
+
+#endif
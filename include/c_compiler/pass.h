@@ -0,0 +1,96 @@
+// SPDX-License-Identifier: GPL-3.0-only
+#ifndef C_COMPILER_PASS_H
+#define C_COMPILER_PASS_H
+#include <stdbool.h>
+#include <stdio.h>
+#include <ds/vec.h>
+
+/*
+ * The optimizations of the code generator as an ordered pipeline of passes.
+ * The code generator makes one walk over the tree, and a pass is the set of
+ * decisions it takes there for one optimization. A pass runs at the -O
+ * levels from its own on, unless -f<name> or -fno-<name> says otherwise.
+ * The passes and the analyses they depend on are timed exclusively, code
+ * generated between their begin and end counts towards the innermost one,
+ * and each pass counts the changes it makes.
+ *
+ * Analyses of a function are cached by its definition, so inlined copies
+ * share them. An analysis that depends on more than the definition is
+ * invalidated when that changes.
+ */
+
+/* in the order they act, from the whole translation unit to single
+ * instructions */
+enum pass_id {
+	PASS_INLINE,
+	PASS_PURE,
+	PASS_CONST_PROP,
+	PASS_DCE,
+	PASS_CSE,
+	PASS_ALIAS,
+	PASS_LICM,
+	PASS_IV,
+	PASS_MEM_IDIOM,
+	PASS_VECTORIZE,
+	PASS_UNROLL,
+	PASS_IF_CHAIN,
+	PASS_SELECT,
+	PASS_COLD,
+	PASS_TAIL_CALL,
+	PASS_MUL_DIV,
+	PASS_ISEL,
+	PASS_SCHED,
+	PASS_N,
+};
+enum pass_analysis {
+	PASS_A_FUNCTIONS, /* calls, inlining and effects of the functions */
+	PASS_A_ADDRESS_TAKEN,
+	PASS_A_ALIAS, /* also depends on the names at file scope */
+	PASS_A_DEAD_LOCALS,
+	PASS_A_N,
+};
+#define PASS_LEVEL_MAX 2
+
+struct pass_stats {
+	double seconds;
+	int changes; /* for an analysis, the results computed */
+	int reused; /* results of an analysis taken from the cache */
+};
+struct pass_manager {
+	int level;
+	int force[PASS_N]; /* 1 to run, -1 not to, 0 as the level says */
+	bool print_stats;
+	struct pass_stats stats[PASS_N + PASS_A_N];
+	struct vec timers; /* vec<int>, the innermost last */
+	double start; /* of the time not yet counted */
+	struct vec cache; /* vec<struct pass_cached> */
+};
+
+void pass_manager_init(struct pass_manager *pm);
+void pass_manager_finish(struct pass_manager *pm);
+/* -O<level>, -f<pass>, -fno-<pass> or -fstats, false if arg is none of
+ * them */
+bool pass_option(struct pass_manager *pm, const char *arg);
+const char *pass_name(enum pass_id p);
+bool pass_enabled(const struct pass_manager *pm, enum pass_id p);
+
+/* starts timing p and returns true if it is enabled, pass_end stops it */
+bool pass_begin(struct pass_manager *pm, enum pass_id p);
+void pass_analysis_begin(struct pass_manager *pm, enum pass_analysis a);
+/* stops the innermost timer */
+void pass_end(struct pass_manager *pm);
+void pass_changed(struct pass_manager *pm, enum pass_id p);
+
+/* the cached result of a for key, NULL if there is none */
+const struct vec *pass_cached(struct pass_manager *pm, enum pass_analysis a,
+	const void *key);
+/* keeps res as the result of a for key, the manager frees it */
+const struct vec *pass_cache(struct pass_manager *pm, enum pass_analysis a,
+	const void *key, struct vec res);
+/* drops the results of a, after what it depends on has changed */
+void pass_invalidate(struct pass_manager *pm, enum pass_analysis a);
+
+/* one line per pass and analysis */
+void pass_print_stats(const struct pass_manager *pm, FILE *f);
+
+#endif
@@ -0,0 +1,22 @@
+// SPDX-License-Identifier: GPL-3.0-only
+#ifndef C_COMPILER_SCHED_H
+#define C_COMPILER_SCHED_H
+#include <c_compiler/isel.h>
+
+/*
+ * List scheduling of selected code. The instructions are ordered by the
+ * latencies and execution ports of a generic recent x86-64 core, cycle by
+ * cycle, with the longest path to the end going first, so loads are issued
+ * early and their results used once they arrive. The registers are assigned
+ * again afterwards, and an instruction is only issued while the values it
+ * keeps live still fit in ISEL_REGS registers.
+ */
+
+/* reorders the code of one tree, its last instruction stays last, leaves
+ * the code as it is and returns false if it can't improve it */
+bool sched_code(struct isel_code *c);
+/* the cycles the code takes by the model, from the first issue until the
+ * last result is there */
+int sched_cycles(const struct isel_code *c);
+
+#endif
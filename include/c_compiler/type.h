@@ -0,0 +1,52 @@
+// SPDX-License-Identifier: GPL-3.0-only
+#ifndef C_COMPILER_TYPE_H
+#define C_COMPILER_TYPE_H
+#include <c_compiler/ast.h>
+
+/*
+ * The types of expressions as the backends check them: the declaration
+ * specifiers and the declarator of a name, with the derivations of the
+ * declarator applied one by one as the expression dereferences, calls or
+ * indexes, and the address-of operator on top.
+ */
+
+typedef enum {
+	S_OK,
+	S_ERROR,
+} status;
+
+struct type {
+	bool address_of;
+	int app;
+	const struct ast_declaration_specifiers *s;
+	const struct ast_declarator *d;
+};
+
+void warn_node(const char *msg, const struct ast_node *n);
+void warn_type(const char *msg, const struct type *t);
+
+/* the value of an integer constant expression, with a message if it has none */
+status const_eval(const struct ast_node *n, int *res);
+/* like const_eval, but quiet, so it can be used to probe expressions */
+bool const_value(const struct ast_node *n, long long *res, void *ud);
+
+bool type_all_applied(const struct type *t);
+bool type_is_const(const struct type *t);
+bool type_is_pointer(const struct type *t);
+bool type_is_array(const struct type *t);
+bool type_is_unsigned(const struct type *t);
+bool type_is_arithmetic(const struct type *t);
+/* these apply an operator to the type, false with a message if they can't */
+bool type_apply_address_of(struct type *t);
+bool type_apply_deref(struct type *t);
+bool type_apply_call(struct type *t);
+bool type_apply_array(struct type *t);
+/* the address of an array as a pointer to its first element */
+bool type_apply_decay(struct type *t);
+status type_get_size(const struct type *t, int *res);
+/* the type of `c ? a : b`, by the usual arithmetic conversions, with a
+ * pointer arm winning over an integer one */
+struct type type_conditional(const struct type *a, const struct type *b);
+struct type type_from_typename(struct ast_node *n);
+
+#endif
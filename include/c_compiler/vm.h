@@ -0,0 +1,128 @@
+// SPDX-License-Identifier: GPL-3.0-only
+#ifndef C_COMPILER_VM_H
+#define C_COMPILER_VM_H
+#include <stdio.h>
+#include <ds/hashmap.h>
+#include <c_compiler/ast.h>
+
+/*
+ * A bytecode backend that runs programs without generating machine code.
+ * Functions are lowered from the AST to instructions on 64 bit registers,
+ * each one a word for the operation and three for the operands. Locals live
+ * in registers unless their address is taken, and a call passes its
+ * arguments in the registers at the top of the caller, which become the
+ * first registers of the callee. Values are kept as the native code keeps
+ * them: zero extended from the size of their type.
+ *
+ * The interpreter is direct threaded: before running, the operation words
+ * are replaced with the offsets of their handlers, and each handler jumps
+ * straight to the next one. Common sequences are single instructions: a
+ * compare and a branch, and a load, an add and a store to the same address.
+ * Functions that are declared but not defined are looked up in the process
+ * and called with the arguments from the registers.
+ */
+
+enum vm_op {
+	VM_MOVI, /* a = constant b */
+	VM_MOVK, /* a = the 64 bit constant with index b */
+	VM_MOV, /* a = b */
+	VM_ADD, /* a = b + c */
+	VM_ADDW,
+	VM_ADDI, /* a = b + constant c */
+	VM_ADDIW,
+	VM_SUB, /* a = b - c */
+	VM_SUBW,
+	VM_MULW, /* a = b * c, 32 bit operations from here */
+	VM_DIVW,
+	VM_DIVUW,
+	VM_MODW,
+	VM_MODUW,
+	VM_NOT, /* a = ~b */
+	VM_ZX8, /* a = b zero extended from 8 bits */
+	VM_ZX32,
+	VM_SX32, /* a = b sign extended from 32 bits */
+	VM_LT, /* a = b < c, signed, as are all the comparisons */
+	VM_LTI, /* a = b < constant c */
+	VM_EQ,
+	VM_EQI,
+	VM_NE,
+	VM_NEI,
+	VM_LD1, /* a = [b + c] */
+	VM_LD4,
+	VM_LD8,
+	VM_LDX1, /* a = [b + register c] */
+	VM_LDX4,
+	VM_LDX8,
+	VM_ST1, /* [a + b] = c */
+	VM_ST4,
+	VM_ST8,
+	VM_STX1, /* [a + register b] = c */
+	VM_STX4,
+	VM_STX8,
+	VM_LDF1, /* a = [frame + b] */
+	VM_LDF4,
+	VM_LDF8,
+	VM_STF1, /* [frame + a] = b */
+	VM_STF4,
+	VM_STF8,
+	VM_LEAF, /* a = frame + b */
+	VM_INCM1, /* [a + b] += constant c */
+	VM_INCM4,
+	VM_INCM8,
+	VM_ADDM1, /* [a + b] += c */
+	VM_ADDM4,
+	VM_ADDM8,
+	VM_SUBM1, /* [a + b] -= c */
+	VM_SUBM4,
+	VM_SUBM8,
+	VM_JMP, /* to a */
+	VM_JZ, /* to b if a is 0 */
+	VM_JNZ,
+	VM_JLT, /* to c if a < b */
+	VM_JGE,
+	VM_JEQ,
+	VM_JNE,
+	VM_JLTI, /* to c if a < constant b */
+	VM_JGEI,
+	VM_JEQI,
+	VM_JNEI,
+	VM_JTAB, /* to the target of a - b in the c words after, or past them,
+		  * the words filling whole instructions */
+	VM_CALL, /* function b with c arguments in a and up, the result in a */
+	VM_CALLX, /* the same for a function of the process */
+	VM_TAIL, /* replaces the frame with a call, and returns its result */
+	VM_TAILX,
+	VM_RET, /* returns a */
+	VM_OP_N,
+};
+
+#define VM_INS 4 /* words of an instruction */
+
+struct vm_function {
+	const char *name;
+	bool defined;
+	int code; /* index of the first word */
+	int regs; /* registers of a frame, the parameters first */
+	int frame; /* bytes of memory for the locals that have an address */
+	int size; /* of the result, 0 if there is none */
+	void *native; /* the function of the process if not defined */
+};
+
+struct vm_code {
+	struct vec code; /* vec<int> */
+	struct vec functions; /* vec<struct vm_function> */
+	struct hashmap by_name; /* hashmap<int>, function indices */
+	struct vec consts; /* vec<long long> */
+	struct vec strings; /* vec<char *>, the bytes of the literals */
+};
+
+void vm_init(struct vm_code *c);
+void vm_free(struct vm_code *c);
+/* lowers the translation unit, false with a message on stderr on an error */
+bool vm_compile(struct vm_code *c, const struct ast_node *n);
+void vm_print(const struct vm_code *c, FILE *f);
+/* runs main with the arguments, false with a message on stderr if the
+ * program can't be loaded, the result of main in *res */
+bool vm_run(struct vm_code *c, int argc, char **argv, int *res);
+
+#endif
@@ -0,0 +1,61 @@
+// SPDX-License-Identifier: GPL-3.0-only
+#ifndef C_COMPILER_X86_H
+#define C_COMPILER_X86_H
+#include <stdbool.h>
+#include <ds/vec.h>
+#include <ds/hashmap.h>
+#include <c_compiler/emit.h>
+
+/*
+ * Machine code for the instruction records. The records are encoded into
+ * the bytes of their sections, jumps take the short form while their target
+ * is near enough, and the references that can only be resolved once the
+ * sections have their addresses are kept as relocations, for the object
+ * file writer or for whatever loads the code into memory.
+ */
+
+enum x86_section {
+	X86_TEXT,
+	X86_TEXT_UNLIKELY,
+	X86_RODATA,
+	X86_SECTION_N,
+	X86_UNDEFINED = X86_SECTION_N, /* a symbol from elsewhere */
+};
+enum x86_reloc_kind {
+	X86_R_64, /* the address */
+	X86_R_PC32, /* the address relative to the field */
+	X86_R_PLT32, /* like X86_R_PC32, a call of a function from elsewhere */
+};
+
+struct x86_symbol {
+	const char *name;
+	enum x86_section section;
+	int offset;
+	int size; /* the bytes until the next symbol of its section */
+	bool global;
+};
+struct x86_reloc {
+	enum x86_reloc_kind kind;
+	enum x86_section section; /* of the field */
+	int offset; /* of the field in its section */
+	int sym; /* the symbol it refers to, or -1 for the start of target */
+	enum x86_section target;
+	long long addend;
+};
+
+struct x86_code {
+	struct vec section[X86_SECTION_N]; /* vec<unsigned char> */
+	struct vec symbols; /* vec<struct x86_symbol> */
+	struct vec relocs; /* vec<struct x86_reloc> */
+	struct hashmap by_name; /* of the symbols, their index */
+};
+
+void x86_init(struct x86_code *c);
+void x86_free(struct x86_code *c);
+/* encodes the records into c, false with a message on stderr if one can't
+ * be encoded */
+bool x86_encode(struct x86_code *c, const struct emit *e);
+/* the index of the symbol, or -1 */
+int x86_symbol(struct x86_code *c, const char *name);
+
+#endif
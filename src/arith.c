@@ -0,0 +1,224 @@
+// SPDX-License-Identifier: GPL-3.0-only
+#include <c_compiler/arith.h>
+
+static int log2_exact(uint32_t c) {
+	if (c == 0 || (c & (c - 1)) != 0) return -1;
+	int k = 0;
+	while (c >>= 1) ++k;
+	return k;
+}
+
+/* the shift amount for a lea multiplier of 3, 5 or 9 */
+static int lea_k(uint32_t c) {
+	switch (c) {
+	case 3: return 1;
+	case 5: return 2;
+	case 9: return 3;
+	default: return -1;
+	}
+}
+
+static void step(struct arith_mul *res, enum arith_mul_op op, int k) {
+	res->steps[res->n].op = op;
+	res->steps[res->n].k = k;
+	res->n++;
+}
+
+/* at most two cheap instructions, a 3 cycle imul is not worse than that */
+static bool plan_positive(uint32_t c, struct arith_mul *res) {
+	int k = log2_exact(c);
+	if (c == 1) return true;
+	if (k >= 0) return step(res, ARITH_MUL_SHL, k), true;
+	if (lea_k(c) >= 0) return step(res, ARITH_MUL_LEA, lea_k(c)), true;
+	for (uint32_t a = 3; a <= 9; a += 2) {
+		if (lea_k(a) < 0 || c % a != 0) continue;
+		uint32_t b = c / a;
+		if ((k = log2_exact(b)) >= 0) {
+			step(res, ARITH_MUL_LEA, lea_k(a));
+			step(res, ARITH_MUL_SHL, k);
+			return true;
+		}
+		if (lea_k(b) >= 0) {
+			step(res, ARITH_MUL_LEA, lea_k(a));
+			step(res, ARITH_MUL_LEA, lea_k(b));
+			return true;
+		}
+	}
+	if ((k = log2_exact(c - 1)) >= 0) {
+		res->save = true;
+		step(res, ARITH_MUL_SHL, k);
+		step(res, ARITH_MUL_ADD, 0);
+		return true;
+	}
+	if ((k = log2_exact(c + 1)) >= 0) {
+		res->save = true;
+		step(res, ARITH_MUL_SHL, k);
+		step(res, ARITH_MUL_SUB, 0);
+		return true;
+	}
+	return false;
+}
+bool arith_plan_mul(int32_t c, struct arith_mul *res) {
+	*res = (struct arith_mul){ .n = 0 };
+	if (c == 0) return step(res, ARITH_MUL_ZERO, 0), true;
+	if (c > 0) return plan_positive(c, res);
+	if (!plan_positive(-(uint32_t)c, res) || res->n > 1) return false;
+	step(res, ARITH_MUL_NEG, 0);
+	return true;
+}
+uint32_t arith_eval_mul(uint32_t x, const struct arith_mul *p) {
+	uint32_t orig = x;
+	for (int i = 0; i < p->n; ++i) {
+		int k = p->steps[i].k;
+		switch (p->steps[i].op) {
+		case ARITH_MUL_SHL: x <<= k; break;
+		case ARITH_MUL_LEA: x += x << k; break;
+		case ARITH_MUL_ADD: x += orig; break;
+		case ARITH_MUL_SUB: x -= orig; break;
+		case ARITH_MUL_NEG: x = -x; break;
+		case ARITH_MUL_ZERO: x = 0; break;
+		}
+	}
+	return x;
+}
+
+/* Hacker's Delight, figure 10-1 */
+static void magic_signed(int32_t d, struct arith_div *res) {
+	const uint32_t two31 = 0x80000000;
+	uint32_t ad = d < 0 ? -(uint32_t)d : (uint32_t)d;
+	uint32_t t = two31 + ((uint32_t)d >> 31);
+	uint32_t anc = t - 1 - t % ad;
+	uint32_t q1 = two31 / anc, r1 = two31 - q1 * anc;
+	uint32_t q2 = two31 / ad, r2 = two31 - q2 * ad;
+	uint32_t delta;
+	int p = 31;
+	do {
+		p++;
+		q1 *= 2;
+		r1 *= 2;
+		if (r1 >= anc) {
+			q1++;
+			r1 -= anc;
+		}
+		q2 *= 2;
+		r2 *= 2;
+		if (r2 >= ad) {
+			q2++;
+			r2 -= ad;
+		}
+		delta = ad - r2;
+	} while (q1 < delta || (q1 == delta && r1 == 0));
+	int32_t m = (int32_t)(q2 + 1);
+	if (d < 0) m = -m;
+	res->magic = m;
+	res->shift = p - 32;
+	res->fixup = d > 0 && m < 0 ? 1 : d < 0 && m > 0 ? -1 : 0;
+}
+/* Hacker's Delight, figure 10-2 */
+static void magic_unsigned(uint32_t d, struct arith_div *res) {
+	uint32_t nc = -1 - (-d) % d;
+	uint32_t q1 = 0x80000000 / nc, r1 = 0x80000000 - q1 * nc;
+	uint32_t q2 = 0x7FFFFFFF / d, r2 = 0x7FFFFFFF - q2 * d;
+	uint32_t delta;
+	int p = 31;
+	res->fixup = 0;
+	do {
+		p++;
+		if (r1 >= nc - r1) {
+			q1 = 2 * q1 + 1;
+			r1 = 2 * r1 - nc;
+		} else {
+			q1 = 2 * q1;
+			r1 = 2 * r1;
+		}
+		if (r2 + 1 >= d - r2) {
+			if (q2 >= 0x7FFFFFFF) res->fixup = 1;
+			q2 = 2 * q2 + 1;
+			r2 = 2 * r2 + 1 - d;
+		} else {
+			if (q2 >= 0x80000000) res->fixup = 1;
+			q2 = 2 * q2;
+			r2 = 2 * r2 + 1;
+		}
+		delta = d - 1 - r2;
+	} while (p < 64 && (q1 < delta || (q1 == delta && r1 == 0)));
+	res->magic = q2 + 1;
+	res->shift = p - 32;
+}
+
+bool arith_plan_div(int64_t d, bool is_unsigned, struct arith_div *res) {
+	*res = (struct arith_div){ .is_unsigned = is_unsigned };
+	if (is_unsigned) {
+		uint32_t ud = d;
+		int k = log2_exact(ud);
+		if (ud == 0) return false;
+		if (ud == 1) return res->kind = ARITH_DIV_ONE, true;
+		if (k >= 0) {
+			res->kind = ARITH_DIV_POW2;
+			res->shift = k;
+		} else if (ud >= 0x80000000) {
+			res->kind = ARITH_DIV_GE;
+			res->magic = ud;
+		} else {
+			res->kind = ARITH_DIV_MAGIC;
+			magic_unsigned(ud, res);
+		}
+		return true;
+	}
+	int32_t sd = d;
+	if (sd == 0) return false;
+	res->neg = sd < 0;
+	uint32_t ad = sd < 0 ? -(uint32_t)sd : (uint32_t)sd;
+	int k = log2_exact(ad);
+	if (ad == 1) {
+		res->kind = ARITH_DIV_ONE;
+	} else if (k >= 0) {
+		res->kind = ARITH_DIV_POW2;
+		res->shift = k;
+	} else {
+		res->kind = ARITH_DIV_MAGIC;
+		res->neg = false;
+		magic_signed(sd, res);
+	}
+	return true;
+}
+
+int32_t arith_eval_sdiv(int32_t x, const struct arith_div *p) {
+	uint32_t q;
+	int64_t prod;
+	switch (p->kind) {
+	case ARITH_DIV_ONE:
+		q = x;
+		break;
+	case ARITH_DIV_POW2:
+		// bias negative dividends by 2^k - 1 to round towards zero
+		q = (uint32_t)x + ((uint32_t)(x >> 31) >> (32 - p->shift));
+		q = (int32_t)q >> p->shift;
+		break;
+	case ARITH_DIV_MAGIC:
+		prod = (int64_t)x * (int32_t)p->magic;
+		q = (uint32_t)(prod >> 32) + (uint32_t)(p->fixup * x);
+		q = (int32_t)q >> p->shift;
+		q += q >> 31;
+		break;
+	default:
+		return 0;
+	}
+	return p->neg ? -q : q;
+}
+uint32_t arith_eval_udiv(uint32_t x, const struct arith_div *p) {
+	uint32_t q;
+	switch (p->kind) {
+	case ARITH_DIV_ONE:
+		return x;
+	case ARITH_DIV_POW2:
+		return x >> p->shift;
+	case ARITH_DIV_GE:
+		return x >= p->magic;
+	case ARITH_DIV_MAGIC:
+		q = ((uint64_t)x * p->magic) >> 32;
+		if (p->fixup) return (((x - q) >> 1) + q) >> (p->shift - 1);
+		return q >> p->shift;
+	}
+	return 0;
+}
@@ -506,6 +506,112 @@ void ast_fprint(FILE *f, const struct ast_node *n, int ind) {
 		break;
 	}
 }
+static void walk_list(const struct vec *v, ast_visit_fn fn, void *ud) {
+	for (int i = 0; i < v->len; ++i) {
+		const struct ast_node * const *ni = vec_get_c(v, i);
+		ast_walk(*ni, fn, ud);
+	}
+}
+static void walk_opt(const struct ast_node *n, ast_visit_fn fn, void *ud) {
+	if (n) ast_walk(n, fn, ud);
+}
+void ast_walk(const struct ast_node *n, ast_visit_fn fn, void *ud) {
+	if (!fn(n, ud)) return;
+	switch (n->kind) {
+	case AST_INDEX:
+		ast_walk(n->index.a, fn, ud);
+		ast_walk(n->index.b, fn, ud);
+		break;
+	case AST_MEMBER:
+	case AST_MEMBER_DEREF:
+		ast_walk(n->member.a, fn, ud);
+		break;
+	case AST_UNARY:
+		ast_walk(n->unary.a, fn, ud);
+		break;
+	case AST_COMPOUND_LITERAL:
+		walk_list(&n->compound_literal.list, fn, ud);
+		break;
+	case AST_CAST:
+		ast_walk(n->cast.expr, fn, ud);
+		break;
+	case AST_BIN:
+		ast_walk(n->bin.a, fn, ud);
+		ast_walk(n->bin.b, fn, ud);
+		break;
+	case AST_CONDITIONAL:
+		ast_walk(n->conditional.cond, fn, ud);
+		ast_walk(n->conditional.expr, fn, ud);
+		ast_walk(n->conditional.expr_else, fn, ud);
+		break;
+	case AST_STMT_LABELED:
+		ast_walk(n->stmt_labeled.stmt, fn, ud);
+		break;
+	case AST_STMT_LABELED_CASE:
+		ast_walk(n->stmt_labeled_case.expr, fn, ud);
+		ast_walk(n->stmt_labeled_case.stmt, fn, ud);
+		break;
+	case AST_STMT_LABELED_DEFAULT:
+		ast_walk(n->stmt_labeled_default.stmt, fn, ud);
+		break;
+	case AST_STMT_EXPR:
+		walk_opt(n->stmt_expr.a, fn, ud);
+		break;
+	case AST_STMT_COMP:
+		walk_list(&n->stmt_comp, fn, ud);
+		break;
+	case AST_STMT_WHILE:
+		ast_walk(n->stmt_while.cond, fn, ud);
+		ast_walk(n->stmt_while.stmt, fn, ud);
+		break;
+	case AST_STMT_DO_WHILE:
+		ast_walk(n->stmt_do_while.stmt, fn, ud);
+		ast_walk(n->stmt_do_while.cond, fn, ud);
+		break;
+	case AST_STMT_FOR:
+		walk_opt(n->stmt_for.a, fn, ud);
+		walk_opt(n->stmt_for.b, fn, ud);
+		walk_opt(n->stmt_for.c, fn, ud);
+		ast_walk(n->stmt_for.stmt, fn, ud);
+		break;
+	case AST_STMT_IF:
+		ast_walk(n->stmt_if.cond, fn, ud);
+		ast_walk(n->stmt_if.stmt, fn, ud);
+		walk_opt(n->stmt_if.stmt_else, fn, ud);
+		break;
+	case AST_STMT_SWITCH:
+		ast_walk(n->stmt_switch.cond, fn, ud);
+		ast_walk(n->stmt_switch.stmt, fn, ud);
+		break;
+	case AST_STMT_RETURN:
+		walk_opt(n->stmt_return.expr, fn, ud);
+		break;
+	case AST_CALL:
+		ast_walk(n->call.a, fn, ud);
+		walk_list(&n->call.args, fn, ud);
+		break;
+	case AST_DECLARATION:
+		walk_list(&n->declaration.init_declarator_list, fn, ud);
+		break;
+	case AST_INIT_DECLARATOR:
+		walk_opt(n->init_declarator.initializer, fn, ud);
+		break;
+	case AST_TRANSLATION_UNIT:
+		walk_list(&n->translation_unit, fn, ud);
+		break;
+	case AST_FUNCTION_DEFINITION:
+		ast_walk(n->function_definition.compound_statement, fn, ud);
+		break;
+	case AST_INITIALIZER:
+		walk_list(&n->initializer.list, fn, ud);
+		break;
+	case AST_INITIALIZER_LIST_ITEM:
+		ast_walk(n->initializer_list_item.initializer, fn, ud);
+		break;
+	default:
+		break;
+	}
+}
 struct ast_node *ast_ident(const char *ident) {
 	struct ast_node *n = malloc(sizeof(struct ast_node));
 	*n = (struct ast_node){
@@ -538,6 +644,24 @@ struct ast_node *ast_string(const char *ident) {
 	};
 	return n;
 }
+int ast_string_bytes(const char *src, char *res) {
+	static const char escapes[256] = {
+		['n'] = '\n', ['t'] = '\t', ['r'] = '\r', ['0'] = '\0',
+		['a'] = '\a', ['b'] = '\b', ['f'] = '\f', ['v'] = '\v',
+	};
+	size_t len = strlen(src);
+	int n = 0;
+	for (size_t i = 1; i + 1 < len; ++i) {
+		unsigned char ch = src[i];
+		if (ch == '\\' && i + 2 < len) {
+			ch = src[++i];
+			if (escapes[ch] || ch == '0') ch = escapes[ch];
+		}
+		res[n++] = ch;
+	}
+	res[n] = 0;
+	return n;
+}
 struct ast_node *ast_index(struct ast_node *a, struct ast_node *b) {
 	struct ast_node *n = malloc(sizeof(struct ast_node));
 	*n = (struct ast_node){
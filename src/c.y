@@ -3,6 +3,9 @@
 #include <stdio.h>
 #include <c_compiler/ast.h>
 #include <c_compiler/cg.h>
+#include <c_compiler/elf.h>
+#include <c_compiler/jit.h>
+#include <c_compiler/vm.h>
 #include <c.tab.h>
 
 // typedef struct ast_node *YYSTYPE;
@@ -25,18 +28,92 @@ int yywrap()
 	return 1;
 }
 
+// usage: c_compiler ast|asm|obj|run|vm|bc [-O0|-O1|-O2] [-f[no-]PASS] [-fstats]
+//        [-mavx2] [-funroll=N] [-fperf-map] file.c
 int main(int argc, char *argv[])
 {
-	if (argc < 2) return 1;
-	yyin = fopen(argv[2], "r");
+	if (argc < 3) return 1;
+	struct pass_manager pm;
+	pass_manager_init(&pm);
+	struct cg_options opts = { .unroll = 4, .passes = &pm };
+	const char *path = NULL;
+	bool perf_map = false;
+	for (int i = 2; i < argc; ++i) {
+		if (strcmp(argv[i], "-mavx2") == 0) {
+			opts.avx2 = true;
+		} else if (strncmp(argv[i], "-funroll=", 9) == 0) {
+			opts.unroll = atoi(argv[i] + 9);
+			if (opts.unroll < 1) {
+				fprintf(stderr, "error: bad unroll factor `%s`\n",
+					argv[i] + 9);
+				return 1;
+			}
+		} else if (strcmp(argv[i], "-fperf-map") == 0) {
+			perf_map = true;
+		} else if (argv[i][0] == '-') {
+			if (!pass_option(&pm, argv[i])) {
+				fprintf(stderr, "error: unknown option `%s`\n",
+					argv[i]);
+				return 1;
+			}
+		} else {
+			path = argv[i];
+		}
+	}
+	if (!path) return 1;
+	yyin = fopen(path, "r");
 	struct ast_node *n;
 	yyparse(&n);
 	fclose(yyin);
 
+	bool obj = strcmp(argv[1], "obj") == 0;
+	bool run = strcmp(argv[1], "run") == 0;
 	if (strcmp(argv[1], "ast") == 0) {
 		ast_fprint(stdout, n, 0);
-	} else if (strcmp(argv[1], "asm") == 0) {
-		return cg_gen(n);
+	} else if (strcmp(argv[1], "vm") == 0 || strcmp(argv[1], "bc") == 0) {
+		// the bytecode, which runs without the code generator
+		pass_manager_finish(&pm);
+		struct vm_code code;
+		vm_init(&code);
+		int res = 0;
+		if (!vm_compile(&code, n)) {
+			res = 1;
+		} else if (strcmp(argv[1], "bc") == 0) {
+			vm_print(&code, stdout);
+		} else {
+			char *args[] = { (char *)path, NULL };
+			if (!vm_run(&code, 1, args, &res)) res = 1;
+		}
+		vm_free(&code);
+		return res;
+	} else if (strcmp(argv[1], "asm") == 0 || obj || run) {
+		struct emit out;
+		emit_init(&out);
+		int res = cg_gen(n, &opts, &out);
+		if (pm.print_stats) pass_print_stats(&pm, stderr);
+		pass_manager_finish(&pm);
+		if (res == 0 && (obj || run)) {
+			struct x86_code code;
+			x86_init(&code);
+			if (!x86_encode(&code, &out)) {
+				res = 1;
+			} else if (run) {
+				// the program is named after its file, and its
+				// result is ours
+				char *args[] = { (char *)path, NULL };
+				if (!jit_run(&code, 1, args, perf_map, &res))
+					res = 1;
+			} else if (!elf_write(&code, 1)) {
+				fprintf(stderr, "error: can't write the output\n");
+				res = 1;
+			}
+			x86_free(&code);
+		} else if (res == 0 && !emit_write(&out, 1)) {
+			fprintf(stderr, "error: can't write the output\n");
+			res = 1;
+		}
+		emit_free(&out);
+		return res;
 	} else {
 		return EXIT_FAILURE;
 	}
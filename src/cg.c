@@ -1,42 +1,25 @@
 // SPDX-License-Identifier: GPL-3.0-only
+#define _POSIX_C_SOURCE 200809L /* open_memstream */
 #include <ds/hashmap.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include <stdbool.h>
 #include <assert.h>
 #include <c_compiler/cg.h>
-
-#define container_of(ptr, type, member) \
-	(type *)((char *)(ptr) - offsetof(type, member))
+#include <c_compiler/type.h>
+#include <c_compiler/opt.h>
+#include <c_compiler/arith.h>
+#include <c_compiler/isel.h>
+#include <c_compiler/sched.h>
+#include <c_compiler/pass.h>
+#include <c_compiler/emit.h>
 
 #define GETI(x, i) *(struct ast_node * const *)vec_get_c(&(x), i)
 #define FOR_EACH_NODE(x) \
 	const struct ast_node *ni = GETI(x, 0); \
 	for (int i = 0; ni; ni = ((++i < (x).len) ? GETI(x, i): NULL))
 
-struct type {
-	bool address_of;
-	int app;
-	const struct ast_declaration_specifiers *s;
-	const struct ast_declarator *d;
-};
-
-static void warn_node(const char *msg, const struct ast_node *n) {
-	fprintf(stderr, "%s: `", msg);
-	ast_fprint(stderr, n, 0);
-	fprintf(stderr, "`\n");
-}
-static void warn_type(const char *msg, const struct type *t) {
-	const struct ast_node *ns = container_of(t->s, struct ast_node, declaration_specifiers);
-	const struct ast_node *nd = container_of(t->d, struct ast_node, declarator);
-
-	fprintf(stderr, "%s: { %sapp: %d, `", msg,
-		t->address_of ? "&, " : "", t->app);
-	ast_fprint(stderr, ns, 0);
-	fprintf(stderr, "` `");
-	ast_fprint(stderr, nd, 0);
-	fprintf(stderr, "` }\n");
-}
-
 struct builtin_types {
 	struct ast_node *spec_int, *spec_char;
 	struct ast_node *p;
@@ -56,180 +39,168 @@ struct scope {
 	struct hashmap vars; /* hashmap<struct decl> */
 };
 
-struct state {
-	struct scope *scope;
-	int sp; /* stack pointer */
-	FILE *f;
-	struct vec strings;
-	int label;
-	struct builtin_types builtin;
-};
+#define VAL_CHAIN_MAX 4
 
 typedef struct {
 	int deref_n;
 	long long int s;
 	bool lvalue;
+	bool imm; /* s is the value itself */
+	/* folded into the last dereference, or the slot if deref_n is 0:
+	 * [base + index * scale + disp] */
+	long long disp;
+	int scale; /* 0 if there is no index */
+	long long index; /* slot of the index */
+	int index_size;
+	/* displacements of the intermediate dereferences */
+	long long chain[VAL_CHAIN_MAX];
 	struct type t;
 } val;
 
-typedef enum {
-	S_OK,
-	S_ERROR,
-} status;
+/* a pointer value plus a scaled index and displacement not yet added */
+struct addr {
+	val base;
+	long long disp;
+	int scale;
+	long long index;
+	int index_size;
+};
 
-static status const_eval(const struct ast_node *n, int *res) {
-	if (n->kind == AST_INTEGER) {
-		*res = n->integer;
-		return S_OK;
-	}
-	warn_node("error: can't eval const expression", n);
-	return S_ERROR;
-}
+/* an invariant expression evaluated in a loop preheader, or a strength
+ * reduced induction expression kept up to date in a slot */
+struct hoisted {
+	const struct ast_node *n;
+	val v;
+};
 
-static bool type_all_applied(const struct type *t) {
-	return !t->address_of && t->app == t->d->v.len;
-}
-static bool type_is_const(const struct type *t) {
-	if (type_all_applied(t)) {
-		return t->s->type_qualifiers[AST_TYPE_QUALIFIER_CONST] > 0;
-	} else if (t->address_of) {
-		// cant modify the result of the address-of operator
-		return true;
-	} else {
-		const struct ast_node *n =
-			*(const struct ast_node **)vec_get_c(&t->d->v, t->app);
-		if (n->kind == AST_FUNCTION_DECLARATOR
-				|| n->kind == AST_ARRAY_DECLARATOR) {
-			// we can't modify arrays or functions
-			return true;
-		}
-		assert(n->kind == AST_POINTER_DECLARATOR);
-		return n->pointer_declarator
-			.type_qualifiers[AST_TYPE_QUALIFIER_CONST] > 0;
-	}
+/* advance a strength reduced expression when `stmt` steps its variable */
+struct iv_update {
+	const struct ast_node *stmt;
+	val v;
+	long long delta;
+};
+
+/* in a copy of an unrolled loop body, the variable stands for v + delta */
+struct unroll_index {
+	const char *iv;
+	int loc; /* of the variable the copy refers to */
+	val v;
+	long long delta;
+};
+
+/* a name declared in the function being generated */
+struct alias_var {
+	const char *ident;
+	struct type t;
+	int decls; /* more than one means the name is ambiguous */
+	bool unique; /* nothing but its own accesses reaches the object */
+};
+
+/* a pure expression already computed into a temporary */
+struct cse {
+	const struct ast_node *n;
+	val v;
+	bool killed;
+};
+
+/* the value a local holds, as a read of its slot gives it */
+struct known {
+	int loc;
+	long long v;
+};
+
+/* the function body being generated, a definition or an inlined call */
+struct frame {
+	const struct ast_node *def;
+	int label_return;
+	int label_entry; /* after the prologue, -1 in inlined bodies */
+	int block; /* index of the body in blocks */
+	bool escapes; /* pointers to the stack frame may be live */
+};
+
+/* the position in an enclosing compound statement */
+struct block_pos {
+	const struct ast_node *comp;
+	int i;
+};
+
+struct state {
+	struct scope *scope;
+	int sp; /* stack pointer */
+	struct emit *code; /* where the code goes, the output, null or cold */
+	struct vec strings;
+	int label;
+	struct builtin_types builtin;
+	struct vec address_taken; /* vec<const char *> */
+	struct vec globals; /* vec<const char *>, declared at file scope */
+	struct vec alias_vars; /* vec<struct alias_var> */
+	struct vec hoisted; /* vec<struct hoisted> */
+	struct vec iv_updates; /* vec<struct iv_update> */
+	struct vec iv_dropped; /* vec<const struct ast_node *> */
+	struct vec blocks; /* vec<struct block_pos> */
+	int loop_depth;
+	struct vec breaks; /* vec<int>, labels */
+	struct vec continues; /* vec<int>, labels */
+	struct vec switch_labels; /* vec<struct switch_label> */
+	struct vec tables; /* vec<struct vec<int>>, jump tables */
+	struct vec functions; /* vec<struct opt_function> */
+	struct vec dead; /* vec<const char *>, locals that are never read */
+	struct emit null; /* where removed code goes to be checked */
+	struct vec cse; /* vec<struct cse>, available at this point */
+	int cse_switch; /* entries available at the cases of a switch */
+	struct vec known; /* vec<struct known>, values of locals here */
+	struct vec known_switch; /* values known at the cases of a switch */
+	int branches_folded, blocks_removed; /* in the current function */
+	struct emit cold; /* code unlikely to run, emitted after the function */
+	int blocks_cold;
+	bool avx2; /* 256 bit vectors */
+	struct vec libc; /* vec<const char *>, library functions called */
+	const struct ast_node *plain_loop; /* generated as it is written */
+	int unroll; /* copies of a loop body per iteration */
+	struct unroll_index unroll_index; /* of the body copy being generated */
+	struct frame frame;
+	struct pass_manager *passes;
+};
+
+/* evaluates call as pass p, timed, if p is enabled */
+#define PASS(s, p, call) \
+	(pass_begin((s)->passes, p) ? pass_done((s)->passes, call) : S_OK)
+static status pass_done(struct pass_manager *pm, status st) {
+	pass_end(pm);
+	return st;
 }
+
 static bool val_modifiable_lvalue(const val *v) {
 	return v->lvalue && !type_is_const(&v->t);
 }
-static bool type_is_pointer(struct type *t) {
-	if (type_all_applied(t)) return false;
-	if (t->address_of) return true;
-	const struct ast_node *n =
-		*(const struct ast_node **)vec_get_c(&t->d->v, t->app);
-	return n->kind == AST_POINTER_DECLARATOR;
-}
-static bool type_apply_address_of(struct type *t) {
-	if (t->address_of) {
-		warn_type("can't take address of", t);
-		return false;
-	}
-	t->address_of = true;
-	return true;
-}
-static bool type_apply_deref(struct type *t) {
-	if (t->address_of) {
-		t->address_of = false;
-		return true;
-	}
-	if (type_all_applied(t)) goto error;
-	const struct ast_node *n =
-		*(const struct ast_node **)vec_get_c(&t->d->v, t->app);
-	if (n->kind == AST_POINTER_DECLARATOR) {
-		t->app++;
-		return true;
-	}
-error:
-	warn_type("can't apply dereference operator", t);
-	return false;
-}
-static bool type_apply_call(struct type *t) {
-	if (t->address_of) goto error;
-	if (type_all_applied(t)) goto error;
-	const struct ast_node *n =
-		*(const struct ast_node **)vec_get_c(&t->d->v, t->app);
-	if (n->kind == AST_FUNCTION_DECLARATOR) {
-		t->app++;
-		return true;
-	}
-error:
-	warn_type("can't call", t);
-	return false;
-}
-static bool type_apply_array(struct type *t) {
-	if (t->address_of) goto error;
-	if (type_all_applied(t)) return false;
-	const struct ast_node *n =
-		*(const struct ast_node **)vec_get_c(&t->d->v, t->app);
-	if (n->kind == AST_ARRAY_DECLARATOR) {
-		t->app++;
-		return true;
-	}
-error:
-	warn_type("can't apply array subscripting", t);
-	return false;
-}
-static bool type_is_arithmetic(const struct type *t) {
-	if (!type_all_applied(t)) return false;
-	// TODO: check builtin types
-	return true;
-}
-
-static status type_get_size(const struct type *t, int *res) {
-	if (t->address_of) {
-		return *res = 8, S_OK;
-	}
-	if (type_all_applied(t)) {
-		const char *bs = t->s->builtin_type_specifiers;
-		if (bs[AST_BUILTIN_TYPE_CHAR]) return *res = 1, S_OK;
-		if (bs[AST_BUILTIN_TYPE_INT]) return *res = 4, S_OK;
-		if (bs[AST_BUILTIN_TYPE_VOID]) return *res = 0, S_OK;
-		goto error;
-	}
-	const struct ast_node *n =
-		*(const struct ast_node **)vec_get_c(&t->d->v, t->app);
-	if (n->kind == AST_POINTER_DECLARATOR) return *res = 8, S_OK;
-	if (n->kind == AST_ARRAY_DECLARATOR) {
-		int array_n, tt_res;
-		if (const_eval(n->array_declarator.size, &array_n) == S_ERROR)
-			goto error;
-		struct type tt = *t;
-		if (!type_apply_array(&tt)) goto error;
-		if (type_get_size(&tt, &tt_res) == S_ERROR) goto error;
-		*res = array_n * tt_res;
-		return S_OK;
-	}
-	if (n->kind == AST_FUNCTION_DECLARATOR) {
-		// here we are supposed to automatically apply the address-of
-		// operator
-		return *res = 8, S_OK;
-	}
-	assert(false);
-error:
-	warn_type("can't determine size of", t);
-	return S_ERROR;
-}
-static struct type type_from_typename(struct ast_node *n) {
-	assert(n->kind == AST_TYPE_NAME);
-	return (struct type){
-		.app = 0,
-		.s = &n->type_name.specifier_qualifier_list->declaration_specifiers,
-		.d = &n->type_name.declarator->declarator
-	};
-}
 
 static int get_label(struct state *s) {
 	return s->label++;
 }
 static void put_label(struct state *s, int l) {
-	fprintf(s->f, "label_%d:\n", l);
+	emit_label(s->code, l);
 }
 
 static void state_init(struct state *s) {
 	*s = (struct state) {
 		.sp = 0,
-		.f = stdout,
 		.strings = vec_new_empty(sizeof(const char *)),
 		.label = 0,
+		.hoisted = vec_new_empty(sizeof(struct hoisted)),
+		.iv_updates = vec_new_empty(sizeof(struct iv_update)),
+		.iv_dropped = vec_new_empty(sizeof(const struct ast_node *)),
+		.blocks = vec_new_empty(sizeof(struct block_pos)),
+		.breaks = vec_new_empty(sizeof(int)),
+		.continues = vec_new_empty(sizeof(int)),
+		.switch_labels = vec_new_empty(sizeof(struct switch_label)),
+		.tables = vec_new_empty(sizeof(struct vec)),
+		.functions = vec_new_empty(sizeof(struct opt_function)),
+		.globals = vec_new_empty(sizeof(const char *)),
+		.dead = vec_new_empty(sizeof(const char *)),
+		.cse = vec_new_empty(sizeof(struct cse)),
+		.known = vec_new_empty(sizeof(struct known)),
+		.known_switch = vec_new_empty(sizeof(struct known)),
+		.libc = vec_new_empty(sizeof(const char *)),
 	};
 
 	s->builtin.spec_int = ast_declaration_specifiers();
@@ -257,25 +228,80 @@ static void state_init(struct state *s) {
 		.d = &s->builtin.decl_p->declarator,
 	};
 	s->builtin.t_size_t = s->builtin.t_int; // TODO
+
+	emit_init(&s->null);
+	s->null.discard = true;
+	emit_init(&s->cold);
 }
 
-static const char *get_mov_size(int size) {
-	if (size == 1) return "byte";
-	if (size == 4) return "dword";
-	if (size == 8) return "qword";
-	return NULL;
+/* shorthands for the operands of emitted instructions */
+static struct emit_operand r64(enum emit_reg r) {
+	return emit_o_reg(r, 8);
+}
+static struct emit_operand r32(enum emit_reg r) {
+	return emit_o_reg(r, 4);
+}
+static struct emit_operand r8(enum emit_reg r) {
+	return emit_o_reg(r, 1);
+}
+static struct emit_operand imm(long long x) {
+	return emit_o_imm(x);
 }
-static const char *get_reg(int i, int size) {
-	if (i == 0) {
-		if (size == 1) return "al";
-		if (size == 4) return "eax";
-		if (size == 8) return "rax";
-	} else if (i == 1) {
-		if (size == 1) return "bl";
-		if (size == 4) return "ebx";
-		if (size == 8) return "rbx";
+/* [base+disp] */
+static struct emit_operand mem(int size, enum emit_reg base, long long disp) {
+	return emit_o_mem(size, base, -1, 0, disp);
+}
+static struct emit_operand slot(int size, long long loc) {
+	return mem(size, EMIT_RBP, loc);
+}
+
+static bool size_ok(int size) {
+	return size == 1 || size == 4 || size == 8;
+}
+static enum emit_reg get_reg(int i) {
+	static const enum emit_reg regs[] = { EMIT_RAX, EMIT_RBX, EMIT_RDX };
+	return regs[i];
+}
+/* loads the pointer that is dereferenced first into rcx */
+static void val_load_base(struct state *s, const val *v) {
+	if (v->imm) {
+		emit2(s->code, EMIT_MOV, r64(EMIT_RCX), imm(v->s));
+	} else {
+		emit2(s->code, EMIT_MOV, r64(EMIT_RCX), slot(8, v->s));
 	}
-	return NULL;
+}
+/* loads an index into rdx */
+static void load_index(struct state *s, int scale, long long index,
+		int index_size) {
+	if (!scale) return;
+	emit2(s->code, index_size == 1 ? EMIT_MOVZX : EMIT_MOV,
+		emit_o_reg(EMIT_RDX, index_size == 8 ? 8 : 4),
+		slot(index_size, index));
+}
+/* [base+rdx*scale+disp], without the index if scale is 0 */
+static struct emit_operand index_mem(int size, enum emit_reg base,
+		int scale, long long disp) {
+	return emit_o_mem(size, base, scale ? EMIT_RDX : -1, scale, disp);
+}
+/* loads the base of an lvalue into rcx and its index into rdx */
+static void val_load_addr(struct state *s, const val *v) {
+	if (v->deref_n > 0) {
+		// dereference pointer recursively
+		val_load_base(s, v);
+		for (int i = 0; i < v->deref_n - 1; ++i) {
+			long long disp = i < VAL_CHAIN_MAX ? v->chain[i] : 0;
+			emit2(s->code, EMIT_MOV, r64(EMIT_RCX),
+				mem(0, EMIT_RCX, disp));
+		}
+	}
+	load_index(s, v->scale, v->index, v->index_size);
+}
+/* the memory operand of an lvalue, after val_load_addr */
+static struct emit_operand val_mem(const val *v, int size) {
+	if (v->deref_n == 0) {
+		return index_mem(size, EMIT_RBP, v->scale, v->s + v->disp);
+	}
+	return index_mem(size, EMIT_RCX, v->scale, v->disp);
 }
 static status val_read(struct state *s, const val *v, int regi) {
 	int size;
@@ -284,27 +310,29 @@ static status val_read(struct state *s, const val *v, int regi) {
 		warn_type("can't read void type", &v->t);
 		return S_ERROR;
 	}
-	const char *regs = get_reg(regi, size);
-	const char *movs = get_mov_size(size);
-	if (!regs || !movs) return S_ERROR;
+	if (!size_ok(size)) return S_ERROR;
+	enum emit_reg r = get_reg(regi);
 
-	if (size != 8) {
-		const char *regs8 = get_reg(regi, 8);
-		fprintf(s->f, "xor %s, %s\n", regs8, regs8);
+	if (v->imm && v->deref_n == 0) {
+		// the same zero extended value a read from a slot would give
+		long long x = v->s;
+		if (size == 4) x = (unsigned int)x;
+		if (size == 1) x = (unsigned char)x;
+		emit2(s->code, EMIT_MOV, r64(r), imm(x));
+		return S_OK;
 	}
 
+	if (size != 8) emit2(s->code, EMIT_XOR, r64(r), r64(r));
+
 	if (v->deref_n == 0) {
-		fprintf(s->f, "mov %s, %s [rbp%lld] ; read\n", regs, movs, v->s);
+		val_load_addr(s, v);
+		emit2(s->code, EMIT_MOV, emit_o_reg(r, size), val_mem(v, size));
 		return S_OK;
 	} else if (v->deref_n > 0) {
-		fprintf(s->f, "; read (deref_n=%d) {\n", v->deref_n);
-		// dereference pointer recursively
-		fprintf(s->f, "mov rcx, qword [rbp%lld]\n", v->s);
-		for (int i = 0; i < v->deref_n - 1; ++i) {
-			fprintf(s->f, "mov rcx, [rcx]\n");
-		}
-		fprintf(s->f, "mov %s, %s [rcx]\n", regs, movs);
-		fprintf(s->f, "; }\n");
+		emit_comment(s->code, "read (deref_n=%d) {", v->deref_n);
+		val_load_addr(s, v);
+		emit2(s->code, EMIT_MOV, emit_o_reg(r, size), val_mem(v, size));
+		emit_comment(s->code, "}");
 		return S_OK;
 	} else {
 		assert(false);
@@ -318,26 +346,38 @@ static status val_store(struct state *s, const val *v, int regi) {
 		warn_type("can't read void type", &v->t);
 		return S_ERROR;
 	}
-	const char *regs = get_reg(regi, size);
-	const char *movs = get_mov_size(size);
-	if (!regs || !movs) return S_ERROR;
+	if (!size_ok(size)) return S_ERROR;
+	enum emit_reg r = get_reg(regi);
 
 	if (v->deref_n == 0) {
-		fprintf(s->f, "mov %s [rbp%lld], %s ; store\n", movs, v->s, regs);
+		assert(!v->imm);
+		val_load_addr(s, v);
+		emit2(s->code, EMIT_MOV, val_mem(v, size), emit_o_reg(r, size));
 		return S_OK;
 	} else if (v->deref_n > 0) {
-		fprintf(s->f, "; store (deref_n=%d) {\n", v->deref_n);
-		fprintf(s->f, "mov rcx, qword [rbp%lld]\n", v->s);
-		for (int i = 0; i < v->deref_n - 1; ++i) {
-			fprintf(s->f, "mov rcx, [rcx]\n");
-		}
-		fprintf(s->f, "mov %s [rcx], %s\n", movs, regs);
-		fprintf(s->f, "; }\n");
+		emit_comment(s->code, "store (deref_n=%d) {", v->deref_n);
+		val_load_addr(s, v);
+		emit2(s->code, EMIT_MOV, val_mem(v, size), emit_o_reg(r, size));
+		emit_comment(s->code, "}");
 		return S_OK;
 	} else {
 		assert(false);
 	}
 }
+/* adds a constant to an lvalue in place */
+static status val_add_imm(struct state *s, const val *v, long long x) {
+	int size;
+	if (type_get_size(&v->t, &size) == S_ERROR) return S_ERROR;
+	if (!size_ok(size)) return S_ERROR;
+	val_load_addr(s, v);
+	emit2(s->code, EMIT_ADD, val_mem(v, size), imm(x));
+	return S_OK;
+}
+/* rax = the address of an lvalue */
+static void val_addr(struct state *s, const val *v) {
+	val_load_addr(s, v);
+	emit2(s->code, EMIT_LEA, r64(EMIT_RAX), val_mem(v, 0));
+}
 static status val_push_new(struct state *s, struct type t, int regi, val *vres) {
 	s->sp -= 8;
 	*vres = (val){ .deref_n = 0, .s = s->sp, .lvalue = false, .t = t };
@@ -346,347 +386,3292 @@ static status val_push_new(struct state *s, struct type t, int regi, val *vres)
 }
 
 static status cg_gen_expr(struct state *s, const struct ast_node *n, val *res);
+static bool hoisted_get(struct state *s, const struct ast_node *n, val *res);
 
-#define WARN_MOD_LVALUE(n) warn_node("Error: operand in this expression" \
-	" shall be a modifiable lvalue", (n));
-static status cg_gen_unary(struct state *s, const struct ast_node *n, val *res) {
-	val val_a;
-	if (cg_gen_expr(s, n->unary.a, &val_a) == S_ERROR) return S_ERROR;
-	switch (n->unary.kind) {
-	case AST_PRE_INCR:
-		if (!val_modifiable_lvalue(&val_a)) {
-			WARN_MOD_LVALUE(n);
+/* a value that can be used as the index of a memory operand */
+static status val_to_slot(struct state *s, val *v) {
+	if (v->deref_n == 0 && !v->imm && !v->scale && !v->disp) return S_OK;
+	if (val_read(s, v, 0) == S_ERROR) return S_ERROR;
+	return val_push_new(s, v->t, 0, v);
+}
+/* the address of an array as a pointer to its first element */
+static status val_decay(struct state *s, val *v) {
+	struct type t = v->t;
+	if (!type_apply_decay(&t)) return S_ERROR;
+	val_addr(s, v);
+	return val_push_new(s, t, 0, v);
+}
+/* an operand as its value, arrays as the address of their first element */
+static status val_decay_array(struct state *s, val *v) {
+	return type_is_array(&v->t) ? val_decay(s, v) : S_OK;
+}
+/* adds the folded offsets to the base, leaving it in a slot */
+static status addr_materialize(struct state *s, struct addr *a) {
+	if (!a->scale && !a->disp) return S_OK;
+	if (type_is_array(&a->base.t) && val_decay(s, &a->base) == S_ERROR)
+		return S_ERROR;
+	if (val_read(s, &a->base, 0) == S_ERROR) return S_ERROR;
+	load_index(s, a->scale, a->index, a->index_size);
+	emit2(s->code, EMIT_LEA, r64(EMIT_RAX),
+		index_mem(0, EMIT_RAX, a->scale, a->disp));
+	struct type t = a->base.t;
+	*a = (struct addr){ 0 };
+	return val_push_new(s, t, 0, &a->base);
+}
+static bool addr_fold_disp(struct addr *a, long long x) {
+	long long disp = a->disp + x;
+	if (disp < -0x80000000LL || disp > 0x7fffffffLL) return false;
+	a->disp = disp;
+	return true;
+}
+static status addr_set_index(struct state *s, const struct ast_node *n,
+		struct addr *a, val *v, int scale) {
+	if (!type_is_arithmetic(&v->t) || !(type_is_pointer(&a->base.t)
+			|| type_is_array(&a->base.t))) {
+		warn_node("Cant add operands", n);
+		return S_ERROR;
+	}
+	if (a->scale && addr_materialize(s, a) == S_ERROR) return S_ERROR;
+	if (val_to_slot(s, v) == S_ERROR) return S_ERROR;
+	a->scale = scale;
+	a->index = v->s;
+	return type_get_size(&v->t, &a->index_size);
+}
+
+static status cg_gen_addr(struct state *s, const struct ast_node *n,
+		struct addr *res);
+
+static struct decl *scope_lookup(struct scope *scope, const char *ident);
+
+/* an index that is the variable of an unrolled loop, with the offset of the
+ * body copy folded into the displacement */
+static bool unroll_index(struct state *s, const struct ast_node *b,
+		int scale, struct addr *a, val *v) {
+	const struct unroll_index *u = &s->unroll_index;
+	if (!u->iv || b->kind != AST_IDENT || strcmp(b->ident, u->iv) != 0)
+		return false;
+	const struct decl *decl = scope_lookup(s->scope, b->ident);
+	if (!decl || decl->loc != u->loc
+			|| !addr_fold_disp(a, u->delta * scale)) {
+		return false;
+	}
+	*v = u->v;
+	return true;
+}
+
+/* the address a + b, with a constant factor of b folded into the scale */
+static status cg_gen_addr_add(struct state *s, const struct ast_node *n,
+		const struct ast_node *a, const struct ast_node *b,
+		struct addr *res) {
+	long long c;
+	if (const_value(b, &c, NULL) || const_value(a, &c, NULL)) {
+		if (cg_gen_addr(s, const_value(b, &c, NULL) ? a : b, res)
+				== S_ERROR) {
 			return S_ERROR;
 		}
-		val_read(s, &val_a, 0);
-		fprintf(s->f, "add rax, 1\n");
-		val_store(s, &val_a, 0);
-		*res = val_a;
-		return S_OK;
-	case AST_PRE_DECR:
-		if (!val_modifiable_lvalue(&val_a)) {
-			WARN_MOD_LVALUE(n);
-			return S_ERROR;
+		if (addr_fold_disp(res, c)) return S_OK;
+		if (addr_materialize(s, res) == S_ERROR) return S_ERROR;
+		if (addr_fold_disp(res, c)) return S_OK;
+		warn_node("error: offset out of range", n);
+		return S_ERROR;
+	}
+	val v;
+	if (cg_gen_addr(s, a, res) == S_ERROR) return S_ERROR;
+	if (!type_is_pointer(&res->base.t) && !type_is_array(&res->base.t)) {
+		// the integer is on the left
+		if (addr_materialize(s, res) == S_ERROR) return S_ERROR;
+		v = res->base;
+		if (cg_gen_addr(s, b, res) == S_ERROR) return S_ERROR;
+		return addr_set_index(s, n, res, &v, 1);
+	}
+	// constant terms of the index go into the displacement
+	while (b->kind == AST_BIN && b->bin.kind == AST_BIN_ADD) {
+		if (const_value(b->bin.b, &c, NULL) && addr_fold_disp(res, c)) {
+			b = b->bin.a;
+		} else if (const_value(b->bin.a, &c, NULL)
+				&& addr_fold_disp(res, c)) {
+			b = b->bin.b;
+		} else {
+			break;
 		}
-		val_read(s, &val_a, 0);
-		fprintf(s->f, "sub rax, 1\n");
-		val_store(s, &val_a, 0);
-		*res = val_a;
-		return S_OK;
-	case AST_POST_INCR: assert(false); break;
-	case AST_POST_DECR: assert(false); break;
-	case AST_UNARY_REF:
-		if (!val_a.lvalue) {
-			warn_node("Error: can't take address of non-lvalue", n);
-			return S_ERROR;
+	}
+	int scale = 1;
+	if (b->kind == AST_BIN && b->bin.kind == AST_BIN_MUL) {
+		if (const_value(b->bin.b, &c, NULL)
+				&& (c == 1 || c == 2 || c == 4 || c == 8)) {
+			scale = c;
+			b = b->bin.a;
+		} else if (const_value(b->bin.a, &c, NULL)
+				&& (c == 1 || c == 2 || c == 4 || c == 8)) {
+			scale = c;
+			b = b->bin.b;
 		}
-		if (!type_apply_address_of(&val_a.t)) return S_ERROR;
-	 	fprintf(s->f, "mov rax, rbp\n");
-	 	fprintf(s->f, "sub rax, %lld\n", -val_a.s);
-		return val_push_new(s, val_a.t, 0, res);
-	case AST_UNARY_DEREF:
-		if (!type_apply_deref(&val_a.t)) return S_ERROR;
-		val_a.lvalue = true;
-		val_a.deref_n++;
-		*res = val_a;
-		return S_OK;
-	case AST_UNARY_PLUS: assert(false); break;
-	case AST_UNARY_MINUS: assert(false); break;
-	case AST_UNARY_NOT:
-		val_read(s, &val_a, 0);
-		fprintf(s->f, "not rax\n");
-		return val_push_new(s, val_a.t, 0, res);
-	case AST_UNARY_NOTB: assert(false); break;
-	case AST_UNARY_SIZEOF: assert(false); break;
 	}
-	return S_ERROR;
+	if (unroll_index(s, b, scale, res, &v)) {
+		return addr_set_index(s, n, res, &v, scale);
+	}
+	if (cg_gen_expr(s, b, &v) == S_ERROR) return S_ERROR;
+	return addr_set_index(s, n, res, &v, scale);
+}
+/*
+ * Evaluates a pointer expression, but leaves constant offsets and an index
+ * to be folded into the memory operand that uses it.
+ */
+static status cg_gen_addr(struct state *s, const struct ast_node *n,
+		struct addr *res) {
+	*res = (struct addr){ 0 };
+	if (hoisted_get(s, n, &res->base)) return S_OK;
+	long long c;
+	if (n->kind == AST_BIN && n->bin.kind == AST_BIN_ADD) {
+		return cg_gen_addr_add(s, n, n->bin.a, n->bin.b, res);
+	}
+	if (n->kind != AST_BIN || n->bin.kind != AST_BIN_SUB
+			|| !const_value(n->bin.b, &c, NULL)) {
+		return cg_gen_expr(s, n, &res->base);
+	}
+	if (cg_gen_addr(s, n->bin.a, res) == S_ERROR) return S_ERROR;
+	if (type_is_pointer(&res->base.t) && addr_fold_disp(res, -c))
+		return S_OK;
+	// a plain subtraction
+	if (addr_materialize(s, res) == S_ERROR) return S_ERROR;
+	if (val_read(s, &res->base, 0) == S_ERROR) return S_ERROR;
+	val vc = { .s = c, .imm = true, .t = s->builtin.t_int };
+	val_read(s, &vc, 1);
+	emit2(s->code, EMIT_SUB, r64(EMIT_RAX), r64(EMIT_RBX));
+	return val_push_new(s, res->base.t, 0, &res->base);
 }
 
-static status cg_gen_bin(struct state *s, const struct ast_node *n, val *res) {
-	val val_a, val_b;
-	if (cg_gen_expr(s, n->bin.a, &val_a) == S_ERROR) return S_ERROR;
-	if (cg_gen_expr(s, n->bin.b, &val_b) == S_ERROR) return S_ERROR;
-	bool
-		a_ptr = type_is_pointer(&val_a.t),
-		b_ptr = type_is_pointer(&val_b.t),
-		a_arith = type_is_arithmetic(&val_a.t),
-		b_arith = type_is_arithmetic(&val_b.t);
-	switch (n->bin.kind) {
-	case AST_BIN_MUL:
-		val_read(s, &val_a, 0);
-		val_read(s, &val_b, 1);
-		fprintf(s->f, "imul eax, ebx\n");
-		return val_push_new(s, val_a.t, 0, res);
-	case AST_BIN_DIV: assert(false); break;
-	case AST_BIN_MOD: assert(false); break;
-	case AST_BIN_ADD: ;
-		val_read(s, &val_a, 0);
-		val_read(s, &val_b, 1);
-		fprintf(s->f, "add rax, rbx\n");
-		if (a_arith && b_arith) {
-			// ok, both arithmetic
-			return val_push_new(s, val_a.t, 0, res);
-		} else if (a_ptr && b_arith) {
-			return val_push_new(s, val_a.t, 0, res);
-		} else if (a_arith && b_ptr) {
-			return val_push_new(s, val_b.t, 0, res);
+/* the lvalue at a folded address */
+static status cg_gen_deref(struct state *s, struct addr *a, val *res) {
+	val v = a->base;
+	if (type_is_array(&v.t)) {
+		if (!(v.scale && a->scale)) {
+			// index the array in place
+			if (!type_apply_array(&v.t)) return S_ERROR;
+			v.disp += a->disp;
+			if (a->scale) {
+				v.scale = a->scale;
+				v.index = a->index;
+				v.index_size = a->index_size;
+			}
+			*res = v;
+			return S_OK;
 		}
-		warn_node("Cant add operands", n);
-		return S_ERROR;
-	case AST_BIN_SUB:
-		val_read(s, &val_a, 0);
-		val_read(s, &val_b, 1);
-		fprintf(s->f, "sub rax, rbx\n");
-		if (a_arith && b_arith) {
-			// ok, both arithmetic
-			return val_push_new(s, val_a.t, 0, res);
-		} else if (a_ptr && b_ptr) {
-			// ok, pointers can have difference
-			return val_push_new(s, val_a.t, 0, res);
-		} else if (a_ptr && b_arith) {
-			// ok, can subtract from pointer
-			return val_push_new(s, val_a.t, 0, res);
-		}
-		warn_node("Cant subtract operands", n);
-		return S_ERROR;
-	case AST_BIN_LSHIFT: assert(false); break;
-	case AST_BIN_RSHIFT:
-		break;
-	case AST_BIN_LT:
-		val_read(s, &val_a, 0);
-		val_read(s, &val_b, 1);
-		fprintf(s->f, "cmp rax, rbx\n");
-		fprintf(s->f, "setl al\n");
-		fprintf(s->f, "movzx rax, al\n");
-		return val_push_new(s, s->builtin.t_int, 0, res);
-	case AST_BIN_GT: assert(false); break;
-	case AST_BIN_LEQ: assert(false); break;
-	case AST_BIN_GEQ: assert(false); break;
-	case AST_BIN_EQB:
-	case AST_BIN_NEQ:
-		val_read(s, &val_a, 0);
-		val_read(s, &val_b, 1);
-		fprintf(s->f, "cmp rax, rbx\n");
-		fprintf(s->f, "%s al\n",
-			n->bin.kind == AST_BIN_EQB ? "sete" : "setne");
-		fprintf(s->f, "movzx rax, al\n");
-		return val_push_new(s, s->builtin.t_int, 0, res);
-		return S_OK;
-	case AST_BIN_AND: assert(false); break;
-	case AST_BIN_XOR: assert(false); break;
-	case AST_BIN_OR: assert(false); break;
-	case AST_BIN_ANDB: assert(false); break;
-	case AST_BIN_ORB: assert(false); break;
-	case AST_BIN_ASSIGN:
-		val_read(s, &val_b, 0);
-		val_store(s, &val_a, 0);
-		*res = val_a;
-		return S_OK;
-	case AST_BIN_COMMA: assert(false); break;
+		if (val_decay(s, &a->base) == S_ERROR) return S_ERROR;
+		v = a->base;
 	}
-	return S_ERROR;
+	if (!type_apply_deref(&v.t)) return S_ERROR;
+	if (v.disp && !v.scale && v.deref_n == 0) {
+		v.s += v.disp;
+	} else if (v.disp && !v.scale && v.deref_n <= VAL_CHAIN_MAX) {
+		// the pointer is loaded with the displacement on the way
+		v.chain[v.deref_n - 1] = v.disp;
+	} else if (v.scale || v.disp) {
+		// the pointer itself is at an indexed address
+		struct type t = v.t;
+		if (val_to_slot(s, &a->base) == S_ERROR) return S_ERROR;
+		v = a->base;
+		v.t = t;
+	}
+	v.lvalue = true;
+	v.deref_n++;
+	v.disp = a->disp;
+	v.scale = a->scale;
+	v.index = a->index;
+	v.index_size = a->index_size;
+	*res = v;
+	return S_OK;
 }
 
-static status find_ident(struct scope *scope, const char *ident, val *res) {
-	if (!scope) {
-		fprintf(stderr, "Error: undefined identifier `%s`\n", ident);
-		return S_ERROR;
+#define WARN_MOD_LVALUE(n) warn_node("Error: operand in this expression" \
+	" shall be a modifiable lvalue", (n));
+
+/* removed code is never run */
+static bool cg_discarding(const struct state *s) {
+	return s->code == &s->null;
+}
+/* a comment with the source of n in place of %s */
+static void comment_node(struct state *s, const char *fmt,
+		const struct ast_node *n) {
+	if (s->code->discard) return;
+	char *text = NULL;
+	size_t len = 0;
+	FILE *f = open_memstream(&text, &len);
+	if (!f) return;
+	ast_fprint(f, n, 0);
+	fclose(f);
+	emit_comment(s->code, fmt, text);
+	free(text);
+}
+/* code that is only checked changes nothing */
+static void count_changed(struct state *s, enum pass_id p) {
+	if (!cg_discarding(s)) pass_changed(s->passes, p);
+}
+
+/*
+ * Alias analysis: an access to memory is described by the name its address
+ * is based on and the type it reads. Accesses of different types don't
+ * alias unless one of them is through `char`, distinct arrays and variables
+ * whose address is taken are distinct objects, and an array or restrict
+ * pointer that is only ever used to access memory through is the only way
+ * to reach what it points to.
+ */
+enum alias_kind {
+	ALIAS_ANY,
+	ALIAS_INT,
+	ALIAS_PTR,
+};
+struct alias_access {
+	const struct alias_var *base; /* NULL if unknown */
+	bool object; /* the base is an array or variable, not a pointer */
+	enum alias_kind kind;
+};
+
+static const struct alias_var *alias_var(struct state *s, const char *ident) {
+	for (int i = 0; i < s->alias_vars.len; ++i) {
+		const struct alias_var *v = vec_get_c(&s->alias_vars, i);
+		if (strcmp(v->ident, ident) == 0) return v->decls == 1 ? v : NULL;
 	}
-	struct decl *decl;
-	if (hashmap_get(&scope->vars, ident, (void**)&decl) == MAP_OK) {
-		*res = (val){ .deref_n = 0, .s = decl->loc,
-			.lvalue = true, .t = decl->t };
-		return S_OK;
-	} else {
-		return find_ident(scope->parent, ident, res);
+	return NULL;
+}
+static enum alias_kind alias_kind(const struct type *t) {
+	if (type_all_applied(t)) {
+		return t->s->builtin_type_specifiers[AST_BUILTIN_TYPE_INT]
+			? ALIAS_INT : ALIAS_ANY;
 	}
+	return type_is_pointer(t) ? ALIAS_PTR : ALIAS_ANY;
 }
-
-static status cg_gen_expr(struct state *s, const struct ast_node *n, val *res) {
+/* the pointer or array an address is computed from */
+static const struct alias_var *alias_base(struct state *s,
+		const struct ast_node *n) {
+	const struct alias_var *v;
 	switch (n->kind) {
 	case AST_IDENT:
-		return find_ident(s->scope, n->ident, res);
+		v = alias_var(s, n->ident);
+		if (v && (type_is_pointer(&v->t) || type_is_array(&v->t))) {
+			return v;
+		}
+		return NULL;
+	case AST_BIN:
+		if (n->bin.kind == AST_BIN_ADD) {
+			v = alias_base(s, n->bin.a);
+			return v ? v : alias_base(s, n->bin.b);
+		}
+		return n->bin.kind == AST_BIN_SUB ? alias_base(s, n->bin.a) : NULL;
+	default:
+		return NULL;
+	}
+}
+static void alias_access(struct state *s, const struct ast_node *n,
+		struct alias_access *res) {
+	*res = (struct alias_access){ .kind = ALIAS_ANY };
+	const struct alias_var *v = NULL;
+	if (n->kind == AST_IDENT) {
+		res->base = alias_var(s, n->ident);
+		res->object = true;
+		if (res->base) res->kind = alias_kind(&res->base->t);
+		return;
+	} else if (n->kind == AST_UNARY && n->unary.kind == AST_UNARY_DEREF) {
+		v = alias_base(s, n->unary.a);
+	} else if (n->kind == AST_INDEX) {
+		v = alias_base(s, n->index.a);
+		if (!v) v = alias_base(s, n->index.b);
+	}
+	if (!v) return;
+	struct type t = v->t;
+	res->base = v;
+	res->object = type_is_array(&t);
+	if (res->object ? type_apply_array(&t) : type_apply_deref(&t)) {
+		res->kind = alias_kind(&t);
+	}
+}
+/* whether the accesses `a` and `b` may refer to the same memory */
+static bool alias_access_may(struct state *s, const struct ast_node *a,
+		const struct ast_node *b) {
+	if (a->kind == AST_MEMBER || a->kind == AST_MEMBER_DEREF
+			|| b->kind == AST_MEMBER || b->kind == AST_MEMBER_DEREF) {
+		return true;
+	}
+	struct alias_access x, y;
+	alias_access(s, a, &x);
+	alias_access(s, b, &y);
+	if (x.kind != ALIAS_ANY && y.kind != ALIAS_ANY && x.kind != y.kind) {
+		return false;
+	}
+	if (x.base && x.base == y.base) return true;
+	if ((x.base && x.base->unique) || (y.base && y.base->unique)) {
+		return false;
+	}
+	return !(x.object && y.object && x.base && y.base);
+}
+static bool alias_may(const struct ast_node *a, const struct ast_node *b,
+		void *ud) {
+	struct state *s = ud;
+	if (!pass_begin(s->passes, PASS_ALIAS)) return true;
+	bool res = alias_access_may(s, a, b);
+	if (!res) count_changed(s, PASS_ALIAS);
+	pass_end(s->passes);
+	return res;
+}
+/* whether the pointers `a` and `b` never point into the same object */
+static bool alias_distinct(struct state *s, const char *a, const char *b) {
+	if (!pass_enabled(s->passes, PASS_ALIAS)) return false;
+	const struct alias_var *x = alias_var(s, a), *y = alias_var(s, b);
+	return x && y && x != y && (x->unique || y->unique);
+}
+
+/*
+ * Value numbering over the structured control flow: a pure expression
+ * computed once is reused by later code that the computation dominates.
+ * Entries recorded in a conditional arm or loop are dropped when it is
+ * left, and entries that a write could change are killed when it happens.
+ * Temporaries are never reused for anything else, so a slot keeps its
+ * value for the rest of the function.
+ */
+#define CSE_MAX 256
+
+/* the entry that holds the value of n, NULL if there is none */
+static const struct cse *cse_find(struct state *s, const struct ast_node *n) {
+	for (int i = s->cse.len - 1; i >= 0; --i) {
+		const struct cse *e = vec_get_c(&s->cse, i);
+		if (!e->killed && e->n->kind == n->kind
+				&& opt_expr_equal(e->n, n)) {
+			return e;
+		}
+	}
+	return NULL;
+}
+static bool cse_get(struct state *s, const struct ast_node *n, val *res) {
+	if (s->cse.len == 0 || !pass_begin(s->passes, PASS_CSE)) return false;
+	const struct cse *e = cse_find(s, n);
+	if (e) {
+		comment_node(s, "reused `%s`", n);
+		*res = e->v;
+		count_changed(s, PASS_CSE);
+	}
+	pass_end(s->passes);
+	return e != NULL;
+}
+static void cse_put(struct state *s, const struct ast_node *n, const val *v) {
+	if (v->deref_n > 0 || v->lvalue || v->imm || s->cse.len >= CSE_MAX)
+		return;
+	if (cg_discarding(s) || !pass_begin(s->passes, PASS_CSE)) return;
+	if ((n->kind != AST_BIN || n->bin.kind != AST_BIN_ASSIGN)
+			&& opt_expr_pure(n, &s->functions)) {
+		vec_append(&s->cse, &(struct cse){ .n = n, .v = *v });
+	}
+	pass_end(s->passes);
+}
+/* after a store through a pointer or a call */
+static void cse_kill_memory(struct state *s) {
+	for (int i = 0; i < s->cse.len; ++i) {
+		struct cse *e = vec_get(&s->cse, i);
+		if (opt_expr_reads_memory(e->n, &s->address_taken, &s->functions)) {
+			e->killed = true;
+		}
+	}
+}
+static void cse_kill_ident(struct state *s, const char *ident) {
+	for (int i = 0; i < s->cse.len; ++i) {
+		struct cse *e = vec_get(&s->cse, i);
+		if (opt_ident_count(e->n, ident) > 0) e->killed = true;
+	}
+	// pure functions and pointers from elsewhere may read a global
+	if (opt_names_contain(&s->address_taken, ident)
+			|| opt_names_contain(&s->globals, ident)) {
+		cse_kill_memory(s);
+	}
+}
+/* after a store to memory, only what may read the target changes */
+static void cse_kill_aliases(struct state *s, const struct ast_node *target) {
+	for (int i = 0; i < s->cse.len; ++i) {
+		struct cse *e = vec_get(&s->cse, i);
+		if (opt_expr_reads_store(e->n, target, &s->address_taken,
+				&s->functions, alias_may, s)) {
+			e->killed = true;
+		}
+	}
+}
+static void cse_kill_store(struct state *s, const struct ast_node *target) {
+	if (target->kind != AST_IDENT) {
+		cse_kill_aliases(s, target);
+		return;
+	}
+	for (int i = 0; i < s->cse.len; ++i) {
+		struct cse *e = vec_get(&s->cse, i);
+		if (opt_ident_count(e->n, target->ident) > 0) e->killed = true;
+	}
+	if (opt_names_contain(&s->globals, target->ident)) {
+		cse_kill_memory(s);
+	} else if (opt_names_contain(&s->address_taken, target->ident)) {
+		cse_kill_aliases(s, target);
+	}
+}
+/* before a loop, whose body may run again after any of its writes */
+static void cse_kill_loop(struct state *s, const struct ast_node *loop) {
+	struct loop_info li;
+	loop_info_init(&li, loop, &s->address_taken, &s->functions,
+		&s->globals);
+	for (int i = 0; i < li.modified.len; ++i) {
+		cse_kill_ident(s, *(const char **)vec_get(&li.modified, i));
+	}
+	if (li.calls) {
+		cse_kill_memory(s);
+	} else for (int i = 0; i < li.targets.len; ++i) {
+		cse_kill_aliases(s, *(const struct ast_node **)vec_get(&li.targets, i));
+	}
+	loop_info_finish(&li);
+}
+
+/*
+ * Constant propagation over the structured control flow: the value a local
+ * is known to hold after an assignment is substituted where it is read, and
+ * conditions that evaluate to a constant are folded. At the end of an if
+ * only the values all of its arms agree on survive, arms that never fall
+ * through don't count, and anything a loop or switch body writes is unknown
+ * inside of it and after it.
+ */
+static struct scope *file_scope(struct state *s);
+
+static long long known_trunc(long long v, int size) {
+	return size == 1 ? (unsigned char)v : (unsigned int)v;
+}
+/* the size of a char or int, 0 for anything else */
+static int known_size(const struct type *t) {
+	if (!type_all_applied(t)) return 0;
+	const char *bs = t->s->builtin_type_specifiers;
+	if (bs[AST_BUILTIN_TYPE_CHAR]) return 1;
+	if (bs[AST_BUILTIN_TYPE_INT]) return 4;
+	return 0;
+}
+/* a local whose value is tracked, nothing can write it behind our back */
+static const struct decl *known_decl(struct state *s, const char *ident) {
+	const struct decl *decl = scope_lookup(s->scope, ident);
+	if (!decl || decl->loc > 0
+			|| decl == scope_lookup(file_scope(s), ident)
+			|| opt_names_contain(&s->address_taken, ident)
+			|| !known_size(&decl->t)) {
+		return NULL;
+	}
+	return decl;
+}
+static int known_find(struct state *s, int loc) {
+	for (int i = 0; i < s->known.len; ++i) {
+		if (((struct known *)vec_get(&s->known, i))->loc == loc) return i;
+	}
+	return -1;
+}
+static bool known_get(struct state *s, const char *ident, long long *res) {
+	const struct decl *decl = known_decl(s, ident);
+	int i = decl ? known_find(s, decl->loc) : -1;
+	if (i < 0) return false;
+	*res = ((struct known *)vec_get(&s->known, i))->v;
+	return true;
+}
+/* the size of the type of an integer expression, 0 if it isn't one */
+static int known_expr_size(struct state *s, const struct ast_node *n) {
+	switch (n->kind) {
 	case AST_INTEGER:
-		fprintf(s->f, "mov rax, %lld\n", n->integer);
-		return val_push_new(s, s->builtin.t_int, 0, res);
-		return S_OK;
 	case AST_CHARACTER_CONSTANT:
-		fprintf(s->f, "mov rax, %d\n", n->character_constant);
-		return val_push_new(s, s->builtin.t_int, 0, res);
+	case AST_SIZEOF_EXPR:
+		return 4;
+	case AST_IDENT: ;
+		const struct decl *decl = scope_lookup(s->scope, n->ident);
+		return decl ? known_size(&decl->t) : 0;
+	case AST_BIN:
+		switch (n->bin.kind) {
+		case AST_BIN_ADD:
+		case AST_BIN_SUB:
+		case AST_BIN_MUL:
+			if (!known_expr_size(s, n->bin.b)) return 0;
+			return known_expr_size(s, n->bin.a);
+		case AST_BIN_LT:
+		case AST_BIN_EQB:
+		case AST_BIN_NEQ:
+			return 4;
+		default:
+			return 0;
+		}
+	case AST_CONDITIONAL: ;
+		int a = known_expr_size(s, n->conditional.expr);
+		int b = known_expr_size(s, n->conditional.expr_else);
+		if (!a || !b) return 0;
+		return a > b ? a : b;
+	default:
+		return 0;
+	}
+}
+static bool known_cond(struct state *s, const struct ast_node *n,
+	long long *res);
+/* the value rax holds after n is read, and the size of its type */
+static bool known_expr(struct state *s, const struct ast_node *n,
+		long long *res, int *size) {
+	long long a, b;
+	int sa, sb;
+	switch (n->kind) {
+	case AST_INTEGER:
+	case AST_CHARACTER_CONSTANT:
+	case AST_SIZEOF_EXPR:
+		if (!const_value(n, &a, NULL)) return false;
+		return *res = known_trunc(a, 4), *size = 4, true;
+	case AST_IDENT: ;
+		const struct decl *decl = known_decl(s, n->ident);
+		if (!decl || !known_get(s, n->ident, res)) return false;
+		return *size = known_size(&decl->t), true;
+	case AST_BIN:
+		if (!known_expr(s, n->bin.a, &a, &sa)
+				|| !known_expr(s, n->bin.b, &b, &sb)) {
+			return false;
+		}
+		// the result has the type of the left operand
+		switch (n->bin.kind) {
+		case AST_BIN_ADD: return *res = known_trunc(a + b, sa), *size = sa, true;
+		case AST_BIN_SUB: return *res = known_trunc(a - b, sa), *size = sa, true;
+		case AST_BIN_MUL: return *res = known_trunc(a * b, sa), *size = sa, true;
+		case AST_BIN_LT: return *res = a < b, *size = 4, true;
+		case AST_BIN_EQB: return *res = a == b, *size = 4, true;
+		case AST_BIN_NEQ: return *res = a != b, *size = 4, true;
+		default: return false;
+		}
+	case AST_CONDITIONAL:
+		// the arms are converted to the wider of their types
+		if (!known_cond(s, n->conditional.cond, &a)
+				|| !(*size = known_expr_size(s, n))
+				|| !known_expr(s, a ? n->conditional.expr
+					: n->conditional.expr_else, &b, &sb)) {
+			return false;
+		}
+		return *res = known_trunc(b, *size), true;
+	default:
+		return false;
+	}
+}
+/* the truth value of a condition, if it is known */
+static bool known_cond(struct state *s, const struct ast_node *n,
+		long long *res) {
+	int size;
+	return const_value(n, res, s) || known_expr(s, n, res, &size);
+}
+static void known_remove(struct state *s, int loc) {
+	int i = known_find(s, loc);
+	if (i < 0) return;
+	struct known *last = vec_get(&s->known, s->known.len - 1);
+	*(struct known *)vec_get(&s->known, i) = *last;
+	s->known.len--;
+}
+/* after `ident` is assigned v */
+static void known_put(struct state *s, const char *ident, long long v) {
+	const struct decl *decl = known_decl(s, ident);
+	if (!decl || !pass_enabled(s->passes, PASS_CONST_PROP)) return;
+	known_remove(s, decl->loc);
+	struct known k = { .loc = decl->loc,
+		.v = known_trunc(v, known_size(&decl->t)) };
+	vec_append(&s->known, &k);
+}
+/* after `ident` is assigned e, or anything if e is NULL */
+static void known_assign(struct state *s, const char *ident,
+		const struct ast_node *e) {
+	long long v;
+	int size;
+	if (e && known_expr(s, e, &v, &size)) {
+		known_put(s, ident, v);
+		return;
+	}
+	const struct decl *decl = known_decl(s, ident);
+	if (decl) known_remove(s, decl->loc);
+}
+/* after a store to `target` */
+static void known_store(struct state *s, const struct ast_node *target,
+		const struct ast_node *e) {
+	if (target->kind == AST_IDENT) known_assign(s, target->ident, e);
+}
+/* before code that may run after any of its writes */
+static void known_kill_writes(struct state *s, const struct ast_node *n) {
+	struct loop_info li;
+	loop_info_init(&li, n, &s->address_taken, &s->functions,
+		&s->globals);
+	for (int i = 0; i < li.modified.len; ++i) {
+		known_assign(s, *(const char **)vec_get(&li.modified, i), NULL);
+	}
+	loop_info_finish(&li);
+}
+static struct vec known_copy(const struct vec *known) {
+	struct vec res = vec_new_empty(sizeof(struct known));
+	for (int i = 0; i < known->len; ++i) {
+		vec_append(&res, vec_get_c(known, i));
+	}
+	return res;
+}
+static void known_restore(struct vec *to, const struct vec *known) {
+	to->len = 0;
+	for (int i = 0; i < known->len; ++i) {
+		vec_append(to, vec_get_c(known, i));
+	}
+}
+/* keeps only what `other` knows as well, at a join */
+static void known_meet(struct state *s, const struct vec *other) {
+	for (int i = 0; i < s->known.len; ) {
+		const struct known *k = vec_get(&s->known, i);
+		bool keep = false;
+		for (int j = 0; j < other->len && !keep; ++j) {
+			const struct known *o = vec_get_c(other, j);
+			keep = o->loc == k->loc && o->v == k->v;
+		}
+		if (keep) {
+			++i;
+		} else {
+			known_remove(s, k->loc);
+		}
+	}
+}
+/* replaces the value of n, a local or an expression of them, with an
+ * immediate if it is known */
+static void known_operand(struct state *s, const struct ast_node *n,
+		val *v) {
+	long long x;
+	int size;
+	if (v->deref_n > 0 || v->imm
+			|| !pass_begin(s->passes, PASS_CONST_PROP)) {
+		return;
+	}
+	if (known_expr(s, n, &x, &size)) {
+		*v = (val){ .s = x, .imm = true, .t = v->t };
+		count_changed(s, PASS_CONST_PROP);
+	}
+	pass_end(s->passes);
+}
+static void count_folded(struct state *s) {
+	if (cg_discarding(s)) return;
+	s->branches_folded++;
+	pass_changed(s->passes, PASS_CONST_PROP);
+}
+static void count_removed(struct state *s) {
+	if (cg_discarding(s)) return;
+	s->blocks_removed++;
+	pass_changed(s->passes, PASS_DCE);
+}
+
+/*
+ * Removed code is still generated into a sink, so that it gets the same
+ * diagnostics as the code that is kept.
+ */
+struct discard {
+	struct emit *code;
+	int strings, tables;
+	struct vec known;
+};
+static void discard_begin(struct state *s, struct discard *d) {
+	*d = (struct discard){
+		.code = s->code,
+		.strings = s->strings.len,
+		.tables = s->tables.len,
+		.known = known_copy(&s->known),
+	};
+	s->code = &s->null;
+}
+static void discard_end(struct state *s, struct discard *d) {
+	// even code that is kept is never executed
+	known_restore(&s->known, &d->known);
+	vec_free(&d->known);
+	if (d->code == &s->null) return;
+	s->code = d->code;
+	s->strings.len = d->strings;
+	while (s->tables.len > d->tables) {
+		vec_free(vec_get(&s->tables, --s->tables.len));
+	}
+}
+
+static status cg_gen_unary(struct state *s, const struct ast_node *n, val *res) {
+	if (n->unary.kind == AST_UNARY_DEREF) {
+		struct addr a;
+		if (cg_gen_addr(s, n->unary.a, &a) == S_ERROR) return S_ERROR;
+		return cg_gen_deref(s, &a, res);
+	}
+	val val_a;
+	if (cg_gen_expr(s, n->unary.a, &val_a) == S_ERROR) return S_ERROR;
+	switch (n->unary.kind) {
+	case AST_PRE_INCR:
+		if (!val_modifiable_lvalue(&val_a)) {
+			WARN_MOD_LVALUE(n);
+			return S_ERROR;
+		}
+		if (val_add_imm(s, &val_a, 1) == S_ERROR) return S_ERROR;
+		cse_kill_store(s, n->unary.a);
+		known_store(s, n->unary.a, NULL);
+		*res = val_a;
 		return S_OK;
-	case AST_STRING: ;
-		int str = vec_append(&s->strings, &n->string);
-		fprintf(s->f, "mov rax, s%d\n", str);
-		return val_push_new(s, s->builtin.t_char_p, 0, res);
+	case AST_PRE_DECR:
+		if (!val_modifiable_lvalue(&val_a)) {
+			WARN_MOD_LVALUE(n);
+			return S_ERROR;
+		}
+		if (val_add_imm(s, &val_a, -1) == S_ERROR) return S_ERROR;
+		cse_kill_store(s, n->unary.a);
+		known_store(s, n->unary.a, NULL);
+		*res = val_a;
 		return S_OK;
-	case AST_INDEX: assert(false);
-		// val val_a = cg_gen_expr(s, n->index.a);
-		// val val_b = cg_gen_expr(s, n->index.b);
-		// val_read(s, &val_a, "rax");
-		// val_read(s, &val_b, "rbx");
-		// fprintf(s->f, "add rax, rbx\n");
-		// val res = val_push_new(s, "rax");
-		// ++res.deref_n;
-		// return res;
+	case AST_POST_INCR: assert(false); break;
+	case AST_POST_DECR: assert(false); break;
+	case AST_UNARY_REF:
+		if (!val_a.lvalue) {
+			warn_node("Error: can't take address of non-lvalue", n);
+			return S_ERROR;
+		}
+		if (!type_apply_address_of(&val_a.t)) return S_ERROR;
+		val_addr(s, &val_a);
+		return val_push_new(s, val_a.t, 0, res);
+	case AST_UNARY_DEREF: assert(false); break;
+	case AST_UNARY_PLUS: assert(false); break;
+	case AST_UNARY_MINUS: assert(false); break;
+	case AST_UNARY_NOT:
+		val_read(s, &val_a, 0);
+		emit1(s->code, EMIT_NOT, r64(EMIT_RAX));
+		return val_push_new(s, val_a.t, 0, res);
+	case AST_UNARY_NOTB: assert(false); break;
+	case AST_UNARY_SIZEOF: assert(false); break;
+	}
+	return S_ERROR;
+}
+
+/* eax *= c, clobbers ebx */
+static void cg_mul_const(struct state *s, const struct arith_mul *p) {
+	if (p->save) emit2(s->code, EMIT_MOV, r32(EMIT_RBX), r32(EMIT_RAX));
+	for (int i = 0; i < p->n; ++i) {
+		int k = p->steps[i].k;
+		switch (p->steps[i].op) {
+		case ARITH_MUL_SHL:
+			emit2(s->code, EMIT_SHL, r32(EMIT_RAX), imm(k));
+			break;
+		case ARITH_MUL_LEA:
+			emit2(s->code, EMIT_LEA, r32(EMIT_RAX), emit_o_mem(0,
+				EMIT_RAX, EMIT_RAX, 1 << k, 0));
+			break;
+		case ARITH_MUL_ADD:
+			emit2(s->code, EMIT_ADD, r32(EMIT_RAX), r32(EMIT_RBX));
+			break;
+		case ARITH_MUL_SUB:
+			emit2(s->code, EMIT_SUB, r32(EMIT_RAX), r32(EMIT_RBX));
+			break;
+		case ARITH_MUL_NEG: emit1(s->code, EMIT_NEG, r32(EMIT_RAX)); break;
+		case ARITH_MUL_ZERO:
+			emit2(s->code, EMIT_XOR, r32(EMIT_RAX), r32(EMIT_RAX));
+			break;
+		}
+	}
+}
+static status cg_gen_mul(struct state *s, const struct ast_node *n,
+		const val *val_a, const val *val_b, val *res) {
+	struct arith_mul plan;
+	long long c;
+	const val *x = NULL;
+	if (pass_begin(s->passes, PASS_MUL_DIV)) {
+		if (const_value(n->bin.b, &c, NULL) && arith_plan_mul(c, &plan)) {
+			x = val_a;
+		} else if (const_value(n->bin.a, &c, NULL)
+				&& arith_plan_mul(c, &plan)) {
+			x = val_b;
+		}
+		if (x) count_changed(s, PASS_MUL_DIV);
+		pass_end(s->passes);
+	}
+	if (x) {
+		if (val_read(s, x, 0) == S_ERROR) return S_ERROR;
+		emit_comment(s->code, "* %lld", c);
+		cg_mul_const(s, &plan);
+	} else {
+		val_read(s, val_a, 0);
+		val_read(s, val_b, 1);
+		emit2(s->code, EMIT_IMUL, r32(EMIT_RAX), r32(EMIT_RBX));
+	}
+	return val_push_new(s, val_a->t, 0, res);
+}
+
+/* eax = eax / d (or eax % d), clobbers ebx and edx */
+static void cg_div_const(struct state *s, const struct arith_div *p,
+		long long d, bool mod) {
+	emit2(s->code, EMIT_MOV, r32(EMIT_RBX), r32(EMIT_RAX));
+	if (mod && p->is_unsigned && p->kind == ARITH_DIV_POW2) {
+		emit2(s->code, EMIT_AND, r32(EMIT_RAX),
+			imm((1u << p->shift) - 1));
+		return;
+	}
+	switch (p->kind) {
+	case ARITH_DIV_ONE:
 		break;
-	case AST_CALL: ;
-		val func_val;
-		if (cg_gen_expr(s, n->call.a, &func_val) == S_ERROR)
+	case ARITH_DIV_POW2:
+		if (p->is_unsigned) {
+			emit2(s->code, EMIT_SHR, r32(EMIT_RAX), imm(p->shift));
+			break;
+		}
+		// round towards zero by biasing negative dividends
+		emit2(s->code, EMIT_MOV, r32(EMIT_RDX), r32(EMIT_RAX));
+		if (p->shift > 1) emit2(s->code, EMIT_SAR, r32(EMIT_RDX),
+			imm(31));
+		emit2(s->code, EMIT_SHR, r32(EMIT_RDX), imm(32 - p->shift));
+		emit2(s->code, EMIT_ADD, r32(EMIT_RAX), r32(EMIT_RDX));
+		emit2(s->code, EMIT_SAR, r32(EMIT_RAX), imm(p->shift));
+		break;
+	case ARITH_DIV_GE:
+		emit2(s->code, EMIT_XOR, r32(EMIT_RAX), r32(EMIT_RAX));
+		emit2(s->code, EMIT_CMP, r32(EMIT_RBX), imm(p->magic));
+		emit_setcc(s->code, EMIT_CC_AE, r8(EMIT_RAX));
+		break;
+	case ARITH_DIV_MAGIC:
+		emit2(s->code, EMIT_MOV, r32(EMIT_RDX), imm(p->magic));
+		if (p->is_unsigned) {
+			emit1(s->code, EMIT_MUL, r32(EMIT_RDX));
+			if (p->fixup) {
+				emit2(s->code, EMIT_MOV, r32(EMIT_RAX),
+					r32(EMIT_RBX));
+				emit2(s->code, EMIT_SUB, r32(EMIT_RAX),
+					r32(EMIT_RDX));
+				emit2(s->code, EMIT_SHR, r32(EMIT_RAX), imm(1));
+				emit2(s->code, EMIT_ADD, r32(EMIT_RAX),
+					r32(EMIT_RDX));
+				if (p->shift > 1)
+					emit2(s->code, EMIT_SHR, r32(EMIT_RAX),
+						imm(p->shift - 1));
+			} else {
+				emit2(s->code, EMIT_MOV, r32(EMIT_RAX),
+					r32(EMIT_RDX));
+				if (p->shift) emit2(s->code, EMIT_SHR,
+					r32(EMIT_RAX), imm(p->shift));
+			}
+			break;
+		}
+		emit1(s->code, EMIT_IMUL, r32(EMIT_RDX));
+		if (p->fixup > 0) emit2(s->code, EMIT_ADD, r32(EMIT_RDX),
+			r32(EMIT_RBX));
+		if (p->fixup < 0) emit2(s->code, EMIT_SUB, r32(EMIT_RDX),
+			r32(EMIT_RBX));
+		if (p->shift) emit2(s->code, EMIT_SAR, r32(EMIT_RDX),
+			imm(p->shift));
+		emit2(s->code, EMIT_MOV, r32(EMIT_RAX), r32(EMIT_RDX));
+		emit2(s->code, EMIT_SHR, r32(EMIT_RAX), imm(31));
+		emit2(s->code, EMIT_ADD, r32(EMIT_RAX), r32(EMIT_RDX));
+		break;
+	}
+	if (p->neg) emit1(s->code, EMIT_NEG, r32(EMIT_RAX));
+	if (mod) {
+		// x - x / d * d
+		emit3(s->code, EMIT_IMUL, r32(EMIT_RAX), r32(EMIT_RAX),
+			imm((int)d));
+		emit2(s->code, EMIT_SUB, r32(EMIT_RBX), r32(EMIT_RAX));
+		emit2(s->code, EMIT_MOV, r32(EMIT_RAX), r32(EMIT_RBX));
+	}
+}
+static status cg_gen_div(struct state *s, const struct ast_node *n,
+		const val *val_a, const val *val_b, val *res) {
+	bool mod = n->bin.kind == AST_BIN_MOD;
+	bool is_unsigned = type_is_unsigned(&val_a->t)
+		|| type_is_unsigned(&val_b->t);
+	struct type t = type_is_unsigned(&val_b->t) ? val_b->t : val_a->t;
+	if (!type_is_arithmetic(&val_a->t) || !type_is_arithmetic(&val_b->t)) {
+		warn_node("Cant divide operands", n);
+		return S_ERROR;
+	}
+	struct arith_div plan;
+	long long d;
+	bool planned = false;
+	if (pass_begin(s->passes, PASS_MUL_DIV)) {
+		planned = const_value(n->bin.b, &d, NULL)
+			&& arith_plan_div(d, is_unsigned, &plan);
+		if (planned) count_changed(s, PASS_MUL_DIV);
+		pass_end(s->passes);
+	}
+	if (planned) {
+		if (val_read(s, val_a, 0) == S_ERROR) return S_ERROR;
+		emit_comment(s->code, "%c %lld", mod ? '%' : '/', d);
+		cg_div_const(s, &plan, d, mod);
+		return val_push_new(s, t, 0, res);
+	}
+	val_read(s, val_a, 0);
+	val_read(s, val_b, 1);
+	if (is_unsigned) {
+		emit2(s->code, EMIT_XOR, r32(EMIT_RDX), r32(EMIT_RDX));
+		emit1(s->code, EMIT_DIV, r32(EMIT_RBX));
+	} else {
+		emit0(s->code, EMIT_CDQ);
+		emit1(s->code, EMIT_IDIV, r32(EMIT_RBX));
+	}
+	if (mod) emit2(s->code, EMIT_MOV, r32(EMIT_RAX), r32(EMIT_RDX));
+	return val_push_new(s, t, 0, res);
+}
+
+/* the type of a sum, difference or product, false if the operands can't
+ * have one */
+static bool bin_type(const struct ast_node *n, const val *a, const val *b,
+		struct type *res) {
+	bool
+		a_ptr = type_is_pointer(&a->t),
+		b_ptr = type_is_pointer(&b->t),
+		a_arith = type_is_arithmetic(&a->t),
+		b_arith = type_is_arithmetic(&b->t);
+	switch (n->bin.kind) {
+	case AST_BIN_ADD:
+		if (a_arith && b_ptr) return *res = b->t, true;
+		*res = a->t;
+		return (a_arith || a_ptr) && b_arith;
+	case AST_BIN_SUB:
+		// pointers can have a difference
+		*res = a->t;
+		return (a_arith && b_arith) || (a_ptr && (b_ptr || b_arith));
+	default:
+		*res = a->t;
+		return true;
+	}
+}
+
+/*
+ * Sums, differences and scalings are selected a tree at a time. The
+ * operands that are something else are evaluated first, in the order the
+ * tree evaluates them, and the selected code then reads them as memory or
+ * immediate operands. Results inside of the tree don't go to a slot, so
+ * value numbering doesn't reuse them.
+ */
+struct tree_entry {
+	const struct ast_node *n;
+	int a, b; /* operands of an operation, -1 for an operand of the tree */
+};
+struct tree {
+	int n;
+	struct tree_entry e[ISEL_TREE_MAX]; /* in postorder */
+	val v[ISEL_TREE_MAX]; /* of operands, and of the results once known */
+};
+
+/* the size of a value the selected code can read, 0 for anything else */
+static int tree_size(const struct type *t) {
+	if (type_is_pointer(t)) return 8;
+	if (!type_all_applied(t)) return 0;
+	const char *bs = t->s->builtin_type_specifiers;
+	if (bs[AST_BUILTIN_TYPE_CHAR]) return 1;
+	if (bs[AST_BUILTIN_TYPE_INT]) return 4;
+	return 0;
+}
+static bool val_same_location(const val *a, const val *b) {
+	if (a->deref_n != b->deref_n || a->s != b->s || a->imm != b->imm
+			|| a->disp != b->disp || a->scale != b->scale
+			|| (a->scale && (a->index != b->index
+				|| a->index_size != b->index_size))) {
+		return false;
+	}
+	for (int i = 0; i < a->deref_n - 1 && i < VAL_CHAIN_MAX; ++i)
+		if (a->chain[i] != b->chain[i]) return false;
+	return true;
+}
+/* an operand of the tree as the selector sees it, false if it can't be
+ * read */
+static bool tree_leaf(const struct tree *t, int i, struct isel_node *res) {
+	const val *v = &t->v[i];
+	int size = tree_size(&v->t);
+	if (!size) return false;
+	if (v->imm && v->deref_n == 0) {
+		// the same zero extended value a read from a slot would give
+		long long x = v->s;
+		if (size == 4) x = (unsigned int)x;
+		if (size == 1) x = (unsigned char)x;
+		*res = (struct isel_node){ .op = ISEL_IMM, .size = size, .imm = x };
+		return true;
+	}
+	int mem = i;
+	for (int k = 0; k < i; ++k) {
+		if (t->e[k].a < 0 && !(t->v[k].imm && t->v[k].deref_n == 0)
+				&& val_same_location(&t->v[k], v)) {
+			mem = k;
+			break;
+		}
+	}
+	*res = (struct isel_node){ .op = ISEL_MEM, .size = size, .mem = mem };
+	return true;
+}
+
+static enum emit_reg isel_gpr(int r) {
+	static const enum emit_reg regs[ISEL_REGS] = {
+		EMIT_RAX, EMIT_RBX, EMIT_RSI, EMIT_RDI,
+	};
+	return regs[r];
+}
+static struct emit_operand isel_reg(int r, int size) {
+	return emit_o_reg(isel_gpr(r), size);
+}
+/* an operand of the code, memory operands get their address loaded first */
+static struct emit_operand tree_operand(struct state *s, const struct tree *t,
+		const struct isel_operand *o, int size) {
+	switch (o->kind) {
+	case ISEL_O_REG:
+		return isel_reg(o->reg, size);
+	case ISEL_O_IMM:
+		return imm(o->imm);
+	case ISEL_O_MEM:
+		val_load_addr(s, &t->v[o->mem]);
+		return val_mem(&t->v[o->mem], size);
+	}
+	assert(false);
+	return imm(0);
+}
+static void tree_emit(struct state *s, const struct tree *t,
+		const struct isel_code *c) {
+	static const enum emit_op ops[] = {
+		[ISEL_I_STORE] = EMIT_MOV, [ISEL_I_ADD] = EMIT_ADD,
+		[ISEL_I_SUB] = EMIT_SUB, [ISEL_I_IMUL] = EMIT_IMUL,
+		[ISEL_I_CMP] = EMIT_CMP, [ISEL_I_INC] = EMIT_INC,
+		[ISEL_I_DEC] = EMIT_DEC,
+	};
+	for (int i = 0; i < c->n; ++i) {
+		const struct isel_insn *x = &c->insns[i];
+		struct emit_operand d, src;
+		switch (x->op) {
+		case ISEL_I_LOAD:
+			src = tree_operand(s, t, &x->s, x->size);
+			emit2(s->code, x->size == 1 ? EMIT_MOVZX : EMIT_MOV,
+				isel_reg(x->d.reg, x->size == 8 ? 8 : 4), src);
+			break;
+		case ISEL_I_MOV:
+			if (x->s.kind == ISEL_O_REG) {
+				emit2(s->code, EMIT_MOV, isel_reg(x->d.reg, 8),
+					isel_reg(x->s.reg, 8));
+			} else {
+				// a 32 bit move clears the upper half
+				bool wide = x->s.imm < 0 || x->s.imm > 0xFFFFFFFFll;
+				emit2(s->code, EMIT_MOV,
+					isel_reg(x->d.reg, wide ? 8 : 4), imm(x->s.imm));
+			}
+			break;
+		case ISEL_I_STORE:
+		case ISEL_I_ADD:
+		case ISEL_I_SUB:
+		case ISEL_I_IMUL:
+		case ISEL_I_CMP:
+			src = tree_operand(s, t, &x->s, x->size);
+			d = tree_operand(s, t, &x->d, x->size);
+			emit2(s->code, ops[x->op], d, src);
+			break;
+		case ISEL_I_IMUL3:
+			src = tree_operand(s, t, &x->s, x->size);
+			emit3(s->code, EMIT_IMUL, isel_reg(x->d.reg, x->size),
+				src, imm(x->k));
+			break;
+		case ISEL_I_SHL:
+			emit2(s->code, EMIT_SHL, isel_reg(x->d.reg, x->size),
+				imm(x->k));
+			break;
+		case ISEL_I_LEA:
+			emit2(s->code, EMIT_LEA, isel_reg(x->d.reg, x->size),
+				emit_o_mem(0, x->base >= 0 ? (int)isel_gpr(x->base) : -1,
+					isel_gpr(x->s.reg), x->scale, x->k));
+			break;
+		case ISEL_I_INC:
+		case ISEL_I_DEC:
+			d = tree_operand(s, t, &x->d, x->size);
+			emit1(s->code, ops[x->op], d);
+			break;
+		}
+	}
+}
+
+/* sets the flags for the 64 bit comparison of a with b, or with 0 */
+static status cg_gen_cmp(struct state *s, const val *a, const val *b) {
+	struct tree t = { .n = 2 };
+	struct isel_tree it = { .n = 0 };
+	struct isel_node x, y;
+	struct isel_code code;
+	t.e[0] = t.e[1] = (struct tree_entry){ .a = -1, .b = -1 };
+	t.v[0] = *a;
+	t.v[1] = b ? *b : (val){ .imm = true, .t = s->builtin.t_int };
+	if (pass_begin(s->passes, PASS_ISEL)) {
+		bool selected = false;
+		if (tree_leaf(&t, 0, &x) && tree_leaf(&t, 1, &y)) {
+			isel_add(&it, x);
+			isel_add(&it, y);
+			isel_add(&it, (struct isel_node){ .op = ISEL_CMP,
+				.size = 8, .a = 0, .b = 1 });
+			selected = isel_select(&it, &code);
+		}
+		if (selected) {
+			tree_emit(s, &t, &code);
+			count_changed(s, PASS_ISEL);
+		}
+		pass_end(s->passes);
+		if (selected) return S_OK;
+	}
+	if (val_read(s, a, 0) == S_ERROR) return S_ERROR;
+	if (!b) {
+		emit2(s->code, EMIT_CMP, r64(EMIT_RAX), imm(0));
+		return S_OK;
+	}
+	if (val_read(s, b, 1) == S_ERROR) return S_ERROR;
+	emit2(s->code, EMIT_CMP, r64(EMIT_RAX), r64(EMIT_RBX));
+	return S_OK;
+}
+
+/* the operation of a binary expression on its evaluated operands */
+static status cg_gen_bin_vals(struct state *s, const struct ast_node *n,
+		const val *val_a, const val *val_b, val *res) {
+	struct type t;
+	switch (n->bin.kind) {
+	case AST_BIN_MUL:
+		return cg_gen_mul(s, n, val_a, val_b, res);
+	case AST_BIN_DIV:
+	case AST_BIN_MOD:
+		return cg_gen_div(s, n, val_a, val_b, res);
+	case AST_BIN_ADD: ;
+		val_read(s, val_a, 0);
+		val_read(s, val_b, 1);
+		emit2(s->code, EMIT_ADD, r64(EMIT_RAX), r64(EMIT_RBX));
+		if (!bin_type(n, val_a, val_b, &t)) {
+			warn_node("Cant add operands", n);
 			return S_ERROR;
-		if (!type_apply_call(&func_val.t)) return S_ERROR;
-		int f_res_size;
-		if (type_get_size(&func_val.t, &f_res_size) == S_ERROR)
+		}
+		return val_push_new(s, t, 0, res);
+	case AST_BIN_SUB:
+		val_read(s, val_a, 0);
+		val_read(s, val_b, 1);
+		emit2(s->code, EMIT_SUB, r64(EMIT_RAX), r64(EMIT_RBX));
+		if (!bin_type(n, val_a, val_b, &t)) {
+			warn_node("Cant subtract operands", n);
 			return S_ERROR;
-		const char *func_ident = "<nope>";
-		if (n->call.a->kind == AST_IDENT) {
-			func_ident = n->call.a->ident;
 		}
+		return val_push_new(s, t, 0, res);
+	case AST_BIN_LSHIFT: assert(false); break;
+	case AST_BIN_RSHIFT:
+		break;
+	case AST_BIN_LT:
+		if (cg_gen_cmp(s, val_a, val_b) == S_ERROR) return S_ERROR;
+		emit_setcc(s->code, EMIT_CC_L, r8(EMIT_RAX));
+		emit2(s->code, EMIT_MOVZX, r64(EMIT_RAX), r8(EMIT_RAX));
+		return val_push_new(s, s->builtin.t_int, 0, res);
+	case AST_BIN_GT: assert(false); break;
+	case AST_BIN_LEQ: assert(false); break;
+	case AST_BIN_GEQ: assert(false); break;
+	case AST_BIN_EQB:
+	case AST_BIN_NEQ:
+		if (cg_gen_cmp(s, val_a, val_b) == S_ERROR) return S_ERROR;
+		emit_setcc(s->code, n->bin.kind == AST_BIN_EQB ? EMIT_CC_E
+			: EMIT_CC_NE, r8(EMIT_RAX));
+		emit2(s->code, EMIT_MOVZX, r64(EMIT_RAX), r8(EMIT_RAX));
+		return val_push_new(s, s->builtin.t_int, 0, res);
+		return S_OK;
+	case AST_BIN_AND: assert(false); break;
+	case AST_BIN_XOR: assert(false); break;
+	case AST_BIN_OR: assert(false); break;
+	case AST_BIN_ANDB: assert(false); break;
+	case AST_BIN_ORB: assert(false); break;
+	case AST_BIN_ASSIGN:
+		val_read(s, val_b, 0);
+		val_store(s, val_a, 0);
+		cse_kill_store(s, n->bin.a);
+		known_store(s, n->bin.a, n->bin.b);
+		*res = *val_a;
+		return S_OK;
+	case AST_BIN_COMMA: assert(false); break;
+	}
+	return S_ERROR;
+}
+
+static status cg_gen_bin_plain(struct state *s, const struct ast_node *n,
+		val *res) {
+	val val_a, val_b;
+	if (cg_gen_expr(s, n->bin.a, &val_a) == S_ERROR) return S_ERROR;
+	if (cg_gen_expr(s, n->bin.b, &val_b) == S_ERROR) return S_ERROR;
+	if (n->bin.kind != AST_BIN_ASSIGN) known_operand(s, n->bin.a, &val_a);
+	known_operand(s, n->bin.b, &val_b);
+	return cg_gen_bin_vals(s, n, &val_a, &val_b, res);
+}
+
+/* multiplications by constants other than these are left to the plans of
+ * cg_gen_mul */
+static bool tree_mul(const struct ast_node *n) {
+	long long c;
+	if (!const_value(n->bin.b, &c, NULL)
+			&& !const_value(n->bin.a, &c, NULL)) {
+		return true;
+	}
+	return c == 3 || c == 5 || c == 9
+		|| (c > 0 && c <= 1 << 30 && (c & (c - 1)) == 0);
+}
+/* adds n to the tree, as an operation if it is one whose value isn't
+ * available already and there is room for it, returns its entry */
+static int tree_plan(struct state *s, struct tree *t, const struct ast_node *n,
+		int room, bool root) {
+	long long x;
+	int size;
+	val v;
+	int start = t->n;
+	bool op = n->kind == AST_BIN && room >= 3
+		&& (n->bin.kind == AST_BIN_ADD || n->bin.kind == AST_BIN_SUB
+			|| (n->bin.kind == AST_BIN_MUL && tree_mul(n)));
+	if (op && !root) {
+		op = !hoisted_get(s, n, &v) && !cse_find(s, n)
+			&& !known_expr(s, n, &x, &size);
+	}
+	if (!op) {
+		t->e[t->n] = (struct tree_entry){ .n = n, .a = -1, .b = -1 };
+		return t->n++;
+	}
+	int a = tree_plan(s, t, n->bin.a, room - 2, false);
+	int b = tree_plan(s, t, n->bin.b, room - 1 - (t->n - start), false);
+	t->e[t->n] = (struct tree_entry){ .n = n, .a = a, .b = b };
+	return t->n++;
+}
+/* the operations would read their operands as soon as they are evaluated,
+ * the tree reads them at the end: nothing after the first operation may
+ * change them */
+static bool tree_in_order(struct state *s, const struct tree *t) {
+	bool op = false;
+	for (int i = 0; i < t->n; ++i) {
+		if (t->e[i].a >= 0) {
+			op = true;
+		} else if (op && !opt_expr_pure(t->e[i].n, &s->functions)) {
+			return false;
+		}
+	}
+	return true;
+}
+/* builds the tree for the selector and schedules the selected code, false
+ * if it can't handle the types */
+static bool tree_select(struct state *s, struct tree *t, bool assign,
+		struct isel_code *res) {
+	struct isel_tree it = { .n = 0 };
+	for (int i = 0; i < t->n; ++i) {
+		const struct tree_entry *e = &t->e[i];
+		struct isel_node x;
+		if (e->a < 0) {
+			if (!tree_leaf(t, i, &x)) return false;
+			// the target of an assignment
+			if (assign && i == 0 && x.op != ISEL_MEM) return false;
+		} else if (assign && i == t->n - 1) {
+			x = (struct isel_node){ .op = ISEL_STORE,
+				.size = tree_size(&t->v[0].t), .a = e->a, .b = e->b };
+		} else {
+			val *v = &t->v[i];
+			*v = (val){ .s = 0 };
+			if (!bin_type(e->n, &t->v[e->a], &t->v[e->b], &v->t))
+				return false;
+			// cg_gen_mul multiplies 32 bit
+			int size = tree_size(&v->t);
+			if (size == 1) return false;
+			enum isel_op op = e->n->bin.kind == AST_BIN_ADD ? ISEL_ADD
+				: e->n->bin.kind == AST_BIN_SUB ? ISEL_SUB : ISEL_MUL;
+			x = (struct isel_node){ .op = op,
+				.size = op == ISEL_MUL ? 4 : size,
+				.a = e->a, .b = e->b };
+		}
+		isel_add(&it, x);
+	}
+	if (!isel_select(&it, res)) return false;
+	if (pass_begin(s->passes, PASS_SCHED)) {
+		if (sched_code(res)) count_changed(s, PASS_SCHED);
+		pass_end(s->passes);
+	}
+	return true;
+}
+/* the operations one at a time, as cg_gen_bin_plain would do them */
+static status tree_gen_plain(struct state *s, struct tree *t, val *res) {
+	for (int i = 0; i < t->n; ++i) {
+		const struct tree_entry *e = &t->e[i];
+		if (e->a < 0) continue;
+		if (cg_gen_bin_vals(s, e->n, &t->v[e->a], &t->v[e->b],
+				&t->v[i]) == S_ERROR) {
+			return S_ERROR;
+		}
+		if (i < t->n - 1) cse_put(s, e->n, &t->v[i]);
+	}
+	*res = t->v[t->n - 1];
+	return S_OK;
+}
+static status cg_gen_tree(struct state *s, const struct ast_node *n,
+		val *res) {
+	struct tree t = { .n = 0 };
+	struct isel_code code;
+	bool assign = n->bin.kind == AST_BIN_ASSIGN;
+	if (assign) {
+		t.e[t.n++] = (struct tree_entry){ .n = n->bin.a, .a = -1, .b = -1 };
+		int b = tree_plan(s, &t, n->bin.b, ISEL_TREE_MAX - 2, false);
+		t.e[t.n++] = (struct tree_entry){ .n = n, .a = 0, .b = b };
+	} else {
+		tree_plan(s, &t, n, ISEL_TREE_MAX, true);
+	}
+	if (!tree_in_order(s, &t)) return cg_gen_bin_plain(s, n, res);
+	for (int i = 0; i < t.n; ++i) {
+		if (t.e[i].a >= 0) continue;
+		if (cg_gen_expr(s, t.e[i].n, &t.v[i]) == S_ERROR) return S_ERROR;
+		if (!assign || i > 0) known_operand(s, t.e[i].n, &t.v[i]);
+	}
+	pass_begin(s->passes, PASS_ISEL);
+	bool selected = tree_select(s, &t, assign, &code);
+	if (selected) {
+		tree_emit(s, &t, &code);
+		count_changed(s, PASS_ISEL);
+	}
+	pass_end(s->passes);
+	if (!selected) return tree_gen_plain(s, &t, res);
+	if (assign) {
+		cse_kill_store(s, n->bin.a);
+		known_store(s, n->bin.a, n->bin.b);
+		*res = t.v[0];
+		return S_OK;
+	}
+	return val_push_new(s, t.v[t.n - 1].t, 0, res);
+}
+
+static status cg_gen_bin(struct state *s, const struct ast_node *n, val *res) {
+	if (!pass_enabled(s->passes, PASS_ISEL)) return cg_gen_bin_plain(s, n, res);
+	switch (n->bin.kind) {
+	case AST_BIN_ADD:
+	case AST_BIN_SUB:
+	case AST_BIN_ASSIGN:
+		return cg_gen_tree(s, n, res);
+	default:
+		return cg_gen_bin_plain(s, n, res);
+	}
+}
+
+/* a condition evaluated up to the final compare */
+struct cond {
+	enum emit_cc cc; /* condition code under which it holds */
+	bool cmp; /* compare a with b, otherwise test a */
+	val a, b;
+};
+static status cg_gen_cond(struct state *s, const struct ast_node *n,
+		struct cond *res) {
+	*res = (struct cond){ .cc = EMIT_CC_NE };
+	if (n->kind == AST_BIN && (n->bin.kind == AST_BIN_LT
+			|| n->bin.kind == AST_BIN_EQB
+			|| n->bin.kind == AST_BIN_NEQ)) {
+		if (cg_gen_expr(s, n->bin.a, &res->a) == S_ERROR) return S_ERROR;
+		if (cg_gen_expr(s, n->bin.b, &res->b) == S_ERROR) return S_ERROR;
+		known_operand(s, n->bin.a, &res->a);
+		known_operand(s, n->bin.b, &res->b);
+		res->cmp = true;
+		res->cc = n->bin.kind == AST_BIN_LT ? EMIT_CC_L
+			: n->bin.kind == AST_BIN_EQB ? EMIT_CC_E : EMIT_CC_NE;
+		return S_OK;
+	}
+	return cg_gen_expr(s, n, &res->a);
+}
+/* sets the flags for the condition code of c */
+static status cg_cond_flags(struct state *s, const struct cond *c) {
+	return cg_gen_cmp(s, &c->a, c->cmp ? &c->b : NULL);
+}
+static enum emit_cc cc_invert(enum emit_cc cc) {
+	return cc ^ 1;
+}
+/* jumps to label if the condition evaluates to `when` */
+static status cg_gen_branch(struct state *s, const struct ast_node *n,
+		bool when, int label) {
+	long long v;
+	if (known_cond(s, n, &v)) {
+		if ((v != 0) == when) emit1(s->code, EMIT_JMP,
+			emit_o_label(label));
+		count_folded(s);
+		return S_OK;
+	}
+	struct cond c;
+	if (cg_gen_cond(s, n, &c) == S_ERROR) return S_ERROR;
+	if (cg_cond_flags(s, &c) == S_ERROR) return S_ERROR;
+	emit_jcc(s->code, when ? c.cc : cc_invert(c.cc), label);
+	return S_OK;
+}
+
+#define BRANCH_MISS_COST 16 /* cycles lost on a mispredicted branch */
+
+/* evaluating both arms has to beat a branch that is mispredicted half of
+ * the time, and must be safe */
+static bool select_profitable(const struct ast_node *a,
+		const struct ast_node *b) {
+	return opt_expr_pure(a, NULL) && opt_expr_pure(b, NULL)
+		&& opt_expr_speculatable(a) && opt_expr_speculatable(b)
+		&& opt_expr_cost(a) + opt_expr_cost(b) <= BRANCH_MISS_COST / 2;
+}
+/* rax = cond ? a : b, with setcc or cmov instead of a branch */
+static status cg_gen_select(struct state *s, const struct ast_node *cond,
+		const struct ast_node *a, const struct ast_node *b,
+		struct type *t) {
+	struct cond c;
+	val va, vb;
+	if (cg_gen_cond(s, cond, &c) == S_ERROR
+			|| cg_gen_expr(s, a, &va) == S_ERROR
+			|| val_decay_array(s, &va) == S_ERROR
+			|| cg_gen_expr(s, b, &vb) == S_ERROR
+			|| val_decay_array(s, &vb) == S_ERROR) {
+		return S_ERROR;
+	}
+	known_operand(s, a, &va);
+	known_operand(s, b, &vb);
+	*t = type_conditional(&va.t, &vb.t);
+	if (va.imm && vb.imm && va.s + vb.s == 1 && va.s * vb.s == 0) {
+		if (cg_cond_flags(s, &c) == S_ERROR) return S_ERROR;
+		emit_setcc(s->code, va.s ? c.cc : cc_invert(c.cc),
+			r8(EMIT_RAX));
+		emit2(s->code, EMIT_MOVZX, r32(EMIT_RAX), r8(EMIT_RAX));
+		return S_OK;
+	}
+	if (val_read(s, &vb, 0) == S_ERROR) return S_ERROR;
+	emit2(s->code, EMIT_MOV, r64(EMIT_R9), r64(EMIT_RAX));
+	if (val_read(s, &va, 0) == S_ERROR) return S_ERROR;
+	emit2(s->code, EMIT_MOV, r64(EMIT_R8), r64(EMIT_RAX));
+	if (cg_cond_flags(s, &c) == S_ERROR) return S_ERROR;
+	emit2(s->code, EMIT_MOV, r64(EMIT_RAX), r64(EMIT_R9));
+	emit_cmovcc(s->code, c.cc, r64(EMIT_RAX), r64(EMIT_R8));
+	return S_OK;
+}
+static status cg_gen_conditional(struct state *s, const struct ast_node *n,
+		val *res) {
+	const struct ast_node *a = n->conditional.expr;
+	const struct ast_node *b = n->conditional.expr_else;
+	long long c;
+	if (known_cond(s, n->conditional.cond, &c)) {
+		emit_comment(s->code, "constant condition, arm removed");
+		count_folded(s);
+		count_removed(s);
+		// the removed arm still decides the type
+		struct discard d;
+		val vt, vo;
+		discard_begin(s, &d);
+		status st = cg_gen_expr(s, c ? b : a, &vo);
+		if (st == S_OK) st = val_decay_array(s, &vo);
+		discard_end(s, &d);
+		if (st == S_ERROR
+				|| cg_gen_expr(s, c ? a : b, &vt) == S_ERROR
+				|| val_decay_array(s, &vt) == S_ERROR) {
+			return S_ERROR;
+		}
+		known_operand(s, c ? a : b, &vt);
+		struct type t = c ? type_conditional(&vt.t, &vo.t)
+			: type_conditional(&vo.t, &vt.t);
+		if (vt.imm && vt.deref_n == 0) {
+			*res = vt;
+			res->t = t;
+			return S_OK;
+		}
+		if (val_read(s, &vt, 0) == S_ERROR) return S_ERROR;
+		return val_push_new(s, t, 0, res);
+	}
+	if (pass_enabled(s->passes, PASS_SELECT) && select_profitable(a, b)) {
+		struct type t;
+		count_changed(s, PASS_SELECT);
+		if (cg_gen_select(s, n->conditional.cond, a, b, &t) == S_ERROR)
+			return S_ERROR;
+		return val_push_new(s, t, 0, res);
+	}
+	int label_else = get_label(s), label_end = get_label(s);
+	if (cg_gen_branch(s, n->conditional.cond, false, label_else)
+			== S_ERROR) {
+		return S_ERROR;
+	}
+	// both arms store the whole register, the type is only known later
+	s->sp -= 8;
+	long long loc = s->sp;
+	val va, vb;
+	int cse_mark = s->cse.len;
+	// whatever an arm writes is unknown afterwards
+	known_kill_writes(s, n);
+	struct vec known = known_copy(&s->known);
+	if (cg_gen_expr(s, a, &va) == S_ERROR
+			|| val_decay_array(s, &va) == S_ERROR) {
+		goto error;
+	}
+	known_operand(s, a, &va);
+	if (val_read(s, &va, 0) == S_ERROR) goto error;
+	emit2(s->code, EMIT_MOV, slot(8, loc), r64(EMIT_RAX));
+	emit1(s->code, EMIT_JMP, emit_o_label(label_end));
+	s->cse.len = cse_mark;
+	known_restore(&s->known, &known);
+	put_label(s, label_else);
+	if (cg_gen_expr(s, b, &vb) == S_ERROR
+			|| val_decay_array(s, &vb) == S_ERROR) {
+		goto error;
+	}
+	known_operand(s, b, &vb);
+	if (val_read(s, &vb, 0) == S_ERROR) goto error;
+	emit2(s->code, EMIT_MOV, slot(8, loc), r64(EMIT_RAX));
+	s->cse.len = cse_mark;
+	known_restore(&s->known, &known);
+	vec_free(&known);
+	put_label(s, label_end);
+	*res = (val){ .s = loc, .t = type_conditional(&va.t, &vb.t) };
+	return S_OK;
+error:
+	vec_free(&known);
+	return S_ERROR;
+}
+
+static struct decl *scope_lookup(struct scope *scope, const char *ident) {
+	for (; scope; scope = scope->parent) {
+		struct decl *decl;
+		if (hashmap_get(&scope->vars, ident, (void**)&decl) == MAP_OK) {
+			return decl;
+		}
+	}
+	return NULL;
+}
+static struct scope *file_scope(struct state *s) {
+	struct scope *scope = s->scope;
+	while (scope->parent) scope = scope->parent;
+	return scope;
+}
+static status find_ident(struct scope *scope, const char *ident, val *res) {
+	struct decl *decl = scope_lookup(scope, ident);
+	if (!decl) {
+		fprintf(stderr, "Error: undefined identifier `%s`\n", ident);
+		return S_ERROR;
+	}
+	*res = (val){ .deref_n = 0, .s = decl->loc,
+		.lvalue = true, .t = decl->t };
+	return S_OK;
+}
+
+static bool hoisted_get(struct state *s, const struct ast_node *n, val *res) {
+	for (int i = 0; i < s->hoisted.len; ++i) {
+		const struct hoisted *h = vec_get_c(&s->hoisted, i);
+		if (h->n == n) {
+			*res = h->v;
+			return true;
+		}
+	}
+	return false;
+}
+
+static status cg_gen_inline(struct state *s, const struct ast_node *n,
+	const struct opt_function *f, val *res);
+
+/* evaluates the arguments of a call into the argument registers */
+static status cg_gen_call_args(struct state *s, const struct ast_node *n) {
+	struct vec vals = vec_new_empty(sizeof(val));
+	for (int i = 0; i < n->call.args.len; ++i) {
+		const struct ast_node * const *ni = vec_get_c(&n->call.args, i);
+		val v;
+		if (cg_gen_expr(s, *ni, &v) == S_ERROR) {
+			vec_free(&vals);
+			return S_ERROR;
+		}
+		known_operand(s, *ni, &v);
+		vec_append(&vals, &v);
+	}
+
+	// rcx and rdx address the operands, so they are filled last
+	const enum emit_reg call_regs[] = {
+		EMIT_RDI, EMIT_RSI, EMIT_R10, EMIT_R11, EMIT_R8, EMIT_R9,
+	};
+	for (int i = 0; i < vals.len; ++i) {
+		val *vi = vec_get(&vals, i);
+		assert(i < (int)(sizeof(call_regs) / sizeof(call_regs[0])));
+		val_read(s, vi, 0);
+		emit2(s->code, EMIT_MOV, r64(call_regs[i]), r64(EMIT_RAX));
+	}
+	if (vals.len > 2) emit2(s->code, EMIT_MOV, r64(EMIT_RDX),
+		r64(EMIT_R10));
+	if (vals.len > 3) emit2(s->code, EMIT_MOV, r64(EMIT_RCX),
+		r64(EMIT_R11));
+	vec_free(&vals);
+	return S_OK;
+}
+
+static status cg_gen_expr(struct state *s, const struct ast_node *n, val *res) {
+	if (hoisted_get(s, n, res)) return S_OK;
+	switch (n->kind) {
+	case AST_IDENT:
+		return find_ident(s->scope, n->ident, res);
+	case AST_INTEGER:
+		*res = (val){ .s = n->integer, .imm = true,
+			.t = s->builtin.t_int };
+		return S_OK;
+	case AST_CHARACTER_CONSTANT:
+		*res = (val){ .s = n->character_constant, .imm = true,
+			.t = s->builtin.t_int };
+		return S_OK;
+	case AST_STRING: ;
+		int str = 0;
+		while (str < s->strings.len && strcmp(*(const char **)vec_get(
+				&s->strings, str), n->string) != 0) {
+			str++;
+		}
+		if (str == s->strings.len) vec_append(&s->strings, &n->string);
+		emit2(s->code, EMIT_MOV, r64(EMIT_RAX), emit_o_string(str));
+		return val_push_new(s, s->builtin.t_char_p, 0, res);
+		return S_OK;
+	case AST_INDEX: ;
+		struct addr a;
+		if (cg_gen_addr_add(s, n, n->index.a, n->index.b, &a) == S_ERROR)
+			return S_ERROR;
+		return cg_gen_deref(s, &a, res);
+	case AST_CALL: ;
+		if (cse_get(s, n, res)) return S_OK;
+		const struct opt_function *callee =
+			opt_inline_callee(&s->functions, n);
+		if (callee) {
+			if (PASS(s, PASS_INLINE, cg_gen_inline(s, n, callee, res))
+					== S_ERROR) {
+				return S_ERROR;
+			}
+			cse_put(s, n, res);
+			return S_OK;
+		}
+		val func_val;
+		if (cg_gen_expr(s, n->call.a, &func_val) == S_ERROR)
+			return S_ERROR;
+		if (!type_apply_call(&func_val.t)) return S_ERROR;
+		int f_res_size;
+		if (type_get_size(&func_val.t, &f_res_size) == S_ERROR)
+			return S_ERROR;
+		const char *func_ident = "<nope>";
+		if (n->call.a->kind == AST_IDENT) {
+			func_ident = n->call.a->ident;
+		}
+		if (cg_gen_call_args(s, n) == S_ERROR) return S_ERROR;
+		emit2(s->code, EMIT_SUB, r64(EMIT_RSP),
+			imm((-s->sp) + (16 + s->sp % 16)));
+		emit1(s->code, EMIT_CALL, emit_o_sym(func_ident));
+		if (opt_call_effects(&s->functions, n) == OPT_SIDE_EFFECTS)
+			cse_kill_memory(s);
+		if (f_res_size > 0) {
+			if (val_push_new(s, func_val.t, 0, res) == S_ERROR)
+				return S_ERROR;
+			cse_put(s, n, res);
+			return S_OK;
+		} else {
+			*res = (val){ .s = 1, .t = func_val.t };
+			return S_OK;
+		}
+	case AST_MEMBER: assert(false); break;
+	case AST_MEMBER_DEREF: assert(false); break;
+	case AST_UNARY:
+		return cg_gen_unary(s, n, res);
+	case AST_COMPOUND_LITERAL: assert(false); break;
+	case AST_SIZEOF_EXPR: ;
+		struct type t = type_from_typename(n->sizeof_expr.type_name);
+		int size;
+		if (type_get_size(&t, &size) == S_ERROR) return S_ERROR;
+		*res = (val){ .s = size, .imm = true, .t = s->builtin.t_size_t };
+		return S_OK;
+	case AST_ALIGNOF_EXPR: assert(false); break;
+	case AST_CAST: assert(false); break;
+	case AST_BIN:
+		if (cse_get(s, n, res)) return S_OK;
+		if (cg_gen_bin(s, n, res) == S_ERROR) return S_ERROR;
+		cse_put(s, n, res);
+		return S_OK;
+	case AST_CONDITIONAL:
+		return cg_gen_conditional(s, n, res);
+	default: // TODO: we shouldn't be here
+		break;
+	}
+	return S_ERROR;
+}
+
+static status cg_check_expr(struct state *s, const struct ast_node *n);
+static status cg_check_stmt(struct state *s, const struct ast_node *n);
+
+static status cg_gen_declaration(struct state *s, const struct ast_node *n) {
+	FOR_EACH_NODE(n->declaration.init_declarator_list) {
+		const struct ast_node *d = ni->init_declarator.declarator;
+		const char *ident = d->declarator.ident->ident;
+		struct ast_declaration_specifiers *ds = &n->declaration
+			.declaration_specifiers->declaration_specifiers;
+		bool ext = ds->storage_class_specifiers
+			[AST_STORAGE_CLASS_SPECIFIER_EXTERN] > 0;
+		if (ident) {
+			if (ext) {
+				emit1(s->code, EMIT_EXTERN, emit_o_sym(ident));
+			}
+			int size = 8;
+			struct type t = { .s = ds, .d = &d->declarator };
+			if (!ext && type_is_array(&t)) {
+				if (type_get_size(&t, &size) == S_ERROR)
+					return S_ERROR;
+				size = (size + 7) / 8 * 8;
+			}
+			int loc = ext ? 1 : (s->sp -= size);
+			struct decl decl = {
+				.t = { .s = ds, .d = &d->declarator },
+				.size = size,
+				.loc = loc,
+			};
+			hashmap_put(&s->scope->vars, ident, &decl);
+			if (!s->scope->parent) {
+				vec_append(&s->globals, &ident);
+				pass_invalidate(s->passes, PASS_A_ALIAS);
+			}
+			cse_kill_ident(s, ident);
+
+			emit_comment(s->code, "alloced `%s` on stack at %d",
+				ident, decl.loc);
+
+			fprintf(stderr, "info: declared identifier `%s` as `",
+				ident);
+			ast_fprint(stderr, n->declaration.declaration_specifiers, 0);
+			fprintf(stderr, "` `");
+			ast_fprint(stderr, d,  0);
+			fprintf(stderr, "`\n");
+
+			const struct ast_node *init =
+				ni->init_declarator.initializer;
+			if (init && !ext && opt_names_contain(&s->dead, ident)
+					&& opt_expr_pure(init, &s->functions)) {
+				emit_comment(s->code,
+					"dead initializer removed");
+				count_changed(s, PASS_DCE);
+				if (cg_check_expr(s, init) == S_ERROR)
+					return S_ERROR;
+			} else if (init) {
+				val val_init;
+				if (cg_gen_expr(s, ni->init_declarator
+						.initializer, &val_init)
+						== S_ERROR) {
+					return S_ERROR;
+				}
+				known_operand(s, init, &val_init);
+				val_read(s, &val_init, 0);
+				val val_to;
+				if (find_ident(s->scope, ident, &val_to) == S_ERROR) {
+					return S_ERROR;
+				}
+				val_store(s, &val_to, 0);
+				cse_kill_ident(s, ident);
+			}
+			if (!ext) known_assign(s, ident, init);
+		}
+	}
+	return S_OK;
+}
+
+static status cg_gen_stmt_comp(struct state *s, const struct ast_node *n);
+static status cg_gen_stmt(struct state *s, const struct ast_node *n);
+
+/* evaluates the invariant expressions of a loop into the preheader */
+static status cg_hoist_invariants(struct state *s, const struct ast_node *loop) {
+	struct loop_info li;
+	loop_info_init(&li, loop, &s->address_taken, &s->functions,
+		&s->globals);
+	li.alias = alias_may;
+	li.ud = s;
+	struct vec exprs = vec_new_empty(sizeof(const struct ast_node *));
+	loop_hoistable(&li, loop, &exprs);
+	loop_info_finish(&li);
+
+	status res = S_OK;
+	for (int i = 0; i < exprs.len; ++i) {
+		const struct ast_node * const *ni = vec_get_c(&exprs, i);
+		comment_node(s, "hoisted `%s`", *ni);
+		val v;
+		if (cg_gen_expr(s, *ni, &v) == S_ERROR) {
+			res = S_ERROR;
+			break;
+		}
+		if (v.lvalue) {
+			// load the value now, not the location
+			val_read(s, &v, 0);
+			if (val_push_new(s, v.t, 0, &v) == S_ERROR) {
+				res = S_ERROR;
+				break;
+			}
+		}
+		struct hoisted h = { .n = *ni, .v = v };
+		vec_append(&s->hoisted, &h);
+		count_changed(s, PASS_LICM);
+	}
+	vec_free(&exprs);
+	return res;
+}
+
+/* true if the identifier is referenced after the current statement */
+static bool ident_used_later(struct state *s, const char *ident) {
+	for (int i = 0; i < s->blocks.len; ++i) {
+		const struct block_pos *b = vec_get_c(&s->blocks, i);
+		for (int k = b->i + 1; k < b->comp->stmt_comp.len; ++k) {
+			const struct ast_node *nk = GETI(b->comp->stmt_comp, k);
+			if (opt_ident_count(nk, ident) > 0) return true;
+		}
+	}
+	return false;
+}
+
+/* the bottom test of a loop, rewritten to compare a strength reduced
+ * pointer against its precomputed final value */
+struct iv_exit {
+	bool ok;
+	val p, end;
+};
+
+/*
+ * Expressions of the form iv * c + (invariant) are computed once in the
+ * preheader and then advanced by a constant next to every update of the
+ * induction variable. If the loop condition is `iv < n`, it is replaced by a
+ * pointer comparison, after which the variable itself may become redundant.
+ */
+static status cg_reduce_ivs(struct state *s, const struct ast_node *loop,
+		struct iv_exit *exit) {
+	const struct ast_node *cond = loop->stmt_while.cond;
+	struct loop_info li;
+	loop_info_init(&li, loop, &s->address_taken, &s->functions,
+		&s->globals);
+	struct vec ivs = vec_new_empty(sizeof(struct iv));
+	loop_find_ivs(&li, loop, const_value, s, &ivs);
+
+	status res = S_OK;
+	*exit = (struct iv_exit){ .ok = false };
+	for (int i = 0; i < ivs.len; ++i) {
+		const struct iv *iv = vec_get_c(&ivs, i);
+		int reduced_uses = 0;
+		bool exit_iv = false;
+		for (int k = 0; k < iv->derived.len; ++k) {
+			const struct iv_derived *d = vec_get_c(&iv->derived, k);
+			if (d->group != k) continue;
+			int members = 0;
+			bool uncond = false;
+			for (int j = k; j < iv->derived.len; ++j) {
+				const struct iv_derived *dj =
+					vec_get_c(&iv->derived, j);
+				if (dj->group != k) continue;
+				members++;
+				uncond = uncond || dj->uncond;
+			}
+			// computed in the preheader, so only if every iteration
+			// computes it or it can't trap
+			if (!uncond && !opt_expr_speculatable(d->n)) continue;
+			// not worth it if it may be updated more often than used
+			if (!uncond && members <= iv->writes.len) continue;
+
+			comment_node(s, "iv `%s` strength reduced", d->n);
+			count_changed(s, PASS_IV);
+			val v;
+			if (cg_gen_expr(s, d->n, &v) == S_ERROR
+					|| val_read(s, &v, 0) == S_ERROR
+					|| val_push_new(s, v.t, 0, &v) == S_ERROR) {
+				res = S_ERROR;
+				goto end;
+			}
+			for (int j = k; j < iv->derived.len; ++j) {
+				const struct iv_derived *dj =
+					vec_get_c(&iv->derived, j);
+				if (dj->group != k) continue;
+				struct hoisted h = { .n = dj->n, .v = v };
+				vec_append(&s->hoisted, &h);
+				reduced_uses++;
+			}
+			for (int j = 0; j < iv->writes.len; ++j) {
+				const struct iv_write *w = vec_get_c(&iv->writes, j);
+				struct iv_update u = { .stmt = w->stmt, .v = v,
+					.delta = w->step * d->coeff };
+				vec_append(&s->iv_updates, &u);
+			}
+
+			if (exit->ok || d->coeff <= 0 || !type_is_pointer(&v.t))
+				continue;
+			if (cond->kind != AST_BIN || cond->bin.kind != AST_BIN_LT)
+				continue;
+			if (cond->bin.a->kind != AST_IDENT
+					|| strcmp(cond->bin.a->ident, iv->ident) != 0
+					|| !loop_invariant(&li, cond->bin.b))
+				continue;
+			// end = p + coeff * (n - iv)
+			val val_n, val_iv;
+			if (cg_gen_expr(s, cond->bin.b, &val_n) == S_ERROR
+					|| find_ident(s->scope, iv->ident, &val_iv)
+					== S_ERROR) {
+				res = S_ERROR;
+				goto end;
+			}
+			val_read(s, &val_n, 0);
+			val_read(s, &val_iv, 1);
+			emit2(s->code, EMIT_SUB, r64(EMIT_RAX), r64(EMIT_RBX));
+			emit3(s->code, EMIT_IMUL, r64(EMIT_RAX), r64(EMIT_RAX),
+				imm(d->coeff));
+			val_read(s, &v, 1);
+			emit2(s->code, EMIT_ADD, r64(EMIT_RAX), r64(EMIT_RBX));
+			exit->ok = exit_iv = true;
+			exit->p = v;
+			if (val_push_new(s, v.t, 0, &exit->end) == S_ERROR) {
+				res = S_ERROR;
+				goto end;
+			}
+		}
+
+		// the counter is redundant if only the exit test, its own
+		// updates and reduced expressions refer to it
+		if (!exit_iv || s->loop_depth > 0) continue;
+		int write_uses = 0;
+		for (int j = 0; j < iv->writes.len; ++j) {
+			const struct iv_write *w = vec_get_c(&iv->writes, j);
+			write_uses += opt_ident_count(w->stmt, iv->ident);
+		}
+		if (iv->uses != reduced_uses + write_uses + 1) continue;
+		if (ident_used_later(s, iv->ident)) continue;
+		emit_comment(s->code, "iv `%s` removed", iv->ident);
+		count_changed(s, PASS_IV);
+		for (int j = 0; j < iv->writes.len; ++j) {
+			const struct iv_write *w = vec_get_c(&iv->writes, j);
+			vec_append(&s->iv_dropped, &w->stmt);
+		}
+	}
+end:
+	loop_ivs_free(&ivs);
+	loop_info_finish(&li);
+	return res;
+}
+
+static bool iv_dropped(struct state *s, const struct ast_node *n) {
+	for (int i = 0; i < s->iv_dropped.len; ++i) {
+		const struct ast_node * const *ni = vec_get_c(&s->iv_dropped, i);
+		if (*ni == n) return true;
+	}
+	return false;
+}
+static status iv_advance(struct state *s, const struct ast_node *n) {
+	for (int i = 0; i < s->iv_updates.len; ++i) {
+		const struct iv_update *u = vec_get_c(&s->iv_updates, i);
+		if (u->stmt != n) continue;
+		int size;
+		if (type_get_size(&u->v.t, &size) == S_ERROR) return S_ERROR;
+		emit2(s->code, EMIT_ADD, slot(size, u->v.s), imm(u->delta));
+	}
+	return S_OK;
+}
+
+/*
+ * Innermost loops that do the same sums and differences on every element of
+ * some arrays are vectorized: a block of iterations that fills a vector
+ * register runs at once, as long as all of them would run, and the scalar
+ * loop does the rest. Invariant operands are broadcast into xmm8 and up in
+ * the preheader and expressions are evaluated on a stack from xmm0. If an
+ * array that is stored to could overlap with another one, a runtime check
+ * leaves everything to the scalar loop. With avx2 the ymm registers are used
+ * instead.
+ */
+#define VEC_REGS 8 /* for invariants and for temporaries each */
+
+struct vec_gen {
+	const struct vec_loop *vl;
+	int elem; /* size of the elements */
+	struct vec invariants; /* vec<const struct ast_node *> */
+	struct vec arrays; /* vec<const char *> */
+	struct vec stored; /* vec<const char *>, the arrays stored to */
+};
+/* a local pointer to elements of the loop's step, that is never changed */
+static bool vec_array(struct state *s, struct vec_gen *g, const char *ident) {
+	const struct decl *decl = scope_lookup(s->scope, ident);
+	if (!decl || decl->loc > 0
+			|| decl == scope_lookup(file_scope(s), ident)
+			|| opt_names_contain(&s->address_taken, ident)) {
+		return false;
+	}
+	struct type t = decl->t;
+	if (!type_is_pointer(&t) || !type_apply_deref(&t)
+			|| known_size(&t) != g->elem) {
+		return false;
+	}
+	if (!opt_names_contain(&g->arrays, ident)) {
+		vec_append(&g->arrays, &ident);
+	}
+	return true;
+}
+static int vec_invariant(const struct vec_gen *g, const struct ast_node *n) {
+	for (int i = 0; i < g->invariants.len; ++i) {
+		const struct ast_node * const *ni = vec_get_c(&g->invariants, i);
+		if (opt_expr_equal(*ni, n)) return i;
+	}
+	return -1;
+}
+/* collects the arrays and invariants of n, and the registers it needs */
+static bool vec_collect(struct state *s, struct vec_gen *g,
+		const struct ast_node *n, int *depth) {
+	const struct ast_node *p = opt_elem_ptr(n, g->vl->iv);
+	long long v;
+	if (p) {
+		*depth = 1;
+		return vec_array(s, g, p->ident);
+	}
+	if (n->kind == AST_BIN) {
+		int da, db;
+		if (!vec_collect(s, g, n->bin.a, &da)
+				|| !vec_collect(s, g, n->bin.b, &db)) {
+			return false;
+		}
+		*depth = da > db + 1 ? da : db + 1;
+		return true;
+	}
+	if (!const_value(n, &v, s) && !known_decl(s, n->ident)) return false;
+	*depth = 0;
+	if (vec_invariant(g, n) < 0) vec_append(&g->invariants, &n);
+	return true;
+}
+static status vec_read_ident(struct state *s, const char *ident, int regi) {
+	val v;
+	if (find_ident(s->scope, ident, &v) == S_ERROR) return S_ERROR;
+	return val_read(s, &v, regi);
+}
+/* evaluates n for the elements at r8, returns the register it ends up in */
+static int vec_eval(struct state *s, const struct vec_gen *g,
+		const struct ast_node *n, int k) {
+	int width = s->avx2 ? 32 : 16;
+	int inv = vec_invariant(g, n);
+	if (inv >= 0) return VEC_REGS + inv;
+	const struct ast_node *p = opt_elem_ptr(n, g->vl->iv);
+	if (p) {
+		vec_read_ident(s, p->ident, 0);
+		emit2(s->code, s->avx2 ? EMIT_VMOVDQU : EMIT_MOVDQU,
+			emit_o_reg(k, width),
+			emit_o_mem(0, EMIT_RAX, EMIT_R8, 1, 0));
+		return k;
+	}
+	// by the element size, add or subtract, and AVX2
+	static const enum emit_op ops[2][2][2] = {
+		{ { EMIT_PADDB, EMIT_VPADDB }, { EMIT_PSUBB, EMIT_VPSUBB } },
+		{ { EMIT_PADDD, EMIT_VPADDD }, { EMIT_PSUBD, EMIT_VPSUBD } },
+	};
+	enum emit_op op = ops[g->elem != 1][n->bin.kind != AST_BIN_ADD][s->avx2];
+	int a = vec_eval(s, g, n->bin.a, k);
+	int b = vec_eval(s, g, n->bin.b, a == k ? k + 1 : k);
+	if (s->avx2) {
+		emit3(s->code, op, emit_o_reg(k, 32), emit_o_reg(a, 32),
+			emit_o_reg(b, 32));
+	} else {
+		if (a != k) {
+			emit2(s->code, EMIT_MOVDQA, emit_o_reg(k, 16),
+				emit_o_reg(a, 16));
+		}
+		emit2(s->code, op, emit_o_reg(k, 16), emit_o_reg(b, 16));
+	}
+	return k;
+}
+/* jumps to label if the elements of a and b from r8 to the bound in r9
+ * overlap, clobbers rdx, r10 and r11 */
+static void vec_check_overlap(struct state *s, const struct vec_gen *g,
+		const char *a, const char *b, int label) {
+	int label_ok = get_label(s);
+	emit_comment(s->code, "`%s` and `%s` must not overlap", a, b);
+	vec_read_ident(s, a, 0);
+	emit2(s->code, EMIT_MOV, r64(EMIT_R10), r64(EMIT_RAX));
+	vec_read_ident(s, b, 0);
+	emit2(s->code, EMIT_MOV, r64(EMIT_R11), r64(EMIT_RAX));
+	emit2(s->code, EMIT_LEA, r64(EMIT_RAX), emit_o_mem(0, EMIT_R10, EMIT_R9,
+		1, g->elem));
+	emit2(s->code, EMIT_LEA, r64(EMIT_RDX), emit_o_mem(0, EMIT_R11, EMIT_R8,
+		1, 0));
+	emit2(s->code, EMIT_CMP, r64(EMIT_RAX), r64(EMIT_RDX));
+	emit_jcc(s->code, EMIT_CC_BE, label_ok);
+	emit2(s->code, EMIT_LEA, r64(EMIT_RAX), emit_o_mem(0, EMIT_R11, EMIT_R9,
+		1, g->elem));
+	emit2(s->code, EMIT_LEA, r64(EMIT_RDX), emit_o_mem(0, EMIT_R10, EMIT_R8,
+		1, 0));
+	emit2(s->code, EMIT_CMP, r64(EMIT_RAX), r64(EMIT_RDX));
+	emit_jcc(s->code, EMIT_CC_A, label);
+	put_label(s, label_ok);
+}
+/* emits the vectorized loop in front of `loop` if it can be vectorized */
+static status cg_vectorize(struct state *s, const struct ast_node *loop,
+		bool *done) {
+	*done = false;
+	struct vec_loop vl;
+	if (!loop_vectorizable(loop, const_value, s, &vl)) return S_OK;
+	struct vec_gen g = {
+		.vl = &vl,
+		.elem = vl.step,
+		.invariants = vec_new_empty(sizeof(const struct ast_node *)),
+		.arrays = vec_new_empty(sizeof(const char *)),
+		.stored = vec_new_empty(sizeof(const char *)),
+	};
+	const struct decl *iv = known_decl(s, vl.iv);
+	long long v;
+	bool ok = (g.elem == 1 || g.elem == 4) && iv && known_size(&iv->t) == 4
+		&& (const_value(vl.bound, &v, s) || known_decl(s, vl.bound->ident));
+	for (int i = 0; ok && i < vl.stores.len; ++i) {
+		const struct ast_node * const *e = vec_get_c(&vl.stores, i);
+		const char *p = opt_elem_ptr((*e)->bin.a, vl.iv)->ident;
+		int depth;
+		ok = vec_array(s, &g, p) && vec_collect(s, &g, (*e)->bin.b, &depth)
+			&& depth < VEC_REGS;
+		if (ok && !opt_names_contain(&g.stored, p)) {
+			vec_append(&g.stored, &p);
+		}
+	}
+	ok = ok && g.invariants.len <= VEC_REGS;
+	status res = S_OK;
+	if (!ok) goto end;
+
+	int width = s->avx2 ? 32 : 16;
+	int label_loop = get_label(s), label_exit = get_label(s);
+	int label_scalar = get_label(s);
+	emit_comment(s->code, "loop vectorized, %d elements at a time",
+		width / g.elem);
+	val iv_val, bound;
+	if (find_ident(s->scope, vl.iv, &iv_val) == S_ERROR
+			|| cg_gen_expr(s, vl.bound, &bound) == S_ERROR) {
+		res = S_ERROR;
+		goto end;
+	}
+	known_operand(s, vl.bound, &bound);
+	// r8 is the current element, r9 the bound
+	val_read(s, &iv_val, 0);
+	emit2(s->code, EMIT_MOV, r64(EMIT_R8), r64(EMIT_RAX));
+	val_read(s, &bound, 0);
+	emit2(s->code, EMIT_MOV, r64(EMIT_R9), r64(EMIT_RAX));
+
+	// the arrays from the current element to the bound must be disjoint
+	for (int i = 0; i < g.arrays.len; ++i) {
+		for (int j = i + 1; j < g.arrays.len; ++j) {
+			const char *a = *(const char **)vec_get(&g.arrays, i);
+			const char *b = *(const char **)vec_get(&g.arrays, j);
+			if (!opt_names_contain(&g.stored, a)
+					&& !opt_names_contain(&g.stored, b)) {
+				continue;
+			}
+			if (alias_distinct(s, a, b)) {
+				emit_comment(s->code,
+					"`%s` and `%s` don't alias", a, b);
+				continue;
+			}
+			vec_check_overlap(s, &g, a, b, label_scalar);
+		}
+	}
+	for (int i = 0; i < g.invariants.len; ++i) {
+		const struct ast_node * const *ni = vec_get(&g.invariants, i);
+		if (const_value(*ni, &v, s)) {
+			emit2(s->code, EMIT_MOV, r32(EMIT_RAX),
+				imm((unsigned int)v));
+		} else {
+			vec_read_ident(s, (*ni)->ident, 0);
+		}
+		if (g.elem == 1) {
+			emit2(s->code, EMIT_MOVZX, r32(EMIT_RAX), r8(EMIT_RAX));
+			emit3(s->code, EMIT_IMUL, r32(EMIT_RAX), r32(EMIT_RAX),
+				imm(0x01010101));
+		}
+		int k = VEC_REGS + i;
+		if (s->avx2) {
+			emit2(s->code, EMIT_VMOVD, emit_o_reg(k, 16),
+				r32(EMIT_RAX));
+			emit2(s->code, EMIT_VPBROADCASTD, emit_o_reg(k, 32),
+				emit_o_reg(k, 16));
+		} else {
+			emit2(s->code, EMIT_MOVD, emit_o_reg(k, 16),
+				r32(EMIT_RAX));
+			emit3(s->code, EMIT_PSHUFD, emit_o_reg(k, 16),
+				emit_o_reg(k, 16), imm(0));
+		}
+	}
+
+	put_label(s, label_loop);
+	// all iterations of the block are still in the loop
+	emit2(s->code, EMIT_LEA, r64(EMIT_RAX), mem(0, EMIT_R8,
+		width - g.elem));
+	emit2(s->code, EMIT_CMP, r64(EMIT_RAX), r64(EMIT_R9));
+	emit_jcc(s->code, EMIT_CC_GE, label_exit);
+	for (int i = 0; i < vl.stores.len; ++i) {
+		const struct ast_node * const *e = vec_get_c(&vl.stores, i);
+		int k = vec_eval(s, &g, (*e)->bin.b, 0);
+		vec_read_ident(s, opt_elem_ptr((*e)->bin.a, vl.iv)->ident, 0);
+		emit2(s->code, s->avx2 ? EMIT_VMOVDQU : EMIT_MOVDQU,
+			emit_o_mem(0, EMIT_RAX, EMIT_R8, 1, 0), emit_o_reg(k, width));
+	}
+	emit2(s->code, EMIT_ADD, r64(EMIT_R8), imm(width));
+	emit1(s->code, EMIT_JMP, emit_o_label(label_loop));
+	put_label(s, label_exit);
+	emit2(s->code, EMIT_MOV, r64(EMIT_RAX), r64(EMIT_R8));
+	val_store(s, &iv_val, 0);
+	put_label(s, label_scalar);
+	if (s->avx2) emit0(s->code, EMIT_VZEROUPPER);
+	// the scalar loop starts wherever the vector loop stopped
+	known_kill_writes(s, loop);
+	*done = true;
+end:
+	vec_free(&g.stored);
+	vec_free(&g.arrays);
+	vec_free(&g.invariants);
+	vec_loop_finish(&vl);
+	return res;
+}
+
+/*
+ * A loop that only fills the elements of an array with the same value or
+ * copies them from another array is done at once. Up to MEM_INLINE_MAX
+ * bytes known at compile time are moved with a few vector stores, up to
+ * MEM_REP_MAX bytes with a string instruction and more with a call to the C
+ * library, which picks the best way for the processor it runs on. The
+ * arrays of a copy that could overlap are left to the loop at runtime.
+ */
+#define MEM_INLINE_MAX 64
+#define MEM_REP_MAX 2048
+
+enum mem_strategy {
+	MEM_INLINE,
+	MEM_REP,
+	MEM_CALL,
+};
+
+/* whether the library function can be called, declares it if so */
+static bool mem_libc(struct state *s, const char *ident) {
+	// a definition in this file is not the one from the library
+	if (opt_function_get(&s->functions, ident)) return false;
+	if (!cg_discarding(s) && !opt_names_contain(&s->libc, ident)) {
+		vec_append(&s->libc, &ident);
+	}
+	return true;
+}
+/* moves bytes from rsi, or stores eax repeated in xmm0, to rdi */
+static void mem_inline(struct state *s, bool copy, long long bytes) {
+	long long off = 0;
+	if (!copy && bytes >= 16) {
+		emit2(s->code, EMIT_MOVD, emit_o_reg(0, 16), r32(EMIT_RAX));
+		emit3(s->code, EMIT_PSHUFD, emit_o_reg(0, 16), emit_o_reg(0,
+			16), imm(0));
+	}
+	for (; bytes - off >= 16; off += 16) {
+		if (copy) emit2(s->code, EMIT_MOVDQU, emit_o_reg(0, 16), mem(0,
+			EMIT_RSI, off));
+		emit2(s->code, EMIT_MOVDQU, mem(0, EMIT_RDI, off), emit_o_reg(0,
+			16));
+	}
+	for (; bytes - off >= 4; off += 4) {
+		if (copy) emit2(s->code, EMIT_MOV, r32(EMIT_RAX), mem(0,
+			EMIT_RSI, off));
+		emit2(s->code, EMIT_MOV, mem(0, EMIT_RDI, off), r32(EMIT_RAX));
+	}
+	for (; bytes - off >= 1; off += 1) {
+		if (copy) emit2(s->code, EMIT_MOV, r8(EMIT_RAX), mem(0,
+			EMIT_RSI, off));
+		emit2(s->code, EMIT_MOV, mem(0, EMIT_RDI, off), r8(EMIT_RAX));
+	}
+}
+/* replaces `loop` if it only fills or copies an array, sets done if so */
+static status cg_mem_idiom(struct state *s, const struct ast_node *loop,
+		bool *done) {
+	*done = false;
+	struct vec_loop vl;
+	if (!loop_vectorizable(loop, const_value, s, &vl)) return S_OK;
+	struct vec_gen g = {
+		.vl = &vl,
+		.elem = vl.step,
+		.invariants = vec_new_empty(sizeof(const struct ast_node *)),
+		.arrays = vec_new_empty(sizeof(const char *)),
+		.stored = vec_new_empty(sizeof(const char *)),
+	};
+	const struct decl *iv = known_decl(s, vl.iv);
+	long long v;
+	int size;
+	bool ok = vl.stores.len == 1 && (g.elem == 1 || g.elem == 4)
+		&& iv && known_size(&iv->t) == 4
+		&& (const_value(vl.bound, &v, s) || known_decl(s, vl.bound->ident));
+	const struct ast_node *e = NULL;
+	const char *dst = NULL, *src = NULL;
+	if (ok) {
+		e = *(const struct ast_node * const *)vec_get_c(&vl.stores, 0);
+		dst = opt_elem_ptr(e->bin.a, vl.iv)->ident;
+		const struct ast_node *p = opt_elem_ptr(e->bin.b, vl.iv);
+		int depth;
+		if (p) {
+			src = p->ident;
+			ok = vec_array(s, &g, dst) && vec_array(s, &g, src)
+				&& strcmp(dst, src) != 0;
+		} else {
+			ok = vec_array(s, &g, dst)
+				&& opt_ident_count(e->bin.b, vl.iv) == 0
+				&& vec_collect(s, &g, e->bin.b, &depth);
+		}
+	}
+	status res = S_OK;
+	if (!ok) goto end;
+
+	// the number of bytes, if it is known here
+	long long first, bound, bytes = -1;
+	if (known_get(s, vl.iv, &first)
+			&& known_expr(s, vl.bound, &bound, &size)) {
+		bytes = (bound - first + g.elem - 1) / g.elem * g.elem;
+		// a loop that doesn't run is not worth replacing
+		if (bytes <= 0) goto end;
+	}
+	// every byte of a fill is the same
+	bool uniform = src || g.elem == 1
+		|| (known_expr(s, e->bin.b, &v, &size)
+			&& (v & 0xff) * 0x01010101 == known_trunc(v, 4));
+	enum mem_strategy how = MEM_REP;
+	if (bytes >= 0 && bytes <= MEM_INLINE_MAX) {
+		how = MEM_INLINE;
+	} else if (uniform && (bytes < 0 || bytes > MEM_REP_MAX)
+			&& mem_libc(s, src ? "memcpy" : "memset")) {
+		how = MEM_CALL;
+	}
+
+	emit_comment(s->code, "%s loop replaced", src ? "copy" : "fill");
+	int label_end = get_label(s), label_loop = get_label(s);
+	val iv_val, bound_val, fill;
+	if (find_ident(s->scope, vl.iv, &iv_val) == S_ERROR
+			|| (!src && cg_gen_expr(s, e->bin.b, &fill) == S_ERROR)
+			|| cg_gen_expr(s, vl.bound, &bound_val) == S_ERROR) {
+		res = S_ERROR;
+		goto end;
+	}
+	if (!src) known_operand(s, e->bin.b, &fill);
+	known_operand(s, vl.bound, &bound_val);
+	// r8 is the first element, r9 the bound
+	val_read(s, &iv_val, 0);
+	emit2(s->code, EMIT_MOV, r64(EMIT_R8), r64(EMIT_RAX));
+	val_read(s, &bound_val, 0);
+	emit2(s->code, EMIT_MOV, r64(EMIT_R9), r64(EMIT_RAX));
+	if (bytes < 0) {
+		emit2(s->code, EMIT_CMP, r64(EMIT_R8), r64(EMIT_R9));
+		emit_jcc(s->code, EMIT_CC_GE, label_end);
+	}
+	if (src && alias_distinct(s, dst, src)) {
+		emit_comment(s->code, "`%s` and `%s` don't alias", dst, src);
+	} else if (src) {
+		vec_check_overlap(s, &g, dst, src, label_loop);
+	}
+	// rdx is the number of bytes, the loop stops on the element after them
+	if (bytes >= 0) {
+		emit2(s->code, EMIT_MOV, r64(EMIT_RDX), imm(bytes));
+	} else {
+		emit2(s->code, EMIT_MOV, r64(EMIT_RDX), r64(EMIT_R9));
+		emit2(s->code, EMIT_SUB, r64(EMIT_RDX), r64(EMIT_R8));
+		if (g.elem > 1) {
+			emit2(s->code, EMIT_ADD, r64(EMIT_RDX),
+				imm(g.elem - 1));
+			emit2(s->code, EMIT_AND, r64(EMIT_RDX), imm(-g.elem));
+		}
+	}
+	emit2(s->code, EMIT_LEA, r64(EMIT_RAX), emit_o_mem(0, EMIT_R8, EMIT_RDX,
+		1, 0));
+	val_store(s, &iv_val, 0);
+	vec_read_ident(s, dst, 0);
+	emit2(s->code, EMIT_LEA, r64(EMIT_RDI), emit_o_mem(0, EMIT_RAX, EMIT_R8,
+		1, 0));
+	if (src) {
+		vec_read_ident(s, src, 0);
+		emit2(s->code, EMIT_LEA, r64(EMIT_RSI), emit_o_mem(0, EMIT_RAX,
+			EMIT_R8, 1, 0));
+	} else {
+		val_read(s, &fill, 0);
+		if (g.elem == 1 && how == MEM_INLINE) {
+			emit2(s->code, EMIT_MOVZX, r32(EMIT_RAX), r8(EMIT_RAX));
+			emit3(s->code, EMIT_IMUL, r32(EMIT_RAX), r32(EMIT_RAX),
+				imm(0x01010101));
+		}
+	}
+	switch (how) {
+	case MEM_INLINE:
+		mem_inline(s, src, bytes);
+		break;
+	case MEM_REP:
+		emit2(s->code, EMIT_MOV, r64(EMIT_RCX), r64(EMIT_RDX));
+		if (src) {
+			emit0(s->code, EMIT_REP_MOVSB);
+		} else if (uniform) {
+			emit0(s->code, EMIT_REP_STOSB);
+		} else {
+			emit2(s->code, EMIT_SHR, r64(EMIT_RCX), imm(2));
+			emit0(s->code, EMIT_REP_STOSD);
+		}
+		break;
+	case MEM_CALL:
+		if (!src) emit2(s->code, EMIT_MOVZX, r32(EMIT_RSI),
+			r8(EMIT_RAX));
+		emit2(s->code, EMIT_SUB, r64(EMIT_RSP),
+			imm((-s->sp) + (16 + s->sp % 16)));
+		emit1(s->code, EMIT_CALL,
+			emit_o_sym(src ? "memcpy" : "memset"));
+		break;
+	}
+	cse_kill_loop(s, loop);
+	known_kill_writes(s, loop);
+	// the loop is still checked, and kept for arrays that overlap
+	const struct ast_node *outer = s->plain_loop;
+	s->plain_loop = loop;
+	if (src) {
+		emit1(s->code, EMIT_JMP, emit_o_label(label_end));
+		put_label(s, label_loop);
+		res = cg_gen_stmt(s, loop);
+	} else {
+		res = cg_check_stmt(s, loop);
+	}
+	s->plain_loop = outer;
+	put_label(s, label_end);
+	*done = true;
+end:
+	vec_free(&g.stored);
+	vec_free(&g.arrays);
+	vec_free(&g.invariants);
+	vec_loop_finish(&vl);
+	return res;
+}
+
+/*
+ * Counted loops whose body always runs to the end are unrolled. With a small
+ * trip count known here, the loop becomes that many copies of the body.
+ * Otherwise `unroll` copies run per iteration for as long as that many
+ * iterations are left, and the loop as written does the rest. The copies
+ * don't step the variable, copy k sees it as iv + k * step instead: folded
+ * into the displacement where it indexes an array, and computed into a slot
+ * of its own if it is used otherwise. One add steps it past all of them.
+ */
+#define UNROLL_FULL_MAX 16 /* iterations */
+#define UNROLL_BUDGET 256 /* nodes in all copies of the body */
+
+struct unroll_uses {
+	const char *iv;
+	int index; /* occurrences as the index of an element */
+};
+static bool visit_unroll_uses(const struct ast_node *n, void *ud) {
+	struct unroll_uses *u = ud;
+	const struct ast_node *b = NULL;
+	if (n->kind == AST_UNARY && n->unary.kind == AST_UNARY_DEREF
+			&& n->unary.a->kind == AST_BIN
+			&& n->unary.a->bin.kind == AST_BIN_ADD) {
+		b = n->unary.a->bin.b;
+	} else if (n->kind == AST_INDEX) {
+		b = n->index.b;
+	}
+	if (b && b->kind == AST_IDENT && strcmp(b->ident, u->iv) == 0) {
+		u->index++;
+	}
+	return true;
+}
+/* generates the body of the loop for iv + delta */
+static status cg_unroll_copy(struct state *s, const struct unroll_loop *ul,
+		const struct ast_node *body, const val *iv, long long delta) {
+	struct scope copy_scope = { 0 };
+	hashmap_init(&copy_scope.vars, sizeof(struct decl));
+	copy_scope.parent = s->scope;
+	s->scope = &copy_scope;
+	struct unroll_index outer = s->unroll_index;
+	const struct decl *decl = scope_lookup(s->scope, ul->iv);
+	s->unroll_index = (struct unroll_index){ .iv = ul->iv,
+		.loc = decl->loc, .v = *iv, .delta = delta };
+
+	struct unroll_uses uses = { .iv = ul->iv };
+	ast_walk(body, visit_unroll_uses, &uses);
+	long long v;
+	bool known = known_get(s, ul->iv, &v);
+	if (delta && opt_ident_count(body, ul->iv)
+			> uses.index + opt_ident_count(ul->incr, ul->iv)) {
+		struct decl copy = *decl;
+		copy.loc = s->sp -= 8;
+		hashmap_put(&copy_scope.vars, ul->iv, &copy);
+		s->unroll_index.loc = copy.loc;
+		val copy_val;
+		find_ident(s->scope, ul->iv, &copy_val);
+		if (known) {
+			emit2(s->code, EMIT_MOV, r64(EMIT_RAX),
+				imm(known_trunc(v + delta, 4)));
+			known_put(s, ul->iv, v + delta);
+		} else {
+			val_read(s, iv, 0);
+			emit2(s->code, EMIT_ADD, r64(EMIT_RAX), imm(delta));
+		}
+		val_store(s, &copy_val, 0);
+	}
+	vec_append(&s->iv_dropped, &ul->incr);
+	status st = cg_gen_stmt(s, body);
+	s->iv_dropped.len--;
+
+	s->unroll_index = outer;
+	hashmap_finish(&copy_scope.vars);
+	s->scope = copy_scope.parent;
+	return st;
+}
+/* jumps to label if iv + delta is not below the bound, or if it is */
+static void unroll_test(struct state *s, const val *iv, const val *bound,
+		long long delta, bool below, int label) {
+	val_read(s, iv, 0);
+	val_read(s, bound, 1);
+	emit2(s->code, EMIT_ADD, r64(EMIT_RAX), imm(delta));
+	emit2(s->code, EMIT_CMP, r64(EMIT_RAX), r64(EMIT_RBX));
+	emit_jcc(s->code, below ? EMIT_CC_L : EMIT_CC_GE, label);
+}
+/* unrolls `loop` if it is worth it, sets done if it was generated */
+static status cg_unroll(struct state *s, const struct ast_node *loop,
+		bool *done) {
+	*done = false;
+	struct unroll_loop ul;
+	if (s->unroll < 2 || !loop_unrollable(loop, const_value, s, &ul))
+		return S_OK;
+	const struct decl *decl = known_decl(s, ul.iv);
+	if (!decl || known_size(&decl->t) != 4 || (ul.bound->kind == AST_IDENT
+			&& !known_decl(s, ul.bound->ident))) {
+		return S_OK;
+	}
+	// an enclosing loop keeps values derived from the variable updated
+	for (int i = 0; i < s->iv_updates.len; ++i) {
+		const struct iv_update *u = vec_get_c(&s->iv_updates, i);
+		if (u->stmt == ul.incr) return S_OK;
+	}
+	const struct ast_node *body = loop->stmt_while.stmt;
+	long long first, bound, trips = -1;
+	int size;
+	if (known_get(s, ul.iv, &first)
+			&& known_expr(s, ul.bound, &bound, &size)) {
+		trips = (bound - first + ul.step - 1) / ul.step;
+	}
+	bool full = trips > 0 && trips <= UNROLL_FULL_MAX
+		&& trips * ul.size <= UNROLL_BUDGET;
+	int factor = s->unroll;
+	while (factor > 1 && factor * ul.size > UNROLL_BUDGET) factor--;
+	if (!full && factor < 2) return S_OK;
+
+	val iv, bound_val;
+	if (find_ident(s->scope, ul.iv, &iv) == S_ERROR) return S_ERROR;
+	status res = S_OK;
+	cse_kill_loop(s, loop);
+	int cse_mark = s->cse.len;
+	s->loop_depth++;
+	if (full) {
+		emit_comment(s->code, "loop fully unrolled, %lld iterations",
+			trips);
+		for (long long k = 0; k < trips && res == S_OK; ++k) {
+			res = cg_unroll_copy(s, &ul, body, &iv, k * ul.step);
+			s->cse.len = cse_mark;
+		}
+		s->loop_depth--;
+		if (res == S_ERROR) return S_ERROR;
+		emit2(s->code, EMIT_MOV, r64(EMIT_RAX),
+			imm(known_trunc(first + trips * ul.step, 4)));
+		val_store(s, &iv, 0);
+		known_put(s, ul.iv, first + trips * ul.step);
+		*done = true;
+		return S_OK;
+	}
+
+	emit_comment(s->code, "loop unrolled %d times", factor);
+	int label_body = get_label(s), label_rest = get_label(s);
+	if (cg_gen_expr(s, ul.bound, &bound_val) == S_ERROR) {
+		s->loop_depth--;
+		return S_ERROR;
+	}
+	known_operand(s, ul.bound, &bound_val);
+	long long last = (factor - 1) * ul.step;
+	// all of the copies would run
+	unroll_test(s, &iv, &bound_val, last, false, label_rest);
+	known_kill_writes(s, loop);
+	struct vec known = known_copy(&s->known);
+	int hoisted_mark = s->hoisted.len;
+	res = PASS(s, PASS_LICM, cg_hoist_invariants(s, loop));
+	s->cse.len = cse_mark;
+	put_label(s, label_body);
+	for (int k = 0; k < factor && res == S_OK; ++k) {
+		res = cg_unroll_copy(s, &ul, body, &iv, k * ul.step);
+		s->cse.len = cse_mark;
+	}
+	s->loop_depth--;
+	if (res == S_OK) {
+		val_add_imm(s, &iv, factor * ul.step);
+		unroll_test(s, &iv, &bound_val, last, true, label_body);
+	}
+	known_restore(&s->known, &known);
+	vec_free(&known);
+	s->hoisted.len = hoisted_mark;
+	if (res == S_ERROR) return S_ERROR;
+	put_label(s, label_rest);
+
+	// the iterations that are left
+	const struct ast_node *outer = s->plain_loop;
+	s->plain_loop = loop;
+	res = cg_gen_stmt(s, loop);
+	s->plain_loop = outer;
+	*done = true;
+	return res;
+}
+
+/* consecutive cases that are handled by one jump table, or a single case */
+struct dispatch_cluster {
+	int lo, hi; /* indices into the sorted cases, inclusive */
+	bool table;
+};
+
+#define DISPATCH_TABLE_MIN 4 /* cases */
+#define DISPATCH_TABLE_DENSITY 40 /* percent of the range */
+#define DISPATCH_LINEAR_MAX 3 /* clusters tested one by one */
+
+static bool dispatch_dense(const struct dispatch_case *c, int lo, int hi) {
+	long long range = (long long)c[hi].v - c[lo].v + 1;
+	return hi - lo + 1 >= DISPATCH_TABLE_MIN
+		&& (hi - lo + 1) * 100 >= range * DISPATCH_TABLE_DENSITY;
+}
+/* splits the sorted cases into the fewest clusters */
+static struct vec dispatch_clusters(const struct dispatch_case *c, int n) {
+	int *best = malloc((n + 1) * sizeof(int));
+	int *from = malloc((n + 1) * sizeof(int));
+	best[0] = 0;
+	for (int j = 1; j <= n; ++j) {
+		best[j] = best[j - 1] + 1;
+		from[j] = j - 1;
+		for (int i = 0; i + DISPATCH_TABLE_MIN <= j; ++i) {
+			if (best[i] + 1 < best[j] && dispatch_dense(c, i, j - 1)) {
+				best[j] = best[i] + 1;
+				from[j] = i;
+			}
+		}
+	}
+	struct vec clusters = vec_new_empty(sizeof(struct dispatch_cluster));
+	struct vec rev = vec_new_empty(sizeof(struct dispatch_cluster));
+	for (int j = n; j > 0; j = from[j]) {
+		struct dispatch_cluster cl = { .lo = from[j], .hi = j - 1,
+			.table = j - 1 > from[j] };
+		vec_append(&rev, &cl);
+	}
+	for (int i = rev.len - 1; i >= 0; --i) {
+		vec_append(&clusters, vec_get(&rev, i));
+	}
+	vec_free(&rev);
+	free(best);
+	free(from);
+	return clusters;
+}
+static void cg_dispatch_table(struct state *s, const struct dispatch_case *c,
+		const struct dispatch_cluster *cl, int label_default) {
+	struct vec table = vec_new_empty(sizeof(int));
+	for (int i = cl->lo; i <= cl->hi; ++i) {
+		while (i > cl->lo && table.len < c[i].v - c[cl->lo].v) {
+			vec_append(&table, &label_default);
+		}
+		vec_append(&table, &c[i].label);
+	}
+	int t = vec_append(&s->tables, &table);
+	emit2(s->code, EMIT_MOV, r32(EMIT_RDX), r32(EMIT_RAX));
+	emit2(s->code, EMIT_SUB, r32(EMIT_RDX), imm(c[cl->lo].v));
+	emit2(s->code, EMIT_CMP, r32(EMIT_RDX), imm(table.len - 1));
+	emit_jcc(s->code, EMIT_CC_A, label_default);
+	emit2(s->code, EMIT_MOV, r64(EMIT_RCX), emit_o_table(t));
+	emit1(s->code, EMIT_JMP, emit_o_mem(8, EMIT_RCX, EMIT_RDX, 8, 0));
+}
+/* a balanced compare tree over the clusters */
+static void cg_dispatch_tree(struct state *s, const struct dispatch_case *c,
+		const struct dispatch_cluster *cl, int n, int label_default) {
+	bool linear = n <= DISPATCH_LINEAR_MAX;
+	for (int i = 0; linear && i < n; ++i) linear = !cl[i].table;
+	if (linear) {
+		for (int i = 0; i < n; ++i) {
+			emit2(s->code, EMIT_CMP, r32(EMIT_RAX),
+				imm(c[cl[i].lo].v));
+			emit_jcc(s->code, EMIT_CC_E, c[cl[i].lo].label);
+		}
+		emit1(s->code, EMIT_JMP, emit_o_label(label_default));
+		return;
+	}
+	if (n == 1) {
+		cg_dispatch_table(s, c, cl, label_default);
+		return;
+	}
+	int mid = n / 2, label_low = get_label(s);
+	emit2(s->code, EMIT_CMP, r32(EMIT_RAX), imm(c[cl[mid].lo].v));
+	emit_jcc(s->code, EMIT_CC_L, label_low);
+	if (cl[mid].table) {
+		cg_dispatch_tree(s, c, cl + mid, n - mid, label_default);
+	} else {
+		// the same compare decides a single case
+		emit_jcc(s->code, EMIT_CC_E, c[cl[mid].lo].label);
+		cg_dispatch_tree(s, c, cl + mid + 1, n - mid - 1,
+			label_default);
+	}
+	put_label(s, label_low);
+	cg_dispatch_tree(s, c, cl, mid, label_default);
+}
+/*
+ * Jumps to the label of the case equal to eax, or to label_default. Dense
+ * runs of cases go through bounds checked jump tables, the rest through
+ * compares, all of it arranged as a binary search.
+ */
+static status cg_dispatch(struct state *s, struct vec *cases,
+		int label_default) {
+	if (!opt_dispatch_sort(cases)) return S_ERROR;
+	struct dispatch_case *c = cases->len ? vec_get(cases, 0) : NULL;
+	struct vec clusters = dispatch_clusters(c, cases->len);
+	emit_comment(s->code, "dispatch over %d cases in %d clusters",
+		cases->len, clusters.len);
+	cg_dispatch_tree(s, c, clusters.len ? vec_get(&clusters, 0) : NULL,
+		clusters.len, label_default);
+	vec_free(&clusters);
+	return S_OK;
+}
 
-		struct vec vals = vec_new_empty(sizeof(val));
-		for (int i = 0; i < n->call.args.len; ++i) {
-			const struct ast_node * const *ni = vec_get_c(&n->call.args, i);
-			val v;
-			if (cg_gen_expr(s, *ni, &v) == S_ERROR) {
-				vec_free(&vals);
-				return S_ERROR;
+static status cg_gen_switch(struct state *s, const struct ast_node *n) {
+	val val_cond;
+	if (cg_gen_expr(s, n->stmt_switch.cond, &val_cond) == S_ERROR) {
+		return S_ERROR;
+	}
+	if (!type_is_arithmetic(&val_cond.t)) {
+		warn_node("error: switch on a non-integer", n->stmt_switch.cond);
+		return S_ERROR;
+	}
+
+	int labels_mark = s->switch_labels.len;
+	opt_switch_labels(n, &s->switch_labels);
+
+	int label_end = get_label(s), label_default = label_end;
+	struct vec cases = vec_new_empty(sizeof(struct dispatch_case));
+	status res = S_OK;
+	for (int i = labels_mark; i < s->switch_labels.len; ++i) {
+		struct switch_label *l = vec_get(&s->switch_labels, i);
+		l->label = get_label(s);
+		if (l->n->kind == AST_STMT_LABELED_DEFAULT) {
+			if (label_default != label_end) {
+				fprintf(stderr, "error: multiple default labels\n");
+				res = S_ERROR;
+				goto end;
 			}
-			vec_append(&vals, &v);
+			label_default = l->label;
+			continue;
 		}
+		int v;
+		if (const_eval(l->n->stmt_labeled_case.expr, &v) == S_ERROR) {
+			res = S_ERROR;
+			goto end;
+		}
+		struct dispatch_case c = { .v = v, .label = l->label };
+		vec_append(&cases, &c);
+	}
 
-		const char *call_regs[] = { "rdi", "rsi", "rdx", "rcx", "r8", "r9" };
-		for (int i = 0; i < vals.len; ++i) {
-			val *vi = vec_get(&vals, i);
-			assert(i < sizeof(call_regs) / sizeof(call_regs[0]));
-			val_read(s, vi, 0);
-			fprintf(s->f, "mov %s, rax\n", call_regs[i]);
+	long long v;
+	if (known_cond(s, n->stmt_switch.cond, &v)) {
+		// the dispatch is only checked
+		struct discard d;
+		discard_begin(s, &d);
+		res = cg_dispatch(s, &cases, label_default);
+		discard_end(s, &d);
+		if (res == S_ERROR) goto end;
+		int label = label_default;
+		for (int i = 0; i < cases.len; ++i) {
+			const struct dispatch_case *c = vec_get(&cases, i);
+			if (c->v == (int)v) label = c->label;
 		}
-		vec_free(&vals);
+		emit_comment(s->code, "constant switch");
+		emit1(s->code, EMIT_JMP, emit_o_label(label));
+		count_folded(s);
+	} else {
+		val_read(s, &val_cond, 0);
+		if (cg_dispatch(s, &cases, label_default) == S_ERROR) {
+			res = S_ERROR;
+			goto end;
+		}
+	}
+	vec_append(&s->breaks, &label_end);
+	int cse_switch = s->cse_switch;
+	s->cse_switch = s->cse.len;
+	// any case can be entered after any of the writes
+	known_kill_writes(s, n);
+	struct vec known_switch = s->known_switch;
+	s->known_switch = known_copy(&s->known);
+	res = cg_gen_stmt(s, n->stmt_switch.stmt);
+	s->cse.len = s->cse_switch;
+	s->cse_switch = cse_switch;
+	known_restore(&s->known, &s->known_switch);
+	vec_free(&s->known_switch);
+	s->known_switch = known_switch;
+	s->breaks.len--;
+	put_label(s, label_end);
+end:
+	vec_free(&cases);
+	s->switch_labels.len = labels_mark;
+	return res;
+}
 
-		fprintf(s->f, "sub rsp, %d\n", (-s->sp) + (16 + s->sp % 16));
-		fprintf(s->f, "call %s\n", func_ident);
-		if (f_res_size > 0) {
-			return val_push_new(s, func_val.t, 0, res);
-		} else {
-			*res = (val){ .s = 1, .t = func_val.t };
+/* the assignment to a variable that is the only thing `n` does */
+static const struct ast_node *single_assign(const struct ast_node *n,
+		const struct ast_node **stmt) {
+	if (n->kind == AST_STMT_COMP && n->stmt_comp.len == 1) {
+		n = GETI(n->stmt_comp, 0);
+	}
+	if (n->kind != AST_STMT_EXPR || !n->stmt_expr.a) return NULL;
+	const struct ast_node *e = n->stmt_expr.a;
+	if (e->kind != AST_BIN || e->bin.kind != AST_BIN_ASSIGN
+			|| e->bin.a->kind != AST_IDENT) {
+		return NULL;
+	}
+	*stmt = n;
+	return e;
+}
+static bool iv_updated(struct state *s, const struct ast_node *n) {
+	for (int i = 0; i < s->iv_updates.len; ++i) {
+		const struct iv_update *u = vec_get_c(&s->iv_updates, i);
+		if (u->stmt == n) return true;
+	}
+	return iv_dropped(s, n);
+}
+/*
+ * `if (c) x = a; else x = b;` and `if (c) x = a;` with cheap arms become
+ * x = c ? a : x, computed with a conditional move.
+ */
+static status cg_if_select(struct state *s, const struct ast_node *n,
+		bool *done) {
+	*done = false;
+	const struct ast_node *st = NULL, *se = NULL;
+	const struct ast_node *ta = single_assign(n->stmt_if.stmt, &st);
+	const struct ast_node *ea = NULL;
+	if (!ta) return S_OK;
+	if (n->stmt_if.stmt_else) {
+		ea = single_assign(n->stmt_if.stmt_else, &se);
+		if (!ea || strcmp(ea->bin.a->ident, ta->bin.a->ident) != 0)
 			return S_OK;
-		}
-	case AST_MEMBER: assert(false); break;
-	case AST_MEMBER_DEREF: assert(false); break;
-	case AST_UNARY:
-		return cg_gen_unary(s, n, res);
-	case AST_COMPOUND_LITERAL: assert(false); break;
-	case AST_SIZEOF_EXPR: ;
-		struct type t = type_from_typename(n->sizeof_expr.type_name);
-		int size;
-		if (type_get_size(&t, &size) == S_ERROR) return S_ERROR;
-		fprintf(s->f, "mov rax, %d\n", size);
-		return val_push_new(s, s->builtin.t_size_t, 0, res);
-	case AST_ALIGNOF_EXPR: assert(false); break;
-	case AST_CAST: assert(false); break;
-	case AST_BIN:
-		return cg_gen_bin(s, n, res);
-	case AST_CONDITIONAL: assert(false); break;
-	default: // TODO: we shouldn't be here
-		break;
 	}
-	return S_ERROR;
+	if (iv_updated(s, st) || (se && iv_updated(s, se))) return S_OK;
+	const struct ast_node *b = ea ? ea->bin.b : ta->bin.a;
+	if (!select_profitable(ta->bin.b, b)) return S_OK;
+	// only a local variable, writing it unconditionally must be harmless
+	const struct decl *decl = scope_lookup(s->scope, ta->bin.a->ident);
+	if (!decl || decl->loc > 0) return S_OK;
+
+	emit_comment(s->code, "if converted to a select");
+	struct type t;
+	val x;
+	if (cg_gen_select(s, n->stmt_if.cond, ta->bin.b, b, &t) == S_ERROR
+			|| find_ident(s->scope, ta->bin.a->ident, &x) == S_ERROR) {
+		return S_ERROR;
+	}
+	if (!val_modifiable_lvalue(&x)) {
+		WARN_MOD_LVALUE(ta);
+		return S_ERROR;
+	}
+	*done = true;
+	if (val_store(s, &x, 0) == S_ERROR) return S_ERROR;
+	cse_kill_ident(s, ta->bin.a->ident);
+	// still known if both values are the same
+	long long va, vb;
+	int size;
+	bool same = known_expr(s, ta->bin.b, &va, &size)
+		&& known_expr(s, b, &vb, &size) && va == vb;
+	known_assign(s, ta->bin.a->ident, same ? ta->bin.b : NULL);
+	return S_OK;
 }
 
-static status cg_gen_declaration(struct state *s, const struct ast_node *n) {
-	FOR_EACH_NODE(n->declaration.init_declarator_list) {
-		const struct ast_node *d = ni->init_declarator.declarator;
-		const char *ident = d->declarator.ident->ident;
-		struct ast_declaration_specifiers *ds = &n->declaration
-			.declaration_specifiers->declaration_specifiers;
-		bool ext = ds->storage_class_specifiers
-			[AST_STORAGE_CLASS_SPECIFIER_EXTERN] > 0;
-		if (ident) {
-			if (ext) {
-				fprintf(s->f, "extern %s\n", ident);
-			}
-			int size = 8;
-			int loc = ext ? 1 : (s->sp -= size);
-			struct decl decl = {
-				.t = { .s = ds, .d = &d->declarator },
-				.size = size,
-				.loc = loc,
-			};
-			hashmap_put(&s->scope->vars, ident, &decl);
+static status cg_gen_tail_call(struct state *s, const struct ast_node *n,
+	bool *done);
 
-			fprintf(s->f, "; alloced `%s` on stack at %d\n",
-				ident, decl.loc);
+static status cg_check_expr(struct state *s, const struct ast_node *n) {
+	struct discard d;
+	discard_begin(s, &d);
+	val v;
+	status st = cg_gen_expr(s, n, &v);
+	discard_end(s, &d);
+	return st;
+}
+static status cg_check_stmt(struct state *s, const struct ast_node *n) {
+	struct discard d;
+	discard_begin(s, &d);
+	status st = cg_gen_stmt(s, n);
+	discard_end(s, &d);
+	return st;
+}
 
-			fprintf(stderr, "info: declared identifier `%s` as `",
-				ident);
-			ast_fprint(stderr, n->declaration.declaration_specifiers, 0);
-			fprintf(stderr, "` `");
-			ast_fprint(stderr, d,  0);
-			fprintf(stderr, "`\n");
+static bool call_noreturn(const struct ast_node *call, void *ud) {
+	struct state *s = ud;
+	if (call->call.a->kind != AST_IDENT) return false;
+	const struct decl *decl = scope_lookup(s->scope, call->call.a->ident);
+	return decl && decl->t.s->function_specifiers
+		[AST_FUNCTION_SPECIFIER_NORETURN] > 0;
+}
+static bool cg_falls_through(struct state *s, const struct ast_node *n) {
+	struct opt_flow flow = {
+		.ce = const_value,
+		.noreturn = call_noreturn,
+		.ud = s,
+	};
+	return opt_stmt_falls_through(n, &flow);
+}
 
-			if (ni->init_declarator.initializer) {
-				val val_init;
-				if (cg_gen_expr(s, ni->init_declarator
-						.initializer, &val_init)
-						== S_ERROR) {
-					return S_ERROR;
-				}
-				val_read(s, &val_init, 0);
-				val val_to;
-				if (find_ident(s->scope, ident, &val_to) == S_ERROR) {
-					return S_ERROR;
-				}
-				val_store(s, &val_to, 0);
-			}
+/* what is left of `x = e` if the local x is never read, which is `e` only
+ * for its side effects */
+static const struct ast_node *cg_dead_store(struct state *s,
+		const struct ast_node *e, bool *error) {
+	if (e->kind != AST_BIN || e->bin.kind != AST_BIN_ASSIGN
+			|| e->bin.a->kind != AST_IDENT
+			|| !opt_names_contain(&s->dead, e->bin.a->ident)) {
+		return e;
+	}
+	// globals of the same name are still visible elsewhere
+	const struct decl *decl = scope_lookup(s->scope, e->bin.a->ident);
+	if (!decl || decl == scope_lookup(file_scope(s), e->bin.a->ident))
+		return e;
+	emit_comment(s->code, "dead store to `%s` removed", e->bin.a->ident);
+	count_changed(s, PASS_DCE);
+	if (cg_check_expr(s, e) == S_ERROR) *error = true;
+	return opt_expr_pure(e->bin.b, &s->functions) ? NULL : e->bin.b;
+}
+
+/* the arms of an if after its condition, what is known after them is what
+ * the arms that fall through agree on */
+static status cg_gen_if_arms(struct state *s, const struct ast_node *n,
+		int label_else, int label_end) {
+	const struct ast_node *arms[] = { n->stmt_if.stmt, n->stmt_if.stmt_else };
+	int cse_mark = s->cse.len;
+	struct vec before = known_copy(&s->known);
+	struct vec after = vec_new_empty(sizeof(struct known));
+	bool reached = false;
+	status st = S_OK;
+	for (int i = 0; i < 2 && st == S_OK; ++i) {
+		if (i == 1) {
+			if (arms[1]) emit1(s->code, EMIT_JMP,
+				emit_o_label(label_end));
+			put_label(s, label_else);
 		}
+		known_restore(&s->known, &before);
+		if (arms[i]) {
+			st = cg_gen_stmt(s, arms[i]);
+			s->cse.len = cse_mark;
+			if (!cg_falls_through(s, arms[i])) continue;
+		}
+		if (reached) known_meet(s, &after);
+		known_restore(&after, &s->known);
+		reached = true;
 	}
-	return S_OK;
+	if (st == S_OK && arms[1]) put_label(s, label_end);
+	known_restore(&s->known, reached ? &after : &before);
+	vec_free(&after);
+	vec_free(&before);
+	return st;
 }
 
-static status cg_gen_stmt_comp(struct state *s, const struct ast_node *n);
+/*
+ * Static branch prediction: an arm of an if that ends in a call to a
+ * _Noreturn function or in an error return is taken to be unlikely. It is
+ * placed out of line, in .text.unlikely after the function, so the branch
+ * to it is not taken and the likely path stays contiguous.
+ */
+static int if_cold_arm(struct state *s, const struct ast_node *n) {
+	if (s->code == &s->cold || cg_discarding(s)) return -1;
+	struct opt_flow flow = {
+		.ce = const_value,
+		.noreturn = call_noreturn,
+		.ud = s,
+	};
+	if (opt_stmt_cold(n->stmt_if.stmt, &flow)) return 0;
+	if (n->stmt_if.stmt_else && opt_stmt_cold(n->stmt_if.stmt_else, &flow))
+		return 1;
+	return -1;
+}
+static status cg_gen_if_cold(struct state *s, const struct ast_node *n,
+		int cold) {
+	const struct ast_node *arms[] = { n->stmt_if.stmt, n->stmt_if.stmt_else };
+	int label_cold = get_label(s);
+	if (cg_gen_branch(s, n->stmt_if.cond, cold == 0, label_cold)
+			== S_ERROR) {
+		return S_ERROR;
+	}
+	int cse_mark = s->cse.len;
+	struct vec before = known_copy(&s->known);
+	status st = S_OK;
+	if (arms[!cold]) {
+		st = cg_gen_stmt(s, arms[!cold]);
+		s->cse.len = cse_mark;
+	}
+	// the unlikely arm never comes back
+	struct vec after = known_copy(&s->known);
+	if (st == S_OK) {
+		emit_comment(s->code, "unlikely arm moved to label_%d",
+			label_cold);
+		s->blocks_cold++;
+		struct emit *code = s->code;
+		s->code = &s->cold;
+		known_restore(&s->known, &before);
+		put_label(s, label_cold);
+		st = cg_gen_stmt(s, arms[cold]);
+		s->cse.len = cse_mark;
+		s->code = code;
+	}
+	known_restore(&s->known, &after);
+	vec_free(&after);
+	vec_free(&before);
+	return st;
+}
 
 static status cg_gen_stmt(struct state *s, const struct ast_node *n) {
 	switch (n->kind) {
 	case AST_STMT_EXPR: ;
 		val ignored_val;
-		return cg_gen_expr(s, n->stmt_expr.a, &ignored_val);
+		const struct ast_node *e = n->stmt_expr.a;
+		if (e && !iv_dropped(s, n)) {
+			if (pass_begin(s->passes, PASS_DCE)) {
+				bool error = false;
+				e = cg_dead_store(s, e, &error);
+				if (!error && e && opt_expr_pure(e, &s->functions)) {
+					emit_comment(s->code,
+						"unused value removed");
+					count_changed(s, PASS_DCE);
+					error = cg_check_expr(s, e) == S_ERROR;
+					e = NULL;
+				}
+				pass_end(s->passes);
+				if (error) return S_ERROR;
+			}
+			if (e && cg_gen_expr(s, e, &ignored_val) == S_ERROR)
+				return S_ERROR;
+		}
+		return iv_advance(s, n);
 	case AST_STMT_WHILE: ;
-		int label_start = get_label(s), label_end = get_label(s);
-		put_label(s, label_start);
-		val val_cond;
-		if (cg_gen_expr(s, n->stmt_while.cond, &val_cond) == S_ERROR) {
+		// The loop is rotated: the condition is tested once up front,
+		// then the preheader runs and the body is entered at least
+		// once, with the condition repeated at the bottom.
+		long long cond_value;
+		if (known_cond(s, n->stmt_while.cond, &cond_value) && !cond_value
+				&& !opt_stmt_has_label(n->stmt_while.stmt)) {
+			emit_comment(s->code, "loop that never runs removed");
+			count_folded(s);
+			count_removed(s);
+			return cg_check_stmt(s, n->stmt_while.stmt);
+		}
+		if (n != s->plain_loop) {
+			bool replaced = false, vectorized = false;
+			if (PASS(s, PASS_MEM_IDIOM, cg_mem_idiom(s, n, &replaced))
+					== S_ERROR) {
+				return S_ERROR;
+			}
+			if (replaced) {
+				count_changed(s, PASS_MEM_IDIOM);
+				return S_OK;
+			}
+			if (PASS(s, PASS_VECTORIZE, cg_vectorize(s, n, &vectorized))
+					== S_ERROR) {
+				return S_ERROR;
+			}
+			if (!vectorized && PASS(s, PASS_UNROLL,
+					cg_unroll(s, n, &replaced)) == S_ERROR) {
+				return S_ERROR;
+			}
+			if (vectorized) count_changed(s, PASS_VECTORIZE);
+			if (!vectorized && replaced) {
+				count_changed(s, PASS_UNROLL);
+				return S_OK;
+			}
+		}
+		int label_body = get_label(s), label_end = get_label(s);
+		int label_next = get_label(s);
+		cse_kill_loop(s, n);
+		int cse_mark = s->cse.len;
+		// the guard still sees the values from before the loop
+		if (cg_gen_branch(s, n->stmt_while.cond, false, label_end)
+				== S_ERROR) {
 			return S_ERROR;
 		}
-		val_read(s, &val_cond, 0);
-		fprintf(s->f, "cmp rax, 0\n");
-		fprintf(s->f, "je label_%d\n", label_end);
-		if (cg_gen_stmt(s, n->stmt_while.stmt) == S_ERROR) {
+		s->cse.len = cse_mark;
+		known_kill_writes(s, n);
+		struct vec known = known_copy(&s->known);
+		int hoisted_mark = s->hoisted.len;
+		int iv_updates_mark = s->iv_updates.len;
+		int iv_dropped_mark = s->iv_dropped.len;
+		struct iv_exit exit = { .ok = false };
+		if (PASS(s, PASS_LICM, cg_hoist_invariants(s, n)) == S_ERROR)
+			return S_ERROR;
+		if (PASS(s, PASS_IV, cg_reduce_ivs(s, n, &exit)) == S_ERROR)
+			return S_ERROR;
+		// what the preheader computed may involve the variables the
+		// body changes
+		s->cse.len = cse_mark;
+		put_label(s, label_body);
+		s->loop_depth++;
+		vec_append(&s->breaks, &label_end);
+		vec_append(&s->continues, &label_next);
+		status st = cg_gen_stmt(s, n->stmt_while.stmt);
+		s->breaks.len--;
+		s->continues.len--;
+		s->cse.len = cse_mark;
+		known_restore(&s->known, &known);
+		vec_free(&known);
+		if (st == S_ERROR) return S_ERROR;
+		put_label(s, label_next);
+		if (exit.ok) {
+			val_read(s, &exit.p, 0);
+			val_read(s, &exit.end, 1);
+			emit2(s->code, EMIT_CMP, r64(EMIT_RAX), r64(EMIT_RBX));
+			emit_jcc(s->code, EMIT_CC_L, label_body);
+		} else if (cg_gen_branch(s, n->stmt_while.cond, true,
+				label_body) == S_ERROR) {
 			return S_ERROR;
 		}
-		fprintf(s->f, "jmp label_%d\n", label_start);
+		s->loop_depth--;
+		s->cse.len = cse_mark;
 		put_label(s, label_end);
+		s->hoisted.len = hoisted_mark;
+		s->iv_updates.len = iv_updates_mark;
+		s->iv_dropped.len = iv_dropped_mark;
 		return S_OK;
 	case AST_STMT_IF: {
-		int label_end = get_label(s);
-		val val_cond;
-		if (cg_gen_expr(s, n->stmt_if.cond, &val_cond) == S_ERROR) {
+		long long cond_value;
+		if (known_cond(s, n->stmt_if.cond, &cond_value)) {
+			const struct ast_node *taken = cond_value
+				? n->stmt_if.stmt : n->stmt_if.stmt_else;
+			const struct ast_node *other = cond_value
+				? n->stmt_if.stmt_else : n->stmt_if.stmt;
+			if (!other || !opt_stmt_has_label(other)) {
+				emit_comment(s->code,
+					"constant condition, branch removed");
+				count_folded(s);
+				if (other) count_removed(s);
+				if (other && cg_check_stmt(s, other) == S_ERROR)
+					return S_ERROR;
+				return taken ? cg_gen_stmt(s, taken) : S_OK;
+			}
+		}
+		bool done = false;
+		if (PASS(s, PASS_SELECT, cg_if_select(s, n, &done)) == S_ERROR)
+			return S_ERROR;
+		if (done) {
+			count_changed(s, PASS_SELECT);
+			return S_OK;
+		}
+		int cold = -1;
+		if (pass_begin(s->passes, PASS_COLD)) {
+			cold = if_cold_arm(s, n);
+			pass_end(s->passes);
+		}
+		if (cold >= 0) {
+			count_changed(s, PASS_COLD);
+			return cg_gen_if_cold(s, n, cold);
+		}
+		int label_else = get_label(s), label_end = get_label(s);
+		if (cg_gen_branch(s, n->stmt_if.cond, false, label_else)
+				== S_ERROR) {
 			return S_ERROR;
 		}
-		val_read(s, &val_cond, 0);
-		fprintf(s->f, "cmp rax, 0\n");
-		fprintf(s->f, "je label_%d\n", label_end);
-		if (cg_gen_stmt(s, n->stmt_if.stmt) == S_ERROR) return S_ERROR;
-		// TODO: else
-		put_label(s, label_end);
-		return S_OK;
+		return cg_gen_if_arms(s, n, label_else, label_end);
 	case AST_STMT_COMP:
 		return cg_gen_stmt_comp(s, n);
 	}
+	case AST_STMT_SWITCH:
+		return cg_gen_switch(s, n);
+	case AST_STMT_LABELED_CASE:
+	case AST_STMT_LABELED_DEFAULT: ;
+		int label = opt_switch_label_get(&s->switch_labels, n);
+		if (label < 0) {
+			fprintf(stderr, "error: case label not within a switch\n");
+			return S_ERROR;
+		}
+		s->cse.len = s->cse_switch;
+		known_restore(&s->known, &s->known_switch);
+		put_label(s, label);
+		return cg_gen_stmt(s, n->kind == AST_STMT_LABELED_CASE
+			? n->stmt_labeled_case.stmt
+			: n->stmt_labeled_default.stmt);
+	case AST_STMT_BREAK:
+	case AST_STMT_CONTINUE: ;
+		struct vec *targets = n->kind == AST_STMT_BREAK
+			? &s->breaks : &s->continues;
+		if (targets->len == 0) {
+			fprintf(stderr, "error: %s outside of a loop\n",
+				n->kind == AST_STMT_BREAK ? "break" : "continue");
+			return S_ERROR;
+		}
+		emit1(s->code, EMIT_JMP, emit_o_label(
+			*(int *)vec_get(targets, targets->len - 1)));
+		return S_OK;
+	case AST_STMT_RETURN: ;
+		bool tail = false;
+		if (PASS(s, PASS_TAIL_CALL, cg_gen_tail_call(s, n, &tail))
+				== S_ERROR) {
+			return S_ERROR;
+		}
+		if (tail) {
+			count_changed(s, PASS_TAIL_CALL);
+			return S_OK;
+		}
+		if (n->stmt_return.expr) {
+			val v;
+			if (cg_gen_expr(s, n->stmt_return.expr, &v) == S_ERROR)
+				return S_ERROR;
+			known_operand(s, n->stmt_return.expr, &v);
+			if (val_read(s, &v, 0) == S_ERROR) return S_ERROR;
+		}
+		// a return that is itself the last statement of the body falls
+		// through to the epilogue, one nested in it doesn't
+		const struct block_pos *b = vec_get(&s->blocks, s->blocks.len - 1);
+		if (s->blocks.len - 1 != s->frame.block
+				|| b->i != b->comp->stmt_comp.len - 1
+				|| GETI(b->comp->stmt_comp, b->i) != n) {
+			emit1(s->code, EMIT_JMP,
+				emit_o_label(s->frame.label_return));
+		}
+		return S_OK;
 	default: ;
 		// TODO: we shouldn't be here
 	}
 	return S_ERROR;
 }
 
+#define IF_CHAIN_MIN 3
+
+/* the length of a chain of if statements that can become a dispatch */
+static int if_chain_len(struct state *s, const struct ast_node *comp, int i) {
+	if (!pass_enabled(s->passes, PASS_IF_CHAIN)) return 0;
+	int len = opt_if_chain(&comp->stmt_comp, i, &s->address_taken,
+		const_value, s);
+	if (len < IF_CHAIN_MIN) return 0;
+	const struct ast_node *x, *value;
+	opt_eq_test(GETI(comp->stmt_comp, i), &x, &value, const_value, s);
+	// a local integer that fits into eax
+	const struct decl *decl = scope_lookup(s->scope, x->ident);
+	int size;
+	if (!decl || decl->loc > 0 || !type_is_arithmetic(&decl->t)
+			|| type_get_size(&decl->t, &size) == S_ERROR
+			|| size == 0 || size > 4) {
+		return 0;
+	}
+	// the tests fold one by one
+	long long v;
+	if (known_get(s, x->ident, &v)) return 0;
+	return len;
+}
+/*
+ * `if (x == a) ...; if (x == b) ...; ...` with x unchanged by the bodies
+ * takes at most one branch, so it is dispatched like a switch.
+ */
+static status cg_gen_if_chain(struct state *s, const struct ast_node *comp,
+		int i, int len) {
+	const struct ast_node *x, *value;
+	opt_eq_test(GETI(comp->stmt_comp, i), &x, &value, const_value, s);
+	emit_comment(s->code, "if chain on `%s`", x->ident);
+	val v;
+	if (find_ident(s->scope, x->ident, &v) == S_ERROR) return S_ERROR;
+	val_read(s, &v, 0);
+
+	int label_end = get_label(s);
+	struct vec cases = vec_new_empty(sizeof(struct dispatch_case));
+	for (int k = i; k < i + len; ++k) {
+		long long c;
+		opt_eq_test(GETI(comp->stmt_comp, k), &x, &value, const_value, s);
+		const_value(value, &c, s);
+		struct dispatch_case dc = { .v = c, .label = get_label(s) };
+		vec_append(&cases, &dc);
+	}
+	// the dispatch sorts the cases, so keep the labels in order
+	struct vec labels = vec_new_empty(sizeof(int));
+	for (int k = 0; k < cases.len; ++k) {
+		vec_append(&labels, &((struct dispatch_case *)
+			vec_get(&cases, k))->label);
+	}
+	status res = cg_dispatch(s, &cases, label_end);
+	for (int k = 0; k < len; ++k) {
+		known_kill_writes(s, GETI(comp->stmt_comp, i + k));
+	}
+	struct vec known = known_copy(&s->known);
+	for (int k = 0; res == S_OK && k < len; ++k) {
+		const struct ast_node *nk = GETI(comp->stmt_comp, i + k);
+		int cse_mark = s->cse.len;
+		put_label(s, *(int *)vec_get(&labels, k));
+		res = cg_gen_stmt(s, nk->stmt_if.stmt);
+		s->cse.len = cse_mark;
+		known_restore(&s->known, &known);
+		if (k < len - 1) emit1(s->code, EMIT_JMP,
+			emit_o_label(label_end));
+	}
+	vec_free(&known);
+	put_label(s, label_end);
+	vec_free(&labels);
+	vec_free(&cases);
+	return res;
+}
+
+/* checks the statements [from, to) of a compound statement without emitting
+ * them, declarations still take effect */
+static status cg_check_stmts(struct state *s, const struct ast_node *comp,
+		int from, int to) {
+	struct discard d;
+	discard_begin(s, &d);
+	status st = S_OK;
+	for (int k = from; k < to && st == S_OK; ++k) {
+		const struct ast_node *nk = GETI(comp->stmt_comp, k);
+		st = nk->kind == AST_DECLARATION
+			? cg_gen_declaration(s, nk) : cg_gen_stmt(s, nk);
+	}
+	discard_end(s, &d);
+	return st;
+}
+
 static status cg_gen_stmt_comp(struct state *s, const struct ast_node *n) {
 	struct scope block_scope = { 0 };
 	hashmap_init(&block_scope.vars, sizeof(struct decl));
@@ -694,11 +3679,20 @@ static status cg_gen_stmt_comp(struct state *s, const struct ast_node *n) {
 	s->scope = &block_scope;
 
 	status res = S_OK;
+	struct block_pos pos = { .comp = n };
+	vec_append(&s->blocks, &pos);
 
 	FOR_EACH_NODE(n->stmt_comp) {
+		struct block_pos *b = vec_get(&s->blocks, s->blocks.len - 1);
+		b->i = i;
 		status st;
+		int chain;
 		if (ni->kind == AST_DECLARATION) {
 			st = cg_gen_declaration(s, ni);
+		} else if ((chain = if_chain_len(s, n, i)) > 0) {
+			st = PASS(s, PASS_IF_CHAIN, cg_gen_if_chain(s, n, i, chain));
+			count_changed(s, PASS_IF_CHAIN);
+			i += chain - 1;
 		} else {
 			st = cg_gen_stmt(s, ni);
 		}
@@ -706,43 +3700,387 @@ static status cg_gen_stmt_comp(struct state *s, const struct ast_node *n) {
 			res = S_ERROR;
 			goto end;
 		}
+		if (ni->kind != AST_DECLARATION
+				&& pass_enabled(s->passes, PASS_DCE)
+				&& !cg_falls_through(s, GETI(n->stmt_comp, i))) {
+			int k = i + 1;
+			while (k < n->stmt_comp.len
+					&& !opt_stmt_has_label(GETI(n->stmt_comp, k))) {
+				k++;
+			}
+			if (k > i + 1) {
+				// nothing jumps into these
+				emit_comment(s->code,
+					"unreachable code removed");
+				count_removed(s);
+				if (cg_check_stmts(s, n, i + 1, k) == S_ERROR) {
+					res = S_ERROR;
+					goto end;
+				}
+				i = k - 1;
+			}
+		}
 	}
 end:
+	s->blocks.len--;
 	hashmap_finish(&s->scope->vars);
 	s->scope = s->scope->parent;
 	return res;
 }
 
+static struct type function_type(const struct ast_node *def) {
+	return (struct type){
+		.s = &def->function_definition.declaration_specifiers
+			->declaration_specifiers,
+		.d = &def->function_definition.declarator->declarator,
+	};
+}
+
+/*
+ * `return f(...);` in a function whose frame nothing points into reuses the
+ * caller's return address: the frame is torn down and f is jumped to. A call
+ * to the function itself jumps back to the start of the body instead, which
+ * turns tail recursion into a loop. Arguments are only passed in registers,
+ * so the callee never needs stack space for them.
+ */
+static status cg_gen_tail_call(struct state *s, const struct ast_node *n,
+		bool *done) {
+	*done = false;
+	const struct ast_node *call = n->stmt_return.expr;
+	if (!call || call->kind != AST_CALL || call->call.a->kind != AST_IDENT
+			|| s->frame.label_entry < 0 || s->frame.escapes
+			|| opt_inline_callee(&s->functions, call)) {
+		return S_OK;
+	}
+	const char *ident = call->call.a->ident;
+	const struct ast_node *def = s->frame.def;
+	bool self = strcmp(ident,
+		def->function_definition.declarator->declarator.ident->ident) == 0
+		&& scope_lookup(s->scope, ident)
+			== scope_lookup(file_scope(s), ident);
+
+	// the result is returned as is, so it must not need a conversion
+	val func_val;
+	if (cg_gen_expr(s, call->call.a, &func_val) == S_ERROR) return S_ERROR;
+	if (!type_apply_call(&func_val.t)) return S_ERROR;
+	struct type t = function_type(def);
+	type_apply_call(&t);
+	int size, f_size;
+	if (type_get_size(&t, &size) == S_ERROR
+			|| type_get_size(&func_val.t, &f_size) == S_ERROR) {
+		return S_ERROR;
+	}
+	if (size != f_size && size > 0) return S_OK;
+
+	emit_comment(s->code, "tail call to `%s`", ident);
+	if (cg_gen_call_args(s, call) == S_ERROR) return S_ERROR;
+	emit2(s->code, EMIT_MOV, r64(EMIT_RSP), r64(EMIT_RBP));
+	if (self) {
+		emit1(s->code, EMIT_JMP, emit_o_label(s->frame.label_entry));
+	} else {
+		emit1(s->code, EMIT_POP, r64(EMIT_RBP));
+		emit1(s->code, EMIT_JMP, emit_o_sym(ident));
+	}
+	*done = true;
+	return S_OK;
+}
+
+/* declares the parameters of `def` in the current scope, initialized from the
+ * argument registers or from `args` */
+static status cg_declare_params(struct state *s, const struct ast_node *def,
+		const struct vec *args /* vec<val> */) {
+	const struct ast_declarator *d =
+		&def->function_definition.declarator->declarator;
+	const struct ast_node *fd = GETI(d->v, 0);
+	const enum emit_reg regs[] = {
+		EMIT_RDI, EMIT_RSI, EMIT_RDX, EMIT_RCX, EMIT_R8, EMIT_R9,
+	};
+	if (fd->function_declarator.parameter_type_list.len == 0) return S_OK;
+	FOR_EACH_NODE(fd->function_declarator.parameter_type_list) {
+		const struct ast_node *pd = ni->parameter_declaration.declarator;
+		if (!pd || !pd->declarator.ident) continue;
+		if (i >= (int)(sizeof(regs) / sizeof(regs[0]))) {
+			fprintf(stderr, "error: only 6 parameters are supported\n");
+			return S_ERROR;
+		}
+		s->sp -= 8;
+		struct decl decl = {
+			.t = { .s = &ni->parameter_declaration.declaration_specifiers
+				->declaration_specifiers, .d = &pd->declarator },
+			.size = 8,
+			.loc = s->sp,
+		};
+		hashmap_put(&s->scope->vars, pd->declarator.ident->ident, &decl);
+		if (args) {
+			const val *arg = vec_get_c(args, i);
+			if (val_read(s, arg, 0) == S_ERROR) return S_ERROR;
+			emit2(s->code, EMIT_MOV, slot(8, decl.loc),
+				r64(EMIT_RAX));
+			if (arg->imm && arg->deref_n == 0) {
+				known_put(s, pd->declarator.ident->ident, arg->s);
+			}
+		} else {
+			emit2(s->code, EMIT_MOV, slot(8, decl.loc),
+				r64(regs[i]));
+		}
+	}
+	return S_OK;
+}
+
+static void alias_declare(struct vec *vars, const char *ident,
+		struct type t) {
+	for (int i = 0; i < vars->len; ++i) {
+		struct alias_var *v = vec_get(vars, i);
+		if (strcmp(v->ident, ident) == 0) {
+			v->decls++;
+			return;
+		}
+	}
+	vec_append(vars, &(struct alias_var){ .ident = ident, .t = t, .decls = 1 });
+}
+static bool visit_alias_decls(const struct ast_node *n, void *ud) {
+	if (n->kind != AST_DECLARATION) return true;
+	FOR_EACH_NODE(n->declaration.init_declarator_list) {
+		const struct ast_node *d = ni->init_declarator.declarator;
+		if (!d->declarator.ident) continue;
+		struct type t = { .s = &n->declaration.declaration_specifiers
+			->declaration_specifiers, .d = &d->declarator };
+		alias_declare(ud, d->declarator.ident->ident, t);
+	}
+	return true;
+}
+/* the names of `def` and which of them reach memory nothing else does */
+static void alias_analyze(struct state *s, const struct ast_node *def,
+		struct vec *res) {
+	const struct ast_declarator *d =
+		&def->function_definition.declarator->declarator;
+	const struct ast_node *fd = GETI(d->v, 0);
+	if (fd->function_declarator.parameter_type_list.len > 0) {
+		FOR_EACH_NODE(fd->function_declarator.parameter_type_list) {
+			const struct ast_node *pd = ni->parameter_declaration.declarator;
+			if (!pd || !pd->declarator.ident) continue;
+			struct type t = { .s = &ni->parameter_declaration
+				.declaration_specifiers->declaration_specifiers,
+				.d = &pd->declarator };
+			alias_declare(res, pd->declarator.ident->ident, t);
+		}
+	}
+	ast_walk(def->function_definition.compound_statement,
+		visit_alias_decls, res);
+	struct scope *file = file_scope(s);
+	for (int i = 0; i < res->len; ++i) {
+		struct alias_var *v = vec_get(res, i);
+		// a global of the same name may be used before the declaration
+		if (scope_lookup(file, v->ident)) v->decls++;
+		bool restrict_ptr = type_is_pointer(&v->t)
+			&& (GETI(v->t.d->v, 0))->pointer_declarator
+				.type_qualifiers[AST_TYPE_QUALIFIER_RESTRICT] > 0;
+		v->unique = v->decls == 1 && (restrict_ptr || type_is_array(&v->t))
+			&& !opt_names_contain(&s->address_taken, v->ident)
+			&& opt_ident_count(def, v->ident)
+				== opt_base_count(def, v->ident);
+	}
+}
+
+/* an analysis of `def`, computed once and then taken from the cache, the
+ * analyses of passes that are off find nothing */
+static struct vec function_analysis(struct state *s, enum pass_analysis a,
+		const struct ast_node *def) {
+	const struct vec *cached = pass_cached(s->passes, a, def);
+	if (cached) return *cached;
+	struct vec res;
+	pass_analysis_begin(s->passes, a);
+	switch (a) {
+	case PASS_A_ADDRESS_TAKEN:
+		res = vec_new_empty(sizeof(const char *));
+		opt_address_taken(def, &res);
+		break;
+	case PASS_A_ALIAS:
+		// reads the names whose address def takes
+		res = vec_new_empty(sizeof(struct alias_var));
+		if (pass_enabled(s->passes, PASS_ALIAS))
+			alias_analyze(s, def, &res);
+		break;
+	case PASS_A_DEAD_LOCALS:
+		res = vec_new_empty(sizeof(const char *));
+		if (pass_enabled(s->passes, PASS_DCE)) opt_dead_locals(def, &res);
+		break;
+	default:
+		assert(false);
+	}
+	pass_end(s->passes);
+	return *pass_cache(s->passes, a, def, res);
+}
+
+/* generates the body of `def` with its return value left in rax */
+static status cg_gen_body(struct state *s, const struct ast_node *def,
+		const struct vec *args) {
+	struct scope *scope = s->scope;
+	struct scope params = { .parent = file_scope(s) };
+	hashmap_init(&params.vars, sizeof(struct decl));
+	s->scope = &params;
+	struct vec address_taken = s->address_taken;
+	s->address_taken = function_analysis(s, PASS_A_ADDRESS_TAKEN, def);
+	struct vec alias_vars = s->alias_vars;
+	s->alias_vars = function_analysis(s, PASS_A_ALIAS, def);
+	struct vec dead = s->dead;
+	s->dead = function_analysis(s, PASS_A_DEAD_LOCALS, def);
+	struct frame frame = s->frame;
+	s->frame = (struct frame){
+		.def = def,
+		.label_return = get_label(s),
+		.label_entry = args ? -1 : get_label(s),
+		.block = s->blocks.len,
+		.escapes = opt_frame_escapes(def),
+	};
+
+	const struct ast_node *body = def->function_definition.compound_statement;
+	if (!args) put_label(s, s->frame.label_entry);
+	status st = cg_declare_params(s, def, args);
+	if (st == S_OK) st = cg_gen_stmt_comp(s, body);
+	if (st == S_OK) {
+		if (cg_falls_through(s, body)) emit2(s->code, EMIT_MOV,
+			r64(EMIT_RAX), imm(0));
+		put_label(s, s->frame.label_return);
+	}
+
+	s->frame = frame;
+	s->dead = dead;
+	s->alias_vars = alias_vars;
+	s->address_taken = address_taken;
+	hashmap_finish(&params.vars);
+	s->scope = scope;
+	return st;
+}
+
+static status cg_gen_inline(struct state *s, const struct ast_node *n,
+		const struct opt_function *f, val *res) {
+	struct vec args = vec_new_empty(sizeof(val));
+	status st = S_OK;
+	for (int i = 0; i < n->call.args.len && st == S_OK; ++i) {
+		val v;
+		st = cg_gen_expr(s, GETI(n->call.args, i), &v);
+		known_operand(s, GETI(n->call.args, i), &v);
+		vec_append(&args, &v);
+	}
+	if (st == S_OK) {
+		emit_comment(s->code, "inlined call to `%s`", f->ident);
+		count_changed(s, PASS_INLINE);
+		// the body has its own names
+		struct vec cse = s->cse;
+		s->cse = vec_new_empty(sizeof(struct cse));
+		st = cg_gen_body(s, f->def, &args);
+		vec_free(&s->cse);
+		s->cse = cse;
+		if (opt_call_effects(&s->functions, n) == OPT_SIDE_EFFECTS)
+			cse_kill_memory(s);
+	}
+	vec_free(&args);
+	if (st == S_ERROR) return S_ERROR;
+
+	struct type t = function_type(f->def);
+	type_apply_call(&t);
+	int size;
+	if (type_get_size(&t, &size) == S_ERROR) return S_ERROR;
+	if (size > 0) return val_push_new(s, t, 0, res);
+	*res = (val){ .s = 1, .t = t };
+	return S_OK;
+}
+
 static status cg_gen_function_definition(struct state *s,
 		const struct ast_node *n) {
 	const struct ast_declarator *d = &n->function_definition.declarator->declarator;
 	const char *ident = d->ident->ident;
+	const struct opt_function *f = opt_function_get(&s->functions, ident);
 
-	fprintf(s->f, "%s:\n", ident);
-	fprintf(s->f, "push rbp\n");
-	fprintf(s->f, "mov rbp, rsp\n");
-	if (cg_gen_stmt_comp(s, n->function_definition.compound_statement)
-			== S_ERROR) {
-		return S_ERROR;
+	struct scope *file_scope = s->scope;
+	struct decl decl = {
+		.t = { .s = &n->function_definition.declaration_specifiers
+			->declaration_specifiers, .d = d },
+		.size = 8,
+		.loc = 1,
+	};
+	hashmap_put(&file_scope->vars, ident, &decl);
+	pass_invalidate(s->passes, PASS_A_ALIAS);
+	if (!f->emit) {
+		emit_comment(s->code, "`%s` is not referenced after inlining",
+			ident);
+		emit0(s->code, EMIT_BLANK);
+		fprintf(stderr, "info: removed unreferenced function `%s`\n",
+			ident);
+		return S_OK;
+	}
+
+	emit1(s->code, EMIT_LABEL, emit_o_sym(ident));
+	emit1(s->code, EMIT_PUSH, r64(EMIT_RBP));
+	emit2(s->code, EMIT_MOV, r64(EMIT_RBP), r64(EMIT_RSP));
+	s->cse.len = 0;
+	s->known.len = 0;
+	s->branches_folded = s->blocks_removed = s->blocks_cold = 0;
+	status st = cg_gen_body(s, n, NULL);
+	if (st == S_OK && (s->branches_folded || s->blocks_removed)) {
+		fprintf(stderr, "info: `%s`: %d branches folded, "
+			"%d blocks removed\n", ident,
+			s->branches_folded, s->blocks_removed);
+	}
+	if (st == S_OK && s->blocks_cold) {
+		fprintf(stderr, "info: `%s`: %d unlikely blocks moved out of line\n",
+			ident, s->blocks_cold);
+	}
+	if (st == S_OK) {
+		emit2(s->code, EMIT_MOV, r64(EMIT_RSP), r64(EMIT_RBP));
+		emit1(s->code, EMIT_POP, r64(EMIT_RBP));
+		emit0(s->code, EMIT_RET);
+	}
+	if (st == S_OK && s->cold.ins.len > 0) {
+		emit1(s->code, EMIT_SECTION, emit_o_sym(".text.unlikely"));
+		emit_append(s->code, &s->cold);
+		emit1(s->code, EMIT_SECTION, emit_o_sym(".text"));
+	}
+	emit_reset(&s->cold);
+	if (st == S_OK) emit0(s->code, EMIT_BLANK);
+	return st;
+}
+
+/* undoes the decisions of the analysis of the functions that belong to
+ * passes that are off */
+static void functions_apply_passes(struct state *s) {
+	for (int i = 0; i < s->functions.len; ++i) {
+		struct opt_function *f = vec_get(&s->functions, i);
+		if (!pass_enabled(s->passes, PASS_INLINE)) {
+			f->inline_ = false;
+			f->emit = true;
+		}
+		if (!pass_enabled(s->passes, PASS_PURE)) {
+			f->effects = OPT_SIDE_EFFECTS;
+		} else if (f->effects != OPT_SIDE_EFFECTS) {
+			pass_changed(s->passes, PASS_PURE);
+		}
 	}
-	fprintf(s->f, "mov rsp, rbp\n");
-	fprintf(s->f, "pop rbp\n");
-	fprintf(s->f, "mov rax, 0\n");
-	fprintf(s->f, "ret\n");
-	fprintf(s->f, "\n");
-	return S_OK;
 }
 
-int cg_gen(const struct ast_node *n) {
+int cg_gen(const struct ast_node *n, const struct cg_options *opts,
+		struct emit *out) {
 	struct state _s;
 	struct state *s = &_s;
 	state_init(s);
+	s->code = out;
+	s->avx2 = opts->avx2;
+	s->unroll = opts->unroll;
+	s->passes = opts->passes;
 
 	struct scope file_scope = { 0 };
 	hashmap_init(&file_scope.vars, sizeof(struct decl));
 	s->scope = &file_scope;
 
-	fprintf(s->f, "global main\n");
+	emit1(s->code, EMIT_GLOBAL, emit_o_sym("main"));
+
+	if (n->kind == AST_TRANSLATION_UNIT) {
+		pass_analysis_begin(s->passes, PASS_A_FUNCTIONS);
+		opt_functions(n, &s->functions);
+		pass_end(s->passes);
+		functions_apply_passes(s);
+	}
 
 	if (n->kind == AST_TRANSLATION_UNIT) {
 		for (int i = 0; i < n->translation_unit.len; ++i) {
@@ -760,11 +4098,29 @@ int cg_gen(const struct ast_node *n) {
 		}
 	}
 
-	fprintf(s->f, "section .rodata\n");
+	for (int i = 0; i < s->libc.len; ++i) {
+		const char * const *li = vec_get_c(&s->libc, i);
+		if (!scope_lookup(&file_scope, *li)) {
+			emit1(s->code, EMIT_EXTERN, emit_o_sym(*li));
+		}
+	}
+	emit1(s->code, EMIT_SECTION, emit_o_sym(".rodata"));
 	for (int i = 0; i < s->strings.len; ++i) {
 		const char * const *si = vec_get_c(&s->strings, i);
-		fprintf(s->f, "s%d: db %s, 0\n", i, *si);
+		emit2(s->code, EMIT_DB, emit_o_string(i), emit_o_sym(*si));
+	}
+	for (int i = 0; i < s->tables.len; ++i) {
+		struct vec *ti = vec_get(&s->tables, i);
+		emit1(s->code, EMIT_LABEL, emit_o_table(i));
+		for (int k = 0; k < ti->len; ++k) {
+			emit1(s->code, EMIT_DQ, emit_o_label(*(int *)vec_get(ti,
+				k)));
+		}
+		vec_free(ti);
 	}
+	opt_functions_free(&s->functions);
+	emit_free(&s->null);
+	emit_free(&s->cold);
 
 	return 0;
 }
@@ -0,0 +1,195 @@
+// SPDX-License-Identifier: GPL-3.0-only
+#include <c_compiler/elf.h>
+#include <elf.h>
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+
+enum {
+	SEC_NULL,
+	SEC_CODE, /* the sections of the code, in the order of x86_section */
+	SEC_RELA = SEC_CODE + X86_SECTION_N,
+	SEC_SYMTAB = SEC_RELA + X86_SECTION_N,
+	SEC_STRTAB,
+	SEC_SHSTRTAB,
+	SEC_NOTE_STACK,
+	SEC_N,
+};
+/* the section symbols come first, one for each section of the code */
+#define SYM_SECTION(i) (1 + (int)(i))
+
+static const char *code_names[X86_SECTION_N] = {
+	[X86_TEXT] = ".text",
+	[X86_TEXT_UNLIKELY] = ".text.unlikely",
+	[X86_RODATA] = ".rodata",
+};
+
+static int put(struct vec *v, const void *p, size_t n) {
+	int at = v->len;
+	for (size_t i = 0; i < n; ++i) vec_append(v, (const char *)p + i);
+	return at;
+}
+static int put_str(struct vec *v, const char *s) {
+	return put(v, s, strlen(s) + 1);
+}
+static int align(struct vec *v, int a) {
+	while (v->len % a) vec_append(v, &(char){ 0 });
+	return v->len;
+}
+
+static bool write_all(int fd, const char *p, size_t n) {
+	while (n > 0) {
+		ssize_t k = write(fd, p, n);
+		if (k < 0 && errno == EINTR) continue;
+		if (k <= 0) return false;
+		p += k;
+		n -= k;
+	}
+	return true;
+}
+
+bool elf_write(const struct x86_code *c, int fd) {
+	struct vec f = vec_new_empty(sizeof(char));
+	struct vec strtab = vec_new_empty(sizeof(char));
+	struct vec shstrtab = vec_new_empty(sizeof(char));
+	struct vec symtab = vec_new_empty(sizeof(Elf64_Sym));
+	struct vec index = vec_new_empty(sizeof(int)); /* of the symbols */
+	Elf64_Shdr sh[SEC_N] = { 0 };
+	put(&strtab, "", 1);
+	put(&shstrtab, "", 1);
+
+	// the locals first, as the format wants it
+	vec_append(&symtab, &(Elf64_Sym){ 0 });
+	for (int i = 0; i < X86_SECTION_N; ++i) {
+		vec_append(&symtab, &(Elf64_Sym){
+			.st_info = ELF64_ST_INFO(STB_LOCAL, STT_SECTION),
+			.st_shndx = SEC_CODE + i });
+	}
+	for (int i = 0; i < c->symbols.len; ++i)
+		vec_append(&index, &(int){ 0 });
+	int first_global = 0;
+	for (int global = 0; global < 2; ++global) {
+		if (global) first_global = symtab.len;
+		for (int i = 0; i < c->symbols.len; ++i) {
+			const struct x86_symbol *s = vec_get_c(&c->symbols, i);
+			if (s->global != global) continue;
+			bool undef = s->section == X86_UNDEFINED;
+			int bind = global ? STB_GLOBAL : STB_LOCAL;
+			*(int *)vec_get(&index, i) = symtab.len;
+			vec_append(&symtab, &(Elf64_Sym){
+				.st_name = put_str(&strtab, s->name),
+				.st_info = ELF64_ST_INFO(bind,
+					undef ? STT_NOTYPE : STT_FUNC),
+				.st_shndx = undef ? SHN_UNDEF
+					: SEC_CODE + s->section,
+				.st_value = undef ? 0 : s->offset,
+				.st_size = undef ? 0 : s->size,
+			});
+		}
+	}
+
+	put(&f, &(Elf64_Ehdr){ 0 }, sizeof(Elf64_Ehdr));
+	for (int i = 0; i < X86_SECTION_N; ++i) {
+		const struct vec *code = &c->section[i];
+		bool text = i != X86_RODATA;
+		int at = align(&f, text ? 16 : 8);
+		if (code->len) put(&f, vec_get_c(code, 0), code->len);
+		sh[SEC_CODE + i] = (Elf64_Shdr){
+			.sh_name = put_str(&shstrtab, code_names[i]),
+			.sh_type = SHT_PROGBITS,
+			.sh_flags = SHF_ALLOC | (text ? SHF_EXECINSTR : 0),
+			.sh_offset = at,
+			.sh_size = code->len,
+			.sh_addralign = text ? 16 : 8,
+		};
+	}
+	for (int i = 0; i < X86_SECTION_N; ++i) {
+		char name[32] = ".rela";
+		strcat(name, code_names[i]);
+		int at = align(&f, 8);
+		for (int k = 0; k < c->relocs.len; ++k) {
+			const struct x86_reloc *r = vec_get_c(&c->relocs, k);
+			if (r->section != (enum x86_section)i) continue;
+			static const int types[] = {
+				[X86_R_64] = R_X86_64_64,
+				[X86_R_PC32] = R_X86_64_PC32,
+				[X86_R_PLT32] = R_X86_64_PLT32,
+			};
+			int sym = r->sym < 0 ? SYM_SECTION(r->target)
+				: *(int *)vec_get_c(&index, r->sym);
+			put(&f, &(Elf64_Rela){
+				.r_offset = r->offset,
+				.r_info = ELF64_R_INFO(sym, types[r->kind]),
+				.r_addend = r->addend,
+			}, sizeof(Elf64_Rela));
+		}
+		sh[SEC_RELA + i] = (Elf64_Shdr){
+			.sh_name = put_str(&shstrtab, name),
+			.sh_type = SHT_RELA,
+			.sh_flags = SHF_INFO_LINK,
+			.sh_offset = at,
+			.sh_size = f.len - at,
+			.sh_link = SEC_SYMTAB,
+			.sh_info = SEC_CODE + i,
+			.sh_addralign = 8,
+			.sh_entsize = sizeof(Elf64_Rela),
+		};
+	}
+	int at = align(&f, 8);
+	put(&f, vec_get_c(&symtab, 0), symtab.len * sizeof(Elf64_Sym));
+	sh[SEC_SYMTAB] = (Elf64_Shdr){
+		.sh_name = put_str(&shstrtab, ".symtab"),
+		.sh_type = SHT_SYMTAB,
+		.sh_offset = at,
+		.sh_size = symtab.len * sizeof(Elf64_Sym),
+		.sh_link = SEC_STRTAB,
+		.sh_info = first_global,
+		.sh_addralign = 8,
+		.sh_entsize = sizeof(Elf64_Sym),
+	};
+	sh[SEC_STRTAB] = (Elf64_Shdr){
+		.sh_name = put_str(&shstrtab, ".strtab"),
+		.sh_type = SHT_STRTAB,
+		.sh_offset = put(&f, vec_get_c(&strtab, 0), strtab.len),
+		.sh_size = strtab.len,
+		.sh_addralign = 1,
+	};
+	// no executable stack
+	sh[SEC_NOTE_STACK] = (Elf64_Shdr){
+		.sh_name = put_str(&shstrtab, ".note.GNU-stack"),
+		.sh_type = SHT_PROGBITS,
+		.sh_offset = f.len,
+		.sh_addralign = 1,
+	};
+	sh[SEC_SHSTRTAB] = (Elf64_Shdr){
+		.sh_name = put_str(&shstrtab, ".shstrtab"),
+		.sh_type = SHT_STRTAB,
+		.sh_size = shstrtab.len,
+		.sh_addralign = 1,
+	};
+	sh[SEC_SHSTRTAB].sh_offset = put(&f, vec_get_c(&shstrtab, 0),
+		shstrtab.len);
+	int shoff = align(&f, 8);
+	put(&f, sh, sizeof(sh));
+
+	Elf64_Ehdr *h = vec_get(&f, 0);
+	*h = (Elf64_Ehdr){
+		.e_ident = { ELFMAG0, ELFMAG1, ELFMAG2, ELFMAG3, ELFCLASS64,
+			ELFDATA2LSB, EV_CURRENT, ELFOSABI_SYSV },
+		.e_type = ET_REL,
+		.e_machine = EM_X86_64,
+		.e_version = EV_CURRENT,
+		.e_shoff = shoff,
+		.e_ehsize = sizeof(Elf64_Ehdr),
+		.e_shentsize = sizeof(Elf64_Shdr),
+		.e_shnum = SEC_N,
+		.e_shstrndx = SEC_SHSTRTAB,
+	};
+	bool ok = write_all(fd, vec_get_c(&f, 0), f.len);
+	vec_free(&index);
+	vec_free(&symtab);
+	vec_free(&shstrtab);
+	vec_free(&strtab);
+	vec_free(&f);
+	return ok;
+}
@@ -0,0 +1,340 @@
+// SPDX-License-Identifier: GPL-3.0-only
+#include <c_compiler/emit.h>
+#include <c_compiler/ast.h>
+#include <errno.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+static const char *names[EMIT_OP_N] = {
+	[EMIT_MOV] = "mov", [EMIT_MOVZX] = "movzx", [EMIT_LEA] = "lea",
+	[EMIT_ADD] = "add", [EMIT_SUB] = "sub", [EMIT_IMUL] = "imul",
+	[EMIT_AND] = "and", [EMIT_XOR] = "xor", [EMIT_NOT] = "not",
+	[EMIT_NEG] = "neg", [EMIT_INC] = "inc", [EMIT_DEC] = "dec",
+	[EMIT_SHL] = "shl", [EMIT_SHR] = "shr", [EMIT_SAR] = "sar",
+	[EMIT_CMP] = "cmp", [EMIT_MUL] = "mul", [EMIT_DIV] = "div",
+	[EMIT_IDIV] = "idiv", [EMIT_CDQ] = "cdq", [EMIT_JMP] = "jmp",
+	[EMIT_JCC] = "j", [EMIT_SETCC] = "set", [EMIT_CMOVCC] = "cmov",
+	[EMIT_CALL] = "call", [EMIT_RET] = "ret", [EMIT_PUSH] = "push",
+	[EMIT_POP] = "pop", [EMIT_REP_MOVSB] = "rep movsb",
+	[EMIT_REP_STOSB] = "rep stosb", [EMIT_REP_STOSD] = "rep stosd",
+	[EMIT_MOVD] = "movd", [EMIT_MOVDQU] = "movdqu",
+	[EMIT_MOVDQA] = "movdqa", [EMIT_PADDB] = "paddb",
+	[EMIT_PADDD] = "paddd", [EMIT_PSUBB] = "psubb",
+	[EMIT_PSUBD] = "psubd", [EMIT_PSHUFD] = "pshufd",
+	[EMIT_VMOVD] = "vmovd", [EMIT_VMOVDQU] = "vmovdqu",
+	[EMIT_VPADDB] = "vpaddb", [EMIT_VPADDD] = "vpaddd",
+	[EMIT_VPSUBB] = "vpsubb", [EMIT_VPSUBD] = "vpsubd",
+	[EMIT_VPBROADCASTD] = "vpbroadcastd",
+	[EMIT_VZEROUPPER] = "vzeroupper",
+	[EMIT_SECTION] = "section", [EMIT_GLOBAL] = "global",
+	[EMIT_EXTERN] = "extern", [EMIT_DQ] = "dq",
+};
+static const char *cc_names[16] = {
+	[EMIT_CC_B] = "b", [EMIT_CC_AE] = "ae", [EMIT_CC_E] = "e",
+	[EMIT_CC_NE] = "ne", [EMIT_CC_BE] = "be", [EMIT_CC_A] = "a",
+	[EMIT_CC_L] = "l", [EMIT_CC_GE] = "ge", [EMIT_CC_LE] = "le",
+	[EMIT_CC_G] = "g",
+};
+static const char *regs[4][16] = {
+	{ "al", "cl", "dl", "bl", "spl", "bpl", "sil", "dil",
+	  "r8b", "r9b", "r10b", "r11b", "r12b", "r13b", "r14b", "r15b" },
+	{ "ax", "cx", "dx", "bx", "sp", "bp", "si", "di",
+	  "r8w", "r9w", "r10w", "r11w", "r12w", "r13w", "r14w", "r15w" },
+	{ "eax", "ecx", "edx", "ebx", "esp", "ebp", "esi", "edi",
+	  "r8d", "r9d", "r10d", "r11d", "r12d", "r13d", "r14d", "r15d" },
+	{ "rax", "rcx", "rdx", "rbx", "rsp", "rbp", "rsi", "rdi",
+	  "r8", "r9", "r10", "r11", "r12", "r13", "r14", "r15" },
+};
+
+struct emit_operand emit_o_reg(enum emit_reg r, int size) {
+	return (struct emit_operand){ .kind = EMIT_O_REG, .size = size,
+		.reg = r, .index = -1 };
+}
+struct emit_operand emit_o_imm(long long x) {
+	return (struct emit_operand){ .kind = EMIT_O_IMM, .reg = -1,
+		.index = -1, .x = x };
+}
+struct emit_operand emit_o_mem(int size, int base, int index, int scale,
+		long long disp) {
+	return (struct emit_operand){ .kind = EMIT_O_MEM, .size = size,
+		.reg = base, .index = index, .scale = scale, .x = disp };
+}
+struct emit_operand emit_o_label(int label) {
+	return (struct emit_operand){ .kind = EMIT_O_LABEL, .reg = -1,
+		.index = -1, .x = label };
+}
+struct emit_operand emit_o_sym(const char *sym) {
+	return (struct emit_operand){ .kind = EMIT_O_SYM, .reg = -1,
+		.index = -1, .sym = sym };
+}
+struct emit_operand emit_o_string(int i) {
+	return (struct emit_operand){ .kind = EMIT_O_STRING, .reg = -1,
+		.index = -1, .x = i };
+}
+struct emit_operand emit_o_table(int i) {
+	return (struct emit_operand){ .kind = EMIT_O_TABLE, .reg = -1,
+		.index = -1, .x = i };
+}
+
+const char *emit_op_name(enum emit_op op) {
+	return names[op];
+}
+
+void emit_init(struct emit *e) {
+	*e = (struct emit){
+		.ins = vec_new_empty(sizeof(struct emit_ins)),
+		.text = vec_new_empty(sizeof(char)),
+	};
+}
+void emit_free(struct emit *e) {
+	vec_free(&e->ins);
+	vec_free(&e->text);
+}
+void emit_reset(struct emit *e) {
+	e->ins.len = 0;
+	e->text.len = 0;
+}
+
+void emit_ins(struct emit *e, enum emit_op op, int cc, int n,
+		const struct emit_operand *o) {
+	if (e->discard) return;
+	struct emit_ins x = { .op = op, .cc = cc, .n = n };
+	for (int i = 0; i < n; ++i) x.o[i] = o[i];
+	vec_append(&e->ins, &x);
+}
+void emit0(struct emit *e, enum emit_op op) {
+	emit_ins(e, op, 0, 0, NULL);
+}
+void emit1(struct emit *e, enum emit_op op, struct emit_operand a) {
+	emit_ins(e, op, 0, 1, &a);
+}
+void emit2(struct emit *e, enum emit_op op, struct emit_operand a,
+		struct emit_operand b) {
+	emit_ins(e, op, 0, 2, (struct emit_operand[]){ a, b });
+}
+void emit3(struct emit *e, enum emit_op op, struct emit_operand a,
+		struct emit_operand b, struct emit_operand c) {
+	emit_ins(e, op, 0, 3, (struct emit_operand[]){ a, b, c });
+}
+void emit_jcc(struct emit *e, enum emit_cc cc, int label) {
+	emit_ins(e, EMIT_JCC, cc, 1, (struct emit_operand[]){
+		emit_o_label(label) });
+}
+void emit_setcc(struct emit *e, enum emit_cc cc, struct emit_operand a) {
+	emit_ins(e, EMIT_SETCC, cc, 1, &a);
+}
+void emit_cmovcc(struct emit *e, enum emit_cc cc, struct emit_operand a,
+		struct emit_operand b) {
+	emit_ins(e, EMIT_CMOVCC, cc, 2, (struct emit_operand[]){ a, b });
+}
+void emit_label(struct emit *e, int label) {
+	emit1(e, EMIT_LABEL, emit_o_label(label));
+}
+
+static long long text_add(struct emit *e, const char *s) {
+	long long at = e->text.len;
+	do {
+		vec_append(&e->text, s);
+	} while (*s++);
+	return at;
+}
+void emit_comment(struct emit *e, const char *fmt, ...) {
+	if (e->discard) return;
+	char buf[256];
+	char *text = buf;
+	va_list ap;
+	va_start(ap, fmt);
+	int len = vsnprintf(buf, sizeof(buf), fmt, ap);
+	va_end(ap);
+	if (len >= (int)sizeof(buf)) {
+		text = malloc(len + 1);
+		if (!text) return;
+		va_start(ap, fmt);
+		vsnprintf(text, len + 1, fmt, ap);
+		va_end(ap);
+	}
+	struct emit_operand o = { .kind = EMIT_O_IMM, .x = text_add(e, text) };
+	emit_ins(e, EMIT_COMMENT, 0, 1, &o);
+	if (text != buf) free(text);
+}
+void emit_append(struct emit *e, struct emit *src) {
+	for (int i = 0; i < src->ins.len; ++i) {
+		struct emit_ins x = *(struct emit_ins *)vec_get(&src->ins, i);
+		if (x.op == EMIT_COMMENT) x.o[0].x = text_add(e, emit_text(src, &x));
+		emit_ins(e, x.op, x.cc, x.n, x.o);
+	}
+	emit_reset(src);
+}
+const char *emit_text(const struct emit *e, const struct emit_ins *x) {
+	return vec_get_c(&e->text, x->o[0].x);
+}
+
+/*
+ * Serialization, into a buffer that is written out when it is full.
+ */
+struct out {
+	int fd;
+	bool ok;
+	int len;
+	char buf[1 << 16];
+};
+static void flush(struct out *o) {
+	int done = 0;
+	while (o->ok && done < o->len) {
+		ssize_t n = write(o->fd, o->buf + done, o->len - done);
+		if (n < 0 && errno != EINTR) o->ok = false;
+		if (n > 0) done += n;
+	}
+	o->len = 0;
+}
+static void put(struct out *o, const char *s, size_t n) {
+	while (n > 0) {
+		if (o->len == sizeof(o->buf)) flush(o);
+		size_t k = sizeof(o->buf) - o->len;
+		if (k > n) k = n;
+		memcpy(o->buf + o->len, s, k);
+		o->len += k;
+		s += k;
+		n -= k;
+	}
+}
+static void put_str(struct out *o, const char *s) {
+	put(o, s, strlen(s));
+}
+static void put_int(struct out *o, long long x) {
+	char buf[24];
+	int i = sizeof(buf);
+	// the magnitude as unsigned, so the most negative number works too
+	unsigned long long u = x < 0 ? -(unsigned long long)x
+		: (unsigned long long)x;
+	do {
+		buf[--i] = '0' + u % 10;
+		u /= 10;
+	} while (u);
+	if (x < 0) buf[--i] = '-';
+	put(o, buf + i, sizeof(buf) - i);
+}
+/* the bytes of a string literal and its nul, as nasm doesn't decode escapes
+ * the printable ones are quoted and the others written as numbers */
+static void put_bytes(struct out *o, const char *src) {
+	char *b = malloc(strlen(src));
+	int n = ast_string_bytes(src, b);
+	bool quoted = false;
+	for (int i = 0; i <= n; ++i) {
+		unsigned char ch = b[i];
+		if (i < n && ch >= ' ' && ch <= '~' && ch != '"' && ch != '\\') {
+			if (!quoted) {
+				if (i > 0) put(o, ", ", 2);
+				put(o, "\"", 1);
+				quoted = true;
+			}
+			put(o, (const char *)&ch, 1);
+			continue;
+		}
+		if (quoted) put(o, "\"", 1);
+		quoted = false;
+		if (i > 0) put(o, ", ", 2);
+		put_int(o, ch);
+	}
+	free(b);
+}
+static void put_reg(struct out *o, int reg, int size) {
+	if (size >= 16) {
+		put_str(o, size == 16 ? "xmm" : "ymm");
+		put_int(o, reg);
+		return;
+	}
+	put_str(o, regs[size == 1 ? 0 : size == 2 ? 1 : size == 4 ? 2 : 3][reg]);
+}
+static void put_operand(struct out *o, const struct emit_operand *x) {
+	static const char *sizes[] = {
+		[1] = "byte ", [2] = "word ", [4] = "dword ", [8] = "qword ",
+	};
+	switch (x->kind) {
+	case EMIT_O_REG:
+		put_reg(o, x->reg, x->size);
+		break;
+	case EMIT_O_IMM:
+		put_int(o, x->x);
+		break;
+	case EMIT_O_MEM:
+		if (x->size <= 8 && sizes[x->size]) put_str(o, sizes[x->size]);
+		put(o, "[", 1);
+		if (x->reg >= 0) put_reg(o, x->reg, 8);
+		if (x->index >= 0) {
+			if (x->reg >= 0) put(o, "+", 1);
+			put_reg(o, x->index, 8);
+			if (x->scale != 1) {
+				put(o, "*", 1);
+				put_int(o, x->scale);
+			}
+		}
+		if (x->x > 0 && (x->reg >= 0 || x->index >= 0)) put(o, "+", 1);
+		if (x->x || (x->reg < 0 && x->index < 0)) put_int(o, x->x);
+		put(o, "]", 1);
+		break;
+	case EMIT_O_LABEL:
+		put_str(o, "label_");
+		put_int(o, x->x);
+		break;
+	case EMIT_O_SYM:
+		put_str(o, x->sym);
+		break;
+	case EMIT_O_STRING:
+		put(o, "s", 1);
+		put_int(o, x->x);
+		break;
+	case EMIT_O_TABLE:
+		put(o, "t", 1);
+		put_int(o, x->x);
+		break;
+	}
+}
+static void put_ins(struct out *o, const struct emit *e,
+		const struct emit_ins *x) {
+	switch (x->op) {
+	case EMIT_LABEL:
+		put_operand(o, &x->o[0]);
+		put(o, ":\n", 2);
+		return;
+	case EMIT_COMMENT:
+		put(o, "; ", 2);
+		put_str(o, emit_text(e, x));
+		put(o, "\n", 1);
+		return;
+	case EMIT_BLANK:
+		put(o, "\n", 1);
+		return;
+	case EMIT_DB:
+		put_operand(o, &x->o[0]);
+		put(o, ": db ", 5);
+		put_bytes(o, x->o[1].sym);
+		put(o, "\n", 1);
+		return;
+	default:
+		break;
+	}
+	put_str(o, names[x->op]);
+	if (x->op == EMIT_JCC || x->op == EMIT_SETCC || x->op == EMIT_CMOVCC) {
+		put_str(o, cc_names[x->cc]);
+	}
+	for (int i = 0; i < x->n; ++i) {
+		put(o, i ? ", " : " ", i ? 2 : 1);
+		put_operand(o, &x->o[i]);
+	}
+	put(o, "\n", 1);
+}
+bool emit_write(const struct emit *e, int fd) {
+	static struct out o;
+	o.fd = fd;
+	o.ok = true;
+	o.len = 0;
+	for (int i = 0; i < e->ins.len; ++i) {
+		put_ins(&o, e, vec_get_c(&e->ins, i));
+	}
+	flush(&o);
+	return o.ok;
+}
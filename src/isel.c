@@ -0,0 +1,557 @@
+// SPDX-License-Identifier: GPL-3.0-only
+#include <c_compiler/isel.h>
+#include <stddef.h>
+
+/* the kinds of operands a node can be computed as */
+enum nt {
+	NT_REG, /* a register */
+	NT_IMM, /* an immediate */
+	NT_MEM, /* a memory operand */
+	NT_IDX, /* a register times 1, 2, 4 or 8 */
+	NT_EA, /* a base register plus an index */
+	NT_STMT, /* done, for stores and comparisons */
+	NT_N,
+};
+#define CHAIN (-1)
+#define COST_INF 1000000
+
+/* an operator with nonterminal operands, or just a nonterminal */
+struct pat {
+	int op;
+	enum nt nt, sub[2];
+};
+#define N(x) { .op = CHAIN, .nt = (x) }
+#define P(o, x, y) { .op = (o), .sub = { (x), (y) } }
+
+typedef bool pred_fn(const struct isel_tree *t, int n, const int *leaves);
+
+enum emit {
+	E_LEAF,
+	E_MOV_IMM, E_LOAD, E_IDX, E_EA_IDX, E_LEA,
+	E_ADD, E_SUB, E_IMUL, E_SHL, E_LEA_MUL, E_IMUL3,
+	E_SCALE, E_EA, E_EA_SWAP, E_LEA_DISP, E_LEA_NDISP,
+	E_STORE, E_INC, E_DEC, E_RMW_ADD, E_RMW_SUB, E_RMW_ADD_B,
+	E_CMP,
+};
+struct rule {
+	enum nt nt;
+	int op; /* CHAIN to derive nt from kids[0] of the same node */
+	struct pat kids[2];
+	int cost;
+	pred_fn *pred;
+	enum emit emit;
+};
+
+static bool fits(int size, int64_t v) {
+	return size < 8 || (v >= INT32_MIN && v <= INT32_MAX);
+}
+static const struct isel_node *leaf(const struct isel_tree *t,
+		const int *leaves, int i) {
+	return &t->nodes[leaves[i]];
+}
+/* comparisons are always 64 bit */
+static int op_size(const struct isel_tree *t, int n) {
+	return t->nodes[n].op == ISEL_CMP ? 8 : t->nodes[n].size;
+}
+/* the second operand is an immediate the operation can take */
+static bool p_imm(const struct isel_tree *t, int n, const int *leaves) {
+	return fits(op_size(t, n), leaf(t, leaves, 1)->imm);
+}
+/* the second operand is memory at least as wide as the operation */
+static bool p_mem(const struct isel_tree *t, int n, const int *leaves) {
+	return leaf(t, leaves, 1)->size >= op_size(t, n);
+}
+static bool p_mem_imm(const struct isel_tree *t, int n, const int *leaves) {
+	return leaf(t, leaves, 0)->size >= op_size(t, n) && p_imm(t, n, leaves);
+}
+static bool p_pow2(const struct isel_tree *t, int n, const int *leaves) {
+	(void)n;
+	int64_t v = leaf(t, leaves, 1)->imm;
+	return v > 0 && v <= 1 << 30 && (v & (v - 1)) == 0;
+}
+static bool p_lea_mul(const struct isel_tree *t, int n, const int *leaves) {
+	(void)n;
+	int64_t v = leaf(t, leaves, 1)->imm;
+	return v == 3 || v == 5 || v == 9;
+}
+static bool p_scale(const struct isel_tree *t, int n, const int *leaves) {
+	(void)n;
+	int64_t v = leaf(t, leaves, 1)->imm;
+	return v == 2 || v == 4 || v == 8;
+}
+/* the address arithmetic has to wrap like the operation, a scaled index of
+ * another width would not */
+static bool p_ea(const struct isel_tree *t, int n, const int *leaves) {
+	for (int i = 0; i < 2; ++i) {
+		const struct isel_node *l = leaf(t, leaves, i);
+		if (l->op == ISEL_MUL && l->size != t->nodes[n].size) return false;
+	}
+	return true;
+}
+static bool p_disp(const struct isel_tree *t, int n, const int *leaves) {
+	return leaf(t, leaves, 0)->size == t->nodes[n].size
+		&& fits(t->nodes[n].size, leaf(t, leaves, 1)->imm);
+}
+static bool p_ndisp(const struct isel_tree *t, int n, const int *leaves) {
+	int64_t v = leaf(t, leaves, 1)->imm;
+	return leaf(t, leaves, 0)->size == t->nodes[n].size
+		&& v != INT64_MIN && fits(t->nodes[n].size, -v);
+}
+static bool p_cmp_mem(const struct isel_tree *t, int n, const int *leaves) {
+	(void)n;
+	return leaf(t, leaves, 0)->size == 8 && fits(8, leaf(t, leaves, 1)->imm);
+}
+/* a store of an update to the memory that is read, of the same width */
+static bool same(const struct isel_tree *t, int n, const int *leaves, int i) {
+	const struct isel_node *d = leaf(t, leaves, 0), *m = leaf(t, leaves, i);
+	const struct isel_node *op = &t->nodes[t->nodes[n].b];
+	return d->mem == m->mem && d->size == m->size && d->size == op->size;
+}
+static bool p_rmw(const struct isel_tree *t, int n, const int *leaves) {
+	return same(t, n, leaves, 1);
+}
+static bool p_rmw_b(const struct isel_tree *t, int n, const int *leaves) {
+	return same(t, n, leaves, 2);
+}
+static bool p_rmw_imm(const struct isel_tree *t, int n, const int *leaves) {
+	return same(t, n, leaves, 1)
+		&& fits(leaf(t, leaves, 0)->size, leaf(t, leaves, 2)->imm);
+}
+static bool p_rmw_one(const struct isel_tree *t, int n, const int *leaves) {
+	int64_t v = leaf(t, leaves, 2)->imm;
+	return same(t, n, leaves, 1)
+		&& (leaf(t, leaves, 0)->size == 8 ? v == 1 : (int32_t)v == 1);
+}
+
+/*
+ * The patterns, cost is about the number of instructions. Ties go to the
+ * earlier rule, so the plain forms come first.
+ */
+static const struct rule rules[] = {
+	{ NT_IMM, ISEL_IMM, { { 0 } }, 0, NULL, E_LEAF },
+	{ NT_MEM, ISEL_MEM, { { 0 } }, 0, NULL, E_LEAF },
+
+	{ NT_REG, ISEL_ADD, { N(NT_REG), N(NT_IMM) }, 1, p_imm, E_ADD },
+	{ NT_REG, ISEL_ADD, { N(NT_REG), N(NT_MEM) }, 1, p_mem, E_ADD },
+	{ NT_REG, ISEL_ADD, { N(NT_REG), N(NT_REG) }, 1, NULL, E_ADD },
+	{ NT_REG, ISEL_SUB, { N(NT_REG), N(NT_IMM) }, 1, p_imm, E_SUB },
+	{ NT_REG, ISEL_SUB, { N(NT_REG), N(NT_MEM) }, 1, p_mem, E_SUB },
+	{ NT_REG, ISEL_SUB, { N(NT_REG), N(NT_REG) }, 1, NULL, E_SUB },
+	{ NT_REG, ISEL_MUL, { N(NT_REG), N(NT_IMM) }, 1, p_pow2, E_SHL },
+	{ NT_REG, ISEL_MUL, { N(NT_REG), N(NT_IMM) }, 1, p_lea_mul, E_LEA_MUL },
+	{ NT_REG, ISEL_MUL, { N(NT_REG), N(NT_IMM) }, 3, p_imm, E_IMUL3 },
+	{ NT_REG, ISEL_MUL, { N(NT_MEM), N(NT_IMM) }, 3, p_mem_imm, E_IMUL3 },
+	{ NT_REG, ISEL_MUL, { N(NT_REG), N(NT_MEM) }, 3, p_mem, E_IMUL },
+	{ NT_REG, ISEL_MUL, { N(NT_REG), N(NT_REG) }, 3, NULL, E_IMUL },
+
+	// lea
+	{ NT_IDX, ISEL_MUL, { N(NT_REG), N(NT_IMM) }, 0, p_scale, E_SCALE },
+	{ NT_EA, ISEL_ADD, { N(NT_REG), N(NT_IDX) }, 0, p_ea, E_EA },
+	{ NT_EA, ISEL_ADD, { N(NT_IDX), N(NT_REG) }, 0, p_ea, E_EA_SWAP },
+	{ NT_REG, ISEL_ADD, { N(NT_EA), N(NT_IMM) }, 1, p_disp, E_LEA_DISP },
+	{ NT_REG, ISEL_SUB, { N(NT_EA), N(NT_IMM) }, 1, p_ndisp, E_LEA_NDISP },
+
+	{ NT_STMT, ISEL_STORE, { N(NT_MEM), P(ISEL_ADD, NT_MEM, NT_IMM) }, 2,
+		p_rmw_one, E_INC },
+	{ NT_STMT, ISEL_STORE, { N(NT_MEM), P(ISEL_SUB, NT_MEM, NT_IMM) }, 2,
+		p_rmw_one, E_DEC },
+	{ NT_STMT, ISEL_STORE, { N(NT_MEM), P(ISEL_ADD, NT_MEM, NT_IMM) }, 2,
+		p_rmw_imm, E_RMW_ADD },
+	{ NT_STMT, ISEL_STORE, { N(NT_MEM), P(ISEL_SUB, NT_MEM, NT_IMM) }, 2,
+		p_rmw_imm, E_RMW_SUB },
+	{ NT_STMT, ISEL_STORE, { N(NT_MEM), P(ISEL_ADD, NT_MEM, NT_REG) }, 2,
+		p_rmw, E_RMW_ADD },
+	{ NT_STMT, ISEL_STORE, { N(NT_MEM), P(ISEL_SUB, NT_MEM, NT_REG) }, 2,
+		p_rmw, E_RMW_SUB },
+	{ NT_STMT, ISEL_STORE, { N(NT_MEM), P(ISEL_ADD, NT_REG, NT_MEM) }, 2,
+		p_rmw_b, E_RMW_ADD_B },
+	{ NT_STMT, ISEL_STORE, { N(NT_MEM), N(NT_IMM) }, 1, p_imm, E_STORE },
+	{ NT_STMT, ISEL_STORE, { N(NT_MEM), N(NT_REG) }, 1, NULL, E_STORE },
+
+	{ NT_STMT, ISEL_CMP, { N(NT_MEM), N(NT_IMM) }, 1, p_cmp_mem, E_CMP },
+	{ NT_STMT, ISEL_CMP, { N(NT_REG), N(NT_IMM) }, 1, p_imm, E_CMP },
+	{ NT_STMT, ISEL_CMP, { N(NT_REG), N(NT_MEM) }, 1, p_mem, E_CMP },
+	{ NT_STMT, ISEL_CMP, { N(NT_REG), N(NT_REG) }, 1, NULL, E_CMP },
+
+	// chain rules
+	{ NT_REG, CHAIN, { N(NT_IMM) }, 1, NULL, E_MOV_IMM },
+	{ NT_REG, CHAIN, { N(NT_MEM) }, 1, NULL, E_LOAD },
+	{ NT_IDX, CHAIN, { N(NT_REG) }, 0, NULL, E_IDX },
+	{ NT_EA, CHAIN, { N(NT_IDX) }, 0, NULL, E_EA_IDX },
+	{ NT_REG, CHAIN, { N(NT_EA) }, 1, NULL, E_LEA },
+};
+#define RULES_N ((int)(sizeof(rules) / sizeof(*rules)))
+
+int isel_add(struct isel_tree *t, struct isel_node n) {
+	if (t->n == ISEL_TREE_MAX) return -1;
+	t->nodes[t->n] = n;
+	return t->n++;
+}
+
+/* a reduced operand */
+struct opnd {
+	int reg, index; /* base and index of an address, -1 if none */
+	int scale;
+	int64_t imm;
+	int mem, size;
+};
+struct ctx {
+	struct isel_tree t;
+	int cost[ISEL_TREE_MAX][NT_N];
+	const struct rule *rule[ISEL_TREE_MAX][NT_N];
+	unsigned free;
+	bool fail;
+	struct isel_code *code;
+};
+
+static bool is_leaf(const struct isel_node *n) {
+	return n->op == ISEL_IMM || n->op == ISEL_MEM;
+}
+/* puts immediates and then other leaves last, where the patterns have them */
+static void canonicalize(struct isel_tree *t) {
+	for (int i = 0; i < t->n; ++i) {
+		struct isel_node *n = &t->nodes[i];
+		if (n->op != ISEL_ADD && n->op != ISEL_MUL) continue;
+		const struct isel_node *a = &t->nodes[n->a], *b = &t->nodes[n->b];
+		if ((a->op == ISEL_IMM && b->op != ISEL_IMM)
+				|| (is_leaf(a) && !is_leaf(b))) {
+			int x = n->a;
+			n->a = n->b;
+			n->b = x;
+		}
+	}
+}
+
+/* the nodes and nonterminals the pattern leaves are matched to, leaves of
+ * unused slots are -1 */
+static bool match(const struct isel_tree *t, const struct rule *r, int n,
+		int *leaves, enum nt *nts) {
+	const struct isel_node *x = &t->nodes[n];
+	for (int i = 0; i < 4; ++i) leaves[i] = -1;
+	if (r->op == CHAIN) {
+		leaves[0] = n;
+		nts[0] = r->kids[0].nt;
+		return true;
+	}
+	if ((int)x->op != r->op) return false;
+	if (is_leaf(x)) return true;
+	int k = 0;
+	for (int i = 0; i < 2; ++i) {
+		const struct pat *p = &r->kids[i];
+		int c = i == 0 ? x->a : x->b;
+		if (p->op == CHAIN) {
+			leaves[k] = c;
+			nts[k++] = p->nt;
+			continue;
+		}
+		const struct isel_node *y = &t->nodes[c];
+		if ((int)y->op != p->op || is_leaf(y)) return false;
+		leaves[k] = y->a;
+		nts[k++] = p->sub[0];
+		leaves[k] = y->b;
+		nts[k++] = p->sub[1];
+	}
+	return true;
+}
+
+static void label(struct ctx *c) {
+	for (int n = 0; n < c->t.n; ++n) {
+		for (int nt = 0; nt < NT_N; ++nt) {
+			c->cost[n][nt] = COST_INF;
+			c->rule[n][nt] = NULL;
+		}
+		bool changed = true;
+		for (int pass = 0; changed; ++pass) {
+			changed = false;
+			for (int i = 0; i < RULES_N; ++i) {
+				const struct rule *r = &rules[i];
+				int leaves[4];
+				enum nt nts[4];
+				// operators first, then the chain rules until nothing
+				// gets cheaper
+				if ((r->op == CHAIN) != (pass > 0)) continue;
+				if (!match(&c->t, r, n, leaves, nts)) continue;
+				if (r->pred && !r->pred(&c->t, n, leaves)) continue;
+				int cost = r->cost;
+				for (int k = 0; k < 4 && leaves[k] >= 0; ++k)
+					cost += c->cost[leaves[k]][nts[k]];
+				if (cost < c->cost[n][r->nt]) {
+					c->cost[n][r->nt] = cost;
+					c->rule[n][r->nt] = r;
+					changed = true;
+				}
+			}
+			if (pass == 0) changed = true;
+		}
+	}
+}
+
+static int holds(enum nt nt) {
+	return nt == NT_REG || nt == NT_IDX ? 1 : nt == NT_EA ? 2 : 0;
+}
+/* registers needed to reduce n to nt, Sethi-Ullman style, and the order in
+ * which to reduce the operands of the pattern */
+static int need(const struct ctx *c, int n, enum nt nt, int *order) {
+	int leaves[4], needs[4], tmp[4], k;
+	enum nt nts[4];
+	match(&c->t, c->rule[n][nt], n, leaves, nts);
+	if (!order) order = tmp;
+	for (k = 0; k < 4 && leaves[k] >= 0; ++k) {
+		needs[k] = need(c, leaves[k], nts[k], NULL);
+		// the operand that needs the most registers goes first
+		int j = k;
+		for (; j > 0 && needs[order[j - 1]] < needs[k]; --j)
+			order[j] = order[j - 1];
+		order[j] = k;
+	}
+	int held = 0, max = holds(nt);
+	for (int i = 0; i < k; ++i) {
+		if (held + needs[order[i]] > max) max = held + needs[order[i]];
+		held += holds(nts[order[i]]);
+	}
+	return held > max ? held : max;
+}
+
+static int alloc(struct ctx *c) {
+	for (int r = 0; r < ISEL_REGS; ++r) {
+		if (c->free & 1u << r) {
+			c->free &= ~(1u << r);
+			return r;
+		}
+	}
+	c->fail = true;
+	return 0;
+}
+static void release(struct ctx *c, int r) {
+	if (r >= 0) c->free |= 1u << r;
+}
+static void emit(struct ctx *c, struct isel_insn i) {
+	if (c->code->n == ISEL_CODE_MAX) {
+		c->fail = true;
+		return;
+	}
+	c->code->insns[c->code->n++] = i;
+}
+static struct isel_operand o_reg(int r) {
+	return (struct isel_operand){ .kind = ISEL_O_REG, .reg = r };
+}
+static struct isel_operand o_mem(int m) {
+	return (struct isel_operand){ .kind = ISEL_O_MEM, .mem = m };
+}
+/* an immediate, as the 32 bits the instruction encodes */
+static struct isel_operand o_imm(int64_t v, int size) {
+	if (size == 1) v = (int8_t)v;
+	if (size == 4) v = (int32_t)v;
+	return (struct isel_operand){ .kind = ISEL_O_IMM, .imm = v };
+}
+/* a register, immediate or memory operand */
+static struct isel_operand o_any(const struct opnd *o, enum nt nt, int size) {
+	if (nt == NT_IMM) return o_imm(o->imm, size);
+	if (nt == NT_MEM) return o_mem(o->mem);
+	return o_reg(o->reg);
+}
+static int log2_exact(int64_t v) {
+	int k = 0;
+	while (v >>= 1) ++k;
+	return k;
+}
+
+static void reduce(struct ctx *c, int n, enum nt nt, struct opnd *res) {
+	const struct isel_node *x = &c->t.nodes[n];
+	const struct rule *r = c->rule[n][nt];
+	int leaves[4], order[4];
+	enum nt nts[4];
+	struct opnd ops[4];
+	match(&c->t, r, n, leaves, nts);
+	int k = 0;
+	while (k < 4 && leaves[k] >= 0) ++k;
+	need(c, n, nt, order);
+	for (int i = 0; i < k; ++i)
+		reduce(c, leaves[order[i]], nts[order[i]], &ops[order[i]]);
+	*res = (struct opnd){ .reg = -1, .index = -1, .size = x->size };
+	struct opnd *a = &ops[0], *b = &ops[1];
+	enum isel_opcode alu = ISEL_I_ADD;
+	switch (r->emit) {
+	case E_LEAF:
+		res->imm = x->imm;
+		res->mem = x->mem;
+		break;
+	case E_MOV_IMM:
+		res->reg = alloc(c);
+		emit(c, (struct isel_insn){ .op = ISEL_I_MOV, .size = 8,
+			.d = o_reg(res->reg),
+			.s = { .kind = ISEL_O_IMM, .imm = a->imm } });
+		break;
+	case E_LOAD:
+		res->reg = alloc(c);
+		emit(c, (struct isel_insn){ .op = ISEL_I_LOAD, .size = a->size,
+			.d = o_reg(res->reg), .s = o_mem(a->mem) });
+		break;
+	case E_IDX:
+		res->reg = a->reg;
+		res->scale = 1;
+		break;
+	case E_EA_IDX:
+		res->index = a->reg;
+		res->scale = a->scale;
+		break;
+	case E_SCALE:
+		res->reg = a->reg;
+		res->scale = b->imm;
+		break;
+	case E_EA:
+		res->reg = a->reg;
+		res->index = b->reg;
+		res->scale = b->scale;
+		break;
+	case E_EA_SWAP:
+		res->reg = b->reg;
+		res->index = a->reg;
+		res->scale = a->scale;
+		break;
+	case E_LEA:
+	case E_LEA_DISP:
+	case E_LEA_NDISP: ;
+		int64_t disp = r->emit == E_LEA ? 0
+			: r->emit == E_LEA_DISP ? b->imm : -b->imm;
+		int d = a->reg >= 0 && a->reg < a->index ? a->reg : a->index;
+		emit(c, (struct isel_insn){ .op = ISEL_I_LEA, .size = x->size,
+			.d = o_reg(d), .base = a->reg, .s = o_reg(a->index),
+			.scale = a->scale, .k = o_imm(disp, x->size).imm });
+		release(c, d == a->reg ? a->index : a->reg);
+		res->reg = d;
+		break;
+	case E_SUB: alu = ISEL_I_SUB; goto alu;
+	case E_IMUL: alu = ISEL_I_IMUL; goto alu;
+	case E_ADD:
+	alu:
+		emit(c, (struct isel_insn){ .op = alu, .size = x->size,
+			.d = o_reg(a->reg), .s = o_any(b, nts[1], x->size) });
+		if (nts[1] == NT_REG) release(c, b->reg);
+		res->reg = a->reg;
+		break;
+	case E_SHL:
+		emit(c, (struct isel_insn){ .op = ISEL_I_SHL, .size = x->size,
+			.d = o_reg(a->reg), .k = log2_exact(b->imm) });
+		res->reg = a->reg;
+		break;
+	case E_LEA_MUL:
+		emit(c, (struct isel_insn){ .op = ISEL_I_LEA, .size = x->size,
+			.d = o_reg(a->reg), .base = a->reg, .s = o_reg(a->reg),
+			.scale = b->imm - 1 });
+		res->reg = a->reg;
+		break;
+	case E_IMUL3:
+		res->reg = nts[0] == NT_REG ? a->reg : alloc(c);
+		emit(c, (struct isel_insn){ .op = ISEL_I_IMUL3, .size = x->size,
+			.d = o_reg(res->reg), .s = o_any(a, nts[0], x->size),
+			.k = o_imm(b->imm, x->size).imm });
+		break;
+	case E_STORE:
+		emit(c, (struct isel_insn){ .op = ISEL_I_STORE, .size = a->size,
+			.d = o_mem(a->mem), .s = o_any(b, nts[1], a->size) });
+		if (nts[1] == NT_REG) release(c, b->reg);
+		break;
+	case E_INC:
+	case E_DEC:
+		emit(c, (struct isel_insn){ .size = a->size,
+			.op = r->emit == E_INC ? ISEL_I_INC : ISEL_I_DEC,
+			.d = o_mem(a->mem) });
+		break;
+	case E_RMW_ADD:
+	case E_RMW_SUB:
+	case E_RMW_ADD_B: ;
+		const struct opnd *o = r->emit == E_RMW_ADD_B ? b : &ops[2];
+		enum nt ont = r->emit == E_RMW_ADD_B ? nts[1] : nts[2];
+		emit(c, (struct isel_insn){ .size = a->size,
+			.op = r->emit == E_RMW_SUB ? ISEL_I_SUB : ISEL_I_ADD,
+			.d = o_mem(a->mem), .s = o_any(o, ont, a->size) });
+		if (ont == NT_REG) release(c, o->reg);
+		break;
+	case E_CMP:
+		emit(c, (struct isel_insn){ .op = ISEL_I_CMP, .size = 8,
+			.d = o_any(a, nts[0], 8), .s = o_any(b, nts[1], 8) });
+		if (nts[0] == NT_REG) release(c, a->reg);
+		if (nts[1] == NT_REG) release(c, b->reg);
+		break;
+	}
+}
+
+bool isel_select(const struct isel_tree *t, struct isel_code *res) {
+	struct ctx c = { .t = *t, .free = (1u << ISEL_REGS) - 1, .code = res };
+	*res = (struct isel_code){ .n = 0 };
+	if (t->n == 0) return false;
+	canonicalize(&c.t);
+	label(&c);
+	int root = t->n - 1;
+	enum isel_op op = t->nodes[root].op;
+	enum nt nt = op == ISEL_STORE || op == ISEL_CMP ? NT_STMT : NT_REG;
+	if (c.cost[root][nt] >= COST_INF) return false;
+	if (need(&c, root, nt, NULL) > ISEL_REGS) return false;
+	struct opnd o;
+	reduce(&c, root, nt, &o);
+	if (nt == NT_REG && o.reg != 0) {
+		emit(&c, (struct isel_insn){ .op = ISEL_I_MOV, .size = 8,
+			.d = o_reg(0), .s = o_reg(o.reg) });
+	}
+	res->cost = c.cost[root][nt];
+	return !c.fail;
+}
+
+static uint64_t mask(int size) {
+	return size >= 8 ? ~0ull : (1ull << size * 8) - 1;
+}
+static uint64_t get(const struct isel_operand *o, const uint64_t *regs,
+		const uint64_t *mem, int size) {
+	switch (o->kind) {
+	case ISEL_O_REG: return regs[o->reg] & mask(size);
+	case ISEL_O_IMM: return (uint64_t)o->imm & mask(size);
+	case ISEL_O_MEM: return mem[o->mem] & mask(size);
+	}
+	return 0;
+}
+/* writes of 32 bit registers clear the upper half */
+static void put(const struct isel_operand *o, uint64_t *regs, uint64_t *mem,
+		int size, uint64_t v) {
+	if (o->kind == ISEL_O_REG) {
+		regs[o->reg] = v & mask(size < 4 ? 4 : size);
+	} else {
+		mem[o->mem] = (mem[o->mem] & ~mask(size)) | (v & mask(size));
+	}
+}
+uint64_t isel_eval(const struct isel_code *c, uint64_t *mem) {
+	uint64_t regs[ISEL_REGS] = { 0 };
+	uint64_t flags = 0;
+	bool cmp = false;
+	for (int i = 0; i < c->n; ++i) {
+		const struct isel_insn *x = &c->insns[i];
+		int size = x->size;
+		uint64_t d = get(&x->d, regs, mem, size);
+		uint64_t s = get(&x->s, regs, mem, size);
+		// only mov takes a 64 bit immediate
+		if (x->s.kind == ISEL_O_IMM && x->op != ISEL_I_MOV)
+			s = (uint64_t)(int64_t)(int32_t)x->s.imm & mask(size);
+		switch (x->op) {
+		case ISEL_I_LOAD: d = s; size = 8; break;
+		case ISEL_I_MOV: d = s; break;
+		case ISEL_I_STORE: d = s; break;
+		case ISEL_I_ADD: d += s; break;
+		case ISEL_I_SUB: d -= s; break;
+		case ISEL_I_IMUL: d *= s; break;
+		case ISEL_I_IMUL3: d = s * (int32_t)x->k; break;
+		case ISEL_I_SHL: d <<= x->k; break;
+		case ISEL_I_LEA:
+			d = (x->base >= 0 ? regs[x->base] : 0)
+				+ regs[x->s.reg] * x->scale + (int32_t)x->k;
+			break;
+		case ISEL_I_INC: d += 1; break;
+		case ISEL_I_DEC: d -= 1; break;
+		case ISEL_I_CMP:
+			cmp = true;
+			flags = d == s ? 0 : (int64_t)d < (int64_t)s ? 1 : 2;
+			continue;
+		}
+		put(&x->d, regs, mem, size, d);
+	}
+	return cmp ? flags : regs[0];
+}
@@ -0,0 +1,174 @@
+// SPDX-License-Identifier: GPL-3.0-only
+#define _GNU_SOURCE /* RTLD_DEFAULT, MAP_ANONYMOUS */
+#include <c_compiler/jit.h>
+#include <dlfcn.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+/* jmp [rip], the address it jumps to, and int3 up to the size */
+#define STUB_SIZE 16
+
+/*
+ * main is entered through this, as the generated code uses rbx and the other
+ * registers a caller keeps its values in: it saves them, keeps the stack
+ * aligned and calls main, whose rel32 follows the call at ENTRY_CALL.
+ */
+static const unsigned char entry[] = {
+	0x53, 0x55, 0x41, 0x54, 0x41, 0x55, 0x41, 0x56, 0x41, 0x57,
+	0x48, 0x83, 0xEC, 0x08, /* push rbx, rbp, r12-r15; sub rsp, 8 */
+	0xE8, 0, 0, 0, 0, /* call main */
+	0x48, 0x83, 0xC4, 0x08, /* add rsp, 8; pop r15-r12, rbp, rbx; ret */
+	0x41, 0x5F, 0x41, 0x5E, 0x41, 0x5D, 0x41, 0x5C, 0x5D, 0x5B, 0xC3,
+};
+#define ENTRY_CALL 15
+
+struct image {
+	unsigned char *base;
+	size_t code_size, size; /* the code is executable, the rest read only */
+	unsigned char *section[X86_SECTION_N];
+	unsigned char *stubs, *entry;
+	unsigned char **addr; /* of the symbols, the stubs of the undefined */
+};
+
+static size_t round_up(size_t x, size_t a) {
+	return (x + a - 1) / a * a;
+}
+
+/* the rodata goes on pages of its own after the code, the stubs and the
+ * entry */
+static bool image_map(struct image *im, const struct x86_code *c, int stubs) {
+	size_t page = sysconf(_SC_PAGESIZE);
+	size_t at[X86_SECTION_N + 1];
+	size_t len = 0;
+	for (int i = 0; i < X86_SECTION_N; ++i) {
+		if (i == X86_RODATA) continue;
+		at[i] = len = round_up(len, 16);
+		len += c->section[i].len;
+	}
+	size_t stubs_at = round_up(len, 16);
+	size_t entry_at = stubs_at + stubs * STUB_SIZE;
+	im->code_size = round_up(entry_at + sizeof(entry), page);
+	at[X86_RODATA] = im->code_size;
+	im->size = im->code_size + round_up(c->section[X86_RODATA].len, page);
+	im->base = mmap(NULL, im->size, PROT_READ | PROT_WRITE,
+		MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (im->base == MAP_FAILED) {
+		fprintf(stderr, "error: can't map memory for the code\n");
+		return false;
+	}
+	for (int i = 0; i < X86_SECTION_N; ++i) {
+		im->section[i] = im->base + at[i];
+		if (c->section[i].len) {
+			memcpy(im->section[i], vec_get_c(&c->section[i], 0),
+				c->section[i].len);
+		}
+	}
+	im->stubs = im->base + stubs_at;
+	im->entry = im->base + entry_at;
+	memcpy(im->entry, entry, sizeof(entry));
+	return true;
+}
+
+static void put_rel32(unsigned char *p, uintptr_t v) {
+	// the code and the stubs are in one mapping, well in reach
+	int32_t rel = v - (uintptr_t)p;
+	memcpy(p, &rel, 4);
+}
+
+static bool image_link(struct image *im, const struct x86_code *c,
+		int main_sym) {
+	unsigned char *stub = im->stubs;
+	for (int i = 0; i < c->symbols.len; ++i) {
+		const struct x86_symbol *s = vec_get_c(&c->symbols, i);
+		if (s->section != X86_UNDEFINED) {
+			im->addr[i] = im->section[s->section] + s->offset;
+			continue;
+		}
+		void *f = dlsym(RTLD_DEFAULT, s->name);
+		if (!f) {
+			fprintf(stderr, "error: undefined symbol `%s`\n", s->name);
+			return false;
+		}
+		memcpy(stub, (unsigned char[]){ 0xFF, 0x25, 0, 0, 0, 0 }, 6);
+		memcpy(stub + 6, &f, 8);
+		memset(stub + 14, 0xCC, STUB_SIZE - 14);
+		im->addr[i] = stub;
+		stub += STUB_SIZE;
+	}
+	for (int i = 0; i < c->relocs.len; ++i) {
+		const struct x86_reloc *r = vec_get_c(&c->relocs, i);
+		unsigned char *p = im->section[r->section] + r->offset;
+		unsigned char *s = r->sym >= 0 ? im->addr[r->sym]
+			: im->section[r->target];
+		uintptr_t v = (uintptr_t)s + r->addend;
+		if (r->kind == X86_R_64) {
+			memcpy(p, &v, 8);
+			continue;
+		}
+		put_rel32(p, v);
+	}
+	put_rel32(im->entry + ENTRY_CALL,
+		(uintptr_t)im->addr[main_sym] - 4);
+	if (mprotect(im->base, im->code_size, PROT_READ | PROT_EXEC) != 0
+			|| (im->size > im->code_size && mprotect(im->base
+			+ im->code_size, im->size - im->code_size, PROT_READ))) {
+		fprintf(stderr, "error: can't protect the code\n");
+		return false;
+	}
+	return true;
+}
+
+static bool perf_map_write(const struct image *im, const struct x86_code *c) {
+	char path[64];
+	snprintf(path, sizeof(path), "/tmp/perf-%d.map", (int)getpid());
+	FILE *f = fopen(path, "w");
+	if (!f) {
+		fprintf(stderr, "error: can't open `%s`\n", path);
+		return false;
+	}
+	for (int i = 0; i < c->symbols.len; ++i) {
+		const struct x86_symbol *s = vec_get_c(&c->symbols, i);
+		if (s->section == X86_UNDEFINED) {
+			fprintf(f, "%lx %x %s@plt\n", (unsigned long)im->addr[i],
+				STUB_SIZE, s->name);
+		} else {
+			fprintf(f, "%lx %x %s\n", (unsigned long)im->addr[i],
+				s->size, s->name);
+		}
+	}
+	return fclose(f) == 0;
+}
+
+bool jit_run(struct x86_code *c, int argc, char **argv, bool perf_map,
+		int *res) {
+	int main_sym = x86_symbol(c, "main");
+	if (main_sym < 0 || ((const struct x86_symbol *)vec_get_c(&c->symbols,
+			main_sym))->section == X86_UNDEFINED) {
+		fprintf(stderr, "error: no `main` to run\n");
+		return false;
+	}
+	int stubs = 0;
+	for (int i = 0; i < c->symbols.len; ++i) {
+		const struct x86_symbol *s = vec_get_c(&c->symbols, i);
+		stubs += s->section == X86_UNDEFINED;
+	}
+	struct image im = {
+		.addr = calloc(c->symbols.len + 1, sizeof(*im.addr)),
+	};
+	bool ok = image_map(&im, c, stubs);
+	if (ok) ok = image_link(&im, c, main_sym);
+	if (ok && perf_map) ok = perf_map_write(&im, c);
+	if (ok) {
+		int (*main_f)(int, char **);
+		void *p = im.entry;
+		memcpy(&main_f, &p, sizeof(p));
+		*res = main_f(argc, argv);
+	}
+	if (im.base && im.base != MAP_FAILED) munmap(im.base, im.size);
+	free(im.addr);
+	return ok;
+}
@@ -0,0 +1,1595 @@
+// SPDX-License-Identifier: GPL-3.0-only
+#include <c_compiler/opt.h>
+
+bool opt_names_contain(const struct vec *names, const char *ident) {
+	for (int i = 0; i < names->len; ++i) {
+		const char * const *ni = vec_get_c(names, i);
+		if (strcmp(*ni, ident) == 0) return true;
+	}
+	return false;
+}
+static void add_name(struct vec *names, const char *ident) {
+	if (!opt_names_contain(names, ident)) vec_append(names, &ident);
+}
+
+static bool visit_address_taken(const struct ast_node *n, void *ud) {
+	if (n->kind == AST_UNARY && n->unary.kind == AST_UNARY_REF
+			&& n->unary.a->kind == AST_IDENT) {
+		add_name(ud, n->unary.a->ident);
+	}
+	return true;
+}
+void opt_address_taken(const struct ast_node *n, struct vec *res) {
+	ast_walk(n, visit_address_taken, res);
+}
+
+struct pure_ctx {
+	const struct vec *fns;
+	bool pure;
+};
+static bool visit_pure(const struct ast_node *n, void *ud) {
+	struct pure_ctx *ctx = ud;
+	if (n->kind == AST_CALL
+			&& opt_call_effects(ctx->fns, n) == OPT_SIDE_EFFECTS) {
+		ctx->pure = false;
+	}
+	if (n->kind == AST_BIN && n->bin.kind == AST_BIN_ASSIGN) ctx->pure = false;
+	if (n->kind == AST_UNARY) switch (n->unary.kind) {
+	case AST_PRE_INCR:
+	case AST_PRE_DECR:
+	case AST_POST_INCR:
+	case AST_POST_DECR:
+		ctx->pure = false;
+		break;
+	default:
+		break;
+	}
+	return ctx->pure;
+}
+bool opt_expr_pure(const struct ast_node *n, const struct vec *fns) {
+	struct pure_ctx ctx = { .fns = fns, .pure = true };
+	ast_walk(n, visit_pure, &ctx);
+	return ctx.pure;
+}
+
+static bool visit_may_jump(const struct ast_node *n, void *ud) {
+	bool *jump = ud;
+	switch (n->kind) {
+	case AST_STMT_LABELED:
+	case AST_STMT_LABELED_CASE:
+	case AST_STMT_LABELED_DEFAULT:
+	case AST_STMT_GOTO:
+	case AST_STMT_CONTINUE:
+	case AST_STMT_BREAK:
+	case AST_STMT_RETURN:
+		*jump = true;
+		break;
+	default:
+		break;
+	}
+	return !*jump;
+}
+bool opt_stmt_may_jump(const struct ast_node *n) {
+	bool jump = false;
+	ast_walk(n, visit_may_jump, &jump);
+	return jump;
+}
+
+static bool visit_has_call(const struct ast_node *n, void *ud) {
+	bool *call = ud;
+	if (n->kind == AST_CALL) *call = true;
+	return !*call;
+}
+/* true if the flow may not go past `n`: it jumps, or it calls a function,
+ * which may not return */
+static bool stmt_may_leave(const struct ast_node *n) {
+	bool call = false;
+	ast_walk(n, visit_has_call, &call);
+	return call || opt_stmt_may_jump(n);
+}
+
+static void loop_write(struct loop_info *li, const struct ast_node *target) {
+	if (target->kind == AST_IDENT) {
+		add_name(&li->modified, target->ident);
+		// pure functions may read a global
+		if (!opt_names_contain(li->address_taken, target->ident)
+				&& !(li->globals
+					&& opt_names_contain(li->globals, target->ident))) {
+			return;
+		}
+	}
+	li->stores = true;
+	vec_append(&li->targets, &target);
+}
+static bool type_name_equal(const struct ast_node *a, const struct ast_node *b) {
+	const struct ast_declaration_specifiers *sa =
+		&a->type_name.specifier_qualifier_list->declaration_specifiers;
+	const struct ast_declaration_specifiers *sb =
+		&b->type_name.specifier_qualifier_list->declaration_specifiers;
+	if (memcmp(sa->builtin_type_specifiers, sb->builtin_type_specifiers,
+			sizeof(sa->builtin_type_specifiers)) != 0) {
+		return false;
+	}
+	if (sa->type_specifiers.len > 0 || sb->type_specifiers.len > 0) {
+		return false;
+	}
+	const struct vec *va = &a->type_name.declarator->declarator.v;
+	const struct vec *vb = &b->type_name.declarator->declarator.v;
+	if (va->len != vb->len) return false;
+	for (int i = 0; i < va->len; ++i) {
+		const struct ast_node * const *na = vec_get_c(va, i);
+		const struct ast_node * const *nb = vec_get_c(vb, i);
+		// array sizes are not compared
+		if ((*na)->kind != (*nb)->kind
+				|| (*na)->kind == AST_ARRAY_DECLARATOR) {
+			return false;
+		}
+	}
+	return true;
+}
+bool opt_expr_equal(const struct ast_node *a, const struct ast_node *b) {
+	if (a->kind != b->kind) return false;
+	switch (a->kind) {
+	case AST_IDENT:
+		return strcmp(a->ident, b->ident) == 0;
+	case AST_INTEGER:
+		return a->integer == b->integer;
+	case AST_CHARACTER_CONSTANT:
+		return a->character_constant == b->character_constant;
+	case AST_SIZEOF_EXPR:
+		return type_name_equal(a->sizeof_expr.type_name,
+			b->sizeof_expr.type_name);
+	case AST_UNARY:
+		return a->unary.kind == b->unary.kind
+			&& opt_expr_equal(a->unary.a, b->unary.a);
+	case AST_INDEX:
+		return opt_expr_equal(a->index.a, b->index.a)
+			&& opt_expr_equal(a->index.b, b->index.b);
+	case AST_BIN:
+		return a->bin.kind == b->bin.kind
+			&& opt_expr_equal(a->bin.a, b->bin.a)
+			&& opt_expr_equal(a->bin.b, b->bin.b);
+	case AST_CALL:
+		if (!opt_expr_equal(a->call.a, b->call.a)
+				|| a->call.args.len != b->call.args.len) {
+			return false;
+		}
+		for (int i = 0; i < a->call.args.len; ++i) {
+			if (!opt_expr_equal(
+					*(const struct ast_node **)vec_get_c(&a->call.args, i),
+					*(const struct ast_node **)vec_get_c(&b->call.args, i))) {
+				return false;
+			}
+		}
+		return true;
+	default:
+		// strings are distinct objects
+		return false;
+	}
+}
+
+struct ident_count {
+	const char *ident;
+	int n;
+};
+static bool visit_ident_count(const struct ast_node *n, void *ud) {
+	struct ident_count *ic = ud;
+	if (n->kind == AST_IDENT && strcmp(n->ident, ic->ident) == 0) ic->n++;
+	return true;
+}
+int opt_ident_count(const struct ast_node *n, const char *ident) {
+	struct ident_count ic = { .ident = ident };
+	ast_walk(n, visit_ident_count, &ic);
+	return ic.n;
+}
+
+static bool visit_loop_writes(const struct ast_node *n, void *ud) {
+	struct loop_info *li = ud;
+	switch (n->kind) {
+	case AST_BIN:
+		if (n->bin.kind == AST_BIN_ASSIGN) loop_write(li, n->bin.a);
+		break;
+	case AST_UNARY:
+		switch (n->unary.kind) {
+		case AST_PRE_INCR:
+		case AST_PRE_DECR:
+		case AST_POST_INCR:
+		case AST_POST_DECR:
+			loop_write(li, n->unary.a);
+			break;
+		default:
+			break;
+		}
+		break;
+	case AST_CALL:
+		if (opt_call_effects(li->fns, n) == OPT_SIDE_EFFECTS) li->calls = true;
+		break;
+	case AST_INIT_DECLARATOR: ;
+		const struct ast_node *ident =
+			n->init_declarator.declarator->declarator.ident;
+		if (ident) add_name(&li->modified, ident->ident);
+		break;
+	default:
+		break;
+	}
+	return true;
+}
+void loop_info_init(struct loop_info *li, const struct ast_node *loop,
+		const struct vec *address_taken, const struct vec *fns,
+		const struct vec *globals) {
+	*li = (struct loop_info){
+		.address_taken = address_taken,
+		.fns = fns,
+		.globals = globals,
+		.modified = vec_new_empty(sizeof(const char *)),
+		.targets = vec_new_empty(sizeof(const struct ast_node *)),
+	};
+	ast_walk(loop, visit_loop_writes, li);
+}
+void loop_info_finish(struct loop_info *li) {
+	vec_free(&li->targets);
+	vec_free(&li->modified);
+}
+/* whether a store of the loop may write what the access `n` reads */
+static bool loop_clobbers(const struct loop_info *li, const struct ast_node *n) {
+	if (li->calls) return true;
+	if (!li->alias) return li->stores;
+	for (int i = 0; i < li->targets.len; ++i) {
+		const struct ast_node * const *ti = vec_get_c(&li->targets, i);
+		if (li->alias(*ti, n, li->ud)) return true;
+	}
+	return false;
+}
+
+bool loop_invariant(const struct loop_info *li, const struct ast_node *n) {
+	switch (n->kind) {
+	case AST_INTEGER:
+	case AST_CHARACTER_CONSTANT:
+	case AST_STRING:
+	case AST_SIZEOF_EXPR:
+	case AST_ALIGNOF_EXPR:
+		return true;
+	case AST_IDENT:
+		if (opt_names_contain(&li->modified, n->ident)) return false;
+		// a store through a pointer or a call may write the variable
+		return !(opt_names_contain(li->address_taken, n->ident)
+			&& loop_clobbers(li, n));
+	case AST_UNARY:
+		switch (n->unary.kind) {
+		case AST_UNARY_DEREF:
+			return !loop_clobbers(li, n)
+				&& loop_invariant(li, n->unary.a);
+		case AST_UNARY_PLUS:
+		case AST_UNARY_MINUS:
+		case AST_UNARY_NOT:
+		case AST_UNARY_NOTB:
+			return loop_invariant(li, n->unary.a);
+		default:
+			return false;
+		}
+	case AST_INDEX:
+		return !loop_clobbers(li, n) && loop_invariant(li, n->index.a)
+			&& loop_invariant(li, n->index.b);
+	case AST_CAST:
+		return loop_invariant(li, n->cast.expr);
+	case AST_BIN:
+		if (n->bin.kind == AST_BIN_ASSIGN) return false;
+		return loop_invariant(li, n->bin.a) && loop_invariant(li, n->bin.b);
+	case AST_CALL:
+		switch (opt_call_effects(li->fns, n)) {
+		case OPT_CONST:
+			break;
+		case OPT_PURE:
+			// it may read whatever the loop stores
+			if (li->calls || li->stores) return false;
+			break;
+		default:
+			return false;
+		}
+		for (int i = 0; i < n->call.args.len; ++i) {
+			const struct ast_node * const *ni = vec_get_c(&n->call.args, i);
+			if (!loop_invariant(li, *ni)) return false;
+		}
+		return true;
+	default:
+		return false;
+	}
+}
+
+static bool visit_speculatable(const struct ast_node *n, void *ud) {
+	bool *ok = ud;
+	switch (n->kind) {
+	case AST_UNARY:
+		if (n->unary.kind == AST_UNARY_DEREF) *ok = false;
+		break;
+	case AST_INDEX:
+	case AST_MEMBER_DEREF:
+	case AST_CALL:
+		*ok = false;
+		break;
+	case AST_BIN:
+		if (n->bin.kind == AST_BIN_DIV || n->bin.kind == AST_BIN_MOD) {
+			// may trap, unless the divisor is a nonzero constant
+			const struct ast_node *b = n->bin.b;
+			if (b->kind != AST_INTEGER || b->integer == 0) *ok = false;
+		}
+		break;
+	default:
+		break;
+	}
+	return *ok;
+}
+bool opt_expr_speculatable(const struct ast_node *n) {
+	bool ok = true;
+	ast_walk(n, visit_speculatable, &ok);
+	return ok;
+}
+int opt_expr_cost(const struct ast_node *n) {
+	switch (n->kind) {
+	case AST_IDENT:
+	case AST_INTEGER:
+	case AST_CHARACTER_CONSTANT:
+	case AST_STRING:
+	case AST_SIZEOF_EXPR:
+	case AST_ALIGNOF_EXPR:
+		return 1;
+	case AST_UNARY:
+		// a dereference is a dependent load
+		return (n->unary.kind == AST_UNARY_DEREF ? 4 : 1)
+			+ opt_expr_cost(n->unary.a);
+	case AST_INDEX:
+		return 4 + opt_expr_cost(n->index.a) + opt_expr_cost(n->index.b);
+	case AST_CAST:
+		return opt_expr_cost(n->cast.expr);
+	case AST_BIN: ;
+		int cost = opt_expr_cost(n->bin.a) + opt_expr_cost(n->bin.b);
+		switch (n->bin.kind) {
+		case AST_BIN_MUL: return cost + 3;
+		case AST_BIN_DIV:
+		case AST_BIN_MOD: return cost + 20;
+		default: return cost + 1;
+		}
+	case AST_CONDITIONAL:
+		return 2 + opt_expr_cost(n->conditional.cond)
+			+ opt_expr_cost(n->conditional.expr)
+			+ opt_expr_cost(n->conditional.expr_else);
+	default:
+		// calls and the rest
+		return 50;
+	}
+}
+
+static bool worth_hoisting(const struct ast_node *n) {
+	switch (n->kind) {
+	case AST_UNARY:
+	case AST_INDEX:
+	case AST_CAST:
+	case AST_BIN:
+	case AST_CALL:
+		return true;
+	default:
+		return false;
+	}
+}
+
+/*
+ * Walks the expressions of a loop, telling the callback whether the
+ * expression is evaluated unconditionally in every iteration.
+ * Subexpressions are not visited if the callback returns true. Lvalues are
+ * not passed to the callback, only the addresses they are computed from.
+ */
+typedef bool (*loop_expr_fn)(const struct ast_node *n, bool uncond, void *ud);
+struct loop_visitor {
+	loop_expr_fn fn;
+	void *ud;
+};
+
+static void visit_expr(const struct loop_visitor *lv, const struct ast_node *n,
+	bool uncond);
+static void visit_lvalue(const struct loop_visitor *lv, const struct ast_node *n,
+		bool uncond) {
+	// the object itself is written, but its address is an rvalue
+	if (n->kind == AST_UNARY && n->unary.kind == AST_UNARY_DEREF) {
+		visit_expr(lv, n->unary.a, uncond);
+	} else if (n->kind == AST_INDEX) {
+		visit_expr(lv, n->index.a, uncond);
+		visit_expr(lv, n->index.b, uncond);
+	}
+}
+static void visit_expr(const struct loop_visitor *lv, const struct ast_node *n,
+		bool uncond) {
+	if (lv->fn(n, uncond, lv->ud)) return;
+	switch (n->kind) {
+	case AST_UNARY:
+		switch (n->unary.kind) {
+		case AST_PRE_INCR:
+		case AST_PRE_DECR:
+		case AST_POST_INCR:
+		case AST_POST_DECR:
+		case AST_UNARY_REF:
+			visit_lvalue(lv, n->unary.a, uncond);
+			break;
+		case AST_UNARY_SIZEOF:
+			break;
+		default:
+			visit_expr(lv, n->unary.a, uncond);
+			break;
+		}
+		break;
+	case AST_BIN:
+		if (n->bin.kind == AST_BIN_ASSIGN) {
+			visit_lvalue(lv, n->bin.a, uncond);
+		} else {
+			visit_expr(lv, n->bin.a, uncond);
+		}
+		// the right hand side of && and || is conditional
+		visit_expr(lv, n->bin.b, uncond && n->bin.kind != AST_BIN_ANDB
+			&& n->bin.kind != AST_BIN_ORB);
+		break;
+	case AST_INDEX:
+		visit_expr(lv, n->index.a, uncond);
+		visit_expr(lv, n->index.b, uncond);
+		break;
+	case AST_CAST:
+		visit_expr(lv, n->cast.expr, uncond);
+		break;
+	case AST_CONDITIONAL:
+		visit_expr(lv, n->conditional.cond, uncond);
+		visit_expr(lv, n->conditional.expr, false);
+		visit_expr(lv, n->conditional.expr_else, false);
+		break;
+	case AST_CALL:
+		for (int i = 0; i < n->call.args.len; ++i) {
+			const struct ast_node * const *ni =
+				vec_get_c(&n->call.args, i);
+			visit_expr(lv, *ni, uncond);
+		}
+		break;
+	default:
+		break;
+	}
+}
+static void visit_stmt(const struct loop_visitor *lv, const struct ast_node *n,
+		bool uncond) {
+	switch (n->kind) {
+	case AST_STMT_EXPR:
+		if (n->stmt_expr.a) visit_expr(lv, n->stmt_expr.a, uncond);
+		break;
+	case AST_STMT_COMP:
+		for (int i = 0; i < n->stmt_comp.len; ++i) {
+			const struct ast_node * const *ni =
+				vec_get_c(&n->stmt_comp, i);
+			visit_stmt(lv, *ni, uncond);
+			// whatever follows a possible jump or call is
+			// conditional
+			if (stmt_may_leave(*ni)) uncond = false;
+		}
+		break;
+	case AST_DECLARATION:
+		for (int i = 0; i < n->declaration.init_declarator_list.len; ++i) {
+			const struct ast_node * const *ni = vec_get_c(
+				&n->declaration.init_declarator_list, i);
+			const struct ast_node *init =
+				(*ni)->init_declarator.initializer;
+			if (init) visit_expr(lv, init, uncond);
+		}
+		break;
+	case AST_STMT_IF:
+		visit_expr(lv, n->stmt_if.cond, uncond);
+		visit_stmt(lv, n->stmt_if.stmt, false);
+		if (n->stmt_if.stmt_else) {
+			visit_stmt(lv, n->stmt_if.stmt_else, false);
+		}
+		break;
+	case AST_STMT_WHILE:
+		visit_expr(lv, n->stmt_while.cond, uncond);
+		visit_stmt(lv, n->stmt_while.stmt, false);
+		break;
+	case AST_STMT_DO_WHILE:
+		visit_stmt(lv, n->stmt_do_while.stmt, uncond);
+		visit_expr(lv, n->stmt_do_while.cond, uncond
+			&& !stmt_may_leave(n->stmt_do_while.stmt));
+		break;
+	case AST_STMT_FOR:
+		if (n->stmt_for.a) visit_stmt(lv, n->stmt_for.a, uncond);
+		if (n->stmt_for.b) visit_expr(lv, n->stmt_for.b, uncond);
+		if (n->stmt_for.c) visit_expr(lv, n->stmt_for.c, false);
+		visit_stmt(lv, n->stmt_for.stmt, false);
+		break;
+	case AST_STMT_SWITCH:
+		visit_expr(lv, n->stmt_switch.cond, uncond);
+		visit_stmt(lv, n->stmt_switch.stmt, false);
+		break;
+	case AST_STMT_LABELED:
+		visit_stmt(lv, n->stmt_labeled.stmt, false);
+		break;
+	case AST_STMT_LABELED_CASE:
+		visit_stmt(lv, n->stmt_labeled_case.stmt, false);
+		break;
+	case AST_STMT_LABELED_DEFAULT:
+		visit_stmt(lv, n->stmt_labeled_default.stmt, false);
+		break;
+	case AST_STMT_RETURN:
+		if (n->stmt_return.expr) {
+			visit_expr(lv, n->stmt_return.expr, uncond);
+		}
+		break;
+	default:
+		break;
+	}
+}
+static void visit_loop(const struct loop_visitor *lv,
+		const struct ast_node *loop) {
+	switch (loop->kind) {
+	case AST_STMT_WHILE:
+		// the condition is evaluated before every iteration
+		visit_expr(lv, loop->stmt_while.cond, true);
+		visit_stmt(lv, loop->stmt_while.stmt, true);
+		break;
+	case AST_STMT_DO_WHILE:
+		visit_stmt(lv, loop->stmt_do_while.stmt, true);
+		visit_expr(lv, loop->stmt_do_while.cond,
+			!stmt_may_leave(loop->stmt_do_while.stmt));
+		break;
+	default:
+		break;
+	}
+}
+
+struct hoist_ctx {
+	const struct loop_info *li;
+	struct vec *res;
+};
+static bool visit_hoistable(const struct ast_node *n, bool uncond, void *ud) {
+	struct hoist_ctx *ctx = ud;
+	if (worth_hoisting(n) && loop_invariant(ctx->li, n)
+			&& (uncond || opt_expr_speculatable(n))) {
+		vec_append(ctx->res, &n);
+		return true;
+	}
+	return false;
+}
+void loop_hoistable(const struct loop_info *li, const struct ast_node *loop,
+		struct vec *res) {
+	struct hoist_ctx ctx = { .li = li, .res = res };
+	visit_loop(&(struct loop_visitor){ visit_hoistable, &ctx }, loop);
+}
+
+struct iv_ctx {
+	const struct loop_info *li;
+	opt_const_fn ce;
+	void *ud;
+	struct vec *ivs;
+	const char *ident;
+	int writes;
+	bool declared;
+};
+
+/* the write statements `i = i + c;`, `i = i - c;`, `++i;`, `i--;` ... */
+static bool iv_step(const struct iv_ctx *ctx, const struct ast_node *e,
+		long long *step) {
+	const char *ident = ctx->ident;
+	if (e->kind == AST_UNARY && e->unary.a->kind == AST_IDENT
+			&& strcmp(e->unary.a->ident, ident) == 0) {
+		switch (e->unary.kind) {
+		case AST_PRE_INCR:
+		case AST_POST_INCR:
+			return *step = 1, true;
+		case AST_PRE_DECR:
+		case AST_POST_DECR:
+			return *step = -1, true;
+		default:
+			return false;
+		}
+	}
+	if (e->kind != AST_BIN || e->bin.kind != AST_BIN_ASSIGN) return false;
+	const struct ast_node *a = e->bin.a, *b = e->bin.b;
+	if (a->kind != AST_IDENT || strcmp(a->ident, ident) != 0) return false;
+	if (b->kind != AST_BIN) return false;
+	const struct ast_node *x = b->bin.a, *y = b->bin.b;
+	bool x_iv = x->kind == AST_IDENT && strcmp(x->ident, ident) == 0;
+	bool y_iv = y->kind == AST_IDENT && strcmp(y->ident, ident) == 0;
+	if (b->bin.kind == AST_BIN_ADD) {
+		if (x_iv && ctx->ce(y, step, ctx->ud)) return true;
+		if (y_iv && ctx->ce(x, step, ctx->ud)) return true;
+	} else if (b->bin.kind == AST_BIN_SUB) {
+		if (x_iv && ctx->ce(y, step, ctx->ud)) return *step = -*step, true;
+	}
+	return false;
+}
+static bool visit_iv_writes(const struct ast_node *n, void *ud) {
+	struct iv_ctx *ctx = ud;
+	const struct ast_node *target = NULL;
+	if (n->kind == AST_BIN && n->bin.kind == AST_BIN_ASSIGN) {
+		target = n->bin.a;
+	} else if (n->kind == AST_UNARY) {
+		switch (n->unary.kind) {
+		case AST_PRE_INCR:
+		case AST_PRE_DECR:
+		case AST_POST_INCR:
+		case AST_POST_DECR:
+			target = n->unary.a;
+			break;
+		default:
+			break;
+		}
+	} else if (n->kind == AST_INIT_DECLARATOR) {
+		const struct ast_node *ident =
+			n->init_declarator.declarator->declarator.ident;
+		if (ident && strcmp(ident->ident, ctx->ident) == 0) {
+			ctx->declared = true;
+		}
+	}
+	if (target && target->kind == AST_IDENT
+			&& strcmp(target->ident, ctx->ident) == 0) {
+		ctx->writes++;
+	}
+	return true;
+}
+static bool visit_iv_steps(const struct ast_node *n, void *ud) {
+	struct iv_ctx *ctx = ud;
+	struct iv *iv = vec_get(ctx->ivs, ctx->ivs->len - 1);
+	struct iv_write w;
+	if (n->kind == AST_STMT_EXPR && n->stmt_expr.a
+			&& iv_step(ctx, n->stmt_expr.a, &w.step)) {
+		w.stmt = n;
+		vec_append(&iv->writes, &w);
+		return false;
+	}
+	return true;
+}
+
+/* the value of `n` is iv * coeff + (loop invariant) */
+static bool iv_linear(const struct iv_ctx *ctx, const struct ast_node *n,
+		const char *ident, long long *coeff) {
+	long long k;
+	if (n->kind == AST_IDENT) {
+		if (strcmp(n->ident, ident) != 0) return false;
+		return *coeff = 1, true;
+	}
+	if (n->kind != AST_BIN) return false;
+	const struct ast_node *a = n->bin.a, *b = n->bin.b;
+	switch (n->bin.kind) {
+	case AST_BIN_MUL:
+		if (iv_linear(ctx, a, ident, coeff) && ctx->ce(b, &k, ctx->ud)) {
+			return *coeff *= k, true;
+		}
+		if (iv_linear(ctx, b, ident, coeff) && ctx->ce(a, &k, ctx->ud)) {
+			return *coeff *= k, true;
+		}
+		return false;
+	case AST_BIN_ADD:
+		if (loop_invariant(ctx->li, b)) return iv_linear(ctx, a, ident, coeff);
+		if (loop_invariant(ctx->li, a)) return iv_linear(ctx, b, ident, coeff);
+		return false;
+	case AST_BIN_SUB:
+		return loop_invariant(ctx->li, b) && iv_linear(ctx, a, ident, coeff);
+	default:
+		return false;
+	}
+}
+static bool is_iv_write(const struct iv *iv, const struct ast_node *n) {
+	for (int i = 0; i < iv->writes.len; ++i) {
+		const struct iv_write *w = vec_get_c(&iv->writes, i);
+		if (w->stmt->stmt_expr.a == n) return true;
+	}
+	return false;
+}
+static bool visit_iv_derived(const struct ast_node *n, bool uncond, void *ud) {
+	struct iv_ctx *ctx = ud;
+	for (int i = 0; i < ctx->ivs->len; ++i) {
+		struct iv *iv = vec_get(ctx->ivs, i);
+		// the updates themselves are not uses
+		if (is_iv_write(iv, n)) return true;
+	}
+	if (n->kind == AST_IDENT) return true;
+	for (int i = 0; i < ctx->ivs->len; ++i) {
+		struct iv *iv = vec_get(ctx->ivs, i);
+		struct iv_derived d = { .n = n, .uncond = uncond };
+		if (!iv_linear(ctx, n, iv->ident, &d.coeff)) continue;
+		d.group = iv->derived.len;
+		for (int k = 0; k < iv->derived.len; ++k) {
+			const struct iv_derived *dk = vec_get_c(&iv->derived, k);
+			if (opt_expr_equal(dk->n, n)) {
+				d.group = dk->group;
+				break;
+			}
+		}
+		vec_append(&iv->derived, &d);
+		return true;
+	}
+	return false;
+}
+
+void loop_find_ivs(const struct loop_info *li, const struct ast_node *loop,
+		opt_const_fn ce, void *ud, struct vec *res) {
+	struct iv_ctx ctx = { .li = li, .ce = ce, .ud = ud, .ivs = res };
+	for (int i = 0; i < li->modified.len; ++i) {
+		const char * const *ident = vec_get_c(&li->modified, i);
+		if (opt_names_contain(li->address_taken, *ident)) continue;
+		ctx.ident = *ident;
+		ctx.writes = 0;
+		ctx.declared = false;
+		ast_walk(loop, visit_iv_writes, &ctx);
+		if (ctx.declared) continue;
+
+		struct iv iv = {
+			.ident = *ident,
+			.writes = vec_new_empty(sizeof(struct iv_write)),
+			.derived = vec_new_empty(sizeof(struct iv_derived)),
+			.uses = opt_ident_count(loop, *ident),
+		};
+		vec_append(res, &iv);
+		ast_walk(loop, visit_iv_steps, &ctx);
+		// every write has to be a constant step
+		struct iv *last = vec_get(res, res->len - 1);
+		if (last->writes.len != ctx.writes) {
+			vec_free(&last->writes);
+			vec_free(&last->derived);
+			res->len--;
+		}
+	}
+	visit_loop(&(struct loop_visitor){ visit_iv_derived, &ctx }, loop);
+}
+void loop_ivs_free(struct vec *ivs) {
+	for (int i = 0; i < ivs->len; ++i) {
+		struct iv *iv = vec_get(ivs, i);
+		vec_free(&iv->writes);
+		vec_free(&iv->derived);
+	}
+	vec_free(ivs);
+}
+
+const struct ast_node *opt_elem_ptr(const struct ast_node *n, const char *iv) {
+	const struct ast_node *a, *b;
+	if (n->kind == AST_UNARY && n->unary.kind == AST_UNARY_DEREF
+			&& n->unary.a->kind == AST_BIN
+			&& n->unary.a->bin.kind == AST_BIN_ADD) {
+		a = n->unary.a->bin.a;
+		b = n->unary.a->bin.b;
+	} else if (n->kind == AST_INDEX) {
+		a = n->index.a;
+		b = n->index.b;
+	} else {
+		return NULL;
+	}
+	if (a->kind != AST_IDENT || b->kind != AST_IDENT) return NULL;
+	bool a_iv = strcmp(a->ident, iv) == 0, b_iv = strcmp(b->ident, iv) == 0;
+	if (a_iv == b_iv) return NULL;
+	return a_iv ? b : a;
+}
+/* sums and differences of elements at iv, constants and other variables */
+static bool vec_loop_expr(const struct ast_node *n, const char *iv,
+		opt_const_fn ce, void *ud) {
+	long long v;
+	if (opt_elem_ptr(n, iv) || ce(n, &v, ud)) return true;
+	if (n->kind == AST_IDENT) return strcmp(n->ident, iv) != 0;
+	if (n->kind == AST_BIN && (n->bin.kind == AST_BIN_ADD
+			|| n->bin.kind == AST_BIN_SUB)) {
+		return vec_loop_expr(n->bin.a, iv, ce, ud)
+			&& vec_loop_expr(n->bin.b, iv, ce, ud);
+	}
+	return false;
+}
+/* `while (iv < bound) { ...; iv = iv + step; }` with a positive step */
+static bool loop_counted(const struct ast_node *loop, opt_const_fn ce,
+		void *ud, const char **iv, long long *step) {
+	const struct ast_node *cond = loop->stmt_while.cond;
+	const struct ast_node *body = loop->stmt_while.stmt;
+	if (cond->kind != AST_BIN || cond->bin.kind != AST_BIN_LT
+			|| cond->bin.a->kind != AST_IDENT
+			|| body->kind != AST_STMT_COMP || body->stmt_comp.len < 2) {
+		return false;
+	}
+	*iv = cond->bin.a->ident;
+	long long v;
+	const struct ast_node *bound = cond->bin.b;
+	if (!ce(bound, &v, ud) && (bound->kind != AST_IDENT
+			|| strcmp(bound->ident, *iv) == 0)) {
+		return false;
+	}
+	const struct ast_node *last = *(const struct ast_node * const *)
+		vec_get_c(&body->stmt_comp, body->stmt_comp.len - 1);
+	struct iv_ctx ctx = { .ce = ce, .ud = ud, .ident = *iv };
+	return last->kind == AST_STMT_EXPR && last->stmt_expr.a
+		&& iv_step(&ctx, last->stmt_expr.a, step) && *step > 0;
+}
+bool loop_vectorizable(const struct ast_node *loop, opt_const_fn ce, void *ud,
+		struct vec_loop *res) {
+	const struct ast_node *body = loop->stmt_while.stmt;
+	const char *iv;
+	long long step;
+	if (!loop_counted(loop, ce, ud, &iv, &step)) return false;
+	*res = (struct vec_loop){ .iv = iv, .bound = loop->stmt_while.cond->bin.b,
+		.step = step,
+		.stores = vec_new_empty(sizeof(const struct ast_node *)) };
+	for (int i = 0; i < body->stmt_comp.len - 1; ++i) {
+		const struct ast_node *st = *(const struct ast_node * const *)
+			vec_get_c(&body->stmt_comp, i);
+		const struct ast_node *e =
+			st->kind == AST_STMT_EXPR ? st->stmt_expr.a : NULL;
+		if (!e || e->kind != AST_BIN || e->bin.kind != AST_BIN_ASSIGN
+				|| !opt_elem_ptr(e->bin.a, iv)
+				|| !vec_loop_expr(e->bin.b, iv, ce, ud)) {
+			vec_loop_finish(res);
+			return false;
+		}
+		vec_append(&res->stores, &e);
+	}
+	return true;
+}
+void vec_loop_finish(struct vec_loop *vl) {
+	vec_free(&vl->stores);
+}
+
+static bool visit_count(const struct ast_node *n, void *ud) {
+	(void)n;
+	(*(int *)ud)++;
+	return true;
+}
+bool loop_unrollable(const struct ast_node *loop, opt_const_fn ce, void *ud,
+		struct unroll_loop *res) {
+	const struct ast_node *body = loop->stmt_while.stmt;
+	const char *iv;
+	long long step;
+	if (!loop_counted(loop, ce, ud, &iv, &step)
+			|| opt_stmt_may_jump(body)) {
+		return false;
+	}
+	const struct ast_node *bound = loop->stmt_while.cond->bin.b;
+	*res = (struct unroll_loop){ .iv = iv, .bound = bound, .step = step,
+		.incr = *(const struct ast_node * const *)
+			vec_get_c(&body->stmt_comp, body->stmt_comp.len - 1) };
+	struct loop_info li;
+	loop_info_init(&li, loop, &(struct vec){ 0 }, NULL, NULL);
+	bool bound_changes = bound->kind == AST_IDENT
+		&& opt_names_contain(&li.modified, bound->ident);
+	loop_info_finish(&li);
+	// the step is the only write to the variable
+	int writes = 0;
+	for (int i = 0; i < body->stmt_comp.len - 1; ++i) {
+		const struct ast_node *st = *(const struct ast_node * const *)
+			vec_get_c(&body->stmt_comp, i);
+		loop_info_init(&li, st, &(struct vec){ 0 }, NULL, NULL);
+		writes += opt_names_contain(&li.modified, iv);
+		loop_info_finish(&li);
+	}
+	if (bound_changes || writes > 0) return false;
+	ast_walk(body, visit_count, &res->size);
+	return true;
+}
+
+bool opt_eq_test(const struct ast_node *n, const struct ast_node **ident,
+		const struct ast_node **value, opt_const_fn ce, void *ud) {
+	long long v;
+	if (n->kind != AST_STMT_IF || n->stmt_if.stmt_else) return false;
+	const struct ast_node *cond = n->stmt_if.cond;
+	if (cond->kind != AST_BIN || cond->bin.kind != AST_BIN_EQB) return false;
+	if (cond->bin.a->kind == AST_IDENT && ce(cond->bin.b, &v, ud)) {
+		*ident = cond->bin.a;
+		*value = cond->bin.b;
+		return true;
+	}
+	if (cond->bin.b->kind == AST_IDENT && ce(cond->bin.a, &v, ud)) {
+		*ident = cond->bin.b;
+		*value = cond->bin.a;
+		return true;
+	}
+	return false;
+}
+
+static bool visit_label(const struct ast_node *n, void *ud) {
+	bool *label = ud;
+	if (n->kind == AST_STMT_LABELED || n->kind == AST_STMT_LABELED_CASE
+			|| n->kind == AST_STMT_LABELED_DEFAULT) {
+		*label = true;
+	}
+	return !*label;
+}
+int opt_if_chain(const struct vec *stmts, int i,
+		const struct vec *address_taken, opt_const_fn ce, void *ud) {
+	const struct ast_node *x, *value;
+	if (!opt_eq_test(*(const struct ast_node **)vec_get_c(stmts, i),
+			&x, &value, ce, ud)) {
+		return 0;
+	}
+	struct vec values = vec_new_empty(sizeof(int));
+	int k = i;
+	for (; k < stmts->len; ++k) {
+		const struct ast_node *n =
+			*(const struct ast_node **)vec_get_c(stmts, k);
+		const struct ast_node *xk;
+		long long v;
+		if (!opt_eq_test(n, &xk, &value, ce, ud)) break;
+		if (strcmp(xk->ident, x->ident) != 0) break;
+		// compared as 32 bit values
+		ce(value, &v, ud);
+		int v32 = v;
+		bool dup = false;
+		for (int j = 0; j < values.len; ++j) {
+			dup = dup || *(int *)vec_get(&values, j) == v32;
+		}
+		if (dup) break;
+		vec_append(&values, &v32);
+		if (k == i) continue;
+
+		// the previous test would fall through to this one
+		const struct ast_node *prev =
+			*(const struct ast_node **)vec_get_c(stmts, k - 1);
+		struct loop_info li;
+		loop_info_init(&li, prev->stmt_if.stmt, address_taken, NULL, NULL);
+		bool invariant = loop_invariant(&li, x);
+		loop_info_finish(&li);
+		bool label = false;
+		ast_walk(prev->stmt_if.stmt, visit_label, &label);
+		if (!invariant || label) break;
+	}
+	vec_free(&values);
+	return k - i;
+}
+
+struct switch_collect {
+	const struct ast_node *root;
+	struct vec *labels;
+};
+static bool visit_switch_labels(const struct ast_node *n, void *ud) {
+	struct switch_collect *sc = ud;
+	if (n->kind == AST_STMT_LABELED_CASE
+			|| n->kind == AST_STMT_LABELED_DEFAULT) {
+		vec_append(sc->labels, &(struct switch_label){ .n = n });
+	}
+	// the labels of nested switches belong to them
+	return n == sc->root || n->kind != AST_STMT_SWITCH;
+}
+void opt_switch_labels(const struct ast_node *n, struct vec *labels) {
+	struct switch_collect sc = { .root = n, .labels = labels };
+	ast_walk(n, visit_switch_labels, &sc);
+}
+int opt_switch_label_get(const struct vec *labels, const struct ast_node *n) {
+	for (int i = labels->len - 1; i >= 0; --i) {
+		const struct switch_label *l = vec_get_c(labels, i);
+		if (l->n == n) return l->label;
+	}
+	return -1;
+}
+static int dispatch_case_cmp(const void *a, const void *b) {
+	const struct dispatch_case *ca = a, *cb = b;
+	return (ca->v > cb->v) - (ca->v < cb->v);
+}
+bool opt_dispatch_sort(struct vec *cases) {
+	struct dispatch_case *c = cases->len ? vec_get(cases, 0) : NULL;
+	if (c) qsort(c, cases->len, sizeof(*c), dispatch_case_cmp);
+	for (int i = 1; i < cases->len; ++i) {
+		if (c[i].v == c[i - 1].v) {
+			fprintf(stderr, "error: duplicate case value %d\n", c[i].v);
+			return false;
+		}
+	}
+	return true;
+}
+
+static bool visit_frame_escapes(const struct ast_node *n, void *ud) {
+	bool *escapes = ud;
+	if (n->kind == AST_UNARY && n->unary.kind == AST_UNARY_REF) {
+		*escapes = true;
+	} else if (n->kind == AST_INIT_DECLARATOR) {
+		// arrays decay to pointers into the frame
+		const struct vec *v = &n->init_declarator.declarator->declarator.v;
+		for (int i = 0; i < v->len; ++i) {
+			const struct ast_node *d =
+				*(const struct ast_node **)vec_get_c(v, i);
+			if (d->kind == AST_ARRAY_DECLARATOR) *escapes = true;
+		}
+	}
+	return !*escapes;
+}
+bool opt_frame_escapes(const struct ast_node *def) {
+	bool escapes = false;
+	ast_walk(def, visit_frame_escapes, &escapes);
+	return escapes;
+}
+
+#define INLINE_SIZE 24 /* leaf and static functions */
+#define INLINE_SIZE_ONCE 200 /* static functions with a single call site */
+#define INLINE_SIZE_HINT 64 /* functions declared `inline` */
+
+static int function_index(const struct vec *fns, const char *ident) {
+	for (int i = 0; i < fns->len; ++i) {
+		const struct opt_function *f = vec_get_c(fns, i);
+		if (strcmp(f->ident, ident) == 0) return i;
+	}
+	return -1;
+}
+static struct opt_function *function_get(const struct vec *fns,
+		const char *ident) {
+	int i = function_index(fns, ident);
+	return i < 0 ? NULL : (struct opt_function *)vec_get_c(fns, i);
+}
+static int param_count(const struct ast_node *def) {
+	const struct ast_declarator *d =
+		&def->function_definition.declarator->declarator;
+	if (d->v.len == 0) return -1;
+	const struct ast_node *fd = *(const struct ast_node **)vec_get_c(&d->v, 0);
+	if (fd->kind != AST_FUNCTION_DECLARATOR) return -1;
+	const struct vec *params = &fd->function_declarator.parameter_type_list;
+	if (params->len == 1) {
+		// f(void)
+		const struct ast_node *p =
+			*(const struct ast_node **)vec_get_c(params, 0);
+		if (!p->parameter_declaration.declarator
+				&& p->parameter_declaration.declaration_specifiers
+				->declaration_specifiers.builtin_type_specifiers
+				[AST_BUILTIN_TYPE_VOID]) {
+			return 0;
+		}
+	}
+	for (int i = 0; i < params->len; ++i) {
+		const struct ast_node *p =
+			*(const struct ast_node **)vec_get_c(params, i);
+		const struct ast_node *pd = p->parameter_declaration.declarator;
+		if (!pd || !pd->declarator.ident) return -1;
+	}
+	return params->len;
+}
+
+struct functions_ctx {
+	struct vec *fns;
+	struct opt_function *f;
+	struct vec locals; /* vec<const char *>, names declared in a block */
+	bool jumps;
+};
+static bool visit_function_body(const struct ast_node *n, void *ud) {
+	struct functions_ctx *ctx = ud;
+	struct opt_function *f = ctx->f;
+	f->size++;
+	if (n->kind == AST_CALL) {
+		f->leaf = false;
+		if (n->call.a->kind == AST_IDENT) {
+			struct opt_function *g =
+				function_get(ctx->fns, n->call.a->ident);
+			if (g) g->calls++;
+		}
+	} else if (n->kind == AST_IDENT) {
+		int i = function_index(ctx->fns, n->ident);
+		if (i >= 0) vec_append(&f->refs, &i);
+	} else if (n->kind == AST_INIT_DECLARATOR) {
+		const struct ast_node *d = n->init_declarator.declarator;
+		if (d->declarator.ident) {
+			add_name(&ctx->locals, d->declarator.ident->ident);
+		}
+	} else if (n->kind == AST_STMT_LABELED || n->kind == AST_STMT_GOTO) {
+		// labels would be duplicated by every copy
+		ctx->jumps = true;
+	}
+	return true;
+}
+static bool reaches(const struct vec *fns, int from, int to, bool *seen) {
+	if (seen[from]) return false;
+	seen[from] = true;
+	const struct opt_function *f = vec_get_c(fns, from);
+	for (int i = 0; i < f->refs.len; ++i) {
+		int k = *(const int *)vec_get_c(&f->refs, i);
+		if (k == to || reaches(fns, k, to, seen)) return true;
+	}
+	return false;
+}
+
+static void function_scan(const struct vec *fns, struct opt_function *f);
+static void function_emit(const struct vec *fns, struct opt_function *f) {
+	if (f->emit) return;
+	f->emit = true;
+	function_scan(fns, f);
+}
+static bool visit_function_refs(const struct ast_node *n, void *ud) {
+	const struct vec *fns = ud;
+	const struct opt_function *g;
+	if (n->kind == AST_CALL && (g = opt_inline_callee(fns, n))) {
+		// the body is copied, the function itself is not referenced
+		function_scan(fns, (struct opt_function *)g);
+		for (int i = 0; i < n->call.args.len; ++i) {
+			ast_walk(*(const struct ast_node **)vec_get_c(
+				&n->call.args, i), visit_function_refs, ud);
+		}
+		return false;
+	}
+	struct opt_function *h;
+	if (n->kind == AST_IDENT && (h = function_get(fns, n->ident))) {
+		function_emit(fns, h);
+	}
+	return true;
+}
+/* marks the functions referred to from the code generated for f */
+static void function_scan(const struct vec *fns, struct opt_function *f) {
+	if (f->scanned) return;
+	f->scanned = true;
+	ast_walk(f->def->function_definition.compound_statement,
+		visit_function_refs, (void *)fns);
+}
+
+struct effects_ctx {
+	const struct vec *fns;
+	struct vec locals; /* vec<const char *>, automatic variables */
+	struct vec address_taken; /* vec<const char *> */
+	enum opt_effects effects;
+};
+static void effects_add(struct effects_ctx *ctx, enum opt_effects e) {
+	if (ctx->effects < e) ctx->effects = e;
+}
+/* a variable of the call that nothing outside of it can see */
+static bool effects_local(const struct effects_ctx *ctx, const char *ident) {
+	return opt_names_contain(&ctx->locals, ident)
+		&& !opt_names_contain(&ctx->address_taken, ident);
+}
+static void effects_write(struct effects_ctx *ctx,
+		const struct ast_node *target) {
+	if (target->kind != AST_IDENT || !effects_local(ctx, target->ident)) {
+		effects_add(ctx, OPT_SIDE_EFFECTS);
+	}
+}
+/* a loop that may never end keeps the call from being removed */
+static bool effects_forever(const struct ast_node *cond) {
+	return !cond || (cond->kind == AST_INTEGER && cond->integer != 0);
+}
+static bool visit_effects_locals(const struct ast_node *n, void *ud) {
+	if (n->kind != AST_DECLARATION) return true;
+	const char *sc = n->declaration.declaration_specifiers
+		->declaration_specifiers.storage_class_specifiers;
+	// these name objects that outlive the call
+	if (sc[AST_STORAGE_CLASS_SPECIFIER_STATIC]
+			|| sc[AST_STORAGE_CLASS_SPECIFIER_EXTERN]) {
+		return true;
+	}
+	for (int i = 0; i < n->declaration.init_declarator_list.len; ++i) {
+		const struct ast_node *d = (*(const struct ast_node **)vec_get_c(
+			&n->declaration.init_declarator_list, i))
+			->init_declarator.declarator;
+		if (d->declarator.ident) add_name(ud, d->declarator.ident->ident);
+	}
+	return true;
+}
+static bool visit_effects(const struct ast_node *n, void *ud) {
+	struct effects_ctx *ctx = ud;
+	switch (n->kind) {
+	case AST_IDENT:
+		if (!effects_local(ctx, n->ident) && !function_get(ctx->fns, n->ident))
+			effects_add(ctx, OPT_PURE);
+		break;
+	case AST_UNARY:
+		switch (n->unary.kind) {
+		case AST_UNARY_DEREF:
+			effects_add(ctx, OPT_PURE);
+			break;
+		case AST_PRE_INCR:
+		case AST_PRE_DECR:
+		case AST_POST_INCR:
+		case AST_POST_DECR:
+			effects_write(ctx, n->unary.a);
+			break;
+		default:
+			break;
+		}
+		break;
+	case AST_INDEX:
+	case AST_MEMBER:
+	case AST_MEMBER_DEREF:
+		effects_add(ctx, OPT_PURE);
+		break;
+	case AST_BIN:
+		if (n->bin.kind == AST_BIN_ASSIGN) effects_write(ctx, n->bin.a);
+		break;
+	case AST_CALL:
+		// calls within the translation unit are joined in later
+		if (n->call.a->kind != AST_IDENT
+				|| effects_local(ctx, n->call.a->ident)
+				|| !function_get(ctx->fns, n->call.a->ident)) {
+			effects_add(ctx, OPT_SIDE_EFFECTS);
+		}
+		break;
+	case AST_STMT_WHILE:
+		if (effects_forever(n->stmt_while.cond))
+			effects_add(ctx, OPT_SIDE_EFFECTS);
+		break;
+	case AST_STMT_DO_WHILE:
+		if (effects_forever(n->stmt_do_while.cond))
+			effects_add(ctx, OPT_SIDE_EFFECTS);
+		break;
+	case AST_STMT_FOR:
+		if (effects_forever(n->stmt_for.b))
+			effects_add(ctx, OPT_SIDE_EFFECTS);
+		break;
+	case AST_STMT_GOTO:
+		effects_add(ctx, OPT_SIDE_EFFECTS);
+		break;
+	default:
+		break;
+	}
+	return ctx->effects != OPT_SIDE_EFFECTS;
+}
+/* the effects of the body of f on its own */
+static enum opt_effects function_effects(const struct vec *fns,
+		const struct opt_function *f) {
+	const struct ast_node *def = f->def;
+	struct effects_ctx ctx = {
+		.fns = fns,
+		.locals = vec_new_empty(sizeof(const char *)),
+		.address_taken = vec_new_empty(sizeof(const char *)),
+	};
+	const struct ast_node *fd = *(const struct ast_node **)vec_get_c(
+		&def->function_definition.declarator->declarator.v, 0);
+	const struct vec *params = &fd->function_declarator.parameter_type_list;
+	for (int k = 0; f->params > 0 && k < params->len; ++k) {
+		const struct ast_node *p =
+			*(const struct ast_node **)vec_get_c(params, k);
+		add_name(&ctx.locals, p->parameter_declaration.declarator
+			->declarator.ident->ident);
+	}
+	const struct ast_node *body = def->function_definition.compound_statement;
+	ast_walk(body, visit_effects_locals, &ctx.locals);
+	opt_address_taken(body, &ctx.address_taken);
+	ast_walk(body, visit_effects, &ctx);
+	vec_free(&ctx.locals);
+	vec_free(&ctx.address_taken);
+	return ctx.effects;
+}
+
+void opt_functions(const struct ast_node *tu, struct vec *res) {
+	*res = vec_new_empty(sizeof(struct opt_function));
+	for (int i = 0; i < tu->translation_unit.len; ++i) {
+		const struct ast_node *n =
+			*(const struct ast_node **)vec_get_c(&tu->translation_unit, i);
+		if (n->kind != AST_FUNCTION_DEFINITION) continue;
+		const struct ast_node *ident = n->function_definition.declarator
+			->declarator.ident;
+		if (!ident) continue;
+		vec_append(res, &(struct opt_function){
+			.def = n,
+			.ident = ident->ident,
+			.params = param_count(n),
+			.leaf = true,
+			.refs = vec_new_empty(sizeof(int)),
+		});
+	}
+
+	struct functions_ctx ctx = {
+		.fns = res,
+		.locals = vec_new_empty(sizeof(const char *)),
+	};
+	bool *jumps = calloc(res->len + 1, sizeof(bool));
+	for (int i = 0; i < res->len; ++i) {
+		ctx.f = vec_get(res, i);
+		ctx.jumps = false;
+		const struct ast_node *def = ctx.f->def;
+		ast_walk(def->function_definition.compound_statement,
+			visit_function_body, &ctx);
+		jumps[i] = ctx.jumps;
+		const struct ast_node *fd = *(const struct ast_node **)vec_get_c(
+			&def->function_definition.declarator->declarator.v, 0);
+		if (ctx.f->params <= 0) continue;
+		const struct vec *params =
+			&fd->function_declarator.parameter_type_list;
+		for (int k = 0; k < params->len; ++k) {
+			const struct ast_node *p =
+				*(const struct ast_node **)vec_get_c(params, k);
+			add_name(&ctx.locals, p->parameter_declaration.declarator
+				->declarator.ident->ident);
+		}
+	}
+
+	bool *seen = calloc(res->len + 1, sizeof(bool));
+	for (int i = 0; i < res->len; ++i) {
+		struct opt_function *f = vec_get(res, i);
+		const struct ast_declaration_specifiers *ds = &f->def
+			->function_definition.declaration_specifiers
+			->declaration_specifiers;
+		bool is_static = ds->storage_class_specifiers
+			[AST_STORAGE_CLASS_SPECIFIER_STATIC] > 0;
+		f->is_static = is_static;
+		memset(seen, 0, res->len * sizeof(bool));
+		f->recursive = reaches(res, i, i, seen);
+
+		int limit = 0;
+		if (f->leaf || is_static) limit = INLINE_SIZE;
+		if (is_static && f->calls == 1) limit = INLINE_SIZE_ONCE;
+		if (ds->function_specifiers[AST_FUNCTION_SPECIFIER_INLINE]
+				&& limit < INLINE_SIZE_HINT) {
+			limit = INLINE_SIZE_HINT;
+		}
+		// a local variable of the same name could hide the function
+		f->inline_ = f->size <= limit && !f->recursive && !jumps[i]
+			&& f->params >= 0 && f->params <= 6
+			&& strcmp(f->ident, "main") != 0
+			&& !opt_names_contain(&ctx.locals, f->ident);
+	}
+	free(seen);
+	free(jumps);
+
+	for (int i = 0; i < res->len; ++i) {
+		struct opt_function *f = vec_get(res, i);
+		f->effects = opt_names_contain(&ctx.locals, f->ident)
+			? OPT_SIDE_EFFECTS : function_effects(res, f);
+	}
+	bool changed = true;
+	while (changed) {
+		changed = false;
+		for (int i = 0; i < res->len; ++i) {
+			struct opt_function *f = vec_get(res, i);
+			for (int k = 0; k < f->refs.len; ++k) {
+				const struct opt_function *g =
+					vec_get_c(res, *(const int *)vec_get_c(&f->refs, k));
+				if (f->effects < g->effects) {
+					f->effects = g->effects;
+					changed = true;
+				}
+			}
+		}
+	}
+	vec_free(&ctx.locals);
+
+	for (int i = 0; i < res->len; ++i) {
+		struct opt_function *f = vec_get(res, i);
+		if (!f->is_static) function_emit(res, f);
+	}
+}
+void opt_functions_free(struct vec *fns) {
+	for (int i = 0; i < fns->len; ++i) {
+		struct opt_function *f = vec_get(fns, i);
+		vec_free(&f->refs);
+	}
+	vec_free(fns);
+}
+const struct opt_function *opt_function_get(const struct vec *fns,
+		const char *ident) {
+	return function_get(fns, ident);
+}
+enum opt_effects opt_call_effects(const struct vec *fns,
+		const struct ast_node *call) {
+	if (!fns || call->call.a->kind != AST_IDENT) return OPT_SIDE_EFFECTS;
+	const struct opt_function *f = function_get(fns, call->call.a->ident);
+	if (!f || call->call.args.len != f->params) return OPT_SIDE_EFFECTS;
+	return f->effects;
+}
+const struct opt_function *opt_inline_callee(const struct vec *fns,
+		const struct ast_node *call) {
+	if (call->call.a->kind != AST_IDENT) return NULL;
+	const struct opt_function *f = function_get(fns, call->call.a->ident);
+	if (!f || !f->inline_ || call->call.args.len != f->params) return NULL;
+	return f;
+}
+
+bool opt_stmt_has_label(const struct ast_node *n) {
+	bool label = false;
+	ast_walk(n, visit_label, &label);
+	return label;
+}
+
+/* a break that leaves the statement, not an inner loop or switch */
+static bool visit_break(const struct ast_node *n, void *ud) {
+	bool *found = ud;
+	switch (n->kind) {
+	case AST_STMT_BREAK:
+		*found = true;
+		break;
+	case AST_STMT_WHILE:
+	case AST_STMT_DO_WHILE:
+	case AST_STMT_FOR:
+	case AST_STMT_SWITCH:
+		return false;
+	default:
+		break;
+	}
+	return !*found;
+}
+
+bool opt_stmt_falls_through(const struct ast_node *n,
+		const struct opt_flow *flow) {
+	long long v;
+	switch (n->kind) {
+	case AST_STMT_RETURN:
+	case AST_STMT_BREAK:
+	case AST_STMT_CONTINUE:
+	case AST_STMT_GOTO:
+		return false;
+	case AST_STMT_EXPR:
+		return !n->stmt_expr.a || n->stmt_expr.a->kind != AST_CALL
+			|| !flow->noreturn(n->stmt_expr.a, flow->ud);
+	case AST_STMT_COMP: ;
+		bool reachable = true;
+		for (int i = 0; i < n->stmt_comp.len; ++i) {
+			const struct ast_node *ni =
+				*(const struct ast_node **)vec_get_c(&n->stmt_comp, i);
+			if (ni->kind == AST_DECLARATION) continue;
+			reachable = reachable || opt_stmt_has_label(ni);
+			reachable = reachable && opt_stmt_falls_through(ni, flow);
+		}
+		return reachable;
+	case AST_STMT_IF:
+		if (flow->ce(n->stmt_if.cond, &v, flow->ud)) {
+			const struct ast_node *taken = v
+				? n->stmt_if.stmt : n->stmt_if.stmt_else;
+			const struct ast_node *other = v
+				? n->stmt_if.stmt_else : n->stmt_if.stmt;
+			if (!other || !opt_stmt_has_label(other)) {
+				return !taken || opt_stmt_falls_through(taken, flow);
+			}
+		}
+		return !n->stmt_if.stmt_else
+			|| opt_stmt_falls_through(n->stmt_if.stmt, flow)
+			|| opt_stmt_falls_through(n->stmt_if.stmt_else, flow);
+	case AST_STMT_WHILE: ;
+		bool found = false;
+		ast_walk(n->stmt_while.stmt, visit_break, &found);
+		return found || !flow->ce(n->stmt_while.cond, &v, flow->ud) || !v;
+	case AST_STMT_LABELED:
+		return opt_stmt_falls_through(n->stmt_labeled.stmt, flow);
+	case AST_STMT_LABELED_CASE:
+		return opt_stmt_falls_through(n->stmt_labeled_case.stmt, flow);
+	case AST_STMT_LABELED_DEFAULT:
+		return opt_stmt_falls_through(n->stmt_labeled_default.stmt, flow);
+	default:
+		return true;
+	}
+}
+
+bool opt_stmt_cold(const struct ast_node *n, const struct opt_flow *flow) {
+	long long v;
+	switch (n->kind) {
+	case AST_STMT_RETURN:
+		return n->stmt_return.expr
+			&& flow->ce(n->stmt_return.expr, &v, flow->ud) && v < 0;
+	case AST_STMT_EXPR:
+		return !opt_stmt_falls_through(n, flow);
+	case AST_STMT_COMP:
+		for (int i = 0; i < n->stmt_comp.len; ++i) {
+			const struct ast_node *ni =
+				*(const struct ast_node **)vec_get_c(&n->stmt_comp, i);
+			if (ni->kind == AST_DECLARATION) continue;
+			if (opt_stmt_has_label(ni)) return false;
+			if (opt_stmt_cold(ni, flow)) return true;
+			if (!opt_stmt_falls_through(ni, flow)) return false;
+		}
+		return false;
+	case AST_STMT_IF:
+		return n->stmt_if.stmt_else && opt_stmt_cold(n->stmt_if.stmt, flow)
+			&& opt_stmt_cold(n->stmt_if.stmt_else, flow);
+	default:
+		return false;
+	}
+}
+
+struct dead_ctx {
+	struct vec declared; /* vec<const char *> */
+	struct vec read; /* vec<const char *> */
+};
+static bool visit_dead_locals(const struct ast_node *n, void *ud) {
+	struct dead_ctx *ctx = ud;
+	if (n->kind == AST_BIN && n->bin.kind == AST_BIN_ASSIGN
+			&& n->bin.a->kind == AST_IDENT) {
+		// only written
+		ast_walk(n->bin.b, visit_dead_locals, ud);
+		return false;
+	}
+	if (n->kind == AST_IDENT) add_name(&ctx->read, n->ident);
+	if (n->kind == AST_INIT_DECLARATOR) {
+		const struct ast_node *d = n->init_declarator.declarator;
+		if (d->declarator.ident) {
+			add_name(&ctx->declared, d->declarator.ident->ident);
+		}
+	}
+	return true;
+}
+void opt_dead_locals(const struct ast_node *def, struct vec *res) {
+	struct dead_ctx ctx = {
+		.declared = vec_new_empty(sizeof(const char *)),
+		.read = vec_new_empty(sizeof(const char *)),
+	};
+	ast_walk(def, visit_dead_locals, &ctx);
+	for (int i = 0; i < ctx.declared.len; ++i) {
+		const char * const *ni = vec_get_c(&ctx.declared, i);
+		if (!opt_names_contain(&ctx.read, *ni)) add_name(res, *ni);
+	}
+	vec_free(&ctx.declared);
+	vec_free(&ctx.read);
+}
+
+struct memory_ctx {
+	const struct vec *address_taken;
+	const struct vec *fns;
+	bool reads;
+};
+static bool visit_reads_memory(const struct ast_node *n, void *ud) {
+	struct memory_ctx *ctx = ud;
+	if ((n->kind == AST_UNARY && n->unary.kind == AST_UNARY_DEREF)
+			|| n->kind == AST_INDEX || n->kind == AST_MEMBER
+			|| n->kind == AST_MEMBER_DEREF
+			|| (n->kind == AST_CALL
+				&& opt_call_effects(ctx->fns, n) != OPT_CONST)
+			|| (n->kind == AST_IDENT
+				&& opt_names_contain(ctx->address_taken, n->ident))) {
+		ctx->reads = true;
+	}
+	return !ctx->reads;
+}
+bool opt_expr_reads_memory(const struct ast_node *n,
+		const struct vec *address_taken, const struct vec *fns) {
+	struct memory_ctx ctx = { .address_taken = address_taken, .fns = fns };
+	ast_walk(n, visit_reads_memory, &ctx);
+	return ctx.reads;
+}
+
+struct reads_store_ctx {
+	const struct vec *address_taken;
+	const struct vec *fns;
+	const struct ast_node *target;
+	opt_alias_fn alias;
+	void *ud;
+	bool reads;
+};
+static bool visit_reads_store(const struct ast_node *n, void *ud) {
+	struct reads_store_ctx *ctx = ud;
+	if (n->kind == AST_MEMBER || n->kind == AST_MEMBER_DEREF
+			|| (n->kind == AST_CALL
+				&& opt_call_effects(ctx->fns, n) != OPT_CONST)) {
+		ctx->reads = true;
+	} else if ((n->kind == AST_UNARY && n->unary.kind == AST_UNARY_DEREF)
+			|| n->kind == AST_INDEX
+			|| (n->kind == AST_IDENT
+				&& opt_names_contain(ctx->address_taken, n->ident))) {
+		ctx->reads = ctx->alias(ctx->target, n, ctx->ud);
+	}
+	return !ctx->reads;
+}
+bool opt_expr_reads_store(const struct ast_node *n,
+		const struct ast_node *target, const struct vec *address_taken,
+		const struct vec *fns, opt_alias_fn alias, void *ud) {
+	struct reads_store_ctx ctx = { .address_taken = address_taken,
+		.fns = fns, .target = target, .alias = alias, .ud = ud };
+	ast_walk(n, visit_reads_store, &ctx);
+	return ctx.reads;
+}
+
+/* the identifier an address is based on is reached through sums */
+static bool base_is(const struct ast_node *n, const char *ident) {
+	switch (n->kind) {
+	case AST_IDENT:
+		return strcmp(n->ident, ident) == 0;
+	case AST_BIN:
+		if (n->bin.kind == AST_BIN_ADD) {
+			return base_is(n->bin.a, ident) || base_is(n->bin.b, ident);
+		}
+		return n->bin.kind == AST_BIN_SUB && base_is(n->bin.a, ident);
+	default:
+		return false;
+	}
+}
+struct base_count {
+	const char *ident;
+	int n;
+};
+static bool visit_base_count(const struct ast_node *n, void *ud) {
+	struct base_count *bc = ud;
+	if (n->kind == AST_UNARY && n->unary.kind == AST_UNARY_REF) {
+		// `&p[i]` is not an access, only what computes it may contain some
+		const struct ast_node *a = n->unary.a;
+		if (a->kind == AST_UNARY && a->unary.kind == AST_UNARY_DEREF) {
+			ast_walk(a->unary.a, visit_base_count, ud);
+			return false;
+		} else if (a->kind == AST_INDEX) {
+			ast_walk(a->index.a, visit_base_count, ud);
+			ast_walk(a->index.b, visit_base_count, ud);
+			return false;
+		}
+	} else if (n->kind == AST_UNARY && n->unary.kind == AST_UNARY_DEREF) {
+		if (base_is(n->unary.a, bc->ident)) bc->n++;
+	} else if (n->kind == AST_INDEX) {
+		if (base_is(n->index.a, bc->ident)
+				|| base_is(n->index.b, bc->ident)) {
+			bc->n++;
+		}
+	}
+	return true;
+}
+int opt_base_count(const struct ast_node *n, const char *ident) {
+	struct base_count bc = { .ident = ident };
+	ast_walk(n, visit_base_count, &bc);
+	return bc.n;
+}
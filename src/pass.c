@@ -0,0 +1,171 @@
+// SPDX-License-Identifier: GPL-3.0-only
+#include <c_compiler/pass.h>
+#include <string.h>
+#include <time.h>
+
+static const struct {
+	const char *name;
+	int level; /* the lowest -O level it runs at */
+} passes[PASS_N] = {
+	[PASS_INLINE] = { "inline", 2 },
+	[PASS_PURE] = { "pure", 1 },
+	[PASS_CONST_PROP] = { "const-prop", 1 },
+	[PASS_DCE] = { "dce", 1 },
+	[PASS_CSE] = { "cse", 1 },
+	[PASS_ALIAS] = { "alias", 1 },
+	[PASS_LICM] = { "licm", 2 },
+	[PASS_IV] = { "iv", 2 },
+	[PASS_MEM_IDIOM] = { "mem-idiom", 2 },
+	[PASS_VECTORIZE] = { "vectorize", 2 },
+	[PASS_UNROLL] = { "unroll", 2 },
+	[PASS_IF_CHAIN] = { "if-chain", 1 },
+	[PASS_SELECT] = { "select", 1 },
+	[PASS_COLD] = { "cold", 2 },
+	[PASS_TAIL_CALL] = { "tail-call", 1 },
+	[PASS_MUL_DIV] = { "mul-div", 1 },
+	[PASS_ISEL] = { "isel", 1 },
+	[PASS_SCHED] = { "sched", 2 },
+};
+static const char *analyses[PASS_A_N] = {
+	[PASS_A_FUNCTIONS] = "functions",
+	[PASS_A_ADDRESS_TAKEN] = "address-taken",
+	[PASS_A_ALIAS] = "alias",
+	[PASS_A_DEAD_LOCALS] = "dead-locals",
+};
+
+struct pass_cached {
+	enum pass_analysis a;
+	const void *key;
+	struct vec res;
+};
+
+static double now(void) {
+	struct timespec ts;
+	timespec_get(&ts, TIME_UTC);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+void pass_manager_init(struct pass_manager *pm) {
+	*pm = (struct pass_manager){
+		.level = PASS_LEVEL_MAX,
+		.timers = vec_new_empty(sizeof(int)),
+		.cache = vec_new_empty(sizeof(struct pass_cached)),
+	};
+}
+void pass_manager_finish(struct pass_manager *pm) {
+	for (int i = 0; i < PASS_A_N; ++i) pass_invalidate(pm, i);
+	vec_free(&pm->cache);
+	vec_free(&pm->timers);
+}
+
+bool pass_option(struct pass_manager *pm, const char *arg) {
+	if (strncmp(arg, "-O", 2) == 0 && arg[2] >= '0'
+			&& arg[2] <= '0' + PASS_LEVEL_MAX && !arg[3]) {
+		pm->level = arg[2] - '0';
+		return true;
+	}
+	if (strcmp(arg, "-fstats") == 0) {
+		pm->print_stats = true;
+		return true;
+	}
+	if (strncmp(arg, "-f", 2) != 0) return false;
+	const char *name = arg + 2;
+	int force = 1;
+	if (strncmp(name, "no-", 3) == 0) {
+		name += 3;
+		force = -1;
+	}
+	for (int p = 0; p < PASS_N; ++p) {
+		if (strcmp(name, passes[p].name) == 0) {
+			pm->force[p] = force;
+			return true;
+		}
+	}
+	return false;
+}
+const char *pass_name(enum pass_id p) {
+	return passes[p].name;
+}
+bool pass_enabled(const struct pass_manager *pm, enum pass_id p) {
+	if (pm->force[p]) return pm->force[p] > 0;
+	return pm->level >= passes[p].level;
+}
+
+/* counts the time until now towards the innermost timer */
+static void lap(struct pass_manager *pm) {
+	double t = now();
+	if (pm->timers.len > 0) {
+		int i = *(int *)vec_get(&pm->timers, pm->timers.len - 1);
+		pm->stats[i].seconds += t - pm->start;
+	}
+	pm->start = t;
+}
+static void push(struct pass_manager *pm, int timer) {
+	lap(pm);
+	vec_append(&pm->timers, &timer);
+}
+bool pass_begin(struct pass_manager *pm, enum pass_id p) {
+	if (!pass_enabled(pm, p)) return false;
+	push(pm, p);
+	return true;
+}
+void pass_analysis_begin(struct pass_manager *pm, enum pass_analysis a) {
+	pm->stats[PASS_N + a].changes++;
+	push(pm, PASS_N + a);
+}
+void pass_end(struct pass_manager *pm) {
+	lap(pm);
+	pm->timers.len--;
+}
+void pass_changed(struct pass_manager *pm, enum pass_id p) {
+	pm->stats[p].changes++;
+}
+
+const struct vec *pass_cached(struct pass_manager *pm, enum pass_analysis a,
+		const void *key) {
+	for (int i = 0; i < pm->cache.len; ++i) {
+		struct pass_cached *c = vec_get(&pm->cache, i);
+		if (c->a == a && c->key == key) {
+			pm->stats[PASS_N + a].reused++;
+			return &c->res;
+		}
+	}
+	return NULL;
+}
+const struct vec *pass_cache(struct pass_manager *pm, enum pass_analysis a,
+		const void *key, struct vec res) {
+	vec_append(&pm->cache, &(struct pass_cached){ .a = a, .key = key,
+		.res = res });
+	return &((struct pass_cached *)vec_get(&pm->cache,
+		pm->cache.len - 1))->res;
+}
+void pass_invalidate(struct pass_manager *pm, enum pass_analysis a) {
+	int n = 0;
+	for (int i = 0; i < pm->cache.len; ++i) {
+		struct pass_cached *c = vec_get(&pm->cache, i);
+		if (c->a == a) {
+			vec_free(&c->res);
+		} else {
+			*(struct pass_cached *)vec_get(&pm->cache, n++) = *c;
+		}
+	}
+	pm->cache.len = n;
+}
+
+void pass_print_stats(const struct pass_manager *pm, FILE *f) {
+	for (int p = 0; p < PASS_N; ++p) {
+		const struct pass_stats *st = &pm->stats[p];
+		if (!pass_enabled(pm, p)) {
+			fprintf(f, "info: pass `%s`: off\n", passes[p].name);
+			continue;
+		}
+		fprintf(f, "info: pass `%s`: %.3f ms, %d changes\n",
+			passes[p].name, st->seconds * 1e3, st->changes);
+	}
+	for (int a = 0; a < PASS_A_N; ++a) {
+		const struct pass_stats *st = &pm->stats[PASS_N + a];
+		fprintf(f, "info: analysis `%s`: %.3f ms, %d computed, "
+			"%d reused\n", analyses[a], st->seconds * 1e3, st->changes,
+			st->reused);
+	}
+}
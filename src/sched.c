@@ -0,0 +1,343 @@
+// SPDX-License-Identifier: GPL-3.0-only
+#include <c_compiler/sched.h>
+
+#define N ISEL_CODE_MAX
+#define CYCLES_MAX (N * 12)
+#define WIDTH 4
+
+/* execution ports, of which an instruction can use any in the mask */
+enum {
+	P0 = 1 << 0, P1 = 1 << 1, P2 = 1 << 2, P3 = 1 << 3,
+	P4 = 1 << 4, P5 = 1 << 5, P6 = 1 << 6, P7 = 1 << 7,
+	ALU = P0 | P1 | P5 | P6,
+	LOAD = P2 | P3,
+	STORE_ADDR = P2 | P3 | P7,
+	STORE_DATA = P4,
+	MUL = P1,
+	SHIFT = P0 | P6,
+	LEA_FAST = P1 | P5,
+	LEA_SLOW = P1,
+};
+
+struct info {
+	int lat; /* until the result can be used */
+	int uops;
+	unsigned ports[4];
+	/* the value each register operand is part of, -1 if it isn't one */
+	int d, s, base;
+	int reads[3], n_reads;
+	int def; /* the value written, -1 if none */
+	bool fresh; /* whether def starts the value, else it updates it */
+};
+/* the values a register holds from one write that doesn't read it until
+ * the last read, they are what the registers are assigned to */
+struct deps {
+	int n, values;
+	struct info info[N];
+	int lat[N][N]; /* lat[i][j] of the edge from i to j, -1 for none */
+	int uses[N]; /* of each value */
+	int height[N]; /* the longest path from the start of i to the end */
+};
+
+static bool in_place(enum isel_opcode op) {
+	switch (op) {
+	case ISEL_I_ADD:
+	case ISEL_I_SUB:
+	case ISEL_I_IMUL:
+	case ISEL_I_SHL:
+	case ISEL_I_INC:
+	case ISEL_I_DEC:
+	case ISEL_I_CMP:
+		return true;
+	default:
+		return false;
+	}
+}
+static void uop(struct info *f, unsigned ports) {
+	f->ports[f->uops++] = ports;
+}
+/* the uops and latency of an instruction on a generic recent core */
+static void model(const struct isel_insn *x, struct info *f) {
+	bool mem_s = x->s.kind == ISEL_O_MEM, mem_d = x->d.kind == ISEL_O_MEM;
+	f->uops = 0;
+	switch (x->op) {
+	case ISEL_I_LOAD:
+		uop(f, LOAD);
+		f->lat = 5;
+		return;
+	case ISEL_I_MOV:
+		uop(f, ALU);
+		f->lat = 1;
+		return;
+	case ISEL_I_STORE:
+		uop(f, STORE_ADDR);
+		uop(f, STORE_DATA);
+		f->lat = 1;
+		return;
+	case ISEL_I_ADD:
+	case ISEL_I_SUB:
+	case ISEL_I_INC:
+	case ISEL_I_DEC:
+	case ISEL_I_CMP:
+		uop(f, ALU);
+		f->lat = 1;
+		break;
+	case ISEL_I_IMUL:
+	case ISEL_I_IMUL3:
+		uop(f, MUL);
+		f->lat = 3;
+		break;
+	case ISEL_I_SHL:
+		uop(f, SHIFT);
+		f->lat = 1;
+		return;
+	case ISEL_I_LEA:
+		// three components take the slow unit
+		if (x->base >= 0 && x->k) {
+			uop(f, LEA_SLOW);
+			f->lat = 3;
+		} else {
+			uop(f, LEA_FAST);
+			f->lat = 1;
+		}
+		return;
+	}
+	if (mem_s || mem_d) {
+		uop(f, LOAD);
+		f->lat += 5;
+	}
+	if (mem_d && x->op != ISEL_I_CMP) {
+		uop(f, STORE_ADDR);
+		uop(f, STORE_DATA);
+	}
+}
+
+static void edge(struct deps *g, int from, int to, int lat) {
+	if (from >= 0 && from != to && g->lat[from][to] < lat)
+		g->lat[from][to] = lat;
+}
+static void add_read(struct deps *g, int i, int value) {
+	struct info *f = &g->info[i];
+	if (value < 0) return;
+	for (int k = 0; k < f->n_reads; ++k)
+		if (f->reads[k] == value) return;
+	f->reads[f->n_reads++] = value;
+	g->uses[value]++;
+}
+/* the values of the registers and the edges between the instructions, the
+ * readers of a value come before it is updated, and the last instruction,
+ * which stores, compares or moves the result to rax, after all others */
+static void analyze(const struct isel_code *c, struct deps *g) {
+	int cur[ISEL_REGS], writer[N];
+	uint64_t readers[N];
+	g->n = c->n;
+	g->values = 0;
+	for (int r = 0; r < ISEL_REGS; ++r) cur[r] = -1;
+	for (int i = 0; i < c->n; ++i) {
+		for (int j = 0; j < c->n; ++j) g->lat[i][j] = -1;
+		g->uses[i] = 0;
+	}
+	for (int i = 0; i < c->n; ++i) {
+		const struct isel_insn *x = &c->insns[i];
+		struct info *f = &g->info[i];
+		model(x, f);
+		f->n_reads = 0;
+		f->s = x->s.kind == ISEL_O_REG ? cur[x->s.reg] : -1;
+		f->base = x->op == ISEL_I_LEA && x->base >= 0 ? cur[x->base] : -1;
+		f->d = x->d.kind == ISEL_O_REG && in_place(x->op)
+			? cur[x->d.reg] : -1;
+		add_read(g, i, f->s);
+		add_read(g, i, f->base);
+		add_read(g, i, f->d);
+		for (int k = 0; k < f->n_reads; ++k) {
+			int v = f->reads[k];
+			edge(g, writer[v], i, g->info[writer[v]].lat);
+			readers[v] |= 1ull << i;
+		}
+		f->def = -1;
+		f->fresh = false;
+		if (x->d.kind != ISEL_O_REG || x->op == ISEL_I_CMP) continue;
+		if (f->d >= 0) {
+			f->def = f->d;
+			for (int j = 0; j < i; ++j)
+				if (readers[f->def] & 1ull << j) edge(g, j, i, 0);
+		} else {
+			f->def = f->d = cur[x->d.reg] = g->values++;
+			f->fresh = true;
+		}
+		writer[f->def] = i;
+		readers[f->def] = 0;
+	}
+	for (int i = 0; i < c->n - 1; ++i) edge(g, i, c->n - 1, 0);
+	for (int i = c->n - 1; i >= 0; --i) {
+		g->height[i] = g->info[i].lat;
+		for (int j = i + 1; j < c->n; ++j) {
+			int h = g->lat[i][j] + g->height[j];
+			if (g->lat[i][j] >= 0 && h > g->height[i]) g->height[i] = h;
+		}
+	}
+}
+
+/* takes a free port for each uop of f, false if there isn't one */
+static bool take_ports(const struct info *f, unsigned *used) {
+	unsigned u = *used;
+	for (int k = 0; k < f->uops; ++k) {
+		unsigned free = f->ports[k] & ~u;
+		if (!free) return false;
+		// the highest port leaves the others to the units only they have
+		unsigned p = 1u << 7;
+		while (!(free & p)) p >>= 1;
+		u |= p;
+	}
+	*used = u;
+	return true;
+}
+/* the cycle from which the operands of i are there */
+static int ready(const struct deps *g, const int *issue, int i) {
+	int t = 0;
+	for (int j = 0; j < g->n; ++j)
+		if (g->lat[j][i] >= 0 && issue[j] + g->lat[j][i] > t)
+			t = issue[j] + g->lat[j][i];
+	return t;
+}
+
+int sched_cycles(const struct isel_code *c) {
+	struct deps g;
+	unsigned used[CYCLES_MAX] = { 0 };
+	int width[CYCLES_MAX] = { 0 };
+	int issue[N], end = 0, t = 0;
+	analyze(c, &g);
+	for (int i = 0; i < c->n; ++i) {
+		int r = ready(&g, issue, i);
+		if (r > t) t = r;
+		while (t < CYCLES_MAX - 1
+				&& (width[t] == WIDTH || !take_ports(&g.info[i], &used[t])))
+			++t;
+		width[t]++;
+		issue[i] = t;
+		if (t + g.info[i].lat > end) end = t + g.info[i].lat;
+	}
+	return end;
+}
+
+/* the values the registers hold after i, or more than ISEL_REGS if it
+ * can't be issued */
+static int pressure(const struct deps *g, const int *uses, int live, int i) {
+	const struct info *f = &g->info[i];
+	for (int k = 0; k < f->n_reads; ++k)
+		if (uses[f->reads[k]] == 1 && f->reads[k] != f->def) live--;
+	return live + f->fresh;
+}
+/* whether a should be issued before b */
+static bool better(const struct deps *g, const struct isel_code *c, int a,
+		int b) {
+	if (b < 0) return true;
+	if (g->height[a] != g->height[b]) return g->height[a] > g->height[b];
+	return c->insns[a].op == ISEL_I_LOAD && c->insns[b].op != ISEL_I_LOAD;
+}
+/* the order to issue the instructions in, false if the registers don't
+ * suffice for any order it finds */
+static bool order(const struct deps *g, const struct isel_code *c,
+		int *res) {
+	int issue[N], uses[N], n = 0, live = 0;
+	uint64_t done = 0;
+	for (int i = 0; i < g->n; ++i) issue[i] = -1;
+	for (int v = 0; v < g->values; ++v) uses[v] = g->uses[v];
+	for (int t = 0, idle = 0; n < g->n; ++t) {
+		unsigned used = 0;
+		int width = 0;
+		bool issued = false;
+		while (width < WIDTH) {
+			int best = -1;
+			for (int i = 0; i < g->n; ++i) {
+				if (done & 1ull << i) continue;
+				bool ok = true;
+				for (int j = 0; j < g->n && ok; ++j)
+					ok = g->lat[j][i] < 0 || done & 1ull << j;
+				unsigned u = used;
+				if (!ok || ready(g, issue, i) > t
+						|| pressure(g, uses, live, i) > ISEL_REGS
+						|| !take_ports(&g->info[i], &u)) {
+					continue;
+				}
+				if (better(g, c, i, best)) best = i;
+			}
+			if (best < 0) break;
+			take_ports(&g->info[best], &used);
+			live = pressure(g, uses, live, best);
+			for (int k = 0; k < g->info[best].n_reads; ++k)
+				uses[g->info[best].reads[k]]--;
+			issue[best] = t;
+			done |= 1ull << best;
+			res[n++] = best;
+			width++;
+			issued = true;
+		}
+		// waiting doesn't lower the pressure
+		idle = issued ? 0 : idle + 1;
+		if (idle > 16) return false;
+	}
+	return true;
+}
+
+/* the registers for the values, in the new order, the result goes to rax
+ * so the move to it can go */
+static bool assign(const struct deps *g, const struct isel_code *c,
+		const int *ord, struct isel_code *res) {
+	int reg[N], uses[N], result = -1;
+	unsigned free = (1u << ISEL_REGS) - 1;
+	const struct isel_insn *last = &c->insns[c->n - 1];
+	const struct info *fl = &g->info[c->n - 1];
+	bool move = last->op == ISEL_I_MOV && last->s.kind == ISEL_O_REG;
+	if (move) result = fl->s;
+	else if (fl->def >= 0 && last->d.reg == 0) result = fl->def;
+	for (int v = 0; v < g->values; ++v) uses[v] = g->uses[v];
+	*res = (struct isel_code){ .n = 0, .cost = c->cost };
+	for (int k = 0; k < c->n; ++k) {
+		int i = ord[k];
+		const struct info *f = &g->info[i];
+		struct isel_insn x = c->insns[i];
+		if (f->s >= 0) x.s.reg = reg[f->s];
+		if (f->base >= 0) x.base = reg[f->base];
+		if (f->d >= 0 && !f->fresh) x.d.reg = reg[f->d];
+		for (int j = 0; j < f->n_reads; ++j) {
+			int v = f->reads[j];
+			if (--uses[v] == 0 && v != f->def) free |= 1u << reg[v];
+		}
+		if (f->fresh) {
+			int r = 0;
+			bool want_rax = f->def == result || (move && i == c->n - 1);
+			if (!want_rax || !(free & 1)) {
+				// rax is kept for the result where possible
+				while (r < ISEL_REGS && !(free & 1u << r & ~1u)) ++r;
+				if (r == ISEL_REGS) r = 0;
+			}
+			if (!(free & 1u << r)) return false;
+			free &= ~(1u << r);
+			reg[f->def] = x.d.reg = r;
+		}
+		res->insns[res->n++] = x;
+	}
+	struct isel_insn *l = &res->insns[res->n - 1];
+	if (move && l->s.reg == 0) {
+		res->n--;
+	} else if (!move && result >= 0 && reg[result] != 0) {
+		if (res->n == ISEL_CODE_MAX) return false;
+		res->insns[res->n++] = (struct isel_insn){ .op = ISEL_I_MOV,
+			.size = 8, .d = { .kind = ISEL_O_REG, .reg = 0 },
+			.s = { .kind = ISEL_O_REG, .reg = reg[result] } };
+	}
+	return true;
+}
+
+bool sched_code(struct isel_code *c) {
+	struct deps g;
+	struct isel_code res;
+	int ord[N];
+	if (c->n < 3) return false;
+	analyze(c, &g);
+	if (!order(&g, c, ord) || !assign(&g, c, ord, &res)) return false;
+	if (sched_cycles(&res) >= sched_cycles(c)) return false;
+	*c = res;
+	return true;
+}
@@ -0,0 +1,219 @@
+// SPDX-License-Identifier: GPL-3.0-only
+#include <assert.h>
+#include <c_compiler/type.h>
+
+#define container_of(ptr, type, member) \
+	(type *)((char *)(ptr) - offsetof(type, member))
+
+void warn_node(const char *msg, const struct ast_node *n) {
+	fprintf(stderr, "%s: `", msg);
+	ast_fprint(stderr, n, 0);
+	fprintf(stderr, "`\n");
+}
+void warn_type(const char *msg, const struct type *t) {
+	const struct ast_node *ns = container_of(t->s, struct ast_node, declaration_specifiers);
+	const struct ast_node *nd = container_of(t->d, struct ast_node, declarator);
+
+	fprintf(stderr, "%s: { %sapp: %d, `", msg,
+		t->address_of ? "&, " : "", t->app);
+	ast_fprint(stderr, ns, 0);
+	fprintf(stderr, "` `");
+	ast_fprint(stderr, nd, 0);
+	fprintf(stderr, "` }\n");
+}
+
+status const_eval(const struct ast_node *n, int *res) {
+	long long v;
+	if (const_value(n, &v, NULL)) {
+		*res = v;
+		return S_OK;
+	}
+	warn_node("error: can't eval const expression", n);
+	return S_ERROR;
+}
+
+bool type_all_applied(const struct type *t) {
+	return !t->address_of && t->app == t->d->v.len;
+}
+bool type_is_const(const struct type *t) {
+	if (type_all_applied(t)) {
+		return t->s->type_qualifiers[AST_TYPE_QUALIFIER_CONST] > 0;
+	} else if (t->address_of) {
+		// cant modify the result of the address-of operator
+		return true;
+	} else {
+		const struct ast_node *n =
+			*(const struct ast_node **)vec_get_c(&t->d->v, t->app);
+		if (n->kind == AST_FUNCTION_DECLARATOR
+				|| n->kind == AST_ARRAY_DECLARATOR) {
+			// we can't modify arrays or functions
+			return true;
+		}
+		assert(n->kind == AST_POINTER_DECLARATOR);
+		return n->pointer_declarator
+			.type_qualifiers[AST_TYPE_QUALIFIER_CONST] > 0;
+	}
+}
+bool type_is_pointer(const struct type *t) {
+	if (type_all_applied(t)) return false;
+	if (t->address_of) return true;
+	const struct ast_node *n =
+		*(const struct ast_node **)vec_get_c(&t->d->v, t->app);
+	return n->kind == AST_POINTER_DECLARATOR;
+}
+bool type_apply_address_of(struct type *t) {
+	if (t->address_of) {
+		warn_type("can't take address of", t);
+		return false;
+	}
+	t->address_of = true;
+	return true;
+}
+bool type_apply_deref(struct type *t) {
+	if (t->address_of) {
+		t->address_of = false;
+		return true;
+	}
+	if (type_all_applied(t)) goto error;
+	const struct ast_node *n =
+		*(const struct ast_node **)vec_get_c(&t->d->v, t->app);
+	if (n->kind == AST_POINTER_DECLARATOR) {
+		t->app++;
+		return true;
+	}
+error:
+	warn_type("can't apply dereference operator", t);
+	return false;
+}
+bool type_apply_call(struct type *t) {
+	if (t->address_of) goto error;
+	if (type_all_applied(t)) goto error;
+	const struct ast_node *n =
+		*(const struct ast_node **)vec_get_c(&t->d->v, t->app);
+	if (n->kind == AST_FUNCTION_DECLARATOR) {
+		t->app++;
+		return true;
+	}
+error:
+	warn_type("can't call", t);
+	return false;
+}
+bool type_apply_array(struct type *t) {
+	if (t->address_of) goto error;
+	if (type_all_applied(t)) return false;
+	const struct ast_node *n =
+		*(const struct ast_node **)vec_get_c(&t->d->v, t->app);
+	if (n->kind == AST_ARRAY_DECLARATOR) {
+		t->app++;
+		return true;
+	}
+error:
+	warn_type("can't apply array subscripting", t);
+	return false;
+}
+bool type_apply_decay(struct type *t) {
+	return type_apply_array(t) && type_apply_address_of(t);
+}
+bool type_is_array(const struct type *t) {
+	if (type_all_applied(t) || t->address_of) return false;
+	const struct ast_node *n =
+		*(const struct ast_node **)vec_get_c(&t->d->v, t->app);
+	return n->kind == AST_ARRAY_DECLARATOR;
+}
+bool type_is_unsigned(const struct type *t) {
+	return type_all_applied(t)
+		&& t->s->builtin_type_specifiers[AST_BUILTIN_TYPE_UNSIGNED];
+}
+bool type_is_arithmetic(const struct type *t) {
+	if (!type_all_applied(t)) return false;
+	// TODO: check builtin types
+	return true;
+}
+
+status type_get_size(const struct type *t, int *res) {
+	if (t->address_of) {
+		return *res = 8, S_OK;
+	}
+	if (type_all_applied(t)) {
+		const char *bs = t->s->builtin_type_specifiers;
+		if (bs[AST_BUILTIN_TYPE_CHAR]) return *res = 1, S_OK;
+		if (bs[AST_BUILTIN_TYPE_INT]) return *res = 4, S_OK;
+		if (bs[AST_BUILTIN_TYPE_VOID]) return *res = 0, S_OK;
+		goto error;
+	}
+	const struct ast_node *n =
+		*(const struct ast_node **)vec_get_c(&t->d->v, t->app);
+	if (n->kind == AST_POINTER_DECLARATOR) return *res = 8, S_OK;
+	if (n->kind == AST_ARRAY_DECLARATOR) {
+		int array_n, tt_res;
+		if (const_eval(n->array_declarator.size, &array_n) == S_ERROR)
+			goto error;
+		struct type tt = *t;
+		if (!type_apply_array(&tt)) goto error;
+		if (type_get_size(&tt, &tt_res) == S_ERROR) goto error;
+		*res = array_n * tt_res;
+		return S_OK;
+	}
+	if (n->kind == AST_FUNCTION_DECLARATOR) {
+		// here we are supposed to automatically apply the address-of
+		// operator
+		return *res = 8, S_OK;
+	}
+	assert(false);
+error:
+	warn_type("can't determine size of", t);
+	return S_ERROR;
+}
+/* the integer conversion rank, char below int, 0 for anything else */
+static int type_rank(const struct type *t) {
+	if (!type_all_applied(t)) return 0;
+	return t->s->builtin_type_specifiers[AST_BUILTIN_TYPE_CHAR] ? 1 : 2;
+}
+struct type type_conditional(const struct type *a, const struct type *b) {
+	struct type res = *a;
+	if (type_is_pointer(a) || type_is_array(a)) {
+		res = *a;
+	} else if (type_is_pointer(b) || type_is_array(b)) {
+		res = *b;
+	} else {
+		int ra = type_rank(a), rb = type_rank(b);
+		if (rb > ra || (rb == ra && rb == 2 && type_is_unsigned(b)))
+			res = *b;
+	}
+	if (type_is_array(&res)) type_apply_decay(&res);
+	return res;
+}
+struct type type_from_typename(struct ast_node *n) {
+	assert(n->kind == AST_TYPE_NAME);
+	return (struct type){
+		.app = 0,
+		.s = &n->type_name.specifier_qualifier_list->declaration_specifiers,
+		.d = &n->type_name.declarator->declarator
+	};
+}
+/* like const_eval, but quiet, so it can be used to probe expressions */
+bool const_value(const struct ast_node *n, long long *res, void *ud) {
+	long long a, b;
+	switch (n->kind) {
+	case AST_INTEGER:
+		return *res = n->integer, true;
+	case AST_CHARACTER_CONSTANT:
+		return *res = n->character_constant, true;
+	case AST_SIZEOF_EXPR: ;
+		struct type t = type_from_typename(n->sizeof_expr.type_name);
+		int size;
+		if (type_get_size(&t, &size) == S_ERROR) return false;
+		return *res = size, true;
+	case AST_BIN:
+		if (!const_value(n->bin.a, &a, ud)) return false;
+		if (!const_value(n->bin.b, &b, ud)) return false;
+		switch (n->bin.kind) {
+		case AST_BIN_ADD: return *res = a + b, true;
+		case AST_BIN_SUB: return *res = a - b, true;
+		case AST_BIN_MUL: return *res = a * b, true;
+		default: return false;
+		}
+	default:
+		return false;
+	}
+}
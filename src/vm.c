@@ -0,0 +1,1525 @@
+// SPDX-License-Identifier: GPL-3.0-only
+#include <assert.h>
+#include <c_compiler/vm.h>
+#include <c_compiler/type.h>
+#include <c_compiler/opt.h>
+#include <ds/hashmap.h>
+#include <limits.h>
+
+#define GETI(x, i) *(struct ast_node * const *)vec_get_c(&(x), i)
+
+/* a name of a scope, a function or a local in a register or in the frame */
+struct var {
+	struct type t;
+	int fn; /* index of the function, -1 for a local */
+	int reg; /* -1 if the local is in the frame */
+	int loc; /* of the local in the frame */
+};
+
+struct scope {
+	struct scope *parent;
+	struct hashmap vars; /* hashmap<struct var> */
+};
+
+enum val_kind {
+	V_IMM, /* k */
+	V_REG, /* the register reg */
+	V_MEM, /* [reg + k], or [reg + register index] */
+	V_FRAME, /* [frame + k] */
+	V_FN, /* the function fn */
+};
+
+typedef struct {
+	enum val_kind kind;
+	int reg, index, fn;
+	long long k;
+	bool lvalue;
+	struct type t;
+} val;
+
+struct fixup {
+	int at; /* the word that gets the target */
+	int label;
+};
+
+struct state {
+	struct vm_code *c;
+	struct scope *scope;
+	int top; /* the first free register */
+	int regs; /* registers used by the function */
+	int frame; /* bytes of frame memory used by the function */
+	struct vec labels; /* vec<int>, word indices, -1 until placed */
+	struct vec fixups; /* vec<struct fixup> */
+	struct vec breaks; /* vec<int>, labels */
+	struct vec continues; /* vec<int>, labels */
+	struct vec switch_labels; /* vec<struct switch_label> */
+	struct vec address_taken; /* vec<const char *> */
+	int size; /* of the result of the function */
+	bool escapes; /* pointers to the frame may be live */
+	struct hashmap goto_labels; /* hashmap<int> */
+	struct ast_node *spec_int, *spec_char, *decl_empty, *decl_p;
+	struct type t_int, t_char_p;
+};
+
+static status gen(struct state *s, const struct ast_node *n, int dest,
+	val *res);
+static status gen_stmt(struct state *s, const struct ast_node *n);
+
+static int reg_new(struct state *s) {
+	if (++s->top > s->regs) s->regs = s->top;
+	return s->top - 1;
+}
+
+static int ins(struct state *s, enum vm_op op, int a, int b, int c) {
+	int at = s->c->code.len;
+	int w[VM_INS] = { op, a, b, c };
+	for (int i = 0; i < VM_INS; ++i) vec_append(&s->c->code, &w[i]);
+	return at;
+}
+static int label_new(struct state *s) {
+	return vec_append(&s->labels, &(int){ -1 });
+}
+static void label_put(struct state *s, int l) {
+	*(int *)vec_get(&s->labels, l) = s->c->code.len;
+}
+/* an instruction with a label as operand k */
+static void ins_jump(struct state *s, enum vm_op op, int a, int b, int c,
+		int k, int label) {
+	int at = ins(s, op, a, b, c);
+	vec_append(&s->fixups, &(struct fixup){ .at = at + 1 + k,
+		.label = label });
+}
+static void fixups_apply(struct state *s) {
+	for (int i = 0; i < s->fixups.len; ++i) {
+		const struct fixup *f = vec_get_c(&s->fixups, i);
+		*(int *)vec_get(&s->c->code, f->at) =
+			*(int *)vec_get(&s->labels, f->label);
+	}
+	s->fixups.len = 0;
+	s->labels.len = 0;
+}
+
+static bool fits(long long k) {
+	return k >= INT_MIN && k <= INT_MAX;
+}
+/* the value as a read at the size gives it */
+static long long normalize(long long k, int size) {
+	if (size == 1) return (unsigned char)k;
+	if (size == 4) return (unsigned int)k;
+	return k;
+}
+static void movi(struct state *s, int dest, long long k) {
+	if (fits(k)) {
+		ins(s, VM_MOVI, dest, k, 0);
+		return;
+	}
+	int i = vec_append(&s->c->consts, &k);
+	ins(s, VM_MOVK, dest, i, 0);
+}
+static enum vm_op sized(enum vm_op op, int size) {
+	return op + (size == 1 ? 0 : size == 4 ? 1 : 2);
+}
+
+static int val_size(const val *v, int *size) {
+	return type_get_size(&v->t, size);
+}
+
+/* [reg + index] as [reg + k], with the sum in a new register */
+static void mem_plain(struct state *s, val *v) {
+	if (v->kind == V_MEM && v->index >= 0) {
+		int r = reg_new(s);
+		ins(s, VM_ADD, r, v->reg, v->index);
+		v->reg = r;
+		v->index = -1;
+		v->k = 0;
+	} else if (v->kind == V_FRAME) {
+		int r = reg_new(s);
+		ins(s, VM_LEAF, r, v->k, 0);
+		*v = (val){ .kind = V_MEM, .reg = r, .index = -1,
+			.lvalue = v->lvalue, .t = v->t };
+	}
+}
+
+/* the address of an lvalue into dest */
+static status load_addr(struct state *s, const val *v, int dest) {
+	switch (v->kind) {
+	case V_FRAME:
+		ins(s, VM_LEAF, dest, v->k, 0);
+		return S_OK;
+	case V_MEM:
+		if (v->index >= 0) {
+			ins(s, VM_ADD, dest, v->reg, v->index);
+		} else if (v->k) {
+			ins(s, VM_ADDI, dest, v->reg, v->k);
+		} else if (dest != v->reg) {
+			ins(s, VM_MOV, dest, v->reg, 0);
+		}
+		return S_OK;
+	default:
+		fprintf(stderr, "error: the value has no address\n");
+		return S_ERROR;
+	}
+}
+
+/* the value into a register, dest if it is not negative */
+static status load(struct state *s, val *v, int dest, int *res) {
+	int size;
+	if (v->kind == V_FN) {
+		fprintf(stderr, "error: functions can only be called\n");
+		return S_ERROR;
+	}
+	if (type_is_array(&v->t)) {
+		*res = dest >= 0 ? dest : reg_new(s);
+		if (load_addr(s, v, *res) == S_ERROR) return S_ERROR;
+		*v = (val){ .kind = V_REG, .reg = *res, .t = v->t };
+		type_apply_decay(&v->t);
+		return S_OK;
+	}
+	if (val_size(v, &size) == S_ERROR) return S_ERROR;
+	if (size == 0) {
+		warn_type("can't read void type", &v->t);
+		return S_ERROR;
+	}
+	if (v->kind == V_REG) {
+		*res = v->reg;
+		if (dest >= 0 && dest != v->reg) {
+			ins(s, VM_MOV, dest, v->reg, 0);
+			*res = dest;
+		}
+		return S_OK;
+	}
+	*res = dest >= 0 ? dest : reg_new(s);
+	switch (v->kind) {
+	case V_IMM:
+		movi(s, *res, normalize(v->k, size));
+		break;
+	case V_MEM:
+		if (v->index >= 0) {
+			ins(s, sized(VM_LDX1, size), *res, v->reg, v->index);
+		} else {
+			ins(s, sized(VM_LD1, size), *res, v->reg, v->k);
+		}
+		break;
+	case V_FRAME:
+		ins(s, sized(VM_LDF1, size), *res, v->k, 0);
+		break;
+	default:
+		assert(false);
+	}
+	return S_OK;
+}
+
+/* src, a value of type t, into the lvalue */
+static status store(struct state *s, const val *lv, int src,
+		const struct type *t) {
+	int size, src_size;
+	if (val_size(lv, &size) == S_ERROR) return S_ERROR;
+	if (type_get_size(t, &src_size) == S_ERROR) return S_ERROR;
+	val v = *lv;
+	switch (v.kind) {
+	case V_REG:
+		// the register holds what a read of the memory would give
+		if (src_size > size && size < 8) {
+			ins(s, size == 1 ? VM_ZX8 : VM_ZX32, v.reg, src, 0);
+		} else if (src != v.reg) {
+			ins(s, VM_MOV, v.reg, src, 0);
+		}
+		return S_OK;
+	case V_MEM:
+		if (v.index >= 0) {
+			ins(s, sized(VM_STX1, size), v.reg, v.index, src);
+		} else {
+			ins(s, sized(VM_ST1, size), v.reg, v.k, src);
+		}
+		return S_OK;
+	case V_FRAME:
+		ins(s, sized(VM_STF1, size), v.k, src, 0);
+		return S_OK;
+	default:
+		fprintf(stderr, "error: can't assign to the value\n");
+		return S_ERROR;
+	}
+}
+
+/* the value into the lvalue, constants as they read at its size */
+static status assign(struct state *s, const val *lv, val *v) {
+	int r, size, lv_size;
+	if (v->kind == V_IMM && lv->kind == V_REG) {
+		if (val_size(v, &size) == S_ERROR
+				|| val_size(lv, &lv_size) == S_ERROR) {
+			return S_ERROR;
+		}
+		movi(s, lv->reg, normalize(normalize(v->k, size), lv_size));
+		return S_OK;
+	}
+	// a local in a register gets the value directly
+	if (load(s, v, lv->kind == V_REG && v->kind != V_REG ? lv->reg : -1,
+			&r) == S_ERROR) {
+		return S_ERROR;
+	}
+	return store(s, lv, r, &v->t);
+}
+
+/* a register for the result of an operation */
+static int dest_reg(struct state *s, int dest) {
+	return dest >= 0 ? dest : reg_new(s);
+}
+
+static struct var *scope_lookup(struct scope *scope, const char *ident) {
+	for (; scope; scope = scope->parent) {
+		struct var *v;
+		if (hashmap_get(&scope->vars, ident, (void **)&v) == MAP_OK)
+			return v;
+	}
+	return NULL;
+}
+static status gen_ident(struct state *s, const struct ast_node *n, val *res) {
+	const struct var *v = scope_lookup(s->scope, n->ident);
+	if (!v) {
+		fprintf(stderr, "Error: undefined identifier `%s`\n", n->ident);
+		return S_ERROR;
+	}
+	if (v->fn >= 0) {
+		*res = (val){ .kind = V_FN, .fn = v->fn, .t = v->t };
+	} else if (v->reg >= 0) {
+		*res = (val){ .kind = V_REG, .reg = v->reg, .lvalue = true,
+			.t = v->t };
+	} else {
+		*res = (val){ .kind = V_FRAME, .k = v->loc, .lvalue = true,
+			.t = v->t };
+	}
+	return S_OK;
+}
+
+static bool val_pointer(const val *v) {
+	return type_is_pointer(&v->t) || type_is_array(&v->t);
+}
+
+/* the type of a sum or difference, false if the operands can't have one */
+static bool bin_type(enum ast_bin_kind kind, const val *a, const val *b,
+		struct type *res) {
+	bool a_ptr = val_pointer(a), b_ptr = val_pointer(b),
+		a_arith = type_is_arithmetic(&a->t),
+		b_arith = type_is_arithmetic(&b->t);
+	*res = a->t;
+	if (kind == AST_BIN_ADD) {
+		if (a_arith && b_ptr) *res = b->t;
+		if (!((a_arith || a_ptr) && b_arith) && !(a_arith && b_ptr))
+			return false;
+	} else if (!(a_arith && b_arith) && !(a_ptr && (b_ptr || b_arith))) {
+		return false;
+	}
+	if (type_is_array(res)) type_apply_decay(res);
+	return true;
+}
+
+/* the result of an operation of type t in r, extended from its size */
+static status result(int r, struct type t, val *res) {
+	*res = (val){ .kind = V_REG, .reg = r, .t = t };
+	return S_OK;
+}
+/* zero extends r for a type of size 1, the others have their operations */
+static void narrow(struct state *s, int r, int size) {
+	if (size == 1) ins(s, VM_ZX8, r, r, 0);
+}
+
+static status gen_add(struct state *s, const struct ast_node *n,
+		enum ast_bin_kind kind, val *a, val *b, int dest, val *res) {
+	struct type t;
+	int size, ra, rb;
+	if (!bin_type(kind, a, b, &t)) {
+		warn_node(kind == AST_BIN_ADD ? "Cant add operands"
+			: "Cant subtract operands", n);
+		return S_ERROR;
+	}
+	if (type_get_size(&t, &size) == S_ERROR) return S_ERROR;
+	if (a->kind == V_IMM && b->kind == V_IMM) {
+		long long k = kind == AST_BIN_ADD ? a->k + b->k : a->k - b->k;
+		*res = (val){ .kind = V_IMM, .k = normalize(k, size), .t = t };
+		return S_OK;
+	}
+	if (kind == AST_BIN_ADD && a->kind == V_IMM) {
+		val *x = a;
+		a = b;
+		b = x;
+	}
+	if (load(s, a, -1, &ra) == S_ERROR) return S_ERROR;
+	long long k = kind == AST_BIN_ADD ? b->k : -b->k;
+	int r;
+	if (b->kind == V_IMM && fits(k)) {
+		r = dest_reg(s, dest);
+		ins(s, size == 4 ? VM_ADDIW : VM_ADDI, r, ra, k);
+	} else {
+		if (load(s, b, -1, &rb) == S_ERROR) return S_ERROR;
+		r = dest_reg(s, dest);
+		enum vm_op op = kind == AST_BIN_ADD ? VM_ADD : VM_SUB;
+		ins(s, size == 4 ? op + 1 : op, r, ra, rb);
+	}
+	narrow(s, r, size);
+	return result(r, t, res);
+}
+
+static status gen_arith(struct state *s, const struct ast_node *n,
+		val *a, val *b, int dest, val *res) {
+	if (!type_is_arithmetic(&a->t) || !type_is_arithmetic(&b->t)) {
+		warn_node("Cant multiply or divide operands", n);
+		return S_ERROR;
+	}
+	bool is_unsigned = type_is_unsigned(&a->t) || type_is_unsigned(&b->t);
+	struct type t = a->t;
+	enum vm_op op = VM_MULW;
+	if (n->bin.kind != AST_BIN_MUL) {
+		if (type_is_unsigned(&b->t)) t = b->t;
+		op = n->bin.kind == AST_BIN_DIV ? VM_DIVW : VM_MODW;
+		if (is_unsigned) op++;
+	}
+	int size, ra, rb;
+	if (type_get_size(&t, &size) == S_ERROR) return S_ERROR;
+	if (load(s, a, -1, &ra) == S_ERROR) return S_ERROR;
+	if (load(s, b, -1, &rb) == S_ERROR) return S_ERROR;
+	int r = dest_reg(s, dest);
+	ins(s, op, r, ra, rb);
+	narrow(s, r, size);
+	return result(r, t, res);
+}
+
+static const enum vm_op cmp_ops[][2] = {
+	[AST_BIN_LT] = { VM_LT, VM_LTI },
+	[AST_BIN_EQB] = { VM_EQ, VM_EQI },
+	[AST_BIN_NEQ] = { VM_NE, VM_NEI },
+};
+/* a comparison as a value, 1 if it holds */
+static status gen_cmp(struct state *s, enum ast_bin_kind kind, val *a,
+		val *b, int dest, val *res) {
+	bool negate = false;
+	if (kind == AST_BIN_GT || kind == AST_BIN_LEQ) {
+		val *x = a;
+		a = b;
+		b = x;
+	}
+	if (kind == AST_BIN_LEQ || kind == AST_BIN_GEQ) negate = true;
+	if (kind != AST_BIN_EQB && kind != AST_BIN_NEQ) kind = AST_BIN_LT;
+	int ra, rb, size;
+	if (load(s, a, -1, &ra) == S_ERROR) return S_ERROR;
+	if (b->kind == V_IMM && val_size(b, &size) == S_OK
+			&& fits(normalize(b->k, size))) {
+		int r = dest_reg(s, dest);
+		ins(s, cmp_ops[kind][1], r, ra, normalize(b->k, size));
+		if (negate) ins(s, VM_EQI, r, r, 0);
+		return result(r, s->t_int, res);
+	}
+	if (load(s, b, -1, &rb) == S_ERROR) return S_ERROR;
+	int r = dest_reg(s, dest);
+	ins(s, cmp_ops[kind][0], r, ra, rb);
+	if (negate) ins(s, VM_EQI, r, r, 0);
+	return result(r, s->t_int, res);
+}
+
+static bool is_cmp(const struct ast_node *n) {
+	if (n->kind != AST_BIN) return false;
+	switch (n->bin.kind) {
+	case AST_BIN_LT:
+	case AST_BIN_GT:
+	case AST_BIN_LEQ:
+	case AST_BIN_GEQ:
+	case AST_BIN_EQB:
+	case AST_BIN_NEQ:
+		return true;
+	default:
+		return false;
+	}
+}
+
+/* jumps to label if the condition evaluates to `when`, comparisons with a
+ * branch in one instruction */
+static status gen_branch(struct state *s, const struct ast_node *n, bool when,
+		int label) {
+	long long k;
+	int mark = s->top;
+	if (const_value(n, &k, NULL)) {
+		if ((k != 0) == when) ins_jump(s, VM_JMP, 0, 0, 0, 0, label);
+		return S_OK;
+	}
+	if (n->kind == AST_UNARY && n->unary.kind == AST_UNARY_NOTB)
+		return gen_branch(s, n->unary.a, !when, label);
+	if (n->kind == AST_BIN && (n->bin.kind == AST_BIN_ANDB
+			|| n->bin.kind == AST_BIN_ORB)) {
+		// the first operand decides alone if it is false for &&, true
+		// for ||
+		bool or = n->bin.kind == AST_BIN_ORB;
+		if (or == when) {
+			if (gen_branch(s, n->bin.a, when, label) == S_ERROR)
+				return S_ERROR;
+			return gen_branch(s, n->bin.b, when, label);
+		}
+		int skip = label_new(s);
+		if (gen_branch(s, n->bin.a, or, skip) == S_ERROR)
+			return S_ERROR;
+		if (gen_branch(s, n->bin.b, when, label) == S_ERROR)
+			return S_ERROR;
+		label_put(s, skip);
+		return S_OK;
+	}
+	val a, b;
+	int ra, rb, size;
+	if (!is_cmp(n)) {
+		if (gen(s, n, -1, &a) == S_ERROR) return S_ERROR;
+		if (load(s, &a, -1, &ra) == S_ERROR) return S_ERROR;
+		ins_jump(s, when ? VM_JNZ : VM_JZ, ra, 0, 0, 1, label);
+		s->top = mark;
+		return S_OK;
+	}
+	const struct ast_node *na = n->bin.a, *nb = n->bin.b;
+	enum ast_bin_kind kind = n->bin.kind;
+	if (kind == AST_BIN_GT || kind == AST_BIN_LEQ) {
+		na = n->bin.b;
+		nb = n->bin.a;
+		kind = kind == AST_BIN_GT ? AST_BIN_LT : AST_BIN_GEQ;
+	}
+	if (!when) {
+		kind = kind == AST_BIN_LT ? AST_BIN_GEQ
+			: kind == AST_BIN_GEQ ? AST_BIN_LT
+			: kind == AST_BIN_EQB ? AST_BIN_NEQ : AST_BIN_EQB;
+	}
+	enum vm_op op = kind == AST_BIN_LT ? VM_JLT : kind == AST_BIN_GEQ
+		? VM_JGE : kind == AST_BIN_EQB ? VM_JEQ : VM_JNE;
+	if (gen(s, na, -1, &a) == S_ERROR) return S_ERROR;
+	if (gen(s, nb, -1, &b) == S_ERROR) return S_ERROR;
+	if (load(s, &a, -1, &ra) == S_ERROR) return S_ERROR;
+	if (b.kind == V_IMM && val_size(&b, &size) == S_OK
+			&& fits(normalize(b.k, size))) {
+		ins_jump(s, op + VM_JLTI - VM_JLT, ra, normalize(b.k, size), 0, 2,
+			label);
+	} else {
+		if (load(s, &b, -1, &rb) == S_ERROR) return S_ERROR;
+		ins_jump(s, op, ra, rb, 0, 2, label);
+	}
+	s->top = mark;
+	return S_OK;
+}
+
+/* a pointer value as the address it holds */
+static status addr_of_value(struct state *s, val *v) {
+	int r;
+	if (type_is_array(&v->t)) return S_OK;
+	if (load(s, v, -1, &r) == S_ERROR) return S_ERROR;
+	*v = (val){ .kind = V_MEM, .reg = r, .index = -1, .t = v->t };
+	return S_OK;
+}
+
+/* an address with the constant offsets of additions to it folded */
+static status gen_addr(struct state *s, const struct ast_node *n, val *res) {
+	long long k;
+	if (n->kind == AST_BIN && (n->bin.kind == AST_BIN_ADD
+			|| n->bin.kind == AST_BIN_SUB)) {
+		bool sub = n->bin.kind == AST_BIN_SUB;
+		const struct ast_node *p = NULL;
+		if (const_value(n->bin.b, &k, NULL)) {
+			p = n->bin.a;
+			if (sub) k = -k;
+		} else if (!sub && const_value(n->bin.a, &k, NULL)) {
+			p = n->bin.b;
+		}
+		if (p) {
+			if (gen_addr(s, p, res) == S_ERROR) return S_ERROR;
+			if (res->kind == V_MEM && res->index >= 0)
+				mem_plain(s, res);
+			if (!fits(res->k + k)) {
+				fprintf(stderr, "error: offset out of range\n");
+				return S_ERROR;
+			}
+			res->k += k;
+			return S_OK;
+		}
+		val a, b;
+		if (gen(s, n->bin.a, -1, &a) == S_ERROR) return S_ERROR;
+		if (gen(s, n->bin.b, -1, &b) == S_ERROR) return S_ERROR;
+		if (!sub && type_is_arithmetic(&a.t) && val_pointer(&b)) {
+			val x = a;
+			a = b;
+			b = x;
+		}
+		if (sub || !val_pointer(&a) || !type_is_arithmetic(&b.t)) {
+			if (gen_add(s, n, n->bin.kind, &a, &b, -1, res)
+					== S_ERROR) {
+				return S_ERROR;
+			}
+			return addr_of_value(s, res);
+		}
+		// pointer plus register, for an indexed access
+		int ra, rb;
+		struct type t = a.t;
+		if (type_is_array(&t)) type_apply_decay(&t);
+		if (load(s, &a, -1, &ra) == S_ERROR) return S_ERROR;
+		if (load(s, &b, -1, &rb) == S_ERROR) return S_ERROR;
+		*res = (val){ .kind = V_MEM, .reg = ra, .index = rb, .t = t };
+		return S_OK;
+	}
+	if (gen(s, n, -1, res) == S_ERROR) return S_ERROR;
+	return addr_of_value(s, res);
+}
+/* the lvalue an address points to */
+static status gen_deref(struct state *s, const struct ast_node *n, val *res) {
+	if (gen_addr(s, n, res) == S_ERROR) return S_ERROR;
+	if (type_is_array(&res->t)) {
+		// the elements are in place
+		if (!type_apply_array(&res->t)) return S_ERROR;
+	} else if (!type_apply_deref(&res->t)) {
+		return S_ERROR;
+	}
+	res->lvalue = true;
+	return S_OK;
+}
+
+static status gen_args(struct state *s, const struct ast_node *n,
+		const struct type *ft, int base) {
+	const struct ast_node *fd = NULL;
+	if (!ft->address_of && ft->app < ft->d->v.len)
+		fd = GETI(ft->d->v, ft->app);
+	int nargs = n->call.args.len;
+	for (int i = 0; i < nargs; ++i) {
+		val v;
+		int r;
+		s->top = base + (nargs > 1 ? nargs : 1);
+		if (gen(s, GETI(n->call.args, i), base + i, &v) == S_ERROR
+				|| load(s, &v, base + i, &r) == S_ERROR) {
+			return S_ERROR;
+		}
+		// the argument as the parameter reads it
+		if (!fd || i >= fd->function_declarator.parameter_type_list.len)
+			continue;
+		const struct ast_node *p = GETI(fd->function_declarator
+			.parameter_type_list, i);
+		const struct ast_node *pd = p->parameter_declaration.declarator;
+		if (!pd) continue;
+		struct type pt = { .s = &p->parameter_declaration
+			.declaration_specifiers->declaration_specifiers,
+			.d = &pd->declarator };
+		int size, arg_size;
+		if (type_is_array(&pt) || type_get_size(&pt, &size) == S_ERROR
+				|| type_get_size(&v.t, &arg_size) == S_ERROR)
+			continue;
+		if (size < arg_size && size < 8)
+			ins(s, size == 1 ? VM_ZX8 : VM_ZX32, r, r, 0);
+	}
+	return S_OK;
+}
+/* a call, a tail call if `tail`, with the result in a new register */
+static status gen_call(struct state *s, const struct ast_node *n, bool tail,
+		val *res) {
+	val f;
+	if (gen(s, n->call.a, -1, &f) == S_ERROR) return S_ERROR;
+	if (f.kind != V_FN) {
+		warn_node("error: only functions can be called by name", n);
+		return S_ERROR;
+	}
+	struct type ft = f.t;
+	if (!type_apply_call(&f.t)) return S_ERROR;
+	int nargs = n->call.args.len;
+	if (nargs > 6) {
+		fprintf(stderr, "error: only 6 arguments are supported\n");
+		return S_ERROR;
+	}
+	int base = s->top;
+	reg_new(s);
+	for (int i = 1; i < nargs; ++i) reg_new(s);
+	if (gen_args(s, n, &ft, base) == S_ERROR) return S_ERROR;
+	ins(s, tail ? VM_TAIL : VM_CALL, base, f.fn, nargs);
+	s->top = base + 1;
+	int size;
+	if (type_get_size(&f.t, &size) == S_ERROR) return S_ERROR;
+	if (size == 0) {
+		*res = (val){ .kind = V_IMM, .k = 0, .t = f.t };
+		return S_OK;
+	}
+	return result(base, f.t, res);
+}
+
+static status gen_unary(struct state *s, const struct ast_node *n, int dest,
+		val *res) {
+	val a;
+	int r, ra, size;
+	if (n->unary.kind == AST_UNARY_DEREF)
+		return gen_deref(s, n->unary.a, res);
+	if (gen(s, n->unary.a, -1, &a) == S_ERROR) return S_ERROR;
+	switch (n->unary.kind) {
+	case AST_PRE_INCR:
+	case AST_PRE_DECR: ;
+		int d = n->unary.kind == AST_PRE_INCR ? 1 : -1;
+		if (!a.lvalue || type_is_const(&a.t)) {
+			warn_node("Error: operand in this expression"
+				" shall be a modifiable lvalue", n);
+			return S_ERROR;
+		}
+		if (val_size(&a, &size) == S_ERROR) return S_ERROR;
+		if (a.kind == V_REG) {
+			ins(s, size == 4 ? VM_ADDIW : VM_ADDI, a.reg, a.reg, d);
+			narrow(s, a.reg, size);
+		} else {
+			// load, add and store in one
+			mem_plain(s, &a);
+			ins(s, sized(VM_INCM1, size), a.reg, a.k, d);
+		}
+		*res = a;
+		return S_OK;
+	case AST_UNARY_REF:
+		if (!a.lvalue || a.kind == V_REG) {
+			warn_node("Error: can't take address of non-lvalue", n);
+			return S_ERROR;
+		}
+		if (!type_apply_address_of(&a.t)) return S_ERROR;
+		r = dest_reg(s, dest);
+		if (load_addr(s, &a, r) == S_ERROR) return S_ERROR;
+		return result(r, a.t, res);
+	case AST_UNARY_NOT:
+	case AST_UNARY_MINUS:
+		if (!type_is_arithmetic(&a.t)) {
+			warn_node("error: operand is not arithmetic", n);
+			return S_ERROR;
+		}
+		if (val_size(&a, &size) == S_ERROR) return S_ERROR;
+		if (load(s, &a, -1, &ra) == S_ERROR) return S_ERROR;
+		r = dest_reg(s, dest);
+		if (n->unary.kind == AST_UNARY_NOT) {
+			ins(s, VM_NOT, r, ra, 0);
+			if (size < 8) ins(s, size == 1 ? VM_ZX8 : VM_ZX32, r, r, 0);
+		} else {
+			int zero = reg_new(s);
+			ins(s, VM_MOVI, zero, 0, 0);
+			ins(s, size == 4 ? VM_SUBW : VM_SUB, r, zero, ra);
+			narrow(s, r, size);
+		}
+		return result(r, a.t, res);
+	case AST_UNARY_NOTB:
+		if (load(s, &a, -1, &ra) == S_ERROR) return S_ERROR;
+		r = dest_reg(s, dest);
+		ins(s, VM_EQI, r, ra, 0);
+		return result(r, s->t_int, res);
+	case AST_UNARY_PLUS:
+		*res = a;
+		res->lvalue = false;
+		return S_OK;
+	default:
+		warn_node("error: unsupported operator", n);
+		return S_ERROR;
+	}
+}
+
+/* `lv = lv + x` and `lv = lv - x` on memory, as a single instruction */
+static status gen_update(struct state *s, const struct ast_node *n,
+		bool *done, val *res) {
+	const struct ast_node *lhs = n->bin.a, *rhs = n->bin.b, *x;
+	*done = false;
+	if (rhs->kind != AST_BIN || !opt_expr_pure(lhs, NULL)) return S_OK;
+	// x must not change what the lvalue read before it
+	bool sub = rhs->bin.kind == AST_BIN_SUB;
+	if (rhs->bin.kind != AST_BIN_ADD && !sub) return S_OK;
+	if (opt_expr_equal(lhs, rhs->bin.a)) {
+		x = rhs->bin.b;
+	} else if (!sub && opt_expr_equal(lhs, rhs->bin.b)) {
+		x = rhs->bin.a;
+	} else {
+		return S_OK;
+	}
+	if (!opt_expr_pure(x, NULL)) return S_OK;
+	val a, b;
+	struct type t;
+	int size, rb;
+	if (gen(s, lhs, -1, &a) == S_ERROR) return S_ERROR;
+	if (a.kind != V_MEM && a.kind != V_FRAME) return S_OK;
+	if (type_is_const(&a.t)) {
+		warn_node("Error: operand in this expression"
+			" shall be a modifiable lvalue", n);
+		return S_ERROR;
+	}
+	if (gen(s, x, -1, &b) == S_ERROR) return S_ERROR;
+	if (!bin_type(rhs->bin.kind, &a, &b, &t)) {
+		warn_node(sub ? "Cant subtract operands" : "Cant add operands",
+			rhs);
+		return S_ERROR;
+	}
+	if (val_size(&a, &size) == S_ERROR) return S_ERROR;
+	mem_plain(s, &a);
+	if (b.kind == V_IMM && fits(b.k)) {
+		ins(s, sized(VM_INCM1, size), a.reg, a.k, sub ? -b.k : b.k);
+	} else {
+		if (load(s, &b, -1, &rb) == S_ERROR) return S_ERROR;
+		ins(s, sized(sub ? VM_SUBM1 : VM_ADDM1, size), a.reg, a.k, rb);
+	}
+	*done = true;
+	*res = a;
+	return S_OK;
+}
+
+static status gen_assign(struct state *s, const struct ast_node *n, val *res) {
+	bool done;
+	int mark = s->top;
+	if (gen_update(s, n, &done, res) == S_ERROR) return S_ERROR;
+	if (done) return S_OK;
+	s->top = mark;
+	val a, b;
+	if (gen(s, n->bin.a, -1, &a) == S_ERROR) return S_ERROR;
+	if (!a.lvalue || type_is_const(&a.t) || type_is_array(&a.t)) {
+		warn_node("Error: operand in this expression"
+			" shall be a modifiable lvalue", n);
+		return S_ERROR;
+	}
+	// a local in a register gets the result of the operation directly
+	if (gen(s, n->bin.b, a.kind == V_REG ? a.reg : -1, &b) == S_ERROR)
+		return S_ERROR;
+	if (assign(s, &a, &b) == S_ERROR) return S_ERROR;
+	*res = a;
+	return S_OK;
+}
+
+static status gen_bin(struct state *s, const struct ast_node *n, int dest,
+		val *res) {
+	val a, b;
+	switch (n->bin.kind) {
+	case AST_BIN_ASSIGN:
+		return gen_assign(s, n, res);
+	case AST_BIN_COMMA:
+		if (gen(s, n->bin.a, -1, &a) == S_ERROR) return S_ERROR;
+		return gen(s, n->bin.b, dest, res);
+	case AST_BIN_ANDB:
+	case AST_BIN_ORB: ;
+		int r = dest_reg(s, dest), l = label_new(s);
+		ins(s, VM_MOVI, r, 0, 0);
+		if (gen_branch(s, n, false, l) == S_ERROR) return S_ERROR;
+		ins(s, VM_MOVI, r, 1, 0);
+		label_put(s, l);
+		return result(r, s->t_int, res);
+	default:
+		break;
+	}
+	if (gen(s, n->bin.a, -1, &a) == S_ERROR) return S_ERROR;
+	if (gen(s, n->bin.b, -1, &b) == S_ERROR) return S_ERROR;
+	switch (n->bin.kind) {
+	case AST_BIN_ADD:
+	case AST_BIN_SUB:
+		return gen_add(s, n, n->bin.kind, &a, &b, dest, res);
+	case AST_BIN_MUL:
+	case AST_BIN_DIV:
+	case AST_BIN_MOD:
+		return gen_arith(s, n, &a, &b, dest, res);
+	case AST_BIN_LT:
+	case AST_BIN_GT:
+	case AST_BIN_LEQ:
+	case AST_BIN_GEQ:
+	case AST_BIN_EQB:
+	case AST_BIN_NEQ:
+		return gen_cmp(s, n->bin.kind, &a, &b, dest, res);
+	default:
+		warn_node("error: unsupported operator", n);
+		return S_ERROR;
+	}
+}
+
+static status gen_conditional(struct state *s, const struct ast_node *n,
+		int dest, val *res) {
+	int r = dest_reg(s, dest), mark = s->top, rv;
+	int l_else = label_new(s), l_end = label_new(s);
+	val a, b;
+	if (gen_branch(s, n->conditional.cond, false, l_else) == S_ERROR)
+		return S_ERROR;
+	if (gen(s, n->conditional.expr, r, &a) == S_ERROR
+			|| load(s, &a, r, &rv) == S_ERROR) {
+		return S_ERROR;
+	}
+	ins_jump(s, VM_JMP, 0, 0, 0, 0, l_end);
+	label_put(s, l_else);
+	s->top = mark;
+	if (gen(s, n->conditional.expr_else, r, &b) == S_ERROR
+			|| load(s, &b, r, &rv) == S_ERROR) {
+		return S_ERROR;
+	}
+	label_put(s, l_end);
+	struct type t = type_conditional(&a.t, &b.t);
+	int size;
+	if (type_get_size(&t, &size) == S_ERROR) return S_ERROR;
+	narrow(s, r, size);
+	return result(r, t, res);
+}
+
+/* an expression, with the result of its last operation in dest if it is not
+ * negative */
+static status gen(struct state *s, const struct ast_node *n, int dest,
+		val *res) {
+	struct type t;
+	int size;
+	switch (n->kind) {
+	case AST_IDENT:
+		return gen_ident(s, n, res);
+	case AST_INTEGER:
+		*res = (val){ .kind = V_IMM, .k = n->integer, .t = s->t_int };
+		return S_OK;
+	case AST_CHARACTER_CONSTANT:
+		*res = (val){ .kind = V_IMM, .k = n->character_constant,
+			.t = s->t_int };
+		return S_OK;
+	case AST_STRING: ;
+		char *str = malloc(strlen(n->string));
+		ast_string_bytes(n->string, str);
+		vec_append(&s->c->strings, &str);
+		long long k = (long long)str;
+		int r = dest_reg(s, dest);
+		ins(s, VM_MOVK, r, vec_append(&s->c->consts, &k), 0);
+		return result(r, s->t_char_p, res);
+	case AST_INDEX: ;
+		const struct ast_node sum = { .kind = AST_BIN, .bin = {
+			.a = n->index.a, .b = n->index.b,
+			.kind = AST_BIN_ADD } };
+		return gen_deref(s, &sum, res);
+	case AST_CALL:
+		return gen_call(s, n, false, res);
+	case AST_UNARY:
+		return gen_unary(s, n, dest, res);
+	case AST_SIZEOF_EXPR:
+		t = type_from_typename(n->sizeof_expr.type_name);
+		if (type_get_size(&t, &size) == S_ERROR) return S_ERROR;
+		*res = (val){ .kind = V_IMM, .k = size, .t = s->t_int };
+		return S_OK;
+	case AST_CAST: ;
+		val v;
+		int rv;
+		t = type_from_typename(n->cast.type_name);
+		if (gen(s, n->cast.expr, -1, &v) == S_ERROR) return S_ERROR;
+		if (type_get_size(&t, &size) == S_ERROR) return S_ERROR;
+		if (v.kind == V_IMM) {
+			*res = (val){ .kind = V_IMM, .k = normalize(v.k, size),
+				.t = t };
+			return S_OK;
+		}
+		if (load(s, &v, -1, &rv) == S_ERROR) return S_ERROR;
+		r = dest_reg(s, dest);
+		if (size == 1 || size == 4) {
+			ins(s, size == 1 ? VM_ZX8 : VM_ZX32, r, rv, 0);
+		} else if (r != rv) {
+			ins(s, VM_MOV, r, rv, 0);
+		}
+		return result(r, t, res);
+	case AST_BIN:
+		return gen_bin(s, n, dest, res);
+	case AST_CONDITIONAL:
+		return gen_conditional(s, n, dest, res);
+	default:
+		warn_node("error: unsupported expression", n);
+		return S_ERROR;
+	}
+}
+
+static bool is_function(const struct ast_declarator *d) {
+	return d->v.len > 0 && (GETI(d->v, 0))->kind == AST_FUNCTION_DECLARATOR;
+}
+/* the index of the function named ident, added if it is new */
+static int function_declare(struct state *s, const char *ident,
+		struct type t) {
+	int *i;
+	if (hashmap_get(&s->c->by_name, ident, (void **)&i) == MAP_OK)
+		return *i;
+	int size = 0;
+	if (type_apply_call(&t)) type_get_size(&t, &size);
+	int fn = vec_append(&s->c->functions, &(struct vm_function){
+		.name = ident, .size = size });
+	hashmap_put(&s->c->by_name, ident, &fn);
+	return fn;
+}
+
+/* a local in a register, or in the frame if it is an array or its address is
+ * taken */
+static status declare_local(struct state *s, const char *ident, struct type t,
+		struct var *res) {
+	*res = (struct var){ .t = t, .fn = -1, .reg = -1 };
+	int size = 8;
+	if (type_is_array(&t)) {
+		if (type_get_size(&t, &size) == S_ERROR) return S_ERROR;
+		size = (size + 7) / 8 * 8;
+	} else if (!opt_names_contain(&s->address_taken, ident)) {
+		res->reg = reg_new(s);
+	}
+	if (res->reg < 0) {
+		res->loc = s->frame;
+		s->frame += size;
+	}
+	hashmap_put(&s->scope->vars, ident, res);
+	return S_OK;
+}
+
+static status gen_declaration(struct state *s, const struct ast_node *n) {
+	const struct ast_declaration_specifiers *ds = &n->declaration
+		.declaration_specifiers->declaration_specifiers;
+	bool ext = ds->storage_class_specifiers
+		[AST_STORAGE_CLASS_SPECIFIER_EXTERN] > 0;
+	for (int i = 0; i < n->declaration.init_declarator_list.len; ++i) {
+		const struct ast_node *ni =
+			GETI(n->declaration.init_declarator_list, i);
+		const struct ast_node *d = ni->init_declarator.declarator;
+		if (!d->declarator.ident) continue;
+		const char *ident = d->declarator.ident->ident;
+		struct type t = { .s = ds, .d = &d->declarator };
+		struct var v = { .t = t, .reg = -1 };
+		if (is_function(&d->declarator)) {
+			v.fn = function_declare(s, ident, t);
+			hashmap_put(&s->scope->vars, ident, &v);
+			continue;
+		}
+		if (ext || !s->scope->parent) {
+			fprintf(stderr, "error: `%s`: objects outside of functions"
+				" are not supported\n", ident);
+			return S_ERROR;
+		}
+		if (declare_local(s, ident, t, &v) == S_ERROR) return S_ERROR;
+		const struct ast_node *init = ni->init_declarator.initializer;
+		if (!init) continue;
+		if (init->kind == AST_INITIALIZER) {
+			fprintf(stderr, "error: `%s`: initializer lists are not"
+				" supported\n", ident);
+			return S_ERROR;
+		}
+		int mark = s->top;
+		val lv = v.reg >= 0
+			? (val){ .kind = V_REG, .reg = v.reg, .t = t }
+			: (val){ .kind = V_FRAME, .k = v.loc, .t = t }, iv;
+		if (gen(s, init, v.reg, &iv) == S_ERROR
+				|| assign(s, &lv, &iv) == S_ERROR) {
+			return S_ERROR;
+		}
+		s->top = mark;
+	}
+	return S_OK;
+}
+
+static status gen_stmts(struct state *s, const struct ast_node *n) {
+	struct scope scope = { .parent = s->scope };
+	hashmap_init(&scope.vars, sizeof(struct var));
+	s->scope = &scope;
+	int mark = s->top;
+	status st = S_OK;
+	for (int i = 0; st == S_OK && i < n->stmt_comp.len; ++i)
+		st = gen_stmt(s, GETI(n->stmt_comp, i));
+	s->top = mark;
+	s->scope = scope.parent;
+	hashmap_finish(&scope.vars);
+	return st;
+}
+
+/* a loop body with the targets of break and continue */
+static status gen_body(struct state *s, const struct ast_node *n,
+		int l_break, int l_continue) {
+	vec_append(&s->breaks, &l_break);
+	vec_append(&s->continues, &l_continue);
+	status st = gen_stmt(s, n);
+	s->breaks.len--;
+	s->continues.len--;
+	return st;
+}
+
+/* the loop is rotated: the condition is tested once up front and then at the
+ * bottom, where a taken branch starts the next iteration */
+static status gen_loop(struct state *s, const struct ast_node *cond,
+		const struct ast_node *step, const struct ast_node *body,
+		bool test_first) {
+	int l_body = label_new(s), l_next = label_new(s), l_end = label_new(s);
+	val v;
+	if (test_first && cond && gen_branch(s, cond, false, l_end) == S_ERROR)
+		return S_ERROR;
+	label_put(s, l_body);
+	if (gen_body(s, body, l_end, l_next) == S_ERROR) return S_ERROR;
+	label_put(s, l_next);
+	int mark = s->top;
+	if (step && gen(s, step, -1, &v) == S_ERROR) return S_ERROR;
+	s->top = mark;
+	if (!cond) {
+		ins_jump(s, VM_JMP, 0, 0, 0, 0, l_body);
+	} else if (gen_branch(s, cond, true, l_body) == S_ERROR) {
+		return S_ERROR;
+	}
+	label_put(s, l_end);
+	return S_OK;
+}
+
+#define JTAB_MIN 4 /* cases for a table */
+#define JTAB_DENSITY 3 /* entries of a table per case at most */
+
+/* a table when the cases are dense, compares in a row otherwise, on the
+ * value as the 32 bits the cases are compared as */
+static void gen_dispatch(struct state *s, int r,
+		struct dispatch_case *c, int n, int l_default) {
+	long long range = n ? (long long)c[n - 1].v - c[0].v + 1 : 0;
+	if (n >= JTAB_MIN && range <= (long long)n * JTAB_DENSITY) {
+		int at = ins(s, VM_JTAB, r, c[0].v, range);
+		for (int i = 0, k = 0; i < range; ++i) {
+			int label = l_default;
+			if (c[k].v - c[0].v == i) label = c[k++].label;
+			int w = vec_append(&s->c->code, &(int){ -1 });
+			vec_append(&s->fixups, &(struct fixup){ .at = w,
+				.label = label });
+		}
+		while ((s->c->code.len - at) % VM_INS)
+			vec_append(&s->c->code, &(int){ 0 });
+	} else {
+		int x = reg_new(s);
+		ins(s, VM_SX32, x, r, 0);
+		for (int i = 0; i < n; ++i)
+			ins_jump(s, VM_JEQI, x, c[i].v, 0, 2, c[i].label);
+	}
+	ins_jump(s, VM_JMP, 0, 0, 0, 0, l_default);
+}
+
+static status gen_switch(struct state *s, const struct ast_node *n) {
+	val v;
+	int r, mark = s->top;
+	if (gen(s, n->stmt_switch.cond, -1, &v) == S_ERROR) return S_ERROR;
+	if (!type_is_arithmetic(&v.t)) {
+		warn_node("error: switch on a non-integer", n->stmt_switch.cond);
+		return S_ERROR;
+	}
+	if (load(s, &v, -1, &r) == S_ERROR) return S_ERROR;
+
+	int labels_mark = s->switch_labels.len;
+	opt_switch_labels(n, &s->switch_labels);
+	int l_end = label_new(s), l_default = l_end;
+	struct vec cases = vec_new_empty(sizeof(struct dispatch_case));
+	status st = S_OK;
+	for (int i = labels_mark; st == S_OK && i < s->switch_labels.len; ++i) {
+		struct switch_label *l = vec_get(&s->switch_labels, i);
+		l->label = label_new(s);
+		if (l->n->kind == AST_STMT_LABELED_DEFAULT) {
+			if (l_default != l_end) {
+				fprintf(stderr, "error: multiple default labels\n");
+				st = S_ERROR;
+			}
+			l_default = l->label;
+			continue;
+		}
+		int k;
+		st = const_eval(l->n->stmt_labeled_case.expr, &k);
+		vec_append(&cases, &(struct dispatch_case){ .v = k,
+			.label = l->label });
+	}
+	if (st == S_OK && !opt_dispatch_sort(&cases)) st = S_ERROR;
+	if (st == S_OK) {
+		gen_dispatch(s, r, cases.len ? vec_get(&cases, 0) : NULL,
+			cases.len, l_default);
+		s->top = mark;
+		vec_append(&s->breaks, &l_end);
+		st = gen_stmt(s, n->stmt_switch.stmt);
+		s->breaks.len--;
+		label_put(s, l_end);
+	}
+	vec_free(&cases);
+	s->switch_labels.len = labels_mark;
+	return st;
+}
+
+static int goto_label(struct state *s, const char *ident) {
+	int *l;
+	if (hashmap_get(&s->goto_labels, ident, (void **)&l) == MAP_OK)
+		return *l;
+	int label = label_new(s);
+	hashmap_put(&s->goto_labels, ident, &label);
+	return label;
+}
+
+static status gen_return(struct state *s, const struct ast_node *n) {
+	const struct ast_node *e = n->stmt_return.expr;
+	val v;
+	int r, size;
+	if (!e) {
+		ins(s, VM_RET, 0, 0, 0);
+		return S_OK;
+	}
+	// the result of a call in the place of the frame, if it is returned
+	// as is
+	if (e->kind == AST_CALL && e->call.a->kind == AST_IDENT && !s->escapes) {
+		const struct var *f = scope_lookup(s->scope, e->call.a->ident);
+		if (f && f->fn >= 0) {
+			const struct vm_function *fn = vec_get_c(
+				&s->c->functions, f->fn);
+			if (fn->size == s->size || s->size == 0)
+				return gen_call(s, e, true, &v);
+		}
+	}
+	if (gen(s, e, -1, &v) == S_ERROR) return S_ERROR;
+	if (v.kind == V_IMM) {
+		r = reg_new(s);
+		movi(s, r, normalize(v.k, s->size));
+	} else {
+		if (load(s, &v, -1, &r) == S_ERROR) return S_ERROR;
+		if (val_size(&v, &size) == S_ERROR) return S_ERROR;
+		if (size > s->size && s->size > 0 && s->size < 8) {
+			int x = reg_new(s);
+			ins(s, s->size == 1 ? VM_ZX8 : VM_ZX32, x, r, 0);
+			r = x;
+		}
+	}
+	ins(s, VM_RET, r, 0, 0);
+	return S_OK;
+}
+
+static status gen_stmt(struct state *s, const struct ast_node *n) {
+	int mark = s->top;
+	status st = S_OK;
+	val v;
+	switch (n->kind) {
+	case AST_DECLARATION:
+		return gen_declaration(s, n);
+	case AST_STMT_EXPR:
+		if (n->stmt_expr.a) st = gen(s, n->stmt_expr.a, -1, &v);
+		break;
+	case AST_STMT_COMP:
+		return gen_stmts(s, n);
+	case AST_STMT_IF: ;
+		int l_else = label_new(s), l_end = label_new(s);
+		if (gen_branch(s, n->stmt_if.cond, false, l_else) == S_ERROR
+				|| gen_stmt(s, n->stmt_if.stmt) == S_ERROR) {
+			return S_ERROR;
+		}
+		if (n->stmt_if.stmt_else)
+			ins_jump(s, VM_JMP, 0, 0, 0, 0, l_end);
+		label_put(s, l_else);
+		if (n->stmt_if.stmt_else)
+			st = gen_stmt(s, n->stmt_if.stmt_else);
+		label_put(s, l_end);
+		break;
+	case AST_STMT_WHILE:
+		st = gen_loop(s, n->stmt_while.cond, NULL, n->stmt_while.stmt,
+			true);
+		break;
+	case AST_STMT_DO_WHILE:
+		st = gen_loop(s, n->stmt_do_while.cond, NULL,
+			n->stmt_do_while.stmt, false);
+		break;
+	case AST_STMT_FOR: ;
+		// the declaration of the first clause is local to the loop
+		struct scope scope = { .parent = s->scope };
+		hashmap_init(&scope.vars, sizeof(struct var));
+		s->scope = &scope;
+		const struct ast_node *a = n->stmt_for.a;
+		if (a && a->kind == AST_DECLARATION) {
+			st = gen_declaration(s, a);
+		} else if (a) {
+			int top = s->top;
+			st = gen(s, a, -1, &v);
+			s->top = top;
+		}
+		if (st == S_OK) st = gen_loop(s, n->stmt_for.b, n->stmt_for.c,
+			n->stmt_for.stmt, true);
+		s->scope = scope.parent;
+		hashmap_finish(&scope.vars);
+		break;
+	case AST_STMT_SWITCH:
+		st = gen_switch(s, n);
+		break;
+	case AST_STMT_LABELED_CASE:
+	case AST_STMT_LABELED_DEFAULT: ;
+		int label = opt_switch_label_get(&s->switch_labels, n);
+		if (label < 0) {
+			fprintf(stderr, "error: case label not within a switch\n");
+			return S_ERROR;
+		}
+		label_put(s, label);
+		return gen_stmt(s, n->kind == AST_STMT_LABELED_CASE
+			? n->stmt_labeled_case.stmt
+			: n->stmt_labeled_default.stmt);
+	case AST_STMT_LABELED:
+		label_put(s, goto_label(s, n->stmt_labeled.ident->ident));
+		return gen_stmt(s, n->stmt_labeled.stmt);
+	case AST_STMT_GOTO:
+		ins_jump(s, VM_JMP, 0, 0, 0, 0,
+			goto_label(s, n->stmt_goto.ident->ident));
+		break;
+	case AST_STMT_BREAK:
+	case AST_STMT_CONTINUE: ;
+		struct vec *targets = n->kind == AST_STMT_BREAK
+			? &s->breaks : &s->continues;
+		if (targets->len == 0) {
+			fprintf(stderr, "error: %s outside of a loop\n",
+				n->kind == AST_STMT_BREAK ? "break" : "continue");
+			return S_ERROR;
+		}
+		ins_jump(s, VM_JMP, 0, 0, 0, 0,
+			*(int *)vec_get(targets, targets->len - 1));
+		break;
+	case AST_STMT_RETURN:
+		st = gen_return(s, n);
+		break;
+	default:
+		warn_node("error: unsupported statement", n);
+		return S_ERROR;
+	}
+	s->top = mark;
+	return st;
+}
+
+/* the parameters are the first registers, those whose address is taken are
+ * copied to the frame */
+static status declare_params(struct state *s, const struct ast_node *def) {
+	const struct ast_declarator *d =
+		&def->function_definition.declarator->declarator;
+	const struct vec *params = &(GETI(d->v, 0))->function_declarator
+		.parameter_type_list;
+	if (params->len > 6) {
+		fprintf(stderr, "error: only 6 parameters are supported\n");
+		return S_ERROR;
+	}
+	for (int i = 0; i < params->len; ++i) reg_new(s);
+	for (int i = 0; i < params->len; ++i) {
+		const struct ast_node *p = GETI(*params, i);
+		const struct ast_node *pd = p->parameter_declaration.declarator;
+		if (!pd || !pd->declarator.ident) continue;
+		const char *ident = pd->declarator.ident->ident;
+		struct var v = {
+			.t = { .s = &p->parameter_declaration
+				.declaration_specifiers->declaration_specifiers,
+				.d = &pd->declarator },
+			.fn = -1,
+			.reg = i,
+		};
+		if (opt_names_contain(&s->address_taken, ident)) {
+			v.reg = -1;
+			v.loc = s->frame;
+			s->frame += 8;
+			ins(s, VM_STF8, v.loc, i, 0);
+		}
+		hashmap_put(&s->scope->vars, ident, &v);
+	}
+	return S_OK;
+}
+
+static status gen_function(struct state *s, const struct ast_node *n) {
+	const struct ast_declarator *d =
+		&n->function_definition.declarator->declarator;
+	const char *ident = d->ident->ident;
+	struct type t = { .s = &n->function_definition.declaration_specifiers
+		->declaration_specifiers, .d = d };
+	struct var v = { .t = t, .reg = -1 };
+	v.fn = function_declare(s, ident, t);
+	hashmap_put(&s->scope->vars, ident, &v);
+	struct vm_function *f = vec_get(&s->c->functions, v.fn);
+	if (f->defined) {
+		fprintf(stderr, "error: redefinition of `%s`\n", ident);
+		return S_ERROR;
+	}
+	f->defined = true;
+	f->code = s->c->code.len;
+
+	s->top = s->regs = s->frame = 0;
+	s->size = f->size;
+	s->escapes = opt_frame_escapes(n);
+	s->address_taken.len = 0;
+	opt_address_taken(n, &s->address_taken);
+	hashmap_init(&s->goto_labels, sizeof(int));
+	struct scope params = { .parent = s->scope };
+	hashmap_init(&params.vars, sizeof(struct var));
+	s->scope = &params;
+	status st = declare_params(s, n);
+	if (st == S_OK) st = gen_stmts(s, n->function_definition
+		.compound_statement);
+	if (st == S_OK) {
+		// falling off the end returns 0
+		int r = reg_new(s);
+		ins(s, VM_MOVI, r, 0, 0);
+		ins(s, VM_RET, r, 0, 0);
+		fixups_apply(s);
+		f = vec_get(&s->c->functions, v.fn);
+		f->regs = s->regs;
+		f->frame = s->frame;
+	}
+	s->scope = params.parent;
+	hashmap_finish(&params.vars);
+	hashmap_finish(&s->goto_labels);
+	return st;
+}
+
+void vm_init(struct vm_code *c) {
+	*c = (struct vm_code){
+		.code = vec_new_empty(sizeof(int)),
+		.functions = vec_new_empty(sizeof(struct vm_function)),
+		.consts = vec_new_empty(sizeof(long long)),
+		.strings = vec_new_empty(sizeof(char *)),
+	};
+	hashmap_init(&c->by_name, sizeof(int));
+}
+
+void vm_free(struct vm_code *c) {
+	for (int i = 0; i < c->strings.len; ++i)
+		free(*(char **)vec_get(&c->strings, i));
+	vec_free(&c->code);
+	vec_free(&c->functions);
+	vec_free(&c->consts);
+	vec_free(&c->strings);
+	hashmap_finish(&c->by_name);
+}
+
+/* the words after a jump table, in whole instructions */
+static int table_words(int n) {
+	return (n + VM_INS - 1) / VM_INS * VM_INS;
+}
+
+/* calls of functions that are not defined go to the process */
+static void link_calls(struct vm_code *c) {
+	int *code = c->code.len ? vec_get(&c->code, 0) : NULL;
+	for (int i = 0; i < c->code.len; i += VM_INS) {
+		int *in = code + i;
+		if (in[0] == VM_JTAB) i += table_words(in[3]);
+		if (in[0] != VM_CALL && in[0] != VM_TAIL) continue;
+		const struct vm_function *f = vec_get_c(&c->functions, in[2]);
+		if (!f->defined) in[0] = in[0] == VM_CALL ? VM_CALLX : VM_TAILX;
+	}
+}
+
+bool vm_compile(struct vm_code *c, const struct ast_node *n) {
+	struct state s = {
+		.c = c,
+		.labels = vec_new_empty(sizeof(int)),
+		.fixups = vec_new_empty(sizeof(struct fixup)),
+		.breaks = vec_new_empty(sizeof(int)),
+		.continues = vec_new_empty(sizeof(int)),
+		.switch_labels = vec_new_empty(sizeof(struct switch_label)),
+		.address_taken = vec_new_empty(sizeof(const char *)),
+		.spec_int = ast_declaration_specifiers(),
+		.spec_char = ast_declaration_specifiers(),
+		.decl_empty = ast_declarator_begin(NULL),
+		.decl_p = ast_declarator_begin(NULL),
+	};
+	s.spec_int->declaration_specifiers
+		.builtin_type_specifiers[AST_BUILTIN_TYPE_INT]++;
+	s.spec_char->declaration_specifiers
+		.builtin_type_specifiers[AST_BUILTIN_TYPE_CHAR]++;
+	struct ast_node *p = ast_alloc((struct ast_node){
+		.kind = AST_POINTER_DECLARATOR,
+	});
+	vec_append(&s.decl_p->declarator.v, &p);
+	s.t_int = (struct type){ .s = &s.spec_int->declaration_specifiers,
+		.d = &s.decl_empty->declarator };
+	s.t_char_p = (struct type){ .s = &s.spec_char->declaration_specifiers,
+		.d = &s.decl_p->declarator };
+
+	struct scope file_scope = { 0 };
+	hashmap_init(&file_scope.vars, sizeof(struct var));
+	s.scope = &file_scope;
+	status st = S_OK;
+	if (n->kind == AST_TRANSLATION_UNIT) {
+		for (int i = 0; st == S_OK && i < n->translation_unit.len; ++i) {
+			const struct ast_node *ni = GETI(n->translation_unit, i);
+			st = ni->kind == AST_FUNCTION_DEFINITION
+				? gen_function(&s, ni) : gen_declaration(&s, ni);
+		}
+	}
+	if (st == S_OK) link_calls(c);
+
+	hashmap_finish(&file_scope.vars);
+	vec_free(&s.labels);
+	vec_free(&s.fixups);
+	vec_free(&s.breaks);
+	vec_free(&s.continues);
+	vec_free(&s.switch_labels);
+	vec_free(&s.address_taken);
+	return st == S_OK;
+}
+
+/* operands: a register, an immediate, a constant, a target, a function */
+static const struct {
+	const char *name, *operands;
+} op_info[VM_OP_N] = {
+	[VM_MOVI] = { "movi", "ri" }, [VM_MOVK] = { "movk", "rk" },
+	[VM_MOV] = { "mov", "rr" },
+	[VM_ADD] = { "add", "rrr" }, [VM_ADDW] = { "addw", "rrr" },
+	[VM_ADDI] = { "addi", "rri" }, [VM_ADDIW] = { "addiw", "rri" },
+	[VM_SUB] = { "sub", "rrr" }, [VM_SUBW] = { "subw", "rrr" },
+	[VM_MULW] = { "mulw", "rrr" }, [VM_DIVW] = { "divw", "rrr" },
+	[VM_DIVUW] = { "divuw", "rrr" }, [VM_MODW] = { "modw", "rrr" },
+	[VM_MODUW] = { "moduw", "rrr" }, [VM_NOT] = { "not", "rr" },
+	[VM_ZX8] = { "zx8", "rr" }, [VM_ZX32] = { "zx32", "rr" },
+	[VM_SX32] = { "sx32", "rr" },
+	[VM_LT] = { "lt", "rrr" }, [VM_LTI] = { "lti", "rri" },
+	[VM_EQ] = { "eq", "rrr" }, [VM_EQI] = { "eqi", "rri" },
+	[VM_NE] = { "ne", "rrr" }, [VM_NEI] = { "nei", "rri" },
+	[VM_LD1] = { "ld1", "rri" }, [VM_LD4] = { "ld4", "rri" },
+	[VM_LD8] = { "ld8", "rri" },
+	[VM_LDX1] = { "ldx1", "rrr" }, [VM_LDX4] = { "ldx4", "rrr" },
+	[VM_LDX8] = { "ldx8", "rrr" },
+	[VM_ST1] = { "st1", "rir" }, [VM_ST4] = { "st4", "rir" },
+	[VM_ST8] = { "st8", "rir" },
+	[VM_STX1] = { "stx1", "rrr" }, [VM_STX4] = { "stx4", "rrr" },
+	[VM_STX8] = { "stx8", "rrr" },
+	[VM_LDF1] = { "ldf1", "ri" }, [VM_LDF4] = { "ldf4", "ri" },
+	[VM_LDF8] = { "ldf8", "ri" },
+	[VM_STF1] = { "stf1", "ir" }, [VM_STF4] = { "stf4", "ir" },
+	[VM_STF8] = { "stf8", "ir" },
+	[VM_LEAF] = { "leaf", "ri" },
+	[VM_INCM1] = { "incm1", "rii" }, [VM_INCM4] = { "incm4", "rii" },
+	[VM_INCM8] = { "incm8", "rii" },
+	[VM_ADDM1] = { "addm1", "rir" }, [VM_ADDM4] = { "addm4", "rir" },
+	[VM_ADDM8] = { "addm8", "rir" },
+	[VM_SUBM1] = { "subm1", "rir" }, [VM_SUBM4] = { "subm4", "rir" },
+	[VM_SUBM8] = { "subm8", "rir" },
+	[VM_JMP] = { "jmp", "l" }, [VM_JZ] = { "jz", "rl" },
+	[VM_JNZ] = { "jnz", "rl" },
+	[VM_JLT] = { "jlt", "rrl" }, [VM_JGE] = { "jge", "rrl" },
+	[VM_JEQ] = { "jeq", "rrl" }, [VM_JNE] = { "jne", "rrl" },
+	[VM_JLTI] = { "jlti", "ril" }, [VM_JGEI] = { "jgei", "ril" },
+	[VM_JEQI] = { "jeqi", "ril" }, [VM_JNEI] = { "jnei", "ril" },
+	[VM_JTAB] = { "jtab", "rii" },
+	[VM_CALL] = { "call", "rfi" }, [VM_CALLX] = { "callx", "rfi" },
+	[VM_TAIL] = { "tail", "rfi" }, [VM_TAILX] = { "tailx", "rfi" },
+	[VM_RET] = { "ret", "r" },
+};
+
+static void print_ins(const struct vm_code *c, const int *in, FILE *f) {
+	const char *ops = op_info[in[0]].operands;
+	fprintf(f, "\t%s", op_info[in[0]].name);
+	for (int k = 0; ops[k]; ++k) {
+		int x = in[1 + k];
+		fprintf(f, k ? ", " : " ");
+		switch (ops[k]) {
+		case 'r':
+			fprintf(f, "r%d", x);
+			break;
+		case 'k':
+			fprintf(f, "%lld", *(const long long *)vec_get_c(
+				&c->consts, x));
+			break;
+		case 'l':
+			fprintf(f, "@%d", x);
+			break;
+		case 'f':
+			fprintf(f, "%s", ((const struct vm_function *)vec_get_c(
+				&c->functions, x))->name);
+			break;
+		default:
+			fprintf(f, "%d", x);
+		}
+	}
+	fprintf(f, "\n");
+}
+
+void vm_print(const struct vm_code *c, FILE *f) {
+	const int *code = c->code.len ? vec_get_c(&c->code, 0) : NULL;
+	for (int i = 0; i < c->functions.len; ++i) {
+		const struct vm_function *fn = vec_get_c(&c->functions, i);
+		if (!fn->defined) {
+			fprintf(f, "extern %s\n\n", fn->name);
+			continue;
+		}
+		int end = c->code.len;
+		for (int k = 0; k < c->functions.len; ++k) {
+			const struct vm_function *o = vec_get_c(&c->functions, k);
+			if (o->defined && o->code > fn->code && o->code < end)
+				end = o->code;
+		}
+		fprintf(f, "%s: ; %d registers, %d bytes of frame\n", fn->name,
+			fn->regs, fn->frame);
+		for (int at = fn->code; at < end; at += VM_INS) {
+			const int *in = code + at;
+			fprintf(f, "%5d", at);
+			print_ins(c, in, f);
+			if (in[0] != VM_JTAB) continue;
+			for (int k = 0; k < in[3]; ++k)
+				fprintf(f, "\t\t@%d\n", in[VM_INS + k]);
+			at += table_words(in[3]);
+		}
+		fprintf(f, "\n");
+	}
+}
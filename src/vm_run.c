@@ -0,0 +1,290 @@
+// SPDX-License-Identifier: GPL-3.0-only
+#define _GNU_SOURCE /* RTLD_DEFAULT */
+#include <c_compiler/vm.h>
+#include <dlfcn.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define REGS (1 << 20) /* registers of all the frames */
+#define MEMORY (8 << 20) /* bytes of the frames of locals with an address */
+#define CALLS (1 << 18) /* depth of calls */
+
+typedef uint64_t reg;
+/* functions of the process are called with integer arguments only, and as if
+ * they were variadic */
+typedef reg (*native_fn)();
+
+struct callee {
+	const int *code;
+	int regs, frame, size;
+	native_fn native;
+};
+
+/* where a call returns to */
+struct ret {
+	const int *ip;
+	reg *r;
+	unsigned char *fp;
+	int frame;
+};
+
+struct machine {
+	reg *regs;
+	unsigned char *memory;
+	struct ret *calls;
+	struct callee *fns;
+	const long long *consts;
+};
+
+static reg normalize(reg x, int size) {
+	if (size == 1) return (uint8_t)x;
+	if (size == 4) return (uint32_t)x;
+	return x;
+}
+
+static reg call_native(const struct callee *f, const reg *a, int n) {
+	reg x;
+	switch (n) {
+	case 0: x = f->native(); break;
+	case 1: x = f->native(a[0]); break;
+	case 2: x = f->native(a[0], a[1]); break;
+	case 3: x = f->native(a[0], a[1], a[2]); break;
+	case 4: x = f->native(a[0], a[1], a[2], a[3]); break;
+	case 5: x = f->native(a[0], a[1], a[2], a[3], a[4]); break;
+	default: x = f->native(a[0], a[1], a[2], a[3], a[4], a[5]); break;
+	}
+	return normalize(x, f->size);
+}
+
+static bool resolve(struct callee *f, const char *name) {
+	if (f->native) return true;
+	void *p = dlsym(RTLD_DEFAULT, name);
+	if (!p) {
+		fprintf(stderr, "error: undefined symbol `%s`\n", name);
+		return false;
+	}
+	memcpy(&f->native, &p, sizeof(p));
+	return true;
+}
+
+#define LOAD(type, p) ({ type x_; memcpy(&x_, (p), sizeof(x_)); (reg)x_; })
+#define STORE(type, p, v) do { \
+		type x_ = (v); \
+		memcpy((p), &x_, sizeof(x_)); \
+	} while (0)
+
+/*
+ * Threads the code, replacing the operations with the offsets of their
+ * handlers from the first one, and runs main. The handlers end in a jump to
+ * the handler of the next instruction, so there is no loop and no switch.
+ */
+static bool execute(const struct vm_code *c, struct machine *m, int *code,
+		int main_fn, int argc, char **argv, int *res) {
+#define H(op) [VM_##op] = &&op_##op - &&op_MOVI
+	static const int handlers[VM_OP_N] = {
+		H(MOVI), H(MOVK), H(MOV), H(ADD), H(ADDW), H(ADDI), H(ADDIW),
+		H(SUB), H(SUBW), H(MULW), H(DIVW), H(DIVUW), H(MODW), H(MODUW),
+		H(NOT), H(ZX8), H(ZX32), H(SX32), H(LT), H(LTI), H(EQ), H(EQI),
+		H(NE), H(NEI), H(LD1), H(LD4), H(LD8), H(LDX1), H(LDX4),
+		H(LDX8), H(ST1), H(ST4), H(ST8), H(STX1), H(STX4), H(STX8),
+		H(LDF1), H(LDF4), H(LDF8), H(STF1), H(STF4), H(STF8), H(LEAF),
+		H(INCM1), H(INCM4), H(INCM8), H(ADDM1), H(ADDM4), H(ADDM8),
+		H(SUBM1), H(SUBM4), H(SUBM8), H(JMP), H(JZ), H(JNZ), H(JLT),
+		H(JGE), H(JEQ), H(JNE), H(JLTI), H(JGEI), H(JEQI), H(JNEI),
+		H(JTAB), H(CALL), H(CALLX), H(TAIL), H(TAILX), H(RET),
+	};
+#undef H
+	for (int i = 0; i < c->code.len; i += VM_INS) {
+		int *in = code + i, op = in[0];
+		if (op == VM_CALLX || op == VM_TAILX) {
+			const struct vm_function *f = vec_get_c(&c->functions,
+				in[2]);
+			if (!resolve(&m->fns[in[2]], f->name)) return false;
+		}
+		in[0] = handlers[op];
+		if (op == VM_JTAB) i += (in[3] + VM_INS - 1) / VM_INS * VM_INS;
+	}
+
+	const struct callee *fns = m->fns, *f = &fns[main_fn];
+	const long long *consts = m->consts;
+	reg *r = m->regs, *regs_end = m->regs + REGS;
+	unsigned char *fp = m->memory, *memory_end = m->memory + MEMORY;
+	struct ret *calls = m->calls, *calls_end = m->calls + CALLS;
+	int frame = f->frame;
+	const int *ip = f->code;
+	if (f->regs + 2 > REGS || frame > MEMORY) goto overflow;
+	r[0] = argc;
+	r[1] = (reg)argv;
+
+#define A ip[1]
+#define B ip[2]
+#define C ip[3]
+#define DISPATCH() goto *(void *)((char *)&&op_MOVI + *ip)
+#define NEXT() do { ip += VM_INS; DISPATCH(); } while (0)
+#define JUMP(to) do { ip = code + (to); DISPATCH(); } while (0)
+	DISPATCH();
+op_MOVI: r[A] = (reg)(int64_t)B; NEXT();
+op_MOVK: r[A] = consts[B]; NEXT();
+op_MOV: r[A] = r[B]; NEXT();
+op_ADD: r[A] = r[B] + r[C]; NEXT();
+op_ADDW: r[A] = (uint32_t)(r[B] + r[C]); NEXT();
+op_ADDI: r[A] = r[B] + (int64_t)C; NEXT();
+op_ADDIW: r[A] = (uint32_t)(r[B] + C); NEXT();
+op_SUB: r[A] = r[B] - r[C]; NEXT();
+op_SUBW: r[A] = (uint32_t)(r[B] - r[C]); NEXT();
+op_MULW: r[A] = (uint32_t)((uint32_t)r[B] * (uint32_t)r[C]); NEXT();
+op_DIVW: r[A] = (uint32_t)((int32_t)r[B] / (int32_t)r[C]); NEXT();
+op_DIVUW: r[A] = (uint32_t)r[B] / (uint32_t)r[C]; NEXT();
+op_MODW: r[A] = (uint32_t)((int32_t)r[B] % (int32_t)r[C]); NEXT();
+op_MODUW: r[A] = (uint32_t)r[B] % (uint32_t)r[C]; NEXT();
+op_NOT: r[A] = ~r[B]; NEXT();
+op_ZX8: r[A] = (uint8_t)r[B]; NEXT();
+op_ZX32: r[A] = (uint32_t)r[B]; NEXT();
+op_SX32: r[A] = (reg)(int64_t)(int32_t)r[B]; NEXT();
+op_LT: r[A] = (int64_t)r[B] < (int64_t)r[C]; NEXT();
+op_LTI: r[A] = (int64_t)r[B] < C; NEXT();
+op_EQ: r[A] = r[B] == r[C]; NEXT();
+op_EQI: r[A] = r[B] == (reg)(int64_t)C; NEXT();
+op_NE: r[A] = r[B] != r[C]; NEXT();
+op_NEI: r[A] = r[B] != (reg)(int64_t)C; NEXT();
+op_LD1: r[A] = LOAD(uint8_t, (char *)r[B] + C); NEXT();
+op_LD4: r[A] = LOAD(uint32_t, (char *)r[B] + C); NEXT();
+op_LD8: r[A] = LOAD(uint64_t, (char *)r[B] + C); NEXT();
+op_LDX1: r[A] = LOAD(uint8_t, (char *)r[B] + r[C]); NEXT();
+op_LDX4: r[A] = LOAD(uint32_t, (char *)r[B] + r[C]); NEXT();
+op_LDX8: r[A] = LOAD(uint64_t, (char *)r[B] + r[C]); NEXT();
+op_ST1: STORE(uint8_t, (char *)r[A] + B, r[C]); NEXT();
+op_ST4: STORE(uint32_t, (char *)r[A] + B, r[C]); NEXT();
+op_ST8: STORE(uint64_t, (char *)r[A] + B, r[C]); NEXT();
+op_STX1: STORE(uint8_t, (char *)r[A] + r[B], r[C]); NEXT();
+op_STX4: STORE(uint32_t, (char *)r[A] + r[B], r[C]); NEXT();
+op_STX8: STORE(uint64_t, (char *)r[A] + r[B], r[C]); NEXT();
+op_LDF1: r[A] = LOAD(uint8_t, fp + B); NEXT();
+op_LDF4: r[A] = LOAD(uint32_t, fp + B); NEXT();
+op_LDF8: r[A] = LOAD(uint64_t, fp + B); NEXT();
+op_STF1: STORE(uint8_t, fp + A, r[B]); NEXT();
+op_STF4: STORE(uint32_t, fp + A, r[B]); NEXT();
+op_STF8: STORE(uint64_t, fp + A, r[B]); NEXT();
+op_LEAF: r[A] = (reg)(fp + B); NEXT();
+op_INCM1: STORE(uint8_t, (char *)r[A] + B,
+		LOAD(uint8_t, (char *)r[A] + B) + C); NEXT();
+op_INCM4: STORE(uint32_t, (char *)r[A] + B,
+		LOAD(uint32_t, (char *)r[A] + B) + C); NEXT();
+op_INCM8: STORE(uint64_t, (char *)r[A] + B,
+		LOAD(uint64_t, (char *)r[A] + B) + (int64_t)C); NEXT();
+op_ADDM1: STORE(uint8_t, (char *)r[A] + B,
+		LOAD(uint8_t, (char *)r[A] + B) + r[C]); NEXT();
+op_ADDM4: STORE(uint32_t, (char *)r[A] + B,
+		LOAD(uint32_t, (char *)r[A] + B) + r[C]); NEXT();
+op_ADDM8: STORE(uint64_t, (char *)r[A] + B,
+		LOAD(uint64_t, (char *)r[A] + B) + r[C]); NEXT();
+op_SUBM1: STORE(uint8_t, (char *)r[A] + B,
+		LOAD(uint8_t, (char *)r[A] + B) - r[C]); NEXT();
+op_SUBM4: STORE(uint32_t, (char *)r[A] + B,
+		LOAD(uint32_t, (char *)r[A] + B) - r[C]); NEXT();
+op_SUBM8: STORE(uint64_t, (char *)r[A] + B,
+		LOAD(uint64_t, (char *)r[A] + B) - r[C]); NEXT();
+op_JMP: JUMP(A);
+op_JZ: if (!r[A]) JUMP(B); NEXT();
+op_JNZ: if (r[A]) JUMP(B); NEXT();
+op_JLT: if ((int64_t)r[A] < (int64_t)r[B]) JUMP(C); NEXT();
+op_JGE: if ((int64_t)r[A] >= (int64_t)r[B]) JUMP(C); NEXT();
+op_JEQ: if (r[A] == r[B]) JUMP(C); NEXT();
+op_JNE: if (r[A] != r[B]) JUMP(C); NEXT();
+op_JLTI: if ((int64_t)r[A] < B) JUMP(C); NEXT();
+op_JGEI: if ((int64_t)r[A] >= B) JUMP(C); NEXT();
+op_JEQI: if (r[A] == (reg)(int64_t)B) JUMP(C); NEXT();
+op_JNEI: if (r[A] != (reg)(int64_t)B) JUMP(C); NEXT();
+op_JTAB: {
+	uint32_t i = (uint32_t)r[A] - (uint32_t)B;
+	if (i < (uint32_t)C) JUMP(ip[VM_INS + i]);
+	ip += VM_INS + (C + VM_INS - 1) / VM_INS * VM_INS;
+	DISPATCH();
+}
+op_CALL:
+	f = &fns[B];
+	if (calls == calls_end || r + A + f->regs > regs_end
+			|| fp + frame + f->frame > memory_end) {
+		goto overflow;
+	}
+	*calls++ = (struct ret){ .ip = ip + VM_INS, .r = r, .fp = fp,
+		.frame = frame };
+	r += A;
+	fp += frame;
+	frame = f->frame;
+	ip = f->code;
+	DISPATCH();
+op_CALLX:
+	r[A] = call_native(&fns[B], r + A, C);
+	NEXT();
+op_TAIL:
+	// the frame is left to the callee, which returns to our caller
+	f = &fns[B];
+	if (r + f->regs > regs_end || fp + f->frame > memory_end)
+		goto overflow;
+	memmove(r, r + A, C * sizeof(*r));
+	frame = f->frame;
+	ip = f->code;
+	DISPATCH();
+op_TAILX:
+	r[A] = call_native(&fns[B], r + A, C);
+	goto op_RET;
+op_RET:
+	// the result is in the first register, which is where the caller
+	// passed the arguments
+	r[0] = r[A];
+	if (calls == m->calls) {
+		*res = (int)r[0];
+		return true;
+	}
+	calls--;
+	ip = calls->ip;
+	r = calls->r;
+	fp = calls->fp;
+	frame = calls->frame;
+	DISPATCH();
+#undef JUMP
+#undef NEXT
+#undef DISPATCH
+#undef C
+#undef B
+#undef A
+
+overflow:
+	fprintf(stderr, "error: stack overflow\n");
+	return false;
+}
+
+bool vm_run(struct vm_code *c, int argc, char **argv, int *res) {
+	int *main_fn;
+	if (hashmap_get(&c->by_name, "main", (void **)&main_fn) != MAP_OK
+			|| !((const struct vm_function *)vec_get_c(&c->functions,
+			*main_fn))->defined) {
+		fprintf(stderr, "error: no `main` to run\n");
+		return false;
+	}
+	int *code = malloc(c->code.len * sizeof(int) + 1);
+	if (c->code.len)
+		memcpy(code, vec_get(&c->code, 0), c->code.len * sizeof(int));
+	struct machine m = {
+		.regs = malloc(REGS * sizeof(reg)),
+		.memory = malloc(MEMORY),
+		.calls = malloc(CALLS * sizeof(struct ret)),
+		.fns = calloc(c->functions.len, sizeof(struct callee)),
+		.consts = c->consts.len ? vec_get(&c->consts, 0) : NULL,
+	};
+	for (int i = 0; i < c->functions.len; ++i) {
+		const struct vm_function *f = vec_get_c(&c->functions, i);
+		m.fns[i] = (struct callee){ .code = code + f->code,
+			.regs = f->regs, .frame = f->frame, .size = f->size };
+	}
+	bool ok = m.regs && m.memory && m.calls
+		&& execute(c, &m, code, *main_fn, argc, argv, res);
+	free(m.regs);
+	free(m.memory);
+	free(m.calls);
+	free(m.fns);
+	free(code);
+	return ok;
+}
@@ -0,0 +1,704 @@
+// SPDX-License-Identifier: GPL-3.0-only
+#include <c_compiler/x86.h>
+#include <c_compiler/ast.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+enum fixup_kind { FIX_NONE, FIX_REL8, FIX_REL32, FIX_ABS64 };
+
+/* the bytes of one instruction */
+struct enc {
+	unsigned char b[16];
+	int n;
+	enum fixup_kind fix; /* of the field for the target at the end */
+	struct emit_operand target;
+};
+
+struct fixup {
+	int ins; /* the record, to give its jump the long form */
+	enum x86_section section;
+	enum fixup_kind kind;
+	int offset; /* of the field */
+	int end; /* of the instruction, what the relative ones count from */
+	struct emit_operand target;
+};
+struct place {
+	enum x86_section section; /* X86_UNDEFINED until it is defined */
+	int offset;
+};
+
+struct state {
+	struct x86_code *c;
+	const struct emit *e;
+	enum x86_section section;
+	struct vec labels, strings, tables; /* vec<struct place>, by number */
+	struct vec fixups; /* vec<struct fixup> */
+	struct vec globals; /* vec<const char *> */
+	unsigned char *long_jump; /* by record */
+};
+
+void x86_init(struct x86_code *c) {
+	for (int i = 0; i < X86_SECTION_N; ++i)
+		c->section[i] = vec_new_empty(sizeof(unsigned char));
+	c->symbols = vec_new_empty(sizeof(struct x86_symbol));
+	c->relocs = vec_new_empty(sizeof(struct x86_reloc));
+	hashmap_init(&c->by_name, sizeof(int));
+}
+void x86_free(struct x86_code *c) {
+	for (int i = 0; i < X86_SECTION_N; ++i) vec_free(&c->section[i]);
+	vec_free(&c->symbols);
+	vec_free(&c->relocs);
+	hashmap_finish(&c->by_name);
+}
+int x86_symbol(struct x86_code *c, const char *name) {
+	int *i;
+	if (hashmap_get(&c->by_name, name, (void **)&i) != MAP_OK) return -1;
+	return *i;
+}
+
+static void byte(struct enc *x, long long b) {
+	x->b[x->n++] = b;
+}
+static void bytes(struct enc *x, long long v, int n) {
+	for (int i = 0; i < n; ++i) byte(x, v >> 8 * i);
+}
+/* one to three opcode bytes, the first one highest */
+static void opcode(struct enc *x, unsigned op) {
+	if (op > 0xFFFF) byte(x, op >> 16);
+	if (op > 0xFF) byte(x, op >> 8);
+	byte(x, op);
+}
+static bool fits8(long long v) {
+	return v >= -128 && v <= 127;
+}
+static bool fits32(long long v) {
+	return v >= INT32_MIN && v <= INT32_MAX;
+}
+/* the immediate as the instruction of that size takes it, or false if it
+ * doesn't fit either signed or unsigned */
+static bool imm_of_size(long long v, int size, long long *res) {
+	switch (size) {
+	case 1:
+		if (v < INT8_MIN || v > UINT8_MAX) return false;
+		*res = (int8_t)v;
+		return true;
+	case 2:
+		if (v < INT16_MIN || v > UINT16_MAX) return false;
+		*res = (int16_t)v;
+		return true;
+	case 4:
+		if (v < INT32_MIN || v > UINT32_MAX) return false;
+		*res = (int32_t)v;
+		return true;
+	default:
+		*res = v;
+		return fits32(v);
+	}
+}
+
+static bool is_reg(const struct emit_operand *o) {
+	return o->kind == EMIT_O_REG;
+}
+static bool is_rm(const struct emit_operand *o) {
+	return o->kind == EMIT_O_REG || o->kind == EMIT_O_MEM;
+}
+/* spl, bpl, sil and dil, which are ah to bh without a REX prefix */
+static bool rex_byte_reg(const struct emit_operand *o) {
+	return is_reg(o) && o->size == 1 && o->reg >= EMIT_RSP
+		&& o->reg <= EMIT_RDI;
+}
+
+static void rex(struct enc *x, bool w, int reg, const struct emit_operand *rm,
+		bool force) {
+	int r = (w ? 8 : 0) | (reg >= 8 ? 4 : 0);
+	if (rm->kind == EMIT_O_MEM && rm->index >= 8) r |= 2;
+	if (rm->reg >= 8) r |= 1;
+	if (r || force) byte(x, 0x40 | r);
+}
+/* the ModRM byte and what follows it, reg is a register or the opcode
+ * extension */
+static void modrm(struct enc *x, int reg, const struct emit_operand *rm) {
+	reg &= 7;
+	if (rm->kind == EMIT_O_REG) {
+		byte(x, 0xC0 | reg << 3 | (rm->reg & 7));
+		return;
+	}
+	int ss = rm->scale == 8 ? 3 : rm->scale == 4 ? 2 : rm->scale == 2;
+	int index = rm->index >= 0 ? rm->index & 7 : 4;
+	if (rm->reg < 0) {
+		byte(x, reg << 3 | 4);
+		byte(x, ss << 6 | index << 3 | 5);
+		bytes(x, rm->x, 4);
+		return;
+	}
+	int base = rm->reg & 7;
+	int mod = rm->x == 0 && base != EMIT_RBP ? 0 : fits8(rm->x) ? 1 : 2;
+	if (rm->index >= 0 || base == EMIT_RSP) {
+		byte(x, mod << 6 | reg << 3 | 4);
+		byte(x, ss << 6 | index << 3 | base);
+	} else {
+		byte(x, mod << 6 | reg << 3 | base);
+	}
+	if (mod == 1) byte(x, rm->x);
+	if (mod == 2) bytes(x, rm->x, 4);
+}
+/* an instruction on general purpose registers of the size */
+static void rm_ins(struct enc *x, int size, unsigned op, int reg,
+		bool force_rex, const struct emit_operand *rm) {
+	if (size == 2) byte(x, 0x66);
+	force_rex = force_rex || (size == 1 && rex_byte_reg(rm));
+	rex(x, size == 8, reg, rm, force_rex);
+	opcode(x, op);
+	modrm(x, reg, rm);
+}
+/* an SSE instruction, with its mandatory prefix */
+static void sse_ins(struct enc *x, int prefix, unsigned op, int reg,
+		const struct emit_operand *rm) {
+	byte(x, prefix);
+	rex(x, false, reg, rm, false);
+	opcode(x, op);
+	modrm(x, reg, rm);
+}
+/* an AVX instruction, pp 1 for 66 and 2 for F3, map 1 for 0F and 2 for
+ * 0F38, vvvv the second source or 0 */
+static void vex_ins(struct enc *x, bool l, int pp, int map, int op, int reg,
+		int vvvv, const struct emit_operand *rm) {
+	bool rx = rm->kind == EMIT_O_MEM && rm->index >= 8;
+	bool rb = rm->reg >= 8;
+	int tail = (~vvvv & 15) << 3 | l << 2 | pp;
+	if (map == 1 && !rx && !rb) {
+		byte(x, 0xC5);
+		byte(x, (reg < 8) << 7 | tail);
+	} else {
+		byte(x, 0xC4);
+		byte(x, (reg < 8) << 7 | !rx << 6 | !rb << 5 | map);
+		byte(x, tail);
+	}
+	byte(x, op);
+	modrm(x, reg, rm);
+}
+
+static int gpr_size(const struct emit_ins *in) {
+	for (int i = 0; i < in->n; ++i)
+		if (is_reg(&in->o[i])) return in->o[i].size;
+	for (int i = 0; i < in->n; ++i)
+		if (in->o[i].kind == EMIT_O_MEM && in->o[i].size)
+			return in->o[i].size;
+	return 8;
+}
+
+static void field(struct enc *x, enum fixup_kind fix,
+		const struct emit_operand *target) {
+	x->fix = fix;
+	x->target = *target;
+	bytes(x, 0, fix == FIX_REL8 ? 1 : fix == FIX_REL32 ? 4 : 8);
+}
+
+/* add, and, sub, xor and cmp, k is the opcode extension */
+static bool enc_alu(struct enc *x, int k, int size,
+		const struct emit_operand *a, const struct emit_operand *b) {
+	bool by = size == 1;
+	long long v;
+	if (b->kind == EMIT_O_IMM) {
+		if (!is_rm(a) || !imm_of_size(b->x, size, &v)) return false;
+		if (by) {
+			rm_ins(x, size, 0x80, k, false, a);
+			byte(x, v);
+		} else if (fits8(v)) {
+			rm_ins(x, size, 0x83, k, false, a);
+			byte(x, v);
+		} else {
+			rm_ins(x, size, 0x81, k, false, a);
+			bytes(x, v, size == 2 ? 2 : 4);
+		}
+	} else if (is_reg(b) && is_rm(a)) {
+		rm_ins(x, size, 8 * k + !by, b->reg, rex_byte_reg(b), a);
+	} else if (is_reg(a) && b->kind == EMIT_O_MEM) {
+		rm_ins(x, size, 8 * k + 2 + !by, a->reg, rex_byte_reg(a), b);
+	} else {
+		return false;
+	}
+	return true;
+}
+static bool enc_mov(struct enc *x, int size, const struct emit_operand *a,
+		const struct emit_operand *b) {
+	bool by = size == 1;
+	long long v;
+	if (b->kind == EMIT_O_STRING || b->kind == EMIT_O_TABLE) {
+		if (!is_reg(a) || a->size != 8) return false;
+		byte(x, 0x48 | (a->reg >= 8));
+		byte(x, 0xB8 + (a->reg & 7));
+		field(x, FIX_ABS64, b);
+	} else if (b->kind == EMIT_O_IMM && is_reg(a)) {
+		// a 32 bit move clears the upper half
+		if (size == 8 && b->x >= 0 && b->x <= UINT32_MAX) size = 4;
+		if (size == 8 && fits32(b->x)) {
+			rm_ins(x, size, 0xC7, 0, false, a);
+			bytes(x, b->x, 4);
+			return true;
+		}
+		if (size != 8 && !imm_of_size(b->x, size, &v)) return false;
+		if (size == 2) byte(x, 0x66);
+		int r = (size == 8 ? 8 : 0) | (a->reg >= 8);
+		if (r || (by && rex_byte_reg(a))) byte(x, 0x40 | r);
+		byte(x, (by ? 0xB0 : 0xB8) + (a->reg & 7));
+		bytes(x, b->x, size);
+	} else if (b->kind == EMIT_O_IMM && a->kind == EMIT_O_MEM) {
+		if (!imm_of_size(b->x, size, &v)) return false;
+		rm_ins(x, size, by ? 0xC6 : 0xC7, 0, false, a);
+		bytes(x, v, size > 4 ? 4 : size);
+	} else if (is_reg(b) && is_rm(a)) {
+		rm_ins(x, size, by ? 0x88 : 0x89, b->reg, rex_byte_reg(b), a);
+	} else if (is_reg(a) && b->kind == EMIT_O_MEM) {
+		rm_ins(x, size, by ? 0x8A : 0x8B, a->reg, rex_byte_reg(a), b);
+	} else {
+		return false;
+	}
+	return true;
+}
+/* shl, shr and sar by an immediate or cl */
+static bool enc_shift(struct enc *x, int k, int size,
+		const struct emit_operand *a, const struct emit_operand *b) {
+	bool by = size == 1;
+	if (!is_rm(a)) return false;
+	if (is_reg(b) && b->reg == EMIT_RCX && b->size == 1) {
+		rm_ins(x, size, by ? 0xD2 : 0xD3, k, false, a);
+	} else if (b->kind == EMIT_O_IMM && b->x == 1) {
+		rm_ins(x, size, by ? 0xD0 : 0xD1, k, false, a);
+	} else if (b->kind == EMIT_O_IMM && b->x >= 0 && b->x < 64) {
+		rm_ins(x, size, by ? 0xC0 : 0xC1, k, false, a);
+		byte(x, b->x);
+	} else {
+		return false;
+	}
+	return true;
+}
+/* not, neg, mul, imul, div and idiv of one operand, and inc and dec */
+static bool enc_unary(struct enc *x, unsigned op, int k, int size,
+		const struct emit_operand *a) {
+	if (!is_rm(a)) return false;
+	rm_ins(x, size, op - (size != 1 ? 0 : 1), k, false, a);
+	return true;
+}
+static bool enc_branch(struct enc *x, unsigned op, unsigned op_long,
+		const struct emit_operand *a, bool long_jump) {
+	if (a->kind == EMIT_O_LABEL) {
+		opcode(x, long_jump ? op_long : op);
+		field(x, long_jump ? FIX_REL32 : FIX_REL8, a);
+	} else if (a->kind == EMIT_O_SYM) {
+		opcode(x, op_long);
+		field(x, FIX_REL32, a);
+	} else {
+		return false;
+	}
+	return true;
+}
+/* a vector move between a register and a register or memory, op is the
+ * load and op + 0x10 the store */
+static bool enc_vmove(struct enc *x, int prefix, int pp, unsigned op,
+		bool vex, const struct emit_operand *a,
+		const struct emit_operand *b) {
+	const struct emit_operand *reg = a, *rm = b;
+	if (!is_reg(a)) {
+		if (!is_reg(b)) return false;
+		reg = b;
+		rm = a;
+		op += 0x10;
+	}
+	if (vex) {
+		vex_ins(x, reg->size == 32, pp, 1, op, reg->reg, 0, rm);
+	} else {
+		sse_ins(x, prefix, 0x0F00 | op, reg->reg, rm);
+	}
+	return true;
+}
+
+static bool encode(struct enc *x, const struct emit_ins *in, bool long_jump) {
+	const struct emit_operand *a = &in->o[0], *b = &in->o[1];
+	const struct emit_operand *c = &in->o[2];
+	int size = gpr_size(in);
+	switch (in->op) {
+	case EMIT_MOV: return in->n == 2 && enc_mov(x, size, a, b);
+	case EMIT_MOVZX:
+		if (in->n != 2 || !is_reg(a) || !is_rm(b)) return false;
+		rm_ins(x, a->size, b->size == 2 ? 0x0FB7 : 0x0FB6, a->reg,
+			rex_byte_reg(b), b);
+		return true;
+	case EMIT_LEA:
+		if (in->n != 2 || !is_reg(a) || b->kind != EMIT_O_MEM)
+			return false;
+		rm_ins(x, a->size, 0x8D, a->reg, false, b);
+		return true;
+	case EMIT_ADD: return in->n == 2 && enc_alu(x, 0, size, a, b);
+	case EMIT_AND: return in->n == 2 && enc_alu(x, 4, size, a, b);
+	case EMIT_SUB: return in->n == 2 && enc_alu(x, 5, size, a, b);
+	case EMIT_XOR: return in->n == 2 && enc_alu(x, 6, size, a, b);
+	case EMIT_CMP: return in->n == 2 && enc_alu(x, 7, size, a, b);
+	case EMIT_IMUL:
+		if (in->n == 1) return enc_unary(x, 0xF7, 5, size, a);
+		if (!is_reg(a) || !is_rm(b)) return false;
+		if (in->n == 2) {
+			rm_ins(x, size, 0x0FAF, a->reg, false, b);
+		} else if (c->kind == EMIT_O_IMM && fits8(c->x)) {
+			rm_ins(x, size, 0x6B, a->reg, false, b);
+			byte(x, c->x);
+		} else if (c->kind == EMIT_O_IMM && (fits32(c->x)
+				|| (size == 4 && c->x <= UINT32_MAX))) {
+			rm_ins(x, size, 0x69, a->reg, false, b);
+			bytes(x, c->x, 4);
+		} else {
+			return false;
+		}
+		return true;
+	case EMIT_NOT: return enc_unary(x, 0xF7, 2, size, a);
+	case EMIT_NEG: return enc_unary(x, 0xF7, 3, size, a);
+	case EMIT_MUL: return enc_unary(x, 0xF7, 4, size, a);
+	case EMIT_DIV: return enc_unary(x, 0xF7, 6, size, a);
+	case EMIT_IDIV: return enc_unary(x, 0xF7, 7, size, a);
+	case EMIT_INC: return enc_unary(x, 0xFF, 0, size, a);
+	case EMIT_DEC: return enc_unary(x, 0xFF, 1, size, a);
+	case EMIT_SHL: return in->n == 2 && enc_shift(x, 4, size, a, b);
+	case EMIT_SHR: return in->n == 2 && enc_shift(x, 5, size, a, b);
+	case EMIT_SAR: return in->n == 2 && enc_shift(x, 7, size, a, b);
+	case EMIT_CDQ: byte(x, 0x99); return true;
+	case EMIT_JMP:
+		if (is_rm(a)) {
+			rm_ins(x, 4, 0xFF, 4, false, a);
+			return true;
+		}
+		return enc_branch(x, 0xEB, 0xE9, a, long_jump);
+	case EMIT_JCC:
+		return enc_branch(x, 0x70 + in->cc, 0x0F80 + in->cc, a,
+			long_jump);
+	case EMIT_SETCC:
+		if (!is_rm(a)) return false;
+		rm_ins(x, 1, 0x0F90 + in->cc, 0, false, a);
+		return true;
+	case EMIT_CMOVCC:
+		if (!is_reg(a) || !is_rm(b)) return false;
+		rm_ins(x, size, 0x0F40 + in->cc, a->reg, false, b);
+		return true;
+	case EMIT_CALL:
+		if (is_rm(a)) {
+			rm_ins(x, 4, 0xFF, 2, false, a);
+			return true;
+		}
+		if (a->kind != EMIT_O_SYM) return false;
+		byte(x, 0xE8);
+		field(x, FIX_REL32, a);
+		return true;
+	case EMIT_RET: byte(x, 0xC3); return true;
+	case EMIT_PUSH:
+	case EMIT_POP:
+		if (!is_reg(a)) return false;
+		if (a->reg >= 8) byte(x, 0x41);
+		byte(x, (in->op == EMIT_PUSH ? 0x50 : 0x58) + (a->reg & 7));
+		return true;
+	case EMIT_REP_MOVSB: bytes(x, 0xA4F3, 2); return true;
+	case EMIT_REP_STOSB: bytes(x, 0xAAF3, 2); return true;
+	case EMIT_REP_STOSD: bytes(x, 0xABF3, 2); return true;
+	case EMIT_MOVD:
+		if (is_reg(a) && a->size == 16) {
+			sse_ins(x, 0x66, 0x0F6E, a->reg, b);
+		} else if (is_reg(b) && b->size == 16) {
+			sse_ins(x, 0x66, 0x0F7E, b->reg, a);
+		} else {
+			return false;
+		}
+		return true;
+	case EMIT_MOVDQU: return enc_vmove(x, 0xF3, 2, 0x6F, false, a, b);
+	case EMIT_MOVDQA: return enc_vmove(x, 0x66, 1, 0x6F, false, a, b);
+	case EMIT_VMOVDQU: return enc_vmove(x, 0xF3, 2, 0x6F, true, a, b);
+	case EMIT_PADDB:
+	case EMIT_PADDD:
+	case EMIT_PSUBB:
+	case EMIT_PSUBD: ;
+		static const unsigned char sse_ops[EMIT_OP_N] = {
+			[EMIT_PADDB] = 0xFC, [EMIT_PADDD] = 0xFE,
+			[EMIT_PSUBB] = 0xF8, [EMIT_PSUBD] = 0xFA,
+			[EMIT_VPADDB] = 0xFC, [EMIT_VPADDD] = 0xFE,
+			[EMIT_VPSUBB] = 0xF8, [EMIT_VPSUBD] = 0xFA,
+		};
+		if (in->n != 2 || !is_reg(a) || !is_rm(b)) return false;
+		sse_ins(x, 0x66, 0x0F00 | sse_ops[in->op], a->reg, b);
+		return true;
+	case EMIT_PSHUFD:
+		if (in->n != 3 || !is_reg(a) || !is_rm(b)) return false;
+		sse_ins(x, 0x66, 0x0F70, a->reg, b);
+		byte(x, c->x);
+		return true;
+	case EMIT_VMOVD:
+		if (!is_reg(a) || a->size != 16 || !is_rm(b)) return false;
+		vex_ins(x, false, 1, 1, 0x6E, a->reg, 0, b);
+		return true;
+	case EMIT_VPADDB:
+	case EMIT_VPADDD:
+	case EMIT_VPSUBB:
+	case EMIT_VPSUBD: ;
+		// the two operand form is the three operand one with a twice
+		const struct emit_operand *src = in->n == 3 ? c : b;
+		if (!is_reg(a) || !is_reg(b) || !is_rm(src)) return false;
+		vex_ins(x, a->size == 32, 1, 1, sse_ops[in->op], a->reg,
+			in->n == 3 ? b->reg : a->reg, src);
+		return true;
+	case EMIT_VPBROADCASTD:
+		if (!is_reg(a) || !is_rm(b)) return false;
+		vex_ins(x, a->size == 32, 1, 2, 0x58, a->reg, 0, b);
+		return true;
+	case EMIT_VZEROUPPER: bytes(x, 0x77F8C5, 3); return true;
+	default: return false;
+	}
+}
+
+static void place_set(struct vec *v, int i, struct place p) {
+	while (v->len <= i)
+		vec_append(v, &(struct place){ .section = X86_UNDEFINED });
+	*(struct place *)vec_get(v, i) = p;
+}
+static const struct place *place_get(const struct vec *v, long long i) {
+	if (i < 0 || i >= v->len) return NULL;
+	const struct place *p = vec_get_c(v, i);
+	return p->section == X86_UNDEFINED ? NULL : p;
+}
+/* where the target of a fixup is, false if it isn't in the code */
+static bool target_place(struct state *s, const struct emit_operand *t,
+		struct place *res) {
+	const struct place *p = NULL;
+	switch (t->kind) {
+	case EMIT_O_LABEL: p = place_get(&s->labels, t->x); break;
+	case EMIT_O_STRING: p = place_get(&s->strings, t->x); break;
+	case EMIT_O_TABLE: p = place_get(&s->tables, t->x); break;
+	case EMIT_O_SYM: ;
+		int i = x86_symbol(s->c, t->sym);
+		if (i < 0) return false;
+		const struct x86_symbol *sym = vec_get_c(&s->c->symbols, i);
+		if (sym->section == X86_UNDEFINED) return false;
+		*res = (struct place){ sym->section, sym->offset };
+		return true;
+	default: break;
+	}
+	if (!p) return false;
+	*res = *p;
+	return true;
+}
+
+static void put(struct vec *v, const unsigned char *b, int n) {
+	for (int i = 0; i < n; ++i) vec_append(v, &b[i]);
+}
+/* the bytes of a string literal with the nul that ends them */
+static void put_string(struct vec *v, const char *src) {
+	char *b = malloc(strlen(src));
+	int n = ast_string_bytes(src, b);
+	put(v, (const unsigned char *)b, n + 1);
+	free(b);
+}
+static void define_symbol(struct state *s, const char *name) {
+	struct vec *sec = &s->c->section[s->section];
+	int i = x86_symbol(s->c, name);
+	if (i < 0) {
+		i = vec_append(&s->c->symbols, &(struct x86_symbol){
+			.name = name });
+		hashmap_put(&s->c->by_name, name, &i);
+	}
+	struct x86_symbol *sym = vec_get(&s->c->symbols, i);
+	sym->section = s->section;
+	sym->offset = sec->len;
+}
+static bool directive(struct state *s, const struct emit_ins *in) {
+	static const char *sections[X86_SECTION_N] = {
+		[X86_TEXT] = ".text",
+		[X86_TEXT_UNLIKELY] = ".text.unlikely",
+		[X86_RODATA] = ".rodata",
+	};
+	struct vec *sec = &s->c->section[s->section];
+	const struct emit_operand *a = &in->o[0];
+	struct place here = { s->section, sec->len };
+	switch (in->op) {
+	case EMIT_LABEL:
+		if (a->kind == EMIT_O_SYM) {
+			define_symbol(s, a->sym);
+			return true;
+		}
+		if (a->kind == EMIT_O_LABEL) {
+			place_set(&s->labels, a->x, here);
+			return true;
+		}
+		// the entries of jump tables are loaded aligned
+		while (sec->len % 8) vec_append(sec, &(unsigned char){ 0 });
+		here.offset = sec->len;
+		place_set(&s->tables, a->x, here);
+		return true;
+	case EMIT_DB:
+		place_set(&s->strings, a->x, here);
+		put_string(sec, in->o[1].sym);
+		return true;
+	case EMIT_DQ:
+		vec_append(&s->fixups, &(struct fixup){ .ins = -1,
+			.section = s->section, .kind = FIX_ABS64,
+			.offset = sec->len, .end = sec->len + 8,
+			.target = *a });
+		put(sec, (unsigned char[8]){ 0 }, 8);
+		return true;
+	case EMIT_SECTION:
+		for (int i = 0; i < X86_SECTION_N; ++i) {
+			if (strcmp(a->sym, sections[i]) == 0) {
+				s->section = i;
+				return true;
+			}
+		}
+		fprintf(stderr, "error: unknown section `%s`\n", a->sym);
+		return false;
+	case EMIT_GLOBAL:
+		vec_append(&s->globals, &a->sym);
+		return true;
+	default: // comments, and the externs are whatever isn't defined
+		return true;
+	}
+}
+
+static bool encode_all(struct state *s) {
+	for (int i = 0; i < X86_SECTION_N; ++i) s->c->section[i].len = 0;
+	s->fixups.len = 0;
+	s->globals.len = 0;
+	s->section = X86_TEXT;
+	for (int i = 0; i < s->e->ins.len; ++i) {
+		const struct emit_ins *in = vec_get_c(&s->e->ins, i);
+		if (in->op >= EMIT_LABEL) {
+			if (!directive(s, in)) return false;
+			continue;
+		}
+		struct enc x = { 0 };
+		if (!encode(&x, in, s->long_jump[i])) {
+			fprintf(stderr, "error: can't encode `%s`\n",
+				emit_op_name(in->op));
+			return false;
+		}
+		struct vec *sec = &s->c->section[s->section];
+		int start = sec->len;
+		put(sec, x.b, x.n);
+		if (x.fix == FIX_NONE) continue;
+		int field = x.fix == FIX_REL8 ? 1 : x.fix == FIX_REL32 ? 4 : 8;
+		vec_append(&s->fixups, &(struct fixup){ .ins = i,
+			.section = s->section, .kind = x.fix,
+			.offset = start + x.n - field, .end = start + x.n,
+			.target = x.target });
+	}
+	return true;
+}
+/* gives the short jumps that don't reach their target the long form, true
+ * if there were any */
+static bool relax(struct state *s) {
+	bool changed = false;
+	for (int i = 0; i < s->fixups.len; ++i) {
+		const struct fixup *f = vec_get_c(&s->fixups, i);
+		struct place p;
+		if (f->kind != FIX_REL8 || !target_place(s, &f->target, &p))
+			continue;
+		if (p.section != f->section || !fits8(p.offset - f->end)) {
+			s->long_jump[f->ins] = 1;
+			changed = true;
+		}
+	}
+	return changed;
+}
+static int undefined_symbol(struct x86_code *c, const char *name) {
+	int i = x86_symbol(c, name);
+	if (i >= 0) return i;
+	i = vec_append(&c->symbols, &(struct x86_symbol){ .name = name,
+		.section = X86_UNDEFINED, .global = true });
+	hashmap_put(&c->by_name, name, &i);
+	return i;
+}
+/* fills in the fields that are known and turns the others into
+ * relocations */
+static bool resolve(struct state *s) {
+	struct x86_code *c = s->c;
+	for (int i = 0; i < s->fixups.len; ++i) {
+		const struct fixup *f = vec_get_c(&s->fixups, i);
+		unsigned char *field = vec_get(&c->section[f->section],
+			f->offset);
+		struct place p;
+		struct x86_reloc r = { .section = f->section,
+			.offset = f->offset, .sym = -1 };
+		if (!target_place(s, &f->target, &p)) {
+			if (f->target.kind != EMIT_O_SYM) {
+				fprintf(stderr, "error: undefined label\n");
+				return false;
+			}
+			r.sym = undefined_symbol(c, f->target.sym);
+			r.kind = f->kind == FIX_ABS64 ? X86_R_64 : X86_R_PLT32;
+			r.addend = f->offset - f->end;
+			if (f->kind == FIX_ABS64) r.addend = 0;
+			vec_append(&c->relocs, &r);
+			continue;
+		}
+		long long disp = p.offset - f->end;
+		if (f->kind == FIX_REL8) {
+			field[0] = disp;
+		} else if (f->kind == FIX_REL32 && p.section == f->section) {
+			for (int k = 0; k < 4; ++k) field[k] = disp >> 8 * k;
+		} else {
+			r.kind = f->kind == FIX_ABS64 ? X86_R_64 : X86_R_PC32;
+			r.target = p.section;
+			r.addend = p.offset;
+			if (f->kind == FIX_REL32)
+				r.addend += f->offset - f->end;
+			vec_append(&c->relocs, &r);
+		}
+	}
+	return true;
+}
+/* the sizes of the symbols, and which ones are global */
+static void finish_symbols(struct state *s) {
+	struct x86_code *c = s->c;
+	int last[X86_SECTION_N];
+	for (int i = 0; i < X86_SECTION_N; ++i) last[i] = -1;
+	for (int i = 0; i < c->symbols.len; ++i) {
+		struct x86_symbol *sym = vec_get(&c->symbols, i);
+		if (sym->section == X86_UNDEFINED) continue;
+		if (last[sym->section] >= 0) {
+			struct x86_symbol *prev = vec_get(&c->symbols,
+				last[sym->section]);
+			prev->size = sym->offset - prev->offset;
+		}
+		last[sym->section] = i;
+	}
+	for (int i = 0; i < X86_SECTION_N; ++i) {
+		if (last[i] < 0) continue;
+		struct x86_symbol *sym = vec_get(&c->symbols, last[i]);
+		sym->size = c->section[i].len - sym->offset;
+	}
+	for (int i = 0; i < s->globals.len; ++i) {
+		int k = x86_symbol(c, *(const char **)vec_get(&s->globals, i));
+		if (k >= 0) ((struct x86_symbol *)vec_get(&c->symbols, k))
+			->global = true;
+	}
+}
+
+bool x86_encode(struct x86_code *c, const struct emit *e) {
+	struct state s = {
+		.c = c,
+		.e = e,
+		.labels = vec_new_empty(sizeof(struct place)),
+		.strings = vec_new_empty(sizeof(struct place)),
+		.tables = vec_new_empty(sizeof(struct place)),
+		.fixups = vec_new_empty(sizeof(struct fixup)),
+		.globals = vec_new_empty(sizeof(const char *)),
+		.long_jump = calloc(e->ins.len + 1, 1),
+	};
+	// the jumps start short, and the ones that don't reach get longer
+	// until they all do
+	bool ok;
+	while ((ok = encode_all(&s)) && relax(&s));
+	if (ok) ok = resolve(&s);
+	if (ok) finish_symbols(&s);
+	vec_free(&s.labels);
+	vec_free(&s.strings);
+	vec_free(&s.tables);
+	vec_free(&s.fixups);
+	vec_free(&s.globals);
+	free(s.long_jump);
+	return ok;
+}
@@ -0,0 +1,64 @@
+extern void *malloc(int size);
+extern void *memccpy(void *dest, const void *src, int c, int n);
+extern _Noreturn void exit(int exit_code);
+
+int main() {
+	int *p = malloc(64);
+	int i = 0;
+	while (i < 16) {
+		*(p + i * 4) = i;
+		i = i + 1;
+	}
+
+	// base + index * scale + displacement
+	i = 3;
+	if (p[i * 4] != 3) exit(1);
+	if (*(p + i * sizeof(int) + 4) != 4) exit(1);
+	if (*(4 + p + i * 4) != 4) exit(1);
+	if (*(i * 4 + p) != 3) exit(1);
+	if (*(p + 16 - 4) != 3) exit(1);
+	char c = 2;
+	if (*(p + c * 4) != 2) exit(1);
+
+	// in place updates
+	++p[i * 4];
+	if (p[12] != 4) exit(1);
+	--*(p + 12);
+	if (*(p + 12) != 3) exit(1);
+
+	// chained loads
+	int **pp = malloc(64);
+	*(pp + 8) = p;
+	if (*(*(pp + 8) + i * 4) != 3) exit(1);
+	pp[8][i * 4] = 7;
+	if (p[12] != 7) exit(1);
+
+	// arrays on the stack
+	int a[4];
+	i = 0;
+	while (i < 4) {
+		a[i * 4] = i + 10;
+		i = i + 1;
+	}
+	i = 3;
+	if (a[(i - 2) * 4] != 11) exit(1);
+	int *ap = &a[8];
+	if (*ap != 12) exit(1);
+
+	// arguments that are indexed loads themselves
+	char *src = "abxd";
+	char *dst = malloc(8);
+	*(dst + 2) = 0;
+	*(p + 4) = 'b';
+	*(p + 8) = 3;
+	memccpy(dst, src, *(p + i + 1), *(p + i * 2 + 2));
+	if (*(dst + 1) != 'b') exit(1);
+	if (*(dst + 2) != 0) exit(1);
+
+	// the bytes of a string with escapes, the same in every output
+	char *esc = "a\tb\"\\";
+	if (*(esc + 1) != 9) exit(1);
+	if (*(esc + 3) != 34) exit(1);
+	if (*(esc + 4) != 92) exit(1);
+	if (*(esc + 5) != 0) exit(1);
+}
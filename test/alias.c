@@ -0,0 +1,142 @@
+extern void *malloc(int size);
+extern _Noreturn void exit(int exit_code);
+
+// Stores only change what they may alias: accesses of different types are
+// apart unless one is through `char`, and so are distinct arrays and the
+// objects of restrict pointers. A pointer derived from another one, or an
+// array whose address escapes, still aliases it.
+
+void add(int *restrict d, int *restrict a, int n) {
+	int i = 0;
+	while (i < n) {
+		*(d + i) = *(a + i) + 1;
+		i = i + 4;
+	}
+}
+
+void copy(char *restrict d, char *restrict s, int n) {
+	int i = 0;
+	while (i < n) {
+		*(d + i) = *(s + i);
+		i = i + 1;
+	}
+}
+
+// `e` points into the same array as `d`, each element depends on the one
+// before it
+void shift(int *restrict d, int n) {
+	int *e = d + 4;
+	int i = 0;
+	while (i < n) {
+		*(e + i) = *(d + i) + 1;
+		i = i + 4;
+	}
+}
+
+int sum(int *restrict d, int **restrict pp, int n) {
+	int s = 0;
+	int i = 0;
+	// `**pp` is read on every iteration, `*(d + i)` is not it
+	while (i < n) {
+		*(d + i) = i;
+		s = s + **pp;
+		i = i + 4;
+	}
+	return s;
+}
+
+int main() {
+	int *m = malloc(4096);
+	int *n = malloc(4096);
+	char *c = malloc(1024);
+	int b[4];
+	int t[4];
+	int **pp = malloc(16);
+	int x = 0;
+	int v = 2;
+	int *p = m;
+	int *q = m;
+	int *r = &b[4];
+	int i = 0;
+
+	i = 0;
+	while (i < 4000) {
+		*(n + i) = i;
+		i = i + 4;
+	}
+	add(m, n, 4000);
+	i = 0;
+	while (i < 4000) {
+		if (*(m + i) != i + 1) exit(1);
+		i = i + 4;
+	}
+	copy(c, "alias", 6);
+	if (*(c + 3) != 'a') exit(2);
+	i = 0;
+	while (i < 4000) {
+		*(n + i) = 0;
+		i = i + 4;
+	}
+	shift(n, 400);
+	if (*(n + 400) != 100) exit(3);
+	*n = 5;
+	*(m + 4) = 7;
+	if (sum(m, &n, 40) != 50) exit(4);
+	if (*(m + 4) != 4) exit(5);
+
+	// two pointers to the same memory
+	*m = 1;
+	x = *p + 1;
+	*q = 4;
+	if (*p + 1 != 5) exit(6);
+	if (x != 2) exit(6);
+	// an array nothing points to, and a store of a pointer
+	x = *m + 1;
+	t[0] = 9;
+	*pp = m;
+	if (*m + 1 != x) exit(7);
+	if (t[0] + **pp != 13) exit(7);
+	x = t[0] + 1;
+	t[0] = 2;
+	if (t[0] + 1 != 3) exit(7);
+	if (x != 10) exit(7);
+	// a byte store changes an int
+	x = *m * 2;
+	*(c + 0) = 0;
+	*(c + 1) = 0;
+	*(c + 2) = 0;
+	*(c + 3) = 0;
+	c = m;
+	*c = 3;
+	if (*m * 2 != 6) exit(8);
+	if (x != 8) exit(8);
+	// an array whose element address escapes
+	b[4] = 2;
+	x = b[4] * 3;
+	*r = 3;
+	if (b[4] * 3 != 9) exit(9);
+	if (x != 6) exit(9);
+	// a variable whose address is taken
+	p = &v;
+	x = v * 5;
+	*p = 3;
+	if (v * 5 != 15) exit(10);
+	if (x != 10) exit(10);
+	// neither is invariant in a loop that stores to it
+	i = 0;
+	x = 0;
+	while (i < 20) {
+		*p = v + 1;
+		x = x + v;
+		i = i + 1;
+	}
+	if (x != 270) exit(11);
+	*m = 0;
+	i = 0;
+	while (i < 20) {
+		*(m + 0) = *q + 1;
+		i = i + 1;
+	}
+	if (*m != 20) exit(12);
+	return 0;
+}
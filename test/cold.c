@@ -0,0 +1,74 @@
+extern _Noreturn void exit(int exit_code);
+
+// Arms that end in a call that never returns or in an error return are
+// placed out of line. They still run when their condition holds, with the
+// values of before the if, and what follows the if only sees the other arm.
+
+_Noreturn void fail(int code) {
+	exit(code);
+}
+
+static int digit(int c) {
+	int d = c - '0';
+	if (d < 0) return 0 - 1;
+	if (9 < d) return 0 - 1;
+	return d;
+}
+
+int lookup(int k) {
+	int r = 7;
+	if (k != 4) {
+		r = 9;
+	} else {
+		if (r != 7) exit(20);
+		return 0 - 2;
+	}
+	return r;
+}
+
+int find(char *s, int c) {
+	int i = 0;
+	while (*(s + i)) {
+		if (*(s + i) == c) return i;
+		i = i + 1;
+	}
+	return 0 - 1;
+}
+
+int parse(char *s) {
+	int r = 0;
+	int i = 0;
+	while (*(s + i)) {
+		int d = digit(*(s + i));
+		if (9 < d) {
+			if (*(s + i) == '!') fail(21);
+			return 0 - 1;
+		}
+		r = r * 10 + d;
+		i = i + 1;
+	}
+	return r;
+}
+
+int main(int argc) {
+	int x = 1;
+	int y = 0;
+
+	if (argc == 5) {
+		x = 2;
+		exit(x + 10);
+	}
+	if (x != 1) exit(1);
+	if (argc == 1) y = 3; else fail(2);
+	if (y != 3) exit(3);
+
+	if (lookup(4) != 0 - 2) exit(4);
+	if (lookup(5) != 9) exit(5);
+	if (digit('7') != 7) exit(6);
+	if (digit('a') != 0 - 1) exit(7);
+	if (find("cold", 'l') != 2) exit(8);
+	if (find("cold", 'x') != 0 - 1) exit(9);
+	if (parse("4096") != 4096) exit(10);
+	if (parse("40x") != 0 - 1) exit(11);
+	return 0;
+}
@@ -0,0 +1,90 @@
+extern _Noreturn void exit(int exit_code);
+
+int set(int *p, int v) {
+	*p = v;
+	return v;
+}
+
+static int twice(int a) {
+	int b = a * 3;
+	return b - a;
+}
+
+int main() {
+	int a = 6;
+	int b = 7;
+	int x = 0;
+	int y = 0;
+	int i = 0;
+	int *p = &y;
+
+	// reused within and across statements
+	x = a * b + a * b;
+	if (x != 84) exit(1);
+	y = a * b - 2;
+	if (y != 40) exit(2);
+
+	// until an operand changes
+	a = 2;
+	if (a * b != 14) exit(3);
+
+	// or memory does, through a store or a call
+	y = 5;
+	x = *p * 3;
+	*p = 6;
+	if (*p * 3 != 18) exit(4);
+	set(p, 7);
+	if (*p * 3 != 21) exit(5);
+	if (y * 3 != 21) exit(6);
+
+	// a loop changes its variables before the first use in the body
+	// (squares, which strength reduction leaves alone)
+	x = i * i;
+	while (i < 4) {
+		if (i * i != x) exit(7);
+		i = i + 1;
+		x = i * i;
+	}
+	if (i * i != 16) exit(8);
+
+	// values computed in one arm are not available after it
+	i = 3;
+	if (a < b) x = i * 9; else y = i * 9;
+	i = i + 1;
+	if (i * 9 != 36) exit(9);
+	if (b < a) x = i * 11; else y = i * 11;
+	if (y != 44) exit(10);
+
+	// nor at a case label reached from the dispatch
+	x = 0;
+	i = 2;
+	switch (i) {
+	case 1:
+		x = i * 13;
+	case 2:
+		x = x + i * 13;
+	}
+	if (x != 26) exit(11);
+
+	// nor after a continue skipped them
+	i = 0;
+	y = 0;
+	while (i * i < 30) {
+		i = i + 1;
+		if (i == 6) continue;
+		y = y + i * i;
+	}
+	if (y != 55) exit(12);
+
+	// conditional operands
+	i = 5;
+	x = a < b ? i * 7 : 0;
+	y = b < a ? i * 8 : i * 7;
+	if (x + y != 70) exit(13);
+
+	// inlined bodies have their own names
+	a = 4;
+	b = a * 3;
+	if (twice(5) != 10) exit(14);
+	if (a * 3 != b) exit(15);
+}
@@ -0,0 +1,63 @@
+extern _Noreturn void exit(int exit_code);
+extern int printf(const char *format, ...);
+
+int count(int v) {
+	printf("%d ", v);
+	return v;
+}
+
+int after_return(int v) {
+	return v + 1;
+	v = 5;
+	exit(1);
+}
+
+int after_loop(int v) {
+	while (1) {
+		if (v < 10) return v;
+		v = v - 10;
+	}
+	exit(2);
+}
+
+int labels(int v) {
+	switch (v) {
+	case 0:
+		return 10;
+		exit(3);
+	case 1:
+		v = 20;
+	}
+	return v;
+}
+
+int main() {
+	int x = 1;
+	int unused = 0;
+	int dead = 3;
+	int n = 0;
+
+	if (0) exit(4);
+	if (1) x = 2; else exit(5);
+	while (0) exit(6);
+	if (x != 2) exit(7);
+
+	// the store goes, the call stays
+	dead = count(1);
+	dead = 4;
+	x + 1;
+	if (n != 0) exit(8);
+
+	if (after_return(1) != 2) exit(9);
+	if (after_loop(35) != 5) exit(10);
+	if (labels(0) != 10) exit(11);
+	if (labels(1) != 20) exit(12);
+	if (labels(2) != 2) exit(13);
+
+	printf("%s %s\n", "same", "same");
+	{
+		exit(0);
+		exit(14);
+	}
+	exit(15);
+}
@@ -0,0 +1,456 @@
+extern void *malloc(int size);
+extern _Noreturn void exit(int exit_code);
+
+// Division, modulo and multiplication by constants are lowered to shifts and
+// multiplications by magic numbers, so compare them against the division
+// instruction, which is used when the operand is only known at runtime.
+int main() {
+	int *d = malloc(64);
+	unsigned int *ud = malloc(64);
+	int x = 0;
+	int i = 0;
+	unsigned int u = 0;
+	// signed
+	*d = 2;
+	x = 0 - 70000;
+	while (x != 70000) {
+		if (x / 2 != x / *d) exit(1);
+		if (x % 2 != x % *d) exit(1);
+		x = x + 1;
+	}
+	i = 0;
+	x = 2147483647;
+	while (i < 3000) {
+		if (x / 2 != x / *d) exit(1);
+		if (x % 2 != x % *d) exit(1);
+		x = x - 1;
+		i = i + 1;
+	}
+	i = 0;
+	x = 0 - 2147483647 - 1;
+	while (i < 3000) {
+		if (x / 2 != x / *d) exit(1);
+		if (x % 2 != x % *d) exit(1);
+		x = x + 1;
+		i = i + 1;
+	}
+	*d = 3;
+	x = 0 - 70000;
+	while (x != 70000) {
+		if (x / 3 != x / *d) exit(1);
+		if (x % 3 != x % *d) exit(1);
+		x = x + 1;
+	}
+	i = 0;
+	x = 2147483647;
+	while (i < 3000) {
+		if (x / 3 != x / *d) exit(1);
+		if (x % 3 != x % *d) exit(1);
+		x = x - 1;
+		i = i + 1;
+	}
+	i = 0;
+	x = 0 - 2147483647 - 1;
+	while (i < 3000) {
+		if (x / 3 != x / *d) exit(1);
+		if (x % 3 != x % *d) exit(1);
+		x = x + 1;
+		i = i + 1;
+	}
+	*d = 7;
+	x = 0 - 70000;
+	while (x != 70000) {
+		if (x / 7 != x / *d) exit(1);
+		if (x % 7 != x % *d) exit(1);
+		x = x + 1;
+	}
+	i = 0;
+	x = 2147483647;
+	while (i < 3000) {
+		if (x / 7 != x / *d) exit(1);
+		if (x % 7 != x % *d) exit(1);
+		x = x - 1;
+		i = i + 1;
+	}
+	i = 0;
+	x = 0 - 2147483647 - 1;
+	while (i < 3000) {
+		if (x / 7 != x / *d) exit(1);
+		if (x % 7 != x % *d) exit(1);
+		x = x + 1;
+		i = i + 1;
+	}
+	*d = 10;
+	x = 0 - 70000;
+	while (x != 70000) {
+		if (x / 10 != x / *d) exit(1);
+		if (x % 10 != x % *d) exit(1);
+		x = x + 1;
+	}
+	i = 0;
+	x = 2147483647;
+	while (i < 3000) {
+		if (x / 10 != x / *d) exit(1);
+		if (x % 10 != x % *d) exit(1);
+		x = x - 1;
+		i = i + 1;
+	}
+	i = 0;
+	x = 0 - 2147483647 - 1;
+	while (i < 3000) {
+		if (x / 10 != x / *d) exit(1);
+		if (x % 10 != x % *d) exit(1);
+		x = x + 1;
+		i = i + 1;
+	}
+	*d = 16;
+	x = 0 - 70000;
+	while (x != 70000) {
+		if (x / 16 != x / *d) exit(1);
+		if (x % 16 != x % *d) exit(1);
+		x = x + 1;
+	}
+	i = 0;
+	x = 2147483647;
+	while (i < 3000) {
+		if (x / 16 != x / *d) exit(1);
+		if (x % 16 != x % *d) exit(1);
+		x = x - 1;
+		i = i + 1;
+	}
+	i = 0;
+	x = 0 - 2147483647 - 1;
+	while (i < 3000) {
+		if (x / 16 != x / *d) exit(1);
+		if (x % 16 != x % *d) exit(1);
+		x = x + 1;
+		i = i + 1;
+	}
+	*d = 100;
+	x = 0 - 70000;
+	while (x != 70000) {
+		if (x / 100 != x / *d) exit(1);
+		if (x % 100 != x % *d) exit(1);
+		x = x + 1;
+	}
+	i = 0;
+	x = 2147483647;
+	while (i < 3000) {
+		if (x / 100 != x / *d) exit(1);
+		if (x % 100 != x % *d) exit(1);
+		x = x - 1;
+		i = i + 1;
+	}
+	i = 0;
+	x = 0 - 2147483647 - 1;
+	while (i < 3000) {
+		if (x / 100 != x / *d) exit(1);
+		if (x % 100 != x % *d) exit(1);
+		x = x + 1;
+		i = i + 1;
+	}
+	*d = 641;
+	x = 0 - 70000;
+	while (x != 70000) {
+		if (x / 641 != x / *d) exit(1);
+		if (x % 641 != x % *d) exit(1);
+		x = x + 1;
+	}
+	i = 0;
+	x = 2147483647;
+	while (i < 3000) {
+		if (x / 641 != x / *d) exit(1);
+		if (x % 641 != x % *d) exit(1);
+		x = x - 1;
+		i = i + 1;
+	}
+	i = 0;
+	x = 0 - 2147483647 - 1;
+	while (i < 3000) {
+		if (x / 641 != x / *d) exit(1);
+		if (x % 641 != x % *d) exit(1);
+		x = x + 1;
+		i = i + 1;
+	}
+	*d = 1000000007;
+	x = 0 - 70000;
+	while (x != 70000) {
+		if (x / 1000000007 != x / *d) exit(1);
+		if (x % 1000000007 != x % *d) exit(1);
+		x = x + 1;
+	}
+	i = 0;
+	x = 2147483647;
+	while (i < 3000) {
+		if (x / 1000000007 != x / *d) exit(1);
+		if (x % 1000000007 != x % *d) exit(1);
+		x = x - 1;
+		i = i + 1;
+	}
+	i = 0;
+	x = 0 - 2147483647 - 1;
+	while (i < 3000) {
+		if (x / 1000000007 != x / *d) exit(1);
+		if (x % 1000000007 != x % *d) exit(1);
+		x = x + 1;
+		i = i + 1;
+	}
+	*d = 2147483647;
+	x = 0 - 70000;
+	while (x != 70000) {
+		if (x / 2147483647 != x / *d) exit(1);
+		if (x % 2147483647 != x % *d) exit(1);
+		x = x + 1;
+	}
+	i = 0;
+	x = 2147483647;
+	while (i < 3000) {
+		if (x / 2147483647 != x / *d) exit(1);
+		if (x % 2147483647 != x % *d) exit(1);
+		x = x - 1;
+		i = i + 1;
+	}
+	i = 0;
+	x = 0 - 2147483647 - 1;
+	while (i < 3000) {
+		if (x / 2147483647 != x / *d) exit(1);
+		if (x % 2147483647 != x % *d) exit(1);
+		x = x + 1;
+		i = i + 1;
+	}
+	// negative divisors
+	// INT_MIN / -1 overflows, so only the small range
+	*d = (0 - 1);
+	x = 0 - 70000;
+	while (x != 70000) {
+		if (x / (0 - 1) != x / *d) exit(1);
+		if (x % (0 - 1) != x % *d) exit(1);
+		x = x + 1;
+	}
+	*d = (0 - 5);
+	x = 0 - 70000;
+	while (x != 70000) {
+		if (x / (0 - 5) != x / *d) exit(1);
+		if (x % (0 - 5) != x % *d) exit(1);
+		x = x + 1;
+	}
+	i = 0;
+	x = 2147483647;
+	while (i < 3000) {
+		if (x / (0 - 5) != x / *d) exit(1);
+		if (x % (0 - 5) != x % *d) exit(1);
+		x = x - 1;
+		i = i + 1;
+	}
+	i = 0;
+	x = 0 - 2147483647 - 1;
+	while (i < 3000) {
+		if (x / (0 - 5) != x / *d) exit(1);
+		if (x % (0 - 5) != x % *d) exit(1);
+		x = x + 1;
+		i = i + 1;
+	}
+	*d = (0 - 8);
+	x = 0 - 70000;
+	while (x != 70000) {
+		if (x / (0 - 8) != x / *d) exit(1);
+		if (x % (0 - 8) != x % *d) exit(1);
+		x = x + 1;
+	}
+	i = 0;
+	x = 2147483647;
+	while (i < 3000) {
+		if (x / (0 - 8) != x / *d) exit(1);
+		if (x % (0 - 8) != x % *d) exit(1);
+		x = x - 1;
+		i = i + 1;
+	}
+	i = 0;
+	x = 0 - 2147483647 - 1;
+	while (i < 3000) {
+		if (x / (0 - 8) != x / *d) exit(1);
+		if (x % (0 - 8) != x % *d) exit(1);
+		x = x + 1;
+		i = i + 1;
+	}
+	*d = (0 - 641);
+	x = 0 - 70000;
+	while (x != 70000) {
+		if (x / (0 - 641) != x / *d) exit(1);
+		if (x % (0 - 641) != x % *d) exit(1);
+		x = x + 1;
+	}
+	i = 0;
+	x = 2147483647;
+	while (i < 3000) {
+		if (x / (0 - 641) != x / *d) exit(1);
+		if (x % (0 - 641) != x % *d) exit(1);
+		x = x - 1;
+		i = i + 1;
+	}
+	i = 0;
+	x = 0 - 2147483647 - 1;
+	while (i < 3000) {
+		if (x / (0 - 641) != x / *d) exit(1);
+		if (x % (0 - 641) != x % *d) exit(1);
+		x = x + 1;
+		i = i + 1;
+	}
+	// unsigned
+	*ud = 3;
+	u = 0;
+	while (u != 70000) {
+		if (u / 3 != u / *ud) exit(1);
+		if (u % 3 != u % *ud) exit(1);
+		u = u + 1;
+	}
+	u = 4294967295;
+	while (u != 4294960000) {
+		if (u / 3 != u / *ud) exit(1);
+		if (u % 3 != u % *ud) exit(1);
+		u = u - 1;
+	}
+	*ud = 7;
+	u = 0;
+	while (u != 70000) {
+		if (u / 7 != u / *ud) exit(1);
+		if (u % 7 != u % *ud) exit(1);
+		u = u + 1;
+	}
+	u = 4294967295;
+	while (u != 4294960000) {
+		if (u / 7 != u / *ud) exit(1);
+		if (u % 7 != u % *ud) exit(1);
+		u = u - 1;
+	}
+	*ud = 10;
+	u = 0;
+	while (u != 70000) {
+		if (u / 10 != u / *ud) exit(1);
+		if (u % 10 != u % *ud) exit(1);
+		u = u + 1;
+	}
+	u = 4294967295;
+	while (u != 4294960000) {
+		if (u / 10 != u / *ud) exit(1);
+		if (u % 10 != u % *ud) exit(1);
+		u = u - 1;
+	}
+	*ud = 16;
+	u = 0;
+	while (u != 70000) {
+		if (u / 16 != u / *ud) exit(1);
+		if (u % 16 != u % *ud) exit(1);
+		u = u + 1;
+	}
+	u = 4294967295;
+	while (u != 4294960000) {
+		if (u / 16 != u / *ud) exit(1);
+		if (u % 16 != u % *ud) exit(1);
+		u = u - 1;
+	}
+	*ud = 641;
+	u = 0;
+	while (u != 70000) {
+		if (u / 641 != u / *ud) exit(1);
+		if (u % 641 != u % *ud) exit(1);
+		u = u + 1;
+	}
+	u = 4294967295;
+	while (u != 4294960000) {
+		if (u / 641 != u / *ud) exit(1);
+		if (u % 641 != u % *ud) exit(1);
+		u = u - 1;
+	}
+	*ud = 3000000000;
+	u = 0;
+	while (u != 70000) {
+		if (u / 3000000000 != u / *ud) exit(1);
+		if (u % 3000000000 != u % *ud) exit(1);
+		u = u + 1;
+	}
+	u = 4294967295;
+	while (u != 4294960000) {
+		if (u / 3000000000 != u / *ud) exit(1);
+		if (u % 3000000000 != u % *ud) exit(1);
+		u = u - 1;
+	}
+	// multiplication
+	*d = 3;
+	x = 0 - 3000;
+	while (x != 3000) {
+		if (x * 3 != x * *d) exit(1);
+		if (3 * x != x * *d) exit(1);
+		x = x + 1;
+	}
+	*d = 5;
+	x = 0 - 3000;
+	while (x != 3000) {
+		if (x * 5 != x * *d) exit(1);
+		if (5 * x != x * *d) exit(1);
+		x = x + 1;
+	}
+	*d = 6;
+	x = 0 - 3000;
+	while (x != 3000) {
+		if (x * 6 != x * *d) exit(1);
+		if (6 * x != x * *d) exit(1);
+		x = x + 1;
+	}
+	*d = 9;
+	x = 0 - 3000;
+	while (x != 3000) {
+		if (x * 9 != x * *d) exit(1);
+		if (9 * x != x * *d) exit(1);
+		x = x + 1;
+	}
+	*d = 10;
+	x = 0 - 3000;
+	while (x != 3000) {
+		if (x * 10 != x * *d) exit(1);
+		if (10 * x != x * *d) exit(1);
+		x = x + 1;
+	}
+	*d = 15;
+	x = 0 - 3000;
+	while (x != 3000) {
+		if (x * 15 != x * *d) exit(1);
+		if (15 * x != x * *d) exit(1);
+		x = x + 1;
+	}
+	*d = 17;
+	x = 0 - 3000;
+	while (x != 3000) {
+		if (x * 17 != x * *d) exit(1);
+		if (17 * x != x * *d) exit(1);
+		x = x + 1;
+	}
+	*d = 31;
+	x = 0 - 3000;
+	while (x != 3000) {
+		if (x * 31 != x * *d) exit(1);
+		if (31 * x != x * *d) exit(1);
+		x = x + 1;
+	}
+	*d = 40;
+	x = 0 - 3000;
+	while (x != 3000) {
+		if (x * 40 != x * *d) exit(1);
+		if (40 * x != x * *d) exit(1);
+		x = x + 1;
+	}
+	*d = 81;
+	x = 0 - 3000;
+	while (x != 3000) {
+		if (x * 81 != x * *d) exit(1);
+		if (81 * x != x * *d) exit(1);
+		x = x + 1;
+	}
+	*d = 100;
+	x = 0 - 3000;
+	while (x != 3000) {
+		if (x * 100 != x * *d) exit(1);
+		if (100 * x != x * *d) exit(1);
+		x = x + 1;
+	}
+}
@@ -0,0 +1,70 @@
+extern _Noreturn void exit(int exit_code);
+
+int main() {
+	int i = 0;
+	int sum = 0;
+	int x = 0;
+	int *px = &x;
+
+	// at most one of the tests is taken
+	while (i < 10) {
+		x = i;
+		if (x == 1) sum = sum + 1;
+		if (x == 2) sum = sum + 10;
+		if (x == 3) sum = sum + 100;
+		if (x == 5) sum = sum + 1000;
+		if (x == 9) { sum = sum + 10000; }
+		i = i + 1;
+	}
+	if (sum != 11111) exit(1);
+
+	// a body that changes the variable lets a later test match too
+	sum = 0;
+	x = 1;
+	if (x == 1) x = 2;
+	if (x == 2) sum = sum + 1;
+	if (x == 3) sum = sum + 10;
+	if (x == 4) sum = sum + 100;
+	if (sum != 1) exit(2);
+
+	// also through a pointer
+	sum = 0;
+	x = 1;
+	if (x == 1) *px = 3;
+	if (x == 2) sum = sum + 1;
+	if (x == 3) sum = sum + 10;
+	if (x == 4) sum = sum + 100;
+	if (sum != 10) exit(3);
+
+	// repeated values are all taken
+	sum = 0;
+	x = 4;
+	if (x == 3) sum = sum + 1;
+	if (x == 4) sum = sum + 10;
+	if (x == 4) sum = sum + 100;
+	if (x == 5) sum = sum + 1000;
+	if (sum != 110) exit(4);
+
+	// the last body may change it
+	sum = 0;
+	x = 7;
+	if (x == 5) sum = sum + 1;
+	if (x == 6) sum = sum + 10;
+	if (x == 7) x = 5;
+	if (x != 5) exit(5);
+	if (sum != 0) exit(6);
+
+	// characters
+	char *s = "a+b-c";
+	i = 0;
+	sum = 0;
+	char c = 0;
+	while (c = *(s + i)) {
+		if (c == '+') sum = sum + 1;
+		if (c == '-') sum = sum + 10;
+		if (c == 'a') sum = sum + 100;
+		if (c == 'b') sum = sum + 1000;
+		i = i + 1;
+	}
+	if (sum != 1111) exit(7);
+}
@@ -0,0 +1,86 @@
+extern _Noreturn void exit(int exit_code);
+
+int main() {
+	int i = 0;
+	int lo = 0;
+	int hi = 0;
+	int odd = 0;
+	int big = 0;
+	int a = 7;
+	int b = 3;
+
+	// ?: between cheap values becomes a conditional move
+	lo = a < b ? a : b;
+	hi = a < b ? b : a;
+	if (lo != 3) exit(1);
+	if (hi != 7) exit(2);
+
+	// and between the constants 1 and 0 a setcc
+	if ((a == 7 ? 1 : 0) != 1) exit(3);
+	if ((a == b ? 1 : 0) != 0) exit(4);
+	if ((a != b ? 0 : 1) != 0) exit(5);
+
+	// if/else assigning the same variable
+	while (i < 20) {
+		if (i - i / 2 * 2 == 1) odd = odd + 1; else odd = odd;
+		if (10 < i) big = big + i;
+		i = i + 1;
+	}
+	if (odd != 10) exit(6);
+	if (big != 11 + 12 + 13 + 14 + 15 + 16 + 17 + 18 + 19) exit(7);
+
+	// pointers select too, and arms that may fault are only taken on branches
+	int x = 1;
+	int *p = &x;
+	int *q = 0;
+	int *r = q == 0 ? p : q;
+	*r = 5;
+	if (x != 5) exit(8);
+	if ((q == 0 ? 2 : *q) != 2) exit(9);
+	if ((p == 0 ? 2 : *p) != 5) exit(10);
+
+	// else branches with side effects
+	i = 0;
+	if (a < b) {
+		i = 1;
+		a = 0;
+	} else {
+		i = 2;
+		b = 0;
+	}
+	if (i != 2) exit(11);
+	if (b != 0) exit(12);
+	if (a != 7) exit(13);
+
+	// nested conditionals
+	i = 0;
+	while (i < 3) {
+		a = i == 0 ? 10 : i == 1 ? 20 : 30;
+		if (a != 10 + i * 10) exit(14);
+		i = i + 1;
+	}
+
+	// arms of different widths are converted to the wider type, whether
+	// selected, branched on or known
+	char ch = 200;
+	int e = 328065;
+	char *pc = &ch;
+	if (((e < ch) ? ch : e) != 328065) exit(15);
+	if (((ch < e) ? e : ch) != 328065) exit(16);
+	if ((e == 0 ? *pc : e) != 328065) exit(17);
+	if ((e != 0 ? e : *pc) != 328065) exit(18);
+	if ((1 ? e : ch) != 328065) exit(19);
+	i = 0;
+	a = 328065;
+	if ((i == 0 ? a : ch) != 328065) exit(20);
+	int c = (e < ch) ? ch : e;
+	if (c != 328065) exit(23);
+
+	// an array arm is the address of its first element
+	int arr[4];
+	arr[1] = 9;
+	r = i == 0 ? arr : q;
+	if (*(r + 1) != 9) exit(21);
+	r = i != 0 ? q : arr;
+	if (*(r + 1) != 9) exit(22);
+}
@@ -0,0 +1,96 @@
+extern _Noreturn void exit(int exit_code);
+extern int printf(const char *format, ...);
+
+static int square(int x) {
+	return x * x;
+}
+
+static inline int max(int a, int b) {
+	if (a < b) return b;
+	return a;
+}
+
+int sum_squares(int a, int b) {
+	return square(a) + square(b);
+}
+
+static void store(int *p, int v) {
+	*p = v;
+}
+
+static int find(char *s, char c) {
+	int i = 0;
+	while (*(s + i)) {
+		if (*(s + i) == c) return i;
+		i = i + 1;
+	}
+	return 0 - 1;
+}
+
+static char low_byte(char c) {
+	return c;
+}
+
+// recursive, so it stays a call
+int fib(int n) {
+	if (n < 2) return n;
+	return fib(n - 1) + fib(n - 2);
+}
+
+static int even(int n);
+static int odd(int n) {
+	if (n == 0) return 0;
+	return even(n - 1);
+}
+static int even(int n) {
+	if (n == 0) return 1;
+	return odd(n - 1);
+}
+
+int six(int a, int b, int c, int d, int e, int f) {
+	return a + b * 2 + c * 3 + d * 4 + e * 5 + f * 6;
+}
+
+static int unused(int x) {
+	return x;
+}
+
+int main() {
+	int i = 0;
+	int x = 0;
+	int total = 0;
+
+	if (square(7) != 49) exit(1);
+	if (max(3, 9) != 9) exit(2);
+	if (max(9, 3) != 9) exit(3);
+	if (sum_squares(3, 4) != 25) exit(4);
+
+	// arguments are evaluated once, in the caller
+	i = 2;
+	if (square(i = i + 1) != 9) exit(5);
+	if (i != 3) exit(6);
+
+	// parameters are copies
+	x = 5;
+	store(&x, max(x, 8));
+	if (x != 8) exit(7);
+
+	// returns from inside a loop, nested in another inlined call
+	if (find("hello", 'l') != 2) exit(8);
+	if (max(find("hello", 'z'), 0 - 5) != 0 - 1) exit(9);
+
+	if (low_byte(300) != 44) exit(10);
+
+	i = 0;
+	while (i < 10) {
+		total = total + square(i);
+		i = i + 1;
+	}
+	if (total != 285) exit(11);
+
+	if (fib(15) != 610) exit(12);
+	if (even(10) != 1) exit(13);
+	if (odd(7) != 1) exit(14);
+	if (six(1, 2, 3, 4, 5, 6) != 91) exit(15);
+	printf("%d\n", square(12));
+}
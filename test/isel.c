@@ -0,0 +1,102 @@
+extern _Noreturn void exit(int exit_code);
+
+// Sums and scalings are computed with lea and with memory and immediate
+// operands, updates of a variable in place. The operands are still read as
+// if the operations were evaluated one at a time.
+
+int bump(int *p) {
+	*p = *p + 100;
+	return 1;
+}
+
+int sum(int *a, int n) {
+	int s = 0;
+	int i = 0;
+	while (i < n) {
+		s = s + *(a + i * 4);
+		i = i + 1;
+	}
+	return s;
+}
+
+int main() {
+	int a = 3;
+	int b = 5;
+	int c = 7;
+	int x = 0;
+	int y = 0;
+	int t[8];
+	int *p = &t[0];
+	int *q = &t[0];
+	char ch = 200;
+
+	x = a + b * 4 + 8;
+	if (x != 31) exit(1);
+	x = b * 8 + a;
+	if (x != 43) exit(1);
+	x = a + b * 2 - 5;
+	if (x != 8) exit(1);
+	x = (a + b) * 3 + c * 5;
+	if (x != 59) exit(1);
+	x = a * 9 - b * 2 + c * 16;
+	if (x != 129) exit(1);
+
+	// in place
+	x = 10;
+	x = x + 1;
+	x = x - 1;
+	x = x + 7;
+	x = 1 + x;
+	x = x - a;
+	x = x + b;
+	x = c + x;
+	x = x + (0 - 2);
+	if (x != 25) exit(2);
+	x = x + x;
+	if (x != 50) exit(2);
+	y = x - y;
+	if (y != 50) exit(2);
+	x = x - x;
+	if (x != 0) exit(2);
+	t[4] = 1;
+	t[4] = t[4] + 1;
+	*(p + 8) = 4;
+	*(p + 8) = *(p + 8) - 3;
+	*q = 9;
+	*p = *p + t[4];
+	if (t[4] != 2) exit(3);
+	if (t[8] != 1) exit(3);
+	if (t[0] != 11) exit(3);
+
+	// chars wrap, a sum of type int doesn't
+	ch = ch + 100;
+	if (ch != 44) exit(4);
+	x = 300 + ch;
+	if (x != 344) exit(4);
+
+	// many operands
+	x = a + b + c + a + b + c + a + b + c + a + b + c + a + b + c + 1;
+	if (x != 76) exit(5);
+	x = ((a + b) + (c + a)) + ((b + c) + (a + b)) - ((c * 2 + a) - (b * 4 - c));
+	if (x != 34) exit(5);
+
+	// `a + b` is read before the call changes `a`
+	x = (a + b) + bump(&a) + a;
+	if (x != 112) exit(6);
+	a = 3;
+	x = a + bump(&a);
+	if (x != 104) exit(6);
+
+	// pointers and comparisons
+	t[0] = 1;
+	t[4] = 2;
+	t[8] = 3;
+	t[12] = 4;
+	if (sum(p, 4) != 10) exit(7);
+	if (p != q) exit(7);
+	if (p + 4 == q) exit(7);
+	if (*(p + 4) != 2) exit(7);
+	if (200 < a) exit(7);
+	if (x < 20) exit(7);
+	return 0;
+}
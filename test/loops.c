@@ -0,0 +1,76 @@
+extern void *malloc(int size);
+extern _Noreturn void exit(int exit_code);
+
+int main() {
+	int *p = malloc(64);
+	int *q = 0;
+	int n = 0;
+	int i = 0;
+	*p = 3;
+
+	// invariant load and arithmetic in the body
+	int sum = 0;
+	while (i < 10) {
+		sum = sum + *p * 2 + n;
+		i = i + 1;
+	}
+	if (sum != 60) exit(1);
+
+	// never entered, so the load through q must not run
+	while (n) {
+		sum = *q;
+	}
+
+	// the store through p keeps the load in the loop
+	i = 0;
+	while (i < 3) {
+		sum = *p;
+		*p = *p + 1;
+		i = i + 1;
+	}
+	if (sum != 5) exit(1);
+
+	// strength reduced stores, the counter is still read afterwards
+	int *a = malloc(64);
+	i = 0;
+	while (i < 40) {
+		*(a + i) = i;
+		i = i + sizeof(int);
+	}
+	if (i != 40) exit(1);
+	if (*(a + 36) != 36) exit(1);
+
+	// the counter is only used to index, so only the pointer remains
+	int k = 0;
+	while (k < 40) {
+		*(a + k) = 7;
+		k = k + sizeof(int);
+	}
+	if (*(a + 4) != 7) exit(1);
+	if (*(a + 36) != 7) exit(1);
+
+	// the load is only made when the pointer isn't null, so the
+	// strength reduced sum must not be computed up front
+	int **pp = malloc(8);
+	*pp = 0;
+	int *z = *pp;
+	int m = *(a + 4);
+	int x = 3;
+	i = 0;
+	while (i < m) {
+		if (z) x = *z + i + (*z + i);
+		i = i + 1;
+	}
+	if (x != 3) exit(1);
+
+	// the division comes after a call that doesn't return, so it must
+	// stay in the loop
+	int d = 0;
+	i = 0;
+	while (i < 300) {
+		if (d == 0) exit(0);
+		sum = sum + n / d;
+		i = i + 1;
+	}
+	exit(1);
+}
@@ -0,0 +1,116 @@
+extern void *malloc(int size);
+extern _Noreturn void exit(int exit_code);
+
+// Loops that fill an array with one value or copy it from another one are
+// done at once, with a few stores, a string instruction or a library call
+// depending on the size. Copies between arrays that overlap still run the
+// loop, one element after the other.
+int main(int argc) {
+	char *s = malloc(8192);
+	char *t = malloc(8192);
+	char *u = s + 1;
+	int *a = malloc(8192);
+	int *b = malloc(8192);
+	int n = argc * 5000;
+	int k = argc + 6;
+	int i = 0;
+
+	// a few stores
+	i = 0;
+	while (i < 37) {
+		*(s + i) = 200;
+		i = i + 1;
+	}
+	if (i != 37) exit(1);
+	// the bound is not a multiple of the elements
+	i = 4;
+	while (i < 49) {
+		*(a + i) = 300;
+		i = i + 4;
+	}
+	if (i != 52) exit(2);
+	// a string instruction
+	i = 37;
+	while (i < 1000) {
+		*(s + i) = k;
+		i = i + 1;
+	}
+	// an int whose bytes differ
+	i = 52;
+	while (i < 1000) {
+		*(a + i) = 0 - 2;
+		i = i + 4;
+	}
+	// a library call
+	i = 1000;
+	while (i < 8000) {
+		*(s + i) = 9;
+		i = i + 1;
+	}
+	i = 1000;
+	while (i < 8000) {
+		*(a + i) = 0 - 1;
+		i = i + 4;
+	}
+	i = 0;
+	while (i < 8000) {
+		if (*(s + i) != (i < 37 ? 200 : (i < 1000 ? 7 : 9))) exit(3);
+		if (3 < i) {
+			if (*(a + i) != (i < 52 ? 300 : (i < 1000 ? 0 - 2 : 0 - 1)))
+				exit(4);
+		}
+		i = i + 4;
+	}
+
+	// sizes only known at runtime
+	i = 10;
+	while (i < n) {
+		*(t + i) = *(s + i);
+		i = i + 1;
+	}
+	if (i != 5000) exit(5);
+	i = 10;
+	while (i < n) {
+		*(b + i) = *(a + i);
+		i = i + 4;
+	}
+	if (i != 5002) exit(6);
+	i = 10;
+	while (i < 5000) {
+		if (*(t + i) != *(s + i)) exit(7);
+		if (*(b + i - i % 4 + 2) != *(a + i - i % 4 + 2)) exit(8);
+		i = i + 1;
+	}
+	// a bound that is already reached
+	i = n;
+	while (i < 100) {
+		*(t + i) = 1;
+		i = i + 1;
+	}
+	if (i != 5000) exit(9);
+	// few bytes copied
+	i = 0;
+	while (i < 21) {
+		*(t + i) = *(s + i);
+		i = i + 1;
+	}
+	if (*(t + 20) != 200) exit(10);
+
+	// each element is copied from the one before it
+	i = 0;
+	while (i < 3000) {
+		*(s + i) = i;
+		i = i + 1;
+	}
+	i = 0;
+	while (i < 2999) {
+		*(u + i) = *(s + i);
+		i = i + 1;
+	}
+	i = 0;
+	while (i < 3000) {
+		if (*(s + i) != 0) exit(11);
+		i = i + 1;
+	}
+	return 0;
+}
@@ -0,0 +1,94 @@
+extern _Noreturn void exit(int exit_code);
+extern int printf(const char *format, ...);
+
+// Calls of functions without side effects are reused, hoisted and removed
+// like other expressions. Those that read memory have to see the stores
+// before them, and anything that writes memory, even through the functions
+// it calls, runs every time.
+
+int fib(int n) {
+	if (n < 2) return n;
+	return fib(n - 1) + fib(n - 2);
+}
+
+int get(int *p, int i) {
+	int k = 0;
+	while (k < i) {
+		k = k + 1;
+	}
+	return *(p + k * 4);
+}
+
+int tick(int *c, int n);
+
+int walk(int *c, int n) {
+	if (n == 0) return 0;
+	return tick(c, n - 1) + 1;
+}
+
+int tick(int *c, int n) {
+	*c = *c + 1;
+	return walk(c, n);
+}
+
+int say(int n) {
+	printf("%d\n", n);
+	return n;
+}
+
+int main() {
+	int a[4];
+	int c = 0;
+	int x = 0;
+	int i = 0;
+	int *p = &a[0];
+	int *z = 0;
+
+	if (fib(10) + fib(10) != 110) exit(1);
+	x = fib(12) * 2;
+	if (fib(12) * 2 != x) exit(2);
+	fib(20);
+
+	a[0] = 1;
+	a[4] = 2;
+	x = get(p, 1) + 1;
+	*(p + 4) = 5;
+	if (get(p, 1) + 1 != 6) exit(3);
+	if (x != 3) exit(3);
+	x = get(p, 0) + 1;
+	walk(p, 1);
+	if (get(p, 0) + 1 != 3) exit(3);
+
+	// the calls change what they return
+	walk(&c, 3);
+	walk(&c, 3);
+	if (c != 6) exit(4);
+	if (walk(&c, 2) + walk(&c, 2) != 4) exit(5);
+	if (c != 10) exit(6);
+	say(7);
+	say(7);
+
+	// invariant until the loop stores to what it reads
+	x = 0;
+	i = 0;
+	while (i < 20) {
+		x = x + get(p, 0) + fib(6);
+		i = i + 1;
+	}
+	if (x != 200) exit(7);
+	x = 0;
+	i = 0;
+	while (i < 20) {
+		x = x + get(p, 0);
+		*p = *p + 1;
+		i = i + 1;
+	}
+	if (x != 230) exit(8);
+	// only evaluated where the program would
+	i = 0;
+	while (i < 20) {
+		if (c == 99) x = x + get(z, 0);
+		i = i + 1;
+	}
+	return 0;
+}
@@ -0,0 +1,113 @@
+extern _Noreturn void exit(int exit_code);
+
+// Values of locals are propagated through assignments and the joins of the
+// control flow, and branches on them are decided at compile time. Whatever
+// is not known has to be left to the code that runs.
+
+static int clamp(int x, int lo) {
+	if (x < lo) return lo;
+	return x;
+}
+
+int choose(int n, int k) {
+	int r = 0;
+	if (n == 1) {
+		r = k;
+	} else {
+		if (n != 2) exit(20);
+		r = k;
+	}
+	// r is k on both arms
+	return r;
+}
+
+int main(int argc) {
+	// argc is only known at runtime
+	int one = argc;
+	int x = 1;
+	int y = 0;
+	int i = 0;
+	char c = 300;
+
+	if (x != 1) exit(1);
+	{
+		if (x != 1) exit(2);
+		int x = 2;
+		if (x != 2) exit(3);
+		x = x * 5 + 1;
+		if (x != 11) exit(4);
+	}
+	if (x != 1) exit(5);
+
+	// truncated like the stores are
+	if (c != 44) exit(6);
+	c = c * 6;
+	if (c != 8) exit(7);
+	x = 0 - 1;
+	if (x + 1 != 0) exit(8);
+
+	// both arms agree
+	if (one == 1) y = 4; else y = 4;
+	if (y != 4) exit(9);
+	// they don't
+	x = 1;
+	if (one == 1) {
+		x = 2;
+		y = 3;
+	}
+	if (x != 2) exit(10);
+	// an arm that leaves doesn't reach the join
+	x = 3;
+	if (one != 1) {
+		x = 7;
+		exit(11);
+	}
+	if (x != 3) exit(12);
+
+	// the guard is decided on entry, the variable is unknown in the loop
+	i = 0;
+	y = 0;
+	while (i < 5) {
+		if (i == 0) y = y + 1;
+		i = i + 1;
+	}
+	if (i != 5) exit(13);
+	if (y != 1) exit(14);
+	// a loop that never runs
+	x = 5;
+	while (x < 5) exit(15);
+
+	// a known switch still falls through, and what it writes is unknown
+	x = 0;
+	i = 2;
+	switch (i) {
+	case 1:
+		x = 10;
+	case 2:
+		x = x + 1;
+	case 3:
+		x = x + 1;
+		break;
+	default:
+		exit(16);
+	}
+	if (x != 2) exit(17);
+	switch (one) {
+	case 1:
+		x = 5;
+		break;
+	}
+	if (x != 5) exit(18);
+
+	// conditional operands
+	x = i == 2 ? 6 : 7;
+	y = x < 6 ? one : x * 2;
+	if (y != 12) exit(19);
+
+	// constant arguments of inlined calls
+	if (clamp(0 - 0, 3) != 3) exit(21);
+	if (clamp(9, 3) != 9) exit(22);
+	if (choose(one, 8) != 8) exit(23);
+	if (choose(one + 1, 9) != 9) exit(24);
+	return 0;
+}
@@ -0,0 +1,90 @@
+extern _Noreturn void exit(int exit_code);
+
+int main() {
+	int i = 0;
+	int sum = 0;
+
+	// dense, goes through a jump table
+	while (i < 12) {
+		switch (i) {
+		case 1: sum = sum + 1; break;
+		case 2: sum = sum + 20; break;
+		case 3: sum = sum + 300; break;
+		case 5: sum = sum + 4000; break;
+		case 6:
+		case 7: sum = sum + 50000; break;
+		default: sum = sum + 600000;
+		}
+		i = i + 1;
+	}
+	// 0, 4, 8, 9, 10, 11 hit the default
+	if (sum != 3704321) exit(1);
+
+	// sparse, goes through compares
+	i = 0;
+	sum = 0;
+	while (i < 2000) {
+		switch (i * 7) {
+		case 7: sum = sum + 1; break;
+		case 700: sum = sum + 2; break;
+		case 1001: sum = sum + 3; break;
+		case 7000: sum = sum + 4; break;
+		case 13993: sum = sum + 5; break;
+		case 14000: sum = sum + 6; break;
+		}
+		i = i + 1;
+	}
+	if (sum != 15) exit(2);
+
+	// mixed: two dense clusters, negative values and outliers
+	i = 0;
+	sum = 0;
+	int x = 0 - 10;
+	while (i < 300) {
+		switch (x) {
+		case 0 - 3: sum = sum + 1;
+		case 0 - 2: sum = sum + 1;
+		case 0 - 1: sum = sum + 1; break;
+		case 0: sum = sum + 10; break;
+		case 100: sum = sum + 100; break;
+		case 101: sum = sum + 100; break;
+		case 102: sum = sum + 100; break;
+		case 104: sum = sum + 100; break;
+		case 200: sum = sum + 1000; break;
+		case 'a': sum = sum + 10000; break;
+		}
+		x = x + 1;
+		i = i + 1;
+	}
+	// -3 falls through twice, 97 is 'a'
+	if (sum != 11416) exit(3);
+
+	// nested switches and continue out of a switch
+	i = 0;
+	sum = 0;
+	while (i < 8) {
+		switch (i % 4) {
+		case 0:
+			switch (i) {
+			case 0: sum = sum + 1; break;
+			case 4: sum = sum + 2; break;
+			}
+			break;
+		case 1:
+			i = i + 1;
+			continue;
+		default:
+			sum = sum + 10;
+		}
+		i = i + 1;
+	}
+	if (sum != 43) exit(4);
+
+	// break out of the loop itself
+	i = 0;
+	while (1) {
+		if (i == 5) break;
+		i = i + 1;
+	}
+	if (i != 5) exit(5);
+}
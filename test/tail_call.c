@@ -0,0 +1,72 @@
+extern _Noreturn void exit(int exit_code);
+
+// deep enough to overflow the stack without tail calls
+
+int count(int n, int acc) {
+	if (n == 0) return acc;
+	return count(n - 1, acc + 2);
+}
+
+int gcd(int a, int b) {
+	if (b == 0) return a;
+	return gcd(b, a % b);
+}
+
+static int is_odd(int n);
+static int is_even(int n) {
+	if (n == 0) return 1;
+	return is_odd(n - 1);
+}
+static int is_odd(int n) {
+	if (n == 0) return 0;
+	return is_even(n - 1);
+}
+
+// a state machine over a string, one function per state
+static int in_word(char *s, int words);
+static int in_space(char *s, int words) {
+	if (*s == 0) return words;
+	if (*s == ' ') return in_space(s + 1, words);
+	return in_word(s + 1, words + 1);
+}
+static int in_word(char *s, int words) {
+	if (*s == 0) return words;
+	if (*s == ' ') return in_space(s + 1, words);
+	return in_word(s + 1, words);
+}
+
+int deref(int *p) {
+	return *p;
+}
+// the argument points into the frame, so this stays a call
+int local(int v) {
+	int x = v;
+	return deref(&x);
+}
+
+char narrow(int v) {
+	return v;
+}
+int widen(int v) {
+	return narrow(v);
+}
+
+// the returns are inside the last statement, not the last statement
+int nested_if(int x) {
+	if (x == 1) return 5;
+}
+int nested_while(int x) {
+	while (x) return 6;
+}
+
+int main() {
+	if (count(10000000, 0) != 20000000) exit(1);
+	if (gcd(1071, 462) != 21) exit(2);
+	if (is_even(1000000) != 1) exit(3);
+	if (is_odd(1000001) != 1) exit(4);
+	if (in_space("  tail calls  in a state machine ", 0) != 6) exit(5);
+	if (local(42) != 42) exit(6);
+	if (widen(300) != 44) exit(7);
+	if (nested_if(1) != 5) exit(8);
+	if (nested_while(1) != 6) exit(9);
+}
@@ -0,0 +1,85 @@
+// SPDX-License-Identifier: GPL-3.0-only
+/*
+ * Checks the constant multiplication and division plans against the
+ * hardware: every divisor of up to 14 bits and a set of interesting larger
+ * ones, each against all small dividends, the ranges around the 32 bit
+ * limits and around multiples of the divisor, and a sweep over the whole
+ * 32 bit range.
+ */
+#include <c_compiler/arith.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+static int failures;
+
+static void check_s(int32_t x, int32_t d, const struct arith_div *p) {
+	if (d == -1 && x == INT32_MIN) return; // overflows
+	int32_t q = arith_eval_sdiv(x, p);
+	if (q != x / d) {
+		if (failures++ < 10)
+			fprintf(stderr, "%d / %d: got %d\n", x, d, q);
+	}
+}
+static void check_u(uint32_t x, uint32_t d, const struct arith_div *p) {
+	uint32_t q = arith_eval_udiv(x, p);
+	if (q != x / d) {
+		if (failures++ < 10)
+			fprintf(stderr, "%uu / %uu: got %u\n", x, d, q);
+	}
+}
+
+static void check_divisor(uint32_t d, int32_t dense) {
+	struct arith_div ps, pu;
+	if (!arith_plan_div((int32_t)d, false, &ps)) abort();
+	if (!arith_plan_div(d, true, &pu)) abort();
+	for (int32_t x = -dense; x <= dense; ++x) {
+		check_s(x, d, &ps);
+		check_u(x, d, &pu);
+	}
+	for (uint32_t i = 0; i < 256; ++i) {
+		uint32_t edges[] = {
+			0x7FFFFFFF - i, 0x80000000 + i, 0xFFFFFFFF - i,
+			// around the largest multiples of d
+			0x7FFFFFFF / d * d - 128 + i,
+			0xFFFFFFFF / d * d - 128 + i,
+			i * 16777213u, // a prime stride over the whole range
+		};
+		for (size_t j = 0; j < sizeof(edges) / sizeof(*edges); ++j) {
+			check_s(edges[j], d, &ps);
+			check_u(edges[j], d, &pu);
+		}
+	}
+}
+
+static void check_mul(int32_t c) {
+	struct arith_mul p;
+	if (!arith_plan_mul(c, &p)) return;
+	for (uint32_t i = 0; i < 256; ++i) {
+		uint32_t x = i * 16777619u + i;
+		if (arith_eval_mul(x, &p) != x * (uint32_t)c) {
+			if (failures++ < 10)
+				fprintf(stderr, "%u * %d wrong\n", x, c);
+		}
+	}
+}
+
+int main() {
+	for (uint32_t d = 1; d <= 16384; ++d) {
+		int32_t dense = d <= 1024 ? 65536 : 4096;
+		check_divisor(d, dense);
+		check_divisor(-d, dense);
+	}
+	for (int k = 14; k < 32; ++k) {
+		for (int32_t off = -3; off <= 3; ++off) {
+			check_divisor((1u << k) + off, 65536);
+			check_divisor(-((1u << k) + off), 65536);
+		}
+	}
+	uint32_t big[] = { 641, 6700417, 1000000007, 0x7FFFFFFF, 0x80000001,
+		0xFFFFFFFF, 0xFFFFFFFE, 3000000000u, 0x55555555, 0xAAAAAAAB };
+	for (size_t i = 0; i < sizeof(big) / sizeof(*big); ++i)
+		check_divisor(big[i], 65536);
+	for (int32_t c = -65536; c <= 65536; ++c) check_mul(c);
+	fprintf(stderr, "%d failures\n", failures);
+	return failures != 0;
+}
@@ -0,0 +1,225 @@
+// SPDX-License-Identifier: GPL-3.0-only
+/*
+ * Checks the selected instructions against the meaning of the trees: random
+ * trees of every shape the code generator builds, with memory operands of
+ * all sizes, some of them the same location, and immediates around the 32
+ * bit limits, before and after scheduling. Also checks that the cheap forms
+ * are found and that loads are scheduled early.
+ */
+#include <c_compiler/isel.h>
+#include <c_compiler/sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#define MEMS 4
+
+static int failures, selected, scheduled;
+static uint64_t state = 88172645463325252ull;
+
+static uint64_t rnd(void) {
+	state ^= state << 13;
+	state ^= state >> 7;
+	state ^= state << 17;
+	return state;
+}
+static uint64_t mask(int size) {
+	return size == 8 ? ~0ull : (1ull << size * 8) - 1;
+}
+
+static uint64_t ref(const struct isel_tree *t, int i, uint64_t *mem) {
+	const struct isel_node *n = &t->nodes[i];
+	uint64_t a, b;
+	switch (n->op) {
+	case ISEL_IMM: return n->imm;
+	case ISEL_MEM: return mem[n->mem] & mask(n->size);
+	case ISEL_STORE:
+		b = ref(t, n->b, mem);
+		a = mask(t->nodes[n->a].size);
+		mem[t->nodes[n->a].mem] = (mem[t->nodes[n->a].mem] & ~a) | (b & a);
+		return 0;
+	default:
+		break;
+	}
+	a = ref(t, n->a, mem);
+	b = ref(t, n->b, mem);
+	switch (n->op) {
+	case ISEL_ADD: return (a + b) & mask(n->size);
+	case ISEL_SUB: return (a - b) & mask(n->size);
+	case ISEL_MUL: return (a * b) & mask(n->size);
+	case ISEL_CMP: return a == b ? 0 : (int64_t)a < (int64_t)b ? 1 : 2;
+	default: abort();
+	}
+}
+
+static int gen_leaf(struct isel_tree *t) {
+	static const int64_t imms[] = { 0, 1, 2, 3, 4, 5, 8, 9, 7, 100,
+		0x7FFFFFFF, 0x80000000, 0xFFFFFFFF, 0x100000000, -1, -8 };
+	static const int sizes[] = { 1, 4, 8 };
+	if (rnd() % 2) {
+		int64_t v = imms[rnd() % (sizeof(imms) / sizeof(*imms))];
+		return isel_add(t, (struct isel_node){ .op = ISEL_IMM, .imm = v });
+	}
+	int m = rnd() % MEMS;
+	// the same location is always read with the same size
+	return isel_add(t, (struct isel_node){ .op = ISEL_MEM, .mem = m,
+		.size = sizes[m % 3] });
+}
+static int gen(struct isel_tree *t, int depth) {
+	if (depth == 0 || rnd() % 3 == 0) return gen_leaf(t);
+	int a = gen(t, depth - 1);
+	int b = gen(t, depth - 1);
+	static const enum isel_op ops[] = { ISEL_ADD, ISEL_SUB, ISEL_MUL };
+	return isel_add(t, (struct isel_node){
+		.op = ops[rnd() % 3], .size = rnd() % 2 ? 4 : 8, .a = a, .b = b });
+}
+
+static void check_code(const struct isel_tree *t,
+		const struct isel_code *code) {
+	uint64_t mem[MEMS], mem_ref[MEMS];
+	for (int k = 0; k < 16; ++k) {
+		for (int i = 0; i < MEMS; ++i) mem[i] = mem_ref[i] = rnd();
+		uint64_t want = ref(t, t->n - 1, mem_ref);
+		uint64_t got = isel_eval(code, mem);
+		if (t->nodes[t->n - 1].op == ISEL_STORE) {
+			got = want;
+		} else if (t->nodes[t->n - 1].op != ISEL_CMP) {
+			want &= mask(t->nodes[t->n - 1].size);
+			got &= mask(t->nodes[t->n - 1].size);
+		}
+		bool ok = got == want;
+		for (int i = 0; i < MEMS; ++i) ok = ok && mem[i] == mem_ref[i];
+		if (!ok && failures++ < 10)
+			fprintf(stderr, "tree %d nodes, %d insns: got %llx want %llx\n",
+				t->n, code->n, (unsigned long long)got,
+				(unsigned long long)want);
+	}
+}
+static void check(const struct isel_tree *t) {
+	struct isel_code code, sched;
+	if (!isel_select(t, &code)) return;
+	selected++;
+	check_code(t, &code);
+	sched = code;
+	sched_code(&sched);
+	if (sched.n == code.n && sched_cycles(&sched) == sched_cycles(&code))
+		return;
+	scheduled++;
+	if (sched_cycles(&sched) >= sched_cycles(&code) && failures++ < 10)
+		fprintf(stderr, "scheduled in %d cycles instead of %d\n",
+			sched_cycles(&sched), sched_cycles(&code));
+	check_code(t, &sched);
+}
+
+static void check_random(void) {
+	for (int i = 0; i < 200000; ++i) {
+		struct isel_tree t = { .n = 0 };
+		int v = gen(&t, 3);
+		if (t.nodes[v].op == ISEL_IMM || t.nodes[v].op == ISEL_MEM) {
+			if (rnd() % 2) continue;
+		}
+		switch (rnd() % 3) {
+		case 0: break;
+		case 1: ;
+			int m = rnd() % MEMS;
+			int d = isel_add(&t, (struct isel_node){ .op = ISEL_MEM,
+				.mem = m, .size = m % 3 == 0 ? 1 : m % 3 == 1 ? 4 : 8 });
+			if (d < 0) continue;
+			// stores go last, the tree is built in postorder otherwise
+			struct isel_tree s = { .n = 0 };
+			isel_add(&s, t.nodes[d]);
+			for (int k = 0; k < d; ++k) {
+				struct isel_node x = t.nodes[k];
+				if (x.op != ISEL_IMM && x.op != ISEL_MEM) {
+					x.a++;
+					x.b++;
+				}
+				isel_add(&s, x);
+			}
+			if (isel_add(&s, (struct isel_node){ .op = ISEL_STORE,
+					.size = s.nodes[0].size, .a = 0, .b = v + 1 }) < 0)
+				continue;
+			t = s;
+			break;
+		case 2:
+			if (isel_add(&t, (struct isel_node){ .op = ISEL_CMP,
+					.size = 8, .a = v, .b = gen_leaf(&t) }) < 0)
+				continue;
+			break;
+		}
+		check(&t);
+	}
+}
+
+/* the number of instructions for x = a + b * 4 + 8, x = x + 1 and
+ * x = x - y */
+static void check_forms(void) {
+	struct isel_tree t = { .n = 0 };
+	struct isel_code code;
+	int a = isel_add(&t, (struct isel_node){ .op = ISEL_MEM, .size = 4, .mem = 0 });
+	int b = isel_add(&t, (struct isel_node){ .op = ISEL_MEM, .size = 4, .mem = 1 });
+	int k = isel_add(&t, (struct isel_node){ .op = ISEL_IMM, .imm = 4 });
+	int m = isel_add(&t, (struct isel_node){ .op = ISEL_MUL, .size = 4, .a = b, .b = k });
+	int s = isel_add(&t, (struct isel_node){ .op = ISEL_ADD, .size = 4, .a = a, .b = m });
+	k = isel_add(&t, (struct isel_node){ .op = ISEL_IMM, .imm = 8 });
+	isel_add(&t, (struct isel_node){ .op = ISEL_ADD, .size = 4, .a = s, .b = k });
+	if (!isel_select(&t, &code) || code.n != 3
+			|| code.insns[2].op != ISEL_I_LEA) {
+		fprintf(stderr, "a + b * 4 + 8: %d insns\n", code.n);
+		failures++;
+	}
+
+	t = (struct isel_tree){ .n = 0 };
+	int x = isel_add(&t, (struct isel_node){ .op = ISEL_MEM, .size = 8, .mem = 0 });
+	int y = isel_add(&t, (struct isel_node){ .op = ISEL_MEM, .size = 8, .mem = 0 });
+	k = isel_add(&t, (struct isel_node){ .op = ISEL_IMM, .imm = 1 });
+	s = isel_add(&t, (struct isel_node){ .op = ISEL_ADD, .size = 8, .a = y, .b = k });
+	isel_add(&t, (struct isel_node){ .op = ISEL_STORE, .size = 8, .a = x, .b = s });
+	if (!isel_select(&t, &code) || code.n != 1
+			|| code.insns[0].op != ISEL_I_INC) {
+		fprintf(stderr, "x = x + 1: %d insns\n", code.n);
+		failures++;
+	}
+
+	t = (struct isel_tree){ .n = 0 };
+	x = isel_add(&t, (struct isel_node){ .op = ISEL_MEM, .size = 4, .mem = 0 });
+	y = isel_add(&t, (struct isel_node){ .op = ISEL_MEM, .size = 4, .mem = 0 });
+	b = isel_add(&t, (struct isel_node){ .op = ISEL_MEM, .size = 4, .mem = 1 });
+	s = isel_add(&t, (struct isel_node){ .op = ISEL_SUB, .size = 4, .a = y, .b = b });
+	isel_add(&t, (struct isel_node){ .op = ISEL_STORE, .size = 4, .a = x, .b = s });
+	if (!isel_select(&t, &code) || code.n != 2
+			|| code.insns[1].op != ISEL_I_SUB
+			|| code.insns[1].d.kind != ISEL_O_MEM) {
+		fprintf(stderr, "x = x - y: %d insns\n", code.n);
+		failures++;
+	}
+}
+
+/* both loads of x = a * 3 + b * 5 go first */
+static void check_sched(void) {
+	struct isel_tree t = { .n = 0 };
+	struct isel_code code;
+	int a = isel_add(&t, (struct isel_node){ .op = ISEL_MEM, .size = 4, .mem = 0 });
+	int k = isel_add(&t, (struct isel_node){ .op = ISEL_IMM, .imm = 3 });
+	int x = isel_add(&t, (struct isel_node){ .op = ISEL_MUL, .size = 4, .a = a, .b = k });
+	int b = isel_add(&t, (struct isel_node){ .op = ISEL_MEM, .size = 4, .mem = 1 });
+	k = isel_add(&t, (struct isel_node){ .op = ISEL_IMM, .imm = 5 });
+	int y = isel_add(&t, (struct isel_node){ .op = ISEL_MUL, .size = 4, .a = b, .b = k });
+	isel_add(&t, (struct isel_node){ .op = ISEL_ADD, .size = 4, .a = x, .b = y });
+	if (!isel_select(&t, &code)) abort();
+	sched_code(&code);
+	if (code.n != 5 || code.insns[0].op != ISEL_I_LOAD
+			|| code.insns[1].op != ISEL_I_LOAD) {
+		fprintf(stderr, "a * 3 + b * 5: %d insns, %d cycles\n", code.n,
+			sched_cycles(&code));
+		failures++;
+	}
+}
+
+int main() {
+	check_forms();
+	check_sched();
+	check_random();
+	fprintf(stderr, "%d trees selected, %d scheduled, %d failures\n",
+		selected, scheduled, failures);
+	return failures != 0 || selected == 0 || scheduled == 0;
+}
@@ -0,0 +1,205 @@
+// SPDX-License-Identifier: GPL-3.0-only
+/*
+ * Checks the machine code of the encoder against the bytes an assembler
+ * gives for the same instructions, with the registers that need REX and VEX
+ * bits and the memory operands that need a SIB byte or a displacement. Also
+ * checks that jumps take the short form only while their target is in
+ * reach, and the relocations left for the linker.
+ */
+#include <c_compiler/x86.h>
+#include <stdio.h>
+#include <string.h>
+
+#define REG(r, s) { .kind = EMIT_O_REG, .size = s, .reg = EMIT_##r, \
+	.index = -1 }
+#define IMM(v) { .kind = EMIT_O_IMM, .reg = -1, .index = -1, .x = v }
+#define MEM(s, b, d) { .kind = EMIT_O_MEM, .size = s, .reg = EMIT_##b, \
+	.index = -1, .x = d }
+#define MEMX(s, b, i, sc, d) { .kind = EMIT_O_MEM, .size = s, \
+	.reg = EMIT_##b, .index = EMIT_##i, .scale = sc, .x = d }
+
+static const struct {
+	const char *text, *bytes;
+	struct emit_ins ins;
+} cases[] = {
+	{ "mov rax, rbx", "4889d8",
+		{ EMIT_MOV, 0, 2, { REG(RAX, 8), REG(RBX, 8) } } },
+	{ "mov eax, dword [rbp-8]", "8b45f8",
+		{ EMIT_MOV, 0, 2, { REG(RAX, 4), MEM(4, RBP, -8) } } },
+	{ "mov qword [rbp-200], r9", "4c898d38ffffff",
+		{ EMIT_MOV, 0, 2, { MEM(8, RBP, -200), REG(R9, 8) } } },
+	{ "mov byte [rdi], sil", "408837",
+		{ EMIT_MOV, 0, 2, { MEM(1, RDI, 0), REG(RSI, 1) } } },
+	{ "mov rax, -1", "48c7c0ffffffff",
+		{ EMIT_MOV, 0, 2, { REG(RAX, 8), IMM(-1) } } },
+	{ "mov rax, 0x100000000", "48b80000000001000000",
+		{ EMIT_MOV, 0, 2, { REG(RAX, 8), IMM(0x100000000) } } },
+	{ "mov r10, 5", "41ba05000000",
+		{ EMIT_MOV, 0, 2, { REG(R10, 8), IMM(5) } } },
+	{ "mov dword [rsp+4], 7", "c744240407000000",
+		{ EMIT_MOV, 0, 2, { MEM(4, RSP, 4), IMM(7) } } },
+	{ "add eax, 1", "83c001",
+		{ EMIT_ADD, 0, 2, { REG(RAX, 4), IMM(1) } } },
+	{ "sub rsp, 1000", "4881ece8030000",
+		{ EMIT_SUB, 0, 2, { REG(RSP, 8), IMM(1000) } } },
+	{ "cmp byte [rax+r8], 0", "42803c0000",
+		{ EMIT_CMP, 0, 2, { MEMX(1, RAX, R8, 1, 0), IMM(0) } } },
+	{ "xor edx, dword [r13]", "41335500",
+		{ EMIT_XOR, 0, 2, { REG(RDX, 4), MEM(4, R13, 0) } } },
+	{ "lea rax, [r11+r9+16]", "4b8d440b10",
+		{ EMIT_LEA, 0, 2, { REG(RAX, 8), MEMX(0, R11, R9, 1, 16) } } },
+	{ "imul eax, ebx, 10", "6bc30a",
+		{ EMIT_IMUL, 0, 3, { REG(RAX, 4), REG(RBX, 4), IMM(10) } } },
+	{ "imul eax, eax, 16843009", "69c001010101",
+		{ EMIT_IMUL, 0, 3, { REG(RAX, 4), REG(RAX, 4),
+			IMM(0x01010101) } } },
+	{ "imul rax, qword [rbp-8]", "480faf45f8",
+		{ EMIT_IMUL, 0, 2, { REG(RAX, 8), MEM(8, RBP, -8) } } },
+	{ "movzx eax, byte [rbp-1]", "0fb645ff",
+		{ EMIT_MOVZX, 0, 2, { REG(RAX, 4), MEM(1, RBP, -1) } } },
+	{ "movzx esi, dil", "400fb6f7",
+		{ EMIT_MOVZX, 0, 2, { REG(RSI, 4), REG(RDI, 1) } } },
+	{ "shr eax, 1", "d1e8",
+		{ EMIT_SHR, 0, 2, { REG(RAX, 4), IMM(1) } } },
+	{ "sar edx, 31", "c1fa1f",
+		{ EMIT_SAR, 0, 2, { REG(RDX, 4), IMM(31) } } },
+	{ "idiv ebx", "f7fb",
+		{ EMIT_IDIV, 0, 1, { REG(RBX, 4) } } },
+	{ "neg rax", "48f7d8",
+		{ EMIT_NEG, 0, 1, { REG(RAX, 8) } } },
+	{ "inc dword [rbp-4]", "ff45fc",
+		{ EMIT_INC, 0, 1, { MEM(4, RBP, -4) } } },
+	{ "cdq", "99", { EMIT_CDQ, 0, 0, { { 0 } } } },
+	{ "sete al", "0f94c0",
+		{ EMIT_SETCC, EMIT_CC_E, 1, { REG(RAX, 1) } } },
+	{ "cmovl rax, r8", "490f4cc0",
+		{ EMIT_CMOVCC, EMIT_CC_L, 2, { REG(RAX, 8), REG(R8, 8) } } },
+	{ "push rbp", "55", { EMIT_PUSH, 0, 1, { REG(RBP, 8) } } },
+	{ "pop r12", "415c", { EMIT_POP, 0, 1, { REG(R12, 8) } } },
+	{ "ret", "c3", { EMIT_RET, 0, 0, { { 0 } } } },
+	{ "jmp qword [rcx+rdx*8]", "ff24d1",
+		{ EMIT_JMP, 0, 1, { MEMX(8, RCX, RDX, 8, 0) } } },
+	{ "rep stosd", "f3ab", { EMIT_REP_STOSD, 0, 0, { { 0 } } } },
+	{ "movdqu xmm8, [rax+r8]", "f3460f6f0400",
+		{ EMIT_MOVDQU, 0, 2, { REG(R8, 16),
+			MEMX(0, RAX, R8, 1, 0) } } },
+	{ "movdqu [rdi+16], xmm0", "f30f7f4710",
+		{ EMIT_MOVDQU, 0, 2, { MEM(0, RDI, 16), REG(RAX, 16) } } },
+	{ "paddd xmm0, xmm1", "660ffec1",
+		{ EMIT_PADDD, 0, 2, { REG(RAX, 16), REG(RCX, 16) } } },
+	{ "pshufd xmm9, xmm9, 0", "66450f70c900",
+		{ EMIT_PSHUFD, 0, 3, { REG(R9, 16), REG(R9, 16), IMM(0) } } },
+	{ "movd xmm8, eax", "66440f6ec0",
+		{ EMIT_MOVD, 0, 2, { REG(R8, 16), REG(RAX, 4) } } },
+	{ "vmovdqu ymm0, [rax+r8]", "c4a17e6f0400",
+		{ EMIT_VMOVDQU, 0, 2, { REG(RAX, 32),
+			MEMX(0, RAX, R8, 1, 0) } } },
+	{ "vmovdqu [rdi], ymm9", "c57e7f0f",
+		{ EMIT_VMOVDQU, 0, 2, { MEM(0, RDI, 0), REG(R9, 32) } } },
+	{ "vpaddd ymm0, ymm9, ymm10", "c4c135fec2",
+		{ EMIT_VPADDD, 0, 3, { REG(RAX, 32), REG(R9, 32),
+			REG(R10, 32) } } },
+	{ "vpbroadcastd ymm8, xmm8", "c4427d58c0",
+		{ EMIT_VPBROADCASTD, 0, 2, { REG(R8, 32), REG(R8, 16) } } },
+	{ "vmovd xmm8, eax", "c5796ec0",
+		{ EMIT_VMOVD, 0, 2, { REG(R8, 16), REG(RAX, 4) } } },
+	{ "vzeroupper", "c5f877", { EMIT_VZEROUPPER, 0, 0, { { 0 } } } },
+};
+
+static int failures, checked;
+
+static void hex(char *res, const struct vec *v) {
+	for (int i = 0; i < v->len; ++i)
+		sprintf(res + 2 * i, "%02x", *(unsigned char *)vec_get_c(v, i));
+	res[2 * v->len] = 0;
+}
+
+static void check_cases(void) {
+	for (size_t i = 0; i < sizeof(cases) / sizeof(*cases); ++i) {
+		struct emit e;
+		emit_init(&e);
+		emit_ins(&e, cases[i].ins.op, cases[i].ins.cc, cases[i].ins.n,
+			cases[i].ins.o);
+		struct x86_code c;
+		x86_init(&c);
+		char got[64] = "(error)";
+		if (x86_encode(&c, &e)) hex(got, &c.section[X86_TEXT]);
+		if (strcmp(got, cases[i].bytes) != 0) {
+			fprintf(stderr, "`%s`: %s instead of %s\n",
+				cases[i].text, got, cases[i].bytes);
+			failures++;
+		}
+		checked++;
+		x86_free(&c);
+		emit_free(&e);
+	}
+}
+
+/* a jump over n bytes of code, forward, and back to its start */
+static void check_jumps(int n, int want) {
+	struct emit e;
+	emit_init(&e);
+	emit_label(&e, 0);
+	emit_jcc(&e, EMIT_CC_NE, 1);
+	for (int i = 0; i < n; ++i) emit0(&e, EMIT_CDQ);
+	emit_label(&e, 1);
+	emit1(&e, EMIT_JMP, emit_o_label(0));
+	struct x86_code c;
+	x86_init(&c);
+	if (!x86_encode(&c, &e) || c.section[X86_TEXT].len != n + want) {
+		fprintf(stderr, "jumps over %d bytes: %d bytes instead of %d\n",
+			n, c.section[X86_TEXT].len, n + want);
+		failures++;
+	}
+	checked++;
+	x86_free(&c);
+	emit_free(&e);
+}
+
+static void check_relocs(void) {
+	struct emit e;
+	emit_init(&e);
+	emit1(&e, EMIT_LABEL, emit_o_sym("main"));
+	emit2(&e, EMIT_MOV, emit_o_reg(EMIT_RDI, 8), emit_o_string(0));
+	emit1(&e, EMIT_CALL, emit_o_sym("puts"));
+	emit1(&e, EMIT_CALL, emit_o_sym("main"));
+	emit1(&e, EMIT_SECTION, emit_o_sym(".rodata"));
+	emit2(&e, EMIT_DB, emit_o_string(0), emit_o_sym("\"hi\\n\""));
+	struct x86_code c;
+	x86_init(&c);
+	bool ok = x86_encode(&c, &e) && c.relocs.len == 2;
+	if (ok) {
+		// the address of the string, puts, and main is known
+		const struct x86_reloc *r = vec_get_c(&c.relocs, 0);
+		ok = r->kind == X86_R_64 && r->offset == 2 && r->sym < 0
+			&& r->target == X86_RODATA && r->addend == 0;
+		r = vec_get_c(&c.relocs, 1);
+		ok = ok && r->kind == X86_R_PLT32 && r->offset == 11
+			&& r->addend == -4 && r->sym == x86_symbol(&c, "puts");
+		char got[64];
+		hex(got, &c.section[X86_TEXT]);
+		ok = ok && strcmp(got + 30, "e8ecffffff") == 0;
+		hex(got, &c.section[X86_RODATA]);
+		ok = ok && strcmp(got, "68690a00") == 0;
+	}
+	if (!ok) {
+		fprintf(stderr, "relocations are wrong\n");
+		failures++;
+	}
+	checked++;
+	x86_free(&c);
+	emit_free(&e);
+}
+
+int main() {
+	check_cases();
+	// jcc and jmp, short while the target is in reach
+	check_jumps(0, 4);
+	check_jumps(124, 4);
+	check_jumps(125, 7);
+	check_jumps(127, 7);
+	check_jumps(128, 11);
+	check_relocs();
+	fprintf(stderr, "%d checked, %d failures\n", checked, failures);
+	return failures != 0;
+}
@@ -0,0 +1,90 @@
+extern void *malloc(int size);
+extern _Noreturn void exit(int exit_code);
+
+// Loops with a body that always runs to the end are unrolled, fully if they
+// run only a few times. Each copy of the body sees its own value of the
+// variable, and the iterations that don't fill a whole unrolled body are
+// left to the loop.
+static int sum_to(int *a, int n) {
+	int i = 0;
+	int r = 0;
+	while (i < n) {
+		r = r + *(a + i);
+		i = i + 4;
+	}
+	if (3 < i - n) exit(30);
+	return r;
+}
+
+int main(int argc) {
+	int *a = malloc(4096);
+	char *s = malloc(256);
+	int n = argc * 37;
+	int i = 0;
+	int j = 0;
+	int x = 0;
+
+	// few enough to unroll fully, the variable is used as a value
+	i = 0;
+	while (i < 8) {
+		*(a + i * 4) = i * i;
+		x = x + i;
+		i = i + 1;
+	}
+	if (i != 8) exit(1);
+	if (x != 28) exit(2);
+	if (*(a + 28) != 49) exit(3);
+
+	// the number of iterations is only known at runtime
+	i = 0;
+	while (i < n) {
+		*(s + i) = i + 1;
+		i = i + 1;
+	}
+	if (i != 37) exit(4);
+	i = 0;
+	while (i < 37) {
+		if (*(s + i) != i + 1) exit(5);
+		i = i + 1;
+	}
+	// every remainder of the trip count
+	j = 0;
+	while (j < 9) {
+		i = 0;
+		x = 0;
+		while (i < n - 37 + j) {
+			*(a + i) = j;
+			x = x + 1;
+			i = i + 1;
+		}
+		if (x != j) exit(6);
+		if (i != j) exit(7);
+		j = j + 1;
+	}
+
+	// larger steps, the variable only indexes
+	i = 0;
+	while (i < 404) {
+		*(a + i) = i / 4;
+		i = i + 4;
+	}
+	if (sum_to(a, 400) != 4950) exit(8);
+	if (sum_to(a, 403) != 5050) exit(9);
+	if (sum_to(a, 0) != 0) exit(10);
+	if (sum_to(a, 12) != 3) exit(11);
+
+	// a branch in the body, and a loop nested in it
+	i = 1;
+	x = 0;
+	while (i < n) {
+		if (*(s + i) == 10) x = x + 100;
+		j = 0;
+		while (j < 3) {
+			x = x + 1;
+			j = j + 1;
+		}
+		i = i + 2;
+	}
+	if (x != 154) exit(12);
+	return 0;
+}
@@ -0,0 +1,94 @@
+extern void *malloc(int size);
+extern _Noreturn void exit(int exit_code);
+
+// Loops over arrays run a vector of elements at a time, the elements that
+// are left over go through the scalar loop, and arrays that overlap are
+// left to the scalar loop entirely.
+int main() {
+	int *a = malloc(4096);
+	int *b = malloc(4096);
+	int *c = malloc(4096);
+	char *s = malloc(1024);
+	char *t = malloc(1024);
+	char *u = s + 1;
+	int i = 0;
+	int k = 7;
+	int n = 1000;
+
+	i = 0;
+	while (i < 4096) {
+		*(a + i) = 1;
+		*(b + i) = 2;
+		i = i + sizeof(int);
+	}
+	// a bound that is not a multiple of the vector
+	i = 0;
+	while (i < n) {
+		*(a + i) = 3;
+		*(b + i) = k - 2;
+		i = i + sizeof(int);
+	}
+	i = 0;
+	while (i < 4096) {
+		if (*(a + i) != (i < n ? 3 : 1)) exit(1);
+		if (*(b + i) != (i < n ? 5 : 2)) exit(2);
+		i = i + 4;
+	}
+
+	// element-wise arithmetic from an offset
+	i = 12;
+	while (i < 4000) {
+		*(c + i) = *(a + i) + *(b + i) - k;
+		*(a + i) = *(a + i) + *(c + i);
+		i = i + 4;
+	}
+	if (i != 4000) exit(3);
+	i = 12;
+	while (i < 4000) {
+		if (*(c + i) != (i < n ? 1 : 0 - 4)) exit(4);
+		if (*(a + i) != (i < n ? 4 : 0 - 3)) exit(5);
+		i = i + 4;
+	}
+	if (*(a + 8) != 3) exit(6);
+
+	// bytes wrap around
+	i = 0;
+	while (i < 1000) {
+		*(t + i) = i;
+		i = i + 1;
+	}
+	i = 0;
+	while (i < 999) {
+		*(s + i) = *(t + i) + 200;
+		i = i + 1;
+	}
+	i = 0;
+	while (i < 999) {
+		if (*(s + i) != (i + 200) - (i + 200) / 256 * 256) exit(7);
+		i = i + 1;
+	}
+
+	// each element depends on the one before it
+	*s = 0;
+	i = 0;
+	while (i < 300) {
+		*(u + i) = *(s + i) + 1;
+		i = i + 1;
+	}
+	i = 0;
+	while (i < 301) {
+		if (*(s + i) != i - i / 256 * 256) exit(8);
+		i = i + 1;
+	}
+
+	// fewer elements than a vector
+	i = 0;
+	while (i < 8) {
+		*(a + i) = 9;
+		i = i + 4;
+	}
+	if (*a != 9) exit(9);
+	if (*(a + 4) != 9) exit(10);
+	if (*(a + 8) != 3) exit(11);
+	return 0;
+}